@@ -0,0 +1,246 @@
+#include "AgentSim.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+uint32_t AgentSim::add_agent(const float x, const float y, const float speed_new) {
+    const uint32_t agent = pos_x.size();
+
+    pos_x.push_back(x);
+    pos_y.push_back(y);
+    target_x.push_back(x);
+    target_y.push_back(y);
+    speed.push_back(speed_new);
+    moving.push_back(0);
+    path_id.push_back(NO_PATH);
+    cursor.push_back(0);
+
+    return agent;
+}
+
+uint32_t AgentSim::add_path(const path_t &path) {
+    uint32_t id;
+
+    if (!free_path_ids.empty()) {
+        id = free_path_ids.back();
+        free_path_ids.pop_back();
+    }
+    else {
+        id = path_offset.size();
+
+        path_offset.push_back(0);
+        path_size.push_back(0);
+        path_refs.push_back(0);
+    }
+
+    path_offset[id] = waypoints.size();
+    path_size[id] = path.size();
+    path_refs[id] = 1;
+
+    waypoints.insert(waypoints.end(), path.begin(), path.end());
+
+    return id;
+}
+
+void AgentSim::release_path(const uint32_t id) {
+    assert(path_refs[id] > 0);
+
+    if (--path_refs[id] > 0) {
+        return;
+    }
+
+    dead_waypoints += path_size[id];
+    path_size[id] = 0;
+
+    free_path_ids.push_back(id);
+
+    // Amortized: only compact once most of the pool is dead.
+    if (dead_waypoints > waypoints.size() / 2 && dead_waypoints > 4096) {
+        compact_waypoints();
+    }
+}
+
+void AgentSim::compact_waypoints() {
+    TRACE_SCOPE("AgentSim::compact_waypoints");
+
+    // Live paths are moved down in offset order, so that each copy reads from
+    // at or after where it writes.
+    std::vector<uint32_t> live;
+
+    for (uint32_t id = 0; id < path_offset.size(); ++id) {
+        if (path_refs[id] > 0) {
+            live.push_back(id);
+        }
+    }
+
+    std::sort(
+        live.begin(), live.end(),
+        [&](const uint32_t lhs, const uint32_t rhs) {
+            return path_offset[lhs] < path_offset[rhs];
+        }
+    );
+
+    uint32_t offset {0};
+
+    for (const uint32_t id : live) {
+        std::copy(
+            waypoints.begin() + path_offset[id],
+            waypoints.begin() + path_offset[id] + path_size[id],
+            waypoints.begin() + offset
+        );
+
+        path_offset[id] = offset;
+        offset += path_size[id];
+    }
+
+    waypoints.resize(offset);
+
+    dead_waypoints = 0;
+}
+
+void AgentSim::load_target(const uint32_t agent) {
+    const uint32_t id {path_id[agent]};
+    const auto [x, y] = waypoints[path_offset[id] + cursor[agent] + 1];
+
+    target_x[agent] = x + 0.5f;
+    target_y[agent] = y + 0.5f;
+}
+
+void AgentSim::set_path(const uint32_t agent, const uint32_t id) {
+    ++path_refs[id];
+
+    clear_path(agent);
+
+    path_id[agent] = id;
+    cursor[agent] = 0;
+
+    if (path_size[id] == 0) {
+        return;
+    }
+
+    const auto [x, y] = waypoints[path_offset[id]];
+
+    pos_x[agent] = x + 0.5f;
+    pos_y[agent] = y + 0.5f;
+
+    if (path_size[id] > 1) {
+        moving[agent] = 1;
+
+        load_target(agent);
+    }
+    else {
+        // Already at the end; the movement pass only reports moving agents.
+        events.push_back({Event::ARRIVED, agent});
+    }
+}
+
+void AgentSim::set_path(const uint32_t agent, const path_t &path) {
+    const uint32_t id {add_path(path)};
+
+    set_path(agent, id);
+    release_path(id);
+}
+
+void AgentSim::clear_path(const uint32_t agent) {
+    moving[agent] = 0;
+    target_x[agent] = pos_x[agent];
+    target_y[agent] = pos_y[agent];
+
+    if (path_id[agent] != NO_PATH) {
+        release_path(path_id[agent]);
+
+        path_id[agent] = NO_PATH;
+    }
+}
+
+void AgentSim::move_agents(const float dt) {
+    arrivals.clear();
+
+    const uint32_t num_agents {size()};
+
+    float *const __restrict px {pos_x.data()};
+    float *const __restrict py {pos_y.data()};
+    const float *const __restrict tx {target_x.data()};
+    const float *const __restrict ty {target_y.data()};
+    const float *const __restrict sp {speed.data()};
+    const float *const __restrict mv {moving.data()};
+
+    uint32_t i {0};
+
+#if defined(__SSE2__)
+    const __m128 dt_4 {_mm_set1_ps(dt)};
+    const __m128 zero_4 {_mm_setzero_ps()};
+    const __m128 one_4 {_mm_set1_ps(1.0f)};
+    const __m128 tiny_4 {_mm_set1_ps(1e-12f)};
+
+    for (; i + 4 <= num_agents; i += 4) {
+        const __m128 x {_mm_loadu_ps(px + i)};
+        const __m128 y {_mm_loadu_ps(py + i)};
+        const __m128 dx {_mm_sub_ps(_mm_loadu_ps(tx + i), x)};
+        const __m128 dy {_mm_sub_ps(_mm_loadu_ps(ty + i), y)};
+        const __m128 move {
+            _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(sp + i), dt_4), _mm_loadu_ps(mv + i))
+        };
+
+        const __m128 dist_sq {_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))};
+
+        // Arrived: moving, and within this tick's reach of the target.
+        const __m128 arrived {
+            _mm_and_ps(
+                _mm_cmpgt_ps(move, zero_4),
+                _mm_cmple_ps(dist_sq, _mm_mul_ps(move, move))
+            )
+        };
+
+        // The fraction of the remaining distance covered this tick. Arrived
+        // agents cover all of it, which lands them exactly on the target.
+        const __m128 frac {
+            _mm_min_ps(
+                one_4,
+                _mm_div_ps(move, _mm_sqrt_ps(_mm_max_ps(dist_sq, tiny_4)))
+            )
+        };
+
+        _mm_storeu_ps(px + i, _mm_add_ps(x, _mm_mul_ps(dx, frac)));
+        _mm_storeu_ps(py + i, _mm_add_ps(y, _mm_mul_ps(dy, frac)));
+
+        if (const int mask {_mm_movemask_ps(arrived)}; mask != 0) [[unlikely]] {
+            for (uint32_t lane = 0; lane < 4; ++lane) {
+                if ((mask >> lane) & 1) {
+                    arrivals.push_back(i + lane);
+                }
+            }
+        }
+    }
+#endif
+
+    for (; i < num_agents; ++i) {
+        const float dx {tx[i] - px[i]};
+        const float dy {ty[i] - py[i]};
+        const float move {sp[i] * dt * mv[i]};
+        const float dist_sq {dx * dx + dy * dy};
+
+        const float frac {
+            std::min(1.0f, move / std::sqrt(std::max(dist_sq, 1e-12f)))
+        };
+
+        px[i] += dx * frac;
+        py[i] += dy * frac;
+
+        if (move > 0 && dist_sq <= move * move) {
+            arrivals.push_back(i);
+        }
+    }
+
+    // Snap arrivals exactly onto their waypoints, whatever the rounding.
+    for (const uint32_t agent : arrivals) {
+        px[agent] = tx[agent];
+        py[agent] = ty[agent];
+    }
+}
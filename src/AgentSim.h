@@ -0,0 +1,181 @@
+#ifndef AGENTSIM_H
+#define AGENTSIM_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Trace.h"
+
+// Moves agents along their paths in fixed time steps.
+//
+// Per-agent state lives in contiguous structure-of-arrays storage, so that
+// the per-tick movement of every agent is a single SIMD pass over a few dense
+// float arrays. Only agents that reach a waypoint during the tick take the
+// scalar path, which advances them to their next waypoint.
+//
+// Paths are stored once in a shared waypoint pool, and any number of agents
+// may follow the same path. Waypoints are cell coordinates; agents move
+// between cell centers.
+//
+// The simulation never replans by itself. Instead, when an agent reaches a
+// waypoint whose successor has become blocked, or reaches the end of its path,
+// it stops and an event is queued for the owner to act on, eg, by requesting
+// a new path.
+class AgentSim {
+public:
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    static inline const uint32_t NO_PATH {UINT32_MAX};
+
+    struct Event {
+        enum Kind : uint8_t {
+            // The agent reached the end of its path.
+            ARRIVED,
+            // The agent's next waypoint is blocked.
+            BLOCKED,
+        };
+
+        Kind kind;
+        uint32_t agent;
+    };
+
+private:
+    // Agent state, indexed by agent id.
+    std::vector<float> pos_x;
+    std::vector<float> pos_y;
+    std::vector<float> target_x;
+    std::vector<float> target_y;
+    std::vector<float> speed;
+    // 1 while the agent is following a path, else 0, so that it can be
+    // applied arithmetically in the movement pass.
+    std::vector<float> moving;
+    std::vector<uint32_t> path_id;
+    std::vector<uint32_t> cursor;
+
+    // Path storage, indexed by path id.
+    std::vector<std::pair<uint32_t, uint32_t>> waypoints;
+    std::vector<uint32_t> path_offset;
+    std::vector<uint32_t> path_size;
+    std::vector<uint32_t> path_refs;
+    std::vector<uint32_t> free_path_ids;
+
+    uint64_t dead_waypoints {0};
+
+    std::vector<Event> events;
+    std::vector<Event> draining;
+
+    // Reused between ticks.
+    std::vector<uint32_t> arrivals;
+
+    void compact_waypoints();
+
+    // Point the agent at waypoint `cursor + 1` of its path.
+    void load_target(const uint32_t agent);
+
+    // The SIMD movement pass. Fills `arrivals` with the agents that reached
+    // their target this tick.
+    void move_agents(const float dt);
+
+public:
+    // Returns the new agent's id. The agent starts out idle.
+    uint32_t add_agent(const float x, const float y, const float speed_new);
+
+    // Store a path (in travel order) for agents to follow, and return its id.
+    // Paths are reference counted: the caller holds one reference, which it
+    // must give up with `release_path()`, and each agent following the path
+    // holds another. The path is freed with its last reference.
+    uint32_t add_path(const path_t &path);
+
+    // Release a hold on a path from `add_path()`.
+    void release_path(const uint32_t id);
+
+    // Start the agent along a path from `add_path()`, from its first
+    // waypoint. The agent is moved there immediately, and if that is the
+    // path's only waypoint, its arrival is queued straight away.
+    void set_path(const uint32_t agent, const uint32_t id);
+
+    // As above, for a path only this agent will follow.
+    void set_path(const uint32_t agent, const path_t &path);
+
+    // Stop the agent where it is.
+    void clear_path(const uint32_t agent);
+
+    void set_speed(const uint32_t agent, const float speed_new) {
+        speed[agent] = speed_new;
+    }
+
+    // Advance every agent by `dt` time units. `is_blocked(x, y)` is consulted
+    // only as agents reach waypoints, to check the cell they head for next.
+    //
+    // An agent that reaches a waypoint stops there for the rest of the tick.
+    template <typename IsBlocked>
+    void step(const float dt, IsBlocked &&is_blocked);
+
+    // Hand every event queued since the last drain to `fn`, as
+    // `fn(const Event &)`. Returns the number of events.
+    template <typename F>
+    size_t drain_events(F &&fn) {
+        draining.swap(events);
+
+        for (const Event &event : draining) {
+            fn(event);
+        }
+
+        const size_t count {draining.size()};
+
+        draining.clear();
+
+        return count;
+    }
+
+    uint32_t size() const {
+        return pos_x.size();
+    }
+
+    float get_x(const uint32_t agent) const {
+        return pos_x[agent];
+    }
+
+    float get_y(const uint32_t agent) const {
+        return pos_y[agent];
+    }
+
+    bool is_moving(const uint32_t agent) const {
+        return moving[agent] != 0;
+    }
+};
+
+template <typename IsBlocked>
+void AgentSim::step(const float dt, IsBlocked &&is_blocked) {
+    TRACE_SCOPE("AgentSim::step");
+
+    move_agents(dt);
+
+    for (const uint32_t agent : arrivals) {
+        const uint32_t id {path_id[agent]};
+        const uint32_t next {++cursor[agent] + 1};
+
+        if (next >= path_size[id]) {
+            moving[agent] = 0;
+
+            events.push_back({Event::ARRIVED, agent});
+
+            continue;
+        }
+
+        const auto [x_next, y_next] = waypoints[path_offset[id] + next];
+
+        if (is_blocked(x_next, y_next)) {
+            moving[agent] = 0;
+
+            events.push_back({Event::BLOCKED, agent});
+
+            continue;
+        }
+
+        load_target(agent);
+    }
+}
+
+#endif
@@ -0,0 +1,358 @@
+#include "ChunkedMap.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <latch>
+#include <stdexcept>
+
+#include "Log.h"
+
+ChunkStore::ChunkStore(const std::string &dir):
+    dir(dir)
+{
+    std::error_code error;
+
+    std::filesystem::create_directories(dir, error);
+
+    if (error) {
+        throw std::runtime_error("Failed to create chunk store: " + dir);
+    }
+}
+
+std::string ChunkStore::get_path(const uint32_t x_chunk, const uint32_t y_chunk) const {
+    return dir + "/" + std::to_string(x_chunk) + "_" + std::to_string(y_chunk) + ".chunk";
+}
+
+bool ChunkStore::load(
+    const uint32_t x_chunk, const uint32_t y_chunk, MapChunk &chunk
+) const {
+    const std::string path {get_path(x_chunk, y_chunk)};
+
+    std::ifstream in(path, std::ios::binary);
+
+    if (!in) {
+        return false;
+    }
+
+    in.read(reinterpret_cast<char *>(chunk.blocking.data()), sizeof(chunk.blocking));
+    in.read(reinterpret_cast<char *>(chunk.terrain.data()), sizeof(chunk.terrain));
+
+    if (!in) {
+        throw std::runtime_error("Chunk file is truncated: " + path);
+    }
+
+    return true;
+}
+
+void ChunkStore::save(
+    const uint32_t x_chunk, const uint32_t y_chunk, const MapChunk &chunk
+) const {
+    const std::string path {get_path(x_chunk, y_chunk)};
+    const std::string path_tmp {path + ".tmp"};
+
+    {
+        std::ofstream out(path_tmp, std::ios::binary | std::ios::trunc);
+
+        out.write(
+            reinterpret_cast<const char *>(chunk.blocking.data()), sizeof(chunk.blocking)
+        );
+        out.write(
+            reinterpret_cast<const char *>(chunk.terrain.data()), sizeof(chunk.terrain)
+        );
+
+        if (!out) {
+            throw std::runtime_error("Failed to write chunk file: " + path_tmp);
+        }
+    }
+
+    std::error_code error;
+
+    std::filesystem::rename(path_tmp, path, error);
+
+    if (error) {
+        throw std::runtime_error("Failed to replace chunk file: " + path);
+    }
+}
+
+ChunkedMap::ChunkedMap(
+    const uint32_t width,
+    const uint32_t height,
+    ChunkStore &store,
+    const uint32_t budget,
+    generator_t generator,
+    const uint32_t prefetch_distance,
+    const uint32_t search_nodes
+):
+    store(store),
+    generator(std::move(generator)),
+    chunks_x((width + MapChunk::SIZE - 1) >> MapChunk::BITS),
+    chunks_y((height + MapChunk::SIZE - 1) >> MapChunk::BITS),
+    budget(std::max(budget, 1u)),
+    prefetch_distance(prefetch_distance),
+    search_nodes(search_nodes),
+    loader(1),
+    width(width),
+    height(height)
+{
+    // Chunks are at least as large as the tiles of any `CellLayout`, so this
+    // bounds the index space too.
+    if (
+        (static_cast<uint64_t>(chunks_x) * chunks_y) << (2 * MapChunk::BITS) >
+            UINT32_MAX
+    ) {
+        throw std::invalid_argument("World has too many cells for 32-bit indices");
+    }
+
+    slot_of.assign(static_cast<size_t>(chunks_x) * chunks_y, NONE);
+    versions.assign(static_cast<size_t>(chunks_x) * chunks_y, 0);
+
+    slots.reserve(this->budget);
+}
+
+ChunkedMap::~ChunkedMap() {
+    flush();
+}
+
+void ChunkedMap::read_chunk(const uint32_t id, MapChunk &chunk) const {
+    const uint32_t x_chunk {id % chunks_x};
+    const uint32_t y_chunk {id / chunks_x};
+
+    if (store.load(x_chunk, y_chunk, chunk)) {
+        return;
+    }
+
+    if (generator) {
+        generator(x_chunk, y_chunk, chunk);
+    }
+    else {
+        chunk.blocking.fill(0);
+        chunk.terrain.fill(TERRAIN_GROUND);
+    }
+
+    const uint32_t x_base {x_chunk << MapChunk::BITS};
+    const uint32_t y_base {y_chunk << MapChunk::BITS};
+
+    for (uint32_t y = 0; y < MapChunk::SIZE; ++y) {
+        for (uint32_t x = 0; x < MapChunk::SIZE; ++x) {
+            if (x_base + x >= width || y_base + y >= height) {
+                chunk.set_blocking(MapChunk::offset(x, y), true);
+            }
+        }
+    }
+}
+
+void ChunkedMap::write_back(Slot &slot) {
+    if (!slot.dirty) {
+        return;
+    }
+
+    slot.dirty = false;
+
+    ++versions[slot.id];
+    ++stats.writes;
+
+    const uint32_t id {slot.id};
+    const std::shared_ptr<const MapChunk> data {std::make_shared<MapChunk>(*slot.chunk)};
+
+    {
+        std::scoped_lock<std::mutex> lock(mu);
+
+        writing[id] = data;
+    }
+
+    loader.submit(
+        [this, id, data]() {
+            try {
+                store.save(id % chunks_x, id / chunks_x, *data);
+            } catch (const std::exception &e) {
+                // Left in `writing`, so the edits stay readable.
+                LOG_ERROR("%s", e.what());
+
+                return;
+            }
+
+            std::scoped_lock<std::mutex> lock(mu);
+
+            // Unless a later write of the chunk has replaced this one.
+            if (
+                const auto iter {writing.find(id)};
+                iter != writing.end() && iter->second == data
+            ) {
+                writing.erase(iter);
+            }
+        }
+    );
+}
+
+uint32_t ChunkedMap::install(const uint32_t id, std::unique_ptr<MapChunk> &&chunk) {
+    uint32_t slot;
+
+    if (slots.size() < budget) {
+        slot = slots.size();
+
+        slots.push_back({});
+    }
+    else {
+        slot = std::min_element(
+            slots.begin(), slots.end(),
+            [](const Slot &a, const Slot &b) {
+                return a.last_used < b.last_used;
+            }
+        ) - slots.begin();
+
+        write_back(slots[slot]);
+
+        slot_of[slots[slot].id] = NONE;
+
+        ++stats.evictions;
+    }
+
+    slots[slot] = {std::move(chunk), id, ++tick, false};
+    slot_of[id] = slot;
+
+    ++stats.loads;
+
+    return slot;
+}
+
+void ChunkedMap::adopt_staged() {
+    std::unordered_map<uint32_t, Staged> ready;
+
+    {
+        std::scoped_lock<std::mutex> lock(mu);
+
+        ready.swap(staged);
+    }
+
+    for (auto &[id, entry] : ready) {
+        requested.erase(id);
+
+        // A chunk the loader failed to read is paged in on demand instead,
+        // so that the failure surfaces to the caller.
+        if (
+            !entry.chunk || slot_of[id] != NONE || entry.version != versions[id]
+        ) {
+            continue;
+        }
+
+        install(id, std::move(entry.chunk));
+
+        ++stats.prefetched;
+    }
+}
+
+void ChunkedMap::fetch_chunk(const uint32_t id, MapChunk &chunk) const {
+    std::shared_ptr<const MapChunk> pending;
+
+    {
+        std::scoped_lock<std::mutex> lock(mu);
+
+        if (const auto iter {writing.find(id)}; iter != writing.end()) {
+            pending = iter->second;
+        }
+    }
+
+    if (pending) {
+        chunk = *pending;
+    }
+    else {
+        read_chunk(id, chunk);
+    }
+}
+
+uint32_t ChunkedMap::page_in(const uint32_t id) {
+    adopt_staged();
+
+    if (slot_of[id] != NONE) {
+        return slot_of[id];
+    }
+
+    auto chunk {std::make_unique<MapChunk>()};
+
+    fetch_chunk(id, *chunk);
+
+    return install(id, std::move(chunk));
+}
+
+void ChunkedMap::prefetch_toward(
+    const uint32_t x, const uint32_t y,
+    const uint32_t x_to, const uint32_t y_to
+) {
+    adopt_staged();
+
+    // Leave most of the budget to the chunks the search is using.
+    const uint32_t max_requested {std::max(budget / 4, 1u)};
+
+    const auto request = [&](const int64_t x_chunk, const int64_t y_chunk) {
+        if (
+            x_chunk < 0 || y_chunk < 0 || x_chunk >= chunks_x || y_chunk >= chunks_y ||
+            requested.size() >= max_requested
+        ) {
+            return;
+        }
+
+        const uint32_t id {get_chunk_id(x_chunk, y_chunk)};
+
+        if (slot_of[id] != NONE || !requested.insert(id).second) {
+            return;
+        }
+
+        const uint32_t version {versions[id]};
+
+        loader.submit(
+            [this, id, version]() {
+                auto chunk {std::make_unique<MapChunk>()};
+
+                try {
+                    fetch_chunk(id, *chunk);
+                } catch (const std::exception &) {
+                    chunk.reset();
+                }
+
+                std::scoped_lock<std::mutex> lock(mu);
+
+                staged[id] = {std::move(chunk), version};
+            }
+        );
+    };
+
+    const int64_t x_chunk {x >> MapChunk::BITS};
+    const int64_t y_chunk {y >> MapChunk::BITS};
+    const int64_t d_x {int64_t {x_to >> MapChunk::BITS} - x_chunk};
+    const int64_t d_y {int64_t {y_to >> MapChunk::BITS} - y_chunk};
+
+    // Ahead first, along the line to the goal, which an A* frontier under
+    // `Pathfind`'s heuristic keeps close to.
+    const int64_t steps {std::max(std::abs(d_x), std::abs(d_y))};
+
+    for (int64_t step = 1; step <= std::min<int64_t>(steps, prefetch_distance); ++step) {
+        request(x_chunk + d_x * step / steps, y_chunk + d_y * step / steps);
+    }
+
+    // Then around the frontier, where it spreads around obstacles.
+    for (int64_t n_y = -1; n_y <= 1; ++n_y) {
+        for (int64_t n_x = -1; n_x <= 1; ++n_x) {
+            request(x_chunk + n_x, y_chunk + n_y);
+        }
+    }
+}
+
+void ChunkedMap::flush() {
+    for (Slot &slot : slots) {
+        write_back(slot);
+    }
+
+    // The loader runs tasks in order, so once this one runs, every save
+    // queued before it is done.
+    std::latch done {1};
+
+    loader.submit(
+        [&done]() {
+            done.count_down();
+        }
+    );
+
+    done.wait();
+}
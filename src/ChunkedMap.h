@@ -0,0 +1,330 @@
+#ifndef CHUNKEDMAP_H
+#define CHUNKEDMAP_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "MapChunk.h"
+#include "Terrain.h"
+#include "Util.h"
+#include "WorkerPool.h"
+
+// Chunks on local disk, one file per chunk in a directory. Only chunks that
+// were saved are stored; the rest are generated (see `ChunkedMap`).
+//
+// Loads and saves of different chunks may run concurrently.
+class ChunkStore {
+private:
+    const std::string dir;
+
+    std::string get_path(const uint32_t x_chunk, const uint32_t y_chunk) const;
+
+public:
+    // Creates the directory if it does not exist.
+    //
+    // Throws std::runtime_error if it cannot be created.
+    explicit ChunkStore(const std::string &dir);
+
+    // Read the chunk into `chunk`. Returns false if it was never saved.
+    //
+    // Throws std::runtime_error if the file cannot be read, or is truncated.
+    bool load(const uint32_t x_chunk, const uint32_t y_chunk, MapChunk &chunk) const;
+
+    // Write the chunk, replacing any earlier save atomically, so that a crash
+    // leaves either the old chunk or the new one.
+    //
+    // Throws std::runtime_error on I/O failure.
+    void save(const uint32_t x_chunk, const uint32_t y_chunk, const MapChunk &chunk) const;
+};
+
+// A map too large to hold in memory, split into `MapChunk`s that are paged in
+// when first touched, and evicted, least recently used first, once more than
+// `budget` are resident, so that its memory use is bounded by the budget, not
+// by the size of the world. Chunks are read from a `ChunkStore`, or, if never
+// saved, generated, and edited chunks are written back to the store when
+// evicted.
+//
+// Satisfies the map_t requirements of `Pathfind`, which searches it
+// transparently across chunk boundaries, and calls two hooks it provides:
+//
+// - `prefetch_toward()`, as the search advances, so that a background thread
+//   loads the chunks ahead of its frontier before the search reaches them.
+// - `max_search_nodes()`, which caps the nodes one search may generate, so
+//   that its own state is bounded too: a search that would generate more
+//   finds no path.
+//
+// A chunked map keeps no region labels: every cell reports the same region,
+// so that a search never floods the world to check its endpoints are
+// connected. A search for an unreachable goal therefore runs until it
+// exhausts the goal's surroundings or hits `max_search_nodes()`.
+//
+// Indices are `get_node_index()`s, so the world must have fewer than 2^32
+// cells, padding included.
+//
+// Not thread-safe, reads included, since any read may page chunks in or out.
+// The generator, however, is called from the loader thread as well as the
+// caller's, so must be safe to call concurrently, eg, a pure function of the
+// chunk coordinates.
+class ChunkedMap {
+public:
+    // Fill `chunk`, the chunk at (x_chunk, y_chunk) in chunk coordinates.
+    typedef std::function<
+        void(const uint32_t x_chunk, const uint32_t y_chunk, MapChunk &chunk)
+    > generator_t;
+
+    // A lightweight reference to a single cell of the map.
+    class ChunkedNode {
+    private:
+        ChunkedMap *map;
+        uint32_t idx;
+
+    public:
+        ChunkedNode(ChunkedMap *map, const uint32_t idx):
+            map(map),
+            idx(idx)
+        {}
+
+        bool get_blocking() const {
+            uint32_t offset;
+
+            return map->get_chunk(idx, offset, false).get_blocking(offset);
+        }
+
+        void set_blocking(const bool blocking_new) {
+            uint32_t offset;
+
+            map->get_chunk(idx, offset, true).set_blocking(offset, blocking_new);
+        }
+
+        uint8_t get_terrain() const {
+            uint32_t offset;
+
+            return map->get_chunk(idx, offset, false).terrain[offset];
+        }
+
+        void set_terrain(const uint8_t terrain_new) {
+            assert(terrain_new < TerrainCosts::MAX_CLASSES);
+
+            uint32_t offset;
+
+            map->get_chunk(idx, offset, true).terrain[offset] = terrain_new;
+        }
+
+        std::optional<uint64_t> get_region() const {
+            return REGION;
+        }
+
+        void set_region(std::optional<uint64_t> &&) {}
+    };
+
+    typedef ChunkedNode node_t;
+
+    // An indexable view over every cell of the map.
+    class ChunkedNodes {
+    private:
+        ChunkedMap *map;
+
+    public:
+        ChunkedNodes(ChunkedMap *map):
+            map(map)
+        {}
+
+        node_t operator[](const uint32_t idx) const {
+            return node_t(map, idx);
+        }
+
+        size_t size() const {
+            return get_node_count(map->width, map->height);
+        }
+    };
+
+    struct Stats {
+        // Chunks paged in, whether on demand or prefetched.
+        uint64_t loads;
+        // Of those, the chunks prefetched by the loader thread.
+        uint64_t prefetched;
+        uint64_t evictions;
+        // Of those, the chunks written back to the store.
+        uint64_t writes;
+    };
+
+private:
+    // The region every cell reports.
+    static inline const uint64_t REGION {1};
+
+    static inline const uint32_t NONE {UINT32_MAX};
+
+    struct Slot {
+        std::unique_ptr<MapChunk> chunk;
+        uint32_t id;
+        uint64_t last_used;
+        bool dirty;
+    };
+
+    // A chunk read or generated by the loader thread, and the version of the
+    // chunk it was requested at.
+    struct Staged {
+        std::unique_ptr<MapChunk> chunk;
+        uint32_t version;
+    };
+
+    ChunkStore &store;
+    const generator_t generator;
+
+    const uint32_t chunks_x;
+    const uint32_t chunks_y;
+    const uint32_t budget;
+    const uint32_t prefetch_distance;
+    const uint32_t search_nodes;
+
+    // Per chunk; its slot, or `NONE` if it is not resident.
+    std::vector<uint32_t> slot_of;
+    // Per chunk; bumped whenever the chunk is written back, so that a copy
+    // the loader thread read before then is known to be stale.
+    std::vector<uint32_t> versions;
+
+    std::vector<Slot> slots;
+    uint64_t tick {0};
+
+    // Chunks requested of the loader thread and not yet taken.
+    std::unordered_set<uint32_t> requested;
+
+    Stats stats {};
+
+    // Shared with the loader thread.
+    mutable std::mutex mu;
+    // Chunks the loader thread has ready.
+    std::unordered_map<uint32_t, Staged> staged;
+    // Evicted chunks queued to be written back, and still readable here
+    // until they are.
+    std::unordered_map<uint32_t, std::shared_ptr<const MapChunk>> writing;
+
+    // Last, so that it is destroyed first, finishing its queued writes while
+    // the rest is still intact.
+    WorkerPool loader;
+
+    uint32_t get_chunk_id(const uint32_t x_chunk, const uint32_t y_chunk) const {
+        return y_chunk * chunks_x + x_chunk;
+    }
+
+    // Fill `chunk` from the store, or else the generator. Padding cells,
+    // those beyond the map, are blocked.
+    void read_chunk(const uint32_t id, MapChunk &chunk) const;
+
+    // Fill `chunk` with the copy of chunk `id` queued to be written back, if
+    // any, or else as `read_chunk()`.
+    void fetch_chunk(const uint32_t id, MapChunk &chunk) const;
+
+    // Queue a copy of the slot's chunk to be written back, if edited.
+    void write_back(Slot &slot);
+
+    // Make `chunk` resident as chunk `id`, evicting the least recently used
+    // chunk if at the budget, and return its slot.
+    uint32_t install(const uint32_t id, std::unique_ptr<MapChunk> &&chunk);
+
+    // Make resident every chunk the loader thread has ready, unless it went
+    // stale, or was paged in meanwhile.
+    void adopt_staged();
+
+    // Make chunk `id` resident, and return its slot.
+    uint32_t page_in(const uint32_t id);
+
+    MapChunk &get_chunk(const uint32_t idx, uint32_t &offset, const bool write) {
+        const auto [x, y] = get_node_xy(idx, width);
+
+        const uint32_t id {get_chunk_id(x >> MapChunk::BITS, y >> MapChunk::BITS)};
+
+        uint32_t slot {slot_of[id]};
+
+        if (slot == NONE) [[unlikely]] {
+            slot = page_in(id);
+        }
+
+        Slot &entry {slots[slot]};
+
+        entry.last_used = ++tick;
+        entry.dirty |= write;
+
+        offset = MapChunk::offset(x & (MapChunk::SIZE - 1), y & (MapChunk::SIZE - 1));
+
+        return *entry.chunk;
+    }
+
+public:
+    // The x-coordinate range.
+    const uint32_t width;
+    // The y-coordinate range.
+    const uint32_t height;
+
+    // At most `budget` chunks, of at least one, are resident at a time.
+    // `prefetch_toward()` looks up to `prefetch_distance` chunks ahead, and
+    // a search may generate up to `search_nodes` nodes. Chunks never saved
+    // to `store` come from `generator`, or are open ground if there is none.
+    //
+    // Throws std::invalid_argument if the world has too many cells.
+    ChunkedMap(
+        const uint32_t width,
+        const uint32_t height,
+        ChunkStore &store,
+        const uint32_t budget,
+        generator_t generator = {},
+        const uint32_t prefetch_distance = 4,
+        const uint32_t search_nodes = 1 << 22
+    );
+
+    ChunkedMap(const ChunkedMap &) = delete;
+    ChunkedMap &operator=(const ChunkedMap &) = delete;
+
+    // Writes back every edited chunk.
+    ~ChunkedMap();
+
+    bool is_blocking(const uint32_t x, const uint32_t y) const {
+        return get_nodes()[get_node_index(x, y, width)].get_blocking();
+    }
+
+    ChunkedNodes get_nodes() const {
+        // As for `MappedMap`, the view hands out nodes that can be written
+        // through, but only `get_nodes_mut()` advertises that.
+        return ChunkedNodes(const_cast<ChunkedMap *>(this));
+    }
+
+    ChunkedNodes get_nodes_mut() {
+        return ChunkedNodes(this);
+    }
+
+    void clear_regions() {}
+
+    // Ask the loader thread for the chunks around the one holding (x, y),
+    // and for those along the straight line from there toward (x_to, y_to),
+    // up to `prefetch_distance` chunks ahead, that are not already resident
+    // or on their way. Cheap enough to call every few hundred expansions.
+    void prefetch_toward(
+        const uint32_t x, const uint32_t y,
+        const uint32_t x_to, const uint32_t y_to
+    );
+
+    uint32_t max_search_nodes() const {
+        return search_nodes;
+    }
+
+    // Write every edited resident chunk back to the store, and wait for
+    // all writes to finish.
+    void flush();
+
+    uint32_t get_resident_count() const {
+        return slots.size();
+    }
+
+    const Stats &get_stats() const {
+        return stats;
+    }
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "ClearanceLayer.h"
+
+#include <type_traits>
+
+ClearanceLayer::ClearanceLayer(const uint32_t width, const uint32_t height):
+    width(width),
+    height(height),
+    clearance(get_node_count(width, height), 0),
+    runs_right(width, 0),
+    runs_down(width, 0),
+    row(width, 0),
+    row_below(width, 0),
+    changed_row(width + 1, false),
+    changed_below(width + 1, false)
+{}
+
+void ClearanceLayer::combine_row(const uint32_t y) {
+    // Locals, since stores through `uint8_t` pointers could otherwise alias
+    // the members and defeat vectorization.
+    const uint32_t row_width {width};
+
+    row.swap(row_below);
+
+    uint8_t *const filled {row.data()};
+    uint8_t *const down {runs_down.data()};
+    const uint8_t *const right {runs_right.data()};
+    const uint8_t *const below {row_below.data()};
+
+    const auto store = [&]() {
+        if constexpr (std::is_same_v<CellLayout, RowMajorLayout>) {
+            std::copy_n(
+                filled, row_width,
+                clearance.data() + static_cast<size_t>(y) * row_width
+            );
+        }
+        else {
+            for (uint32_t x = 0; x < row_width; ++x) {
+                clearance[get_node_index(x, y, row_width)] = filled[x];
+            }
+        }
+    };
+
+    // Nothing larger than a single cell fits on the bottom row.
+    if (y + 1 == height) {
+        for (uint32_t x = 0; x < row_width; ++x) {
+            down[x] = right[x] != 0;
+            filled[x] = down[x];
+        }
+
+        store();
+
+        return;
+    }
+
+    const auto saturating_inc = [](const uint8_t value) -> uint8_t {
+        return value + (value != MAX_CLEARANCE);
+    };
+
+    // Branch-free, so that the loop vectorizes: each cell is the least of its
+    // run to the right, its run down, and one more than the clearance of its
+    // diagonal neighbor below. The last column has no diagonal neighbor, so
+    // is handled after.
+    const uint32_t inner {row_width - 1};
+
+    for (uint32_t x = 0; x < inner; ++x) {
+        const uint8_t down_new {
+            static_cast<uint8_t>(right[x] != 0 ? saturating_inc(down[x]) : 0)
+        };
+
+        down[x] = down_new;
+        filled[x] = std::min({right[x], down_new, saturating_inc(below[x + 1])});
+    }
+
+    down[inner] = right[inner] != 0 ? saturating_inc(down[inner]) : 0;
+    filled[inner] = std::min<uint8_t>(right[inner], 1);
+
+    store();
+}
@@ -0,0 +1,208 @@
+#ifndef CLEARANCELAYER_H
+#define CLEARANCELAYER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Util.h"
+
+// The clearance of every cell of a map, ie, the side of the largest square
+// agent that fits with its top-left corner on the cell, for one accessibility
+// predicate. An agent of size `s` occupies the `s` by `s` cells down and to
+// the right of its position, so it may stand on any cell whose clearance is
+// at least `s`, and a search for it need only read one byte per cell, rather
+// than scanning its footprint. Inaccessible cells have a clearance of 0, and
+// clearances saturate at `MAX_CLEARANCE`.
+//
+// `compute()` fills the whole layer in two passes over the map: the first
+// finds the run of accessible cells to the right of each cell, a row at a
+// time, and the second combines each row with the row below it using only
+// elementwise operations, which the compiler vectorizes. After the map
+// changes, `repair()` recomputes only the cells whose clearance can have
+// changed, ie, those up and to the left of the changed cells, stopping once
+// the values stop changing.
+//
+// Not thread-safe: the layer must not be computed or repaired while a search
+// reads it.
+class ClearanceLayer {
+public:
+    static inline const uint8_t MAX_CLEARANCE {UINT8_MAX};
+
+private:
+    const uint32_t width;
+    const uint32_t height;
+
+    std::vector<uint8_t> clearance;
+
+    // Per column; scratch for `compute()`. Rows are combined in `row` and
+    // `row_below`, then stored, since a row's cells are only contiguous in
+    // `clearance` under a row-major `CellLayout`.
+    std::vector<uint8_t> runs_right;
+    std::vector<uint8_t> runs_down;
+    std::vector<uint8_t> row;
+    std::vector<uint8_t> row_below;
+
+    // Per column, and one past the last; scratch for `repair()`. Whether the
+    // cell changed, in the row being repaired and the row below it.
+    std::vector<bool> changed_row;
+    std::vector<bool> changed_below;
+
+    // Fill row `y` from `runs_right` and `runs_down`, which must hold row
+    // `y`, and from row `y + 1`, which must already be filled and still be
+    // in `row`.
+    void combine_row(const uint32_t y);
+
+    // The clearance of (x, y) from its neighbors to the right and below.
+    uint8_t from_neighbors(const uint32_t x, const uint32_t y) const {
+        const uint8_t right {x + 1 < width ? get(x + 1, y) : uint8_t{0}};
+        const uint8_t below {y + 1 < height ? get(x, y + 1) : uint8_t{0}};
+        const uint8_t diagonal {
+            x + 1 < width && y + 1 < height ? get(x + 1, y + 1) : uint8_t{0}
+        };
+
+        const uint8_t least {std::min({right, below, diagonal})};
+
+        return least == MAX_CLEARANCE ? least : least + 1;
+    }
+
+public:
+    ClearanceLayer(const uint32_t width, const uint32_t height);
+
+    uint8_t get(const uint32_t idx) const {
+        return clearance[idx];
+    }
+
+    uint8_t get(const uint32_t x, const uint32_t y) const {
+        return clearance[get_node_index(x, y, width)];
+    }
+
+    // Whether an agent of `agent_size` may stand on cell `idx`.
+    bool fits(const uint32_t idx, const uint8_t agent_size) const {
+        return clearance[idx] >= agent_size;
+    }
+
+    // Recompute every cell of the layer from `map`.
+    template <typename map_t, typename Predicate>
+    void compute(const map_t &map, const Predicate &is_accessible);
+
+    // Recompute the cells affected by changes to the accessibility of the
+    // cells in the rectangle [x_min, x_max] x [y_min, y_max].
+    template <typename map_t, typename Predicate>
+    void repair(
+        const map_t &map, const Predicate &is_accessible,
+        const uint32_t x_min, const uint32_t y_min,
+        const uint32_t x_max, const uint32_t y_max
+    );
+};
+
+template <typename map_t, typename Predicate>
+void ClearanceLayer::compute(const map_t &map, const Predicate &is_accessible) {
+    const auto &nodes {map.get_nodes()};
+
+    std::fill(runs_down.begin(), runs_down.end(), 0);
+
+    for (uint32_t y = height; y-- > 0;) {
+        uint8_t run {0};
+
+        for (uint32_t x = width; x-- > 0;) {
+            if (!is_accessible(nodes[get_node_index(x, y, width)])) {
+                run = 0;
+            }
+            else if (run < MAX_CLEARANCE) {
+                ++run;
+            }
+
+            runs_right[x] = run;
+        }
+
+        combine_row(y);
+    }
+}
+
+template <typename map_t, typename Predicate>
+void ClearanceLayer::repair(
+    const map_t &map, const Predicate &is_accessible,
+    const uint32_t x_min, const uint32_t y_min,
+    const uint32_t x_max, const uint32_t y_max
+) {
+    const auto &nodes {map.get_nodes()};
+
+    // The range of columns changed in the row below, flagged exactly in
+    // `changed_below`; empty when `changed_lo` is past `changed_hi`.
+    int64_t changed_lo {INT64_MAX};
+    int64_t changed_hi {-1};
+
+    for (int64_t y = std::min(y_max, height - 1); y >= 0; --y) {
+        const bool edited_row {y >= y_min};
+
+        // A cell depends only on the cells right of and below it, so the
+        // rightmost cell that can change is the rightmost edited or changed
+        // one, and the leftmost that must be visited is the leftmost edited,
+        // or the one left of the leftmost changed. Past that, only a change
+        // to the right carries on.
+        int64_t x_first {changed_hi};
+        int64_t x_last {changed_lo - 1};
+
+        if (edited_row && x_min < width) {
+            x_first = std::max<int64_t>(x_first, std::min(x_max, width - 1));
+            x_last = std::min<int64_t>(x_last, x_min);
+        }
+
+        if (x_first < 0) {
+            break;
+        }
+
+        int64_t row_lo {INT64_MAX};
+        int64_t row_hi {-1};
+
+        bool right_changed {false};
+
+        for (int64_t x = x_first; x >= 0; --x) {
+            const bool must_visit {
+                (edited_row && x >= x_min && x <= x_max) ||
+                changed_below[x] || changed_below[x + 1]
+            };
+
+            if (!must_visit && !right_changed) {
+                if (x < x_last) {
+                    break;
+                }
+
+                continue;
+            }
+
+            const uint32_t idx {get_node_index(x, y, width)};
+
+            const uint8_t value {
+                is_accessible(nodes[idx]) ? from_neighbors(x, y) : uint8_t{0}
+            };
+
+            right_changed = value != clearance[idx];
+
+            if (right_changed) {
+                clearance[idx] = value;
+                changed_row[x] = true;
+
+                row_lo = std::min(row_lo, x);
+                row_hi = std::max(row_hi, x);
+            }
+        }
+
+        // Clear the flags of the row below for reuse by the row above.
+        for (int64_t x = changed_lo; x <= changed_hi; ++x) {
+            changed_below[x] = false;
+        }
+
+        changed_row.swap(changed_below);
+
+        changed_lo = row_lo;
+        changed_hi = row_hi;
+    }
+
+    for (int64_t x = changed_lo; x <= changed_hi; ++x) {
+        changed_below[x] = false;
+    }
+}
+
+#endif
@@ -0,0 +1,402 @@
+#ifndef COOPERATIVEPATHFIND_H
+#define COOPERATIVEPATHFIND_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <assert.h>
+
+#include "Map.h"
+#include "ReservationTable.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Cooperative A* (windowed, a la WHCA*): plans a single agent's path through
+// (cell, time step) space, avoiding the cells other agents have reserved in a
+// shared `ReservationTable`, then reserves its own path so that agents planned
+// later avoid it in turn.
+//
+// Each step, the agent either moves to a neighboring cell (as generated by
+// `MapExplorer`) or waits where it is. A plan costs its duration in steps;
+// terrain costs are not considered. Within the table's window, a step may not
+// enter a cell reserved by another agent at that time, nor swap cells with
+// another agent. Beyond the window nothing is reserved, so the search there
+// collapses to plain spatial A* and the plan's tail is only advisory; agents
+// are expected to replan before they run off the end of the window.
+//
+// Planning is optimistic: if another thread reserves part of the plan between
+// the search and the reservation, the reservations made so far are released
+// and the search is retried.
+//
+// The map's regions must already be colored for the predicate (see
+// `RegionColorer::color_all_regions()`) if agents are planned concurrently.
+template <typename map_t, typename Predicate>
+class CooperativePathfind : public MapExplorer<map_t, Predicate, CooperativePathfind> {
+public:
+    struct ExploredNode {
+        const uint32_t idx;
+        const uint32_t time;
+        const uint32_t dist_from_start;
+        const uint32_t heur_dist_to_end;
+
+        const ExploredNode *const parent;
+
+        ExploredNode(
+            const uint32_t idx,
+            const uint32_t time,
+            const uint32_t dist_from_start,
+            const uint32_t heur_dist_to_end,
+            const ExploredNode *parent
+        ):
+            idx(idx),
+            time(time),
+            dist_from_start(dist_from_start),
+            heur_dist_to_end(heur_dist_to_end),
+            parent(parent)
+        {}
+
+        // Ties on the estimated total prefer the node further along, which
+        // matters a great deal with unit step costs.
+        friend bool operator>(
+            const ExploredNode &lhs, const ExploredNode &rhs
+        ) {
+            const uint32_t f_lhs {lhs.dist_from_start + lhs.heur_dist_to_end};
+            const uint32_t f_rhs {rhs.dist_from_start + rhs.heur_dist_to_end};
+
+            if (f_lhs != f_rhs) {
+                return f_lhs > f_rhs;
+            }
+
+            return lhs.dist_from_start < rhs.dist_from_start;
+        }
+    };
+
+private:
+    // Searches restarted after losing a reservation race before giving up.
+    static inline const uint32_t MAX_ATTEMPTS {4};
+
+    map_t &map;
+    ReservationTable &reservations;
+    const uint32_t agent;
+    const uint32_t x_start;
+    const uint32_t y_start;
+    const uint32_t x_end;
+    const uint32_t y_end;
+    const uint32_t time_start;
+
+    // The first time step beyond the reservation window.
+    uint32_t time_horizon {0};
+
+    // A deque, so that parents stay put as nodes are added.
+    std::deque<ExploredNode> seen_nodes;
+    // Keyed by time step (clamped to the horizon) and cell.
+    std::unordered_set<uint64_t> seen_nodes_key;
+
+    std::vector<const ExploredNode *> to_explore;
+
+    static bool compare_nodes(const ExploredNode *lhs, const ExploredNode *rhs) {
+        return *lhs > *rhs;
+    }
+
+    bool is_reserved_by_other(const uint32_t idx, const uint32_t time) const {
+        const uint32_t holder {reservations.get_agent(idx, time)};
+
+        return holder != ReservationTable::NO_AGENT && holder != agent;
+    }
+
+    // Whether the agent may stay in the end cell from `time` to the end of the
+    // window, ie, whether arriving at `time` completes the plan.
+    bool can_rest_at_end(const uint32_t idx, const uint32_t time) const {
+        for (uint32_t t = time; t < time_horizon; ++t) {
+            if (is_reserved_by_other(idx, t)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // As in `Pathfind`, the Euclidean distance slightly overestimates the
+    // remaining steps, trading a little optimality for far fewer expansions.
+    uint32_t heuristic(const uint32_t idx) const {
+        const auto [x, y] = get_node_xy(idx, map.width);
+
+        return static_cast<uint32_t>(std::ceil(dist_euclidean(x, y, x_end, y_end)));
+    }
+
+    void reset() {
+        seen_nodes.clear();
+        seen_nodes_key.clear();
+        to_explore.clear();
+    }
+
+    std::optional<std::vector<uint32_t>> search();
+
+    bool reserve_plan(const std::vector<uint32_t> &plan);
+
+public:
+    const Predicate &is_accessible;
+
+    bool can_enter(const uint32_t idx) const {
+        return is_accessible(map.get_nodes()[idx]);
+    }
+
+    // Push the state reached by stepping from `parent` to cell `idx`, unless
+    // another agent has that cell reserved at that time, or the step would
+    // swap cells with another agent.
+    void push_node(const uint32_t idx, const ExploredNode &parent) {
+        const uint32_t time {parent.time + 1};
+
+        if (time < time_horizon) {
+            if (is_reserved_by_other(idx, time)) {
+                return;
+            }
+
+            const uint32_t holder {reservations.get_agent(idx, parent.time)};
+
+            if (
+                holder != ReservationTable::NO_AGENT && holder != agent &&
+                reservations.get_agent(parent.idx, time) == holder
+            ) {
+                return;
+            }
+        }
+
+        const uint64_t key {
+            (static_cast<uint64_t>(std::min(time, time_horizon)) << 32) | idx
+        };
+
+        if (!seen_nodes_key.insert(key).second) {
+            return;
+        }
+
+        to_explore.push_back(
+            &seen_nodes.emplace_back(
+                idx, time, parent.dist_from_start + 1, heuristic(idx), &parent
+            )
+        );
+
+        std::push_heap(to_explore.begin(), to_explore.end(), compare_nodes);
+    }
+
+    void pop_node() {
+        assert(to_explore.size() > 0);
+
+        std::pop_heap(to_explore.begin(), to_explore.end(), compare_nodes);
+
+        to_explore.pop_back();
+    }
+
+    const ExploredNode &get_next_node() const {
+        assert(to_explore.size() > 0);
+
+        return *to_explore.front();
+    }
+
+    decltype(auto) get_map_nodes() const {
+        return map.get_nodes();
+    }
+
+    uint32_t get_map_width() const {
+        return map.width;
+    }
+
+    uint32_t get_map_height() const {
+        return map.height;
+    }
+
+    // Plan for `agent`, which stands at the start cell at time step
+    // `time_start`.
+    CooperativePathfind(
+        map_t &map,
+        ReservationTable &reservations,
+        const uint32_t agent,
+        const uint32_t x_start,
+        const uint32_t y_start,
+        const uint32_t x_end,
+        const uint32_t y_end,
+        const uint32_t time_start,
+        const Predicate &is_accessible
+    ):
+        map(map),
+        reservations(reservations),
+        agent(agent),
+        x_start(x_start),
+        y_start(y_start),
+        x_end(x_end),
+        y_end(y_end),
+        time_start(time_start),
+        is_accessible(is_accessible)
+    {}
+
+    // Plan and reserve a path. The path is in travel order, with one cell per
+    // time step starting at `time_start` (so a wait repeats a cell), and ends
+    // at the end cell. Within the window, the agent keeps the end cell
+    // reserved after it arrives.
+    //
+    // Returns an empty path if the end is unreachable, or if the plan could
+    // not be reserved after several attempts.
+    //
+    // Reservations left over from an earlier plan for the same agent are not
+    // released; they only constrain other agents.
+    std::vector<std::pair<uint32_t, uint32_t>> get_path() {
+        TRACE_SCOPE("cooperative get_path");
+
+        for (uint32_t attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+            const auto plan {search()};
+
+            if (!plan) {
+                return {};
+            }
+
+            if (reserve_plan(*plan)) {
+                std::vector<std::pair<uint32_t, uint32_t>> path;
+
+                path.reserve(plan->size());
+
+                for (const uint32_t idx : *plan) {
+                    path.push_back(get_node_xy(idx, map.width));
+                }
+
+                return path;
+            }
+        }
+
+        return {};
+    }
+};
+
+template <typename map_t, typename Predicate>
+std::optional<std::vector<uint32_t>> CooperativePathfind<map_t, Predicate>::search() {
+    reset();
+
+    time_horizon = reservations.get_base_time() + reservations.get_window();
+
+    const auto &nodes {map.get_nodes()};
+
+    const uint32_t idx_node_start {get_node_index(x_start, y_start, map.width)};
+    const uint32_t idx_node_end {get_node_index(x_end, y_end, map.width)};
+
+    if (
+        !is_accessible(nodes[idx_node_start]) ||
+        !is_accessible(nodes[idx_node_end])
+    ) {
+        return std::nullopt;
+    }
+
+    std::optional<uint64_t> region_start {nodes[idx_node_start].get_region()};
+    std::optional<uint64_t> region_end {nodes[idx_node_end].get_region()};
+
+    if (!region_start) {
+        region_start = RegionColorer<map_t, Predicate>(
+            map, x_start, y_start, is_accessible
+        ).identify_region();
+    }
+
+    if (!region_end) {
+        region_end = RegionColorer<map_t, Predicate>(
+            map, x_end, y_end, is_accessible
+        ).identify_region();
+    }
+
+    if (!region_start || !region_end || *region_start != *region_end) {
+        return std::nullopt;
+    }
+
+    seen_nodes_key.insert(
+        (static_cast<uint64_t>(std::min(time_start, time_horizon)) << 32) |
+            idx_node_start
+    );
+    to_explore.push_back(
+        &seen_nodes.emplace_back(
+            idx_node_start, time_start, 0, heuristic(idx_node_start), nullptr
+        )
+    );
+
+    while (to_explore.size() > 0) {
+        const ExploredNode &best_node {get_next_node()};
+
+        if (
+            best_node.idx == idx_node_end &&
+            can_rest_at_end(best_node.idx, best_node.time)
+        ) {
+            std::vector<uint32_t> plan(best_node.time - time_start + 1);
+
+            for (const ExploredNode *node = &best_node; node; node = node->parent) {
+                plan[node->time - time_start] = node->idx;
+            }
+
+            return plan;
+        }
+
+        this->gen_neighbors();
+
+        // Waiting only makes sense while there are reservations to wait out.
+        if (best_node.time + 1 < time_horizon) {
+            push_node(best_node.idx, best_node);
+        }
+    }
+
+    return std::nullopt;
+}
+
+template <typename map_t, typename Predicate>
+bool CooperativePathfind<map_t, Predicate>::reserve_plan(
+    const std::vector<uint32_t> &plan
+) {
+    const auto rest_time = [&](const uint32_t t) {
+        return time_start + plan.size() - 1 + t;
+    };
+
+    uint32_t reserved_steps {0};
+    uint32_t reserved_rest {0};
+
+    bool ok {true};
+
+    for (; reserved_steps < plan.size(); ++reserved_steps) {
+        const uint32_t time {time_start + reserved_steps};
+
+        if (!reservations.in_window(time)) {
+            break;
+        }
+
+        if (!reservations.reserve(plan[reserved_steps], time, agent)) {
+            ok = false;
+
+            break;
+        }
+    }
+
+    // Hold the end cell for the rest of the window.
+    while (ok && rest_time(reserved_rest + 1) < time_horizon) {
+        if (!reservations.reserve(plan.back(), rest_time(reserved_rest + 1), agent)) {
+            ok = false;
+        }
+        else {
+            ++reserved_rest;
+        }
+    }
+
+    if (ok) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < reserved_steps; ++i) {
+        reservations.release(plan[i], time_start + i, agent);
+    }
+
+    for (uint32_t i = 1; i <= reserved_rest; ++i) {
+        reservations.release(plan.back(), rest_time(i), agent);
+    }
+
+    return false;
+}
+
+#endif
@@ -0,0 +1,476 @@
+#include "CrowdAvoidance.h"
+
+#include <algorithm>
+#include <cmath>
+#include <latch>
+
+#include "Trace.h"
+
+namespace {
+    const float EPSILON {1e-5f};
+
+    float det(const float x_a, const float y_a, const float x_b, const float y_b) {
+        return x_a * y_b - y_a * x_b;
+    }
+
+    typedef CrowdAvoidance::Line Line;
+
+    // Optimize along line `line_no` of `lines`, subject to the lines before
+    // it and the speed limit `radius`. If `dir_opt`, (x_opt, y_opt) is a
+    // direction to go as far as possible along, otherwise the velocity to get
+    // as close as possible to. Returns false if the constraints cannot all be
+    // met.
+    bool solve_line(
+        const std::vector<Line> &lines,
+        const uint32_t line_no,
+        const float radius,
+        const float x_opt,
+        const float y_opt,
+        const bool dir_opt,
+        float &x_result,
+        float &y_result
+    ) {
+        const Line &line {lines[line_no]};
+
+        const float dot {line.x_point * line.x_dir + line.y_point * line.y_dir};
+        const float discriminant {
+            dot * dot + radius * radius
+                - (line.x_point * line.x_point + line.y_point * line.y_point)
+        };
+
+        if (discriminant < 0) {
+            // The speed limit excludes the whole line.
+            return false;
+        }
+
+        const float sqrt_discriminant {std::sqrt(discriminant)};
+
+        float t_left {-dot - sqrt_discriminant};
+        float t_right {-dot + sqrt_discriminant};
+
+        for (uint32_t i = 0; i < line_no; ++i) {
+            const Line &other {lines[i]};
+
+            const float denominator {det(line.x_dir, line.y_dir, other.x_dir, other.y_dir)};
+            const float numerator {
+                det(
+                    other.x_dir, other.y_dir,
+                    line.x_point - other.x_point, line.y_point - other.y_point
+                )
+            };
+
+            if (std::fabs(denominator) <= EPSILON) {
+                // Parallel lines.
+                if (numerator < 0) {
+                    return false;
+                }
+
+                continue;
+            }
+
+            const float t {numerator / denominator};
+
+            if (denominator >= 0) {
+                t_right = std::min(t_right, t);
+            }
+            else {
+                t_left = std::max(t_left, t);
+            }
+
+            if (t_left > t_right) {
+                return false;
+            }
+        }
+
+        float t;
+
+        if (dir_opt) {
+            t = (x_opt * line.x_dir + y_opt * line.y_dir) > 0 ? t_right : t_left;
+        }
+        else {
+            t = std::clamp(
+                line.x_dir * (x_opt - line.x_point) + line.y_dir * (y_opt - line.y_point),
+                t_left, t_right
+            );
+        }
+
+        x_result = line.x_point + t * line.x_dir;
+        y_result = line.y_point + t * line.y_dir;
+
+        return true;
+    }
+
+    // Find the velocity within speed limit `radius` best satisfying (x_opt,
+    // y_opt), as for `solve_line()`, subject to every line. Returns the index
+    // of the line that could not be met, or the number of lines on success.
+    uint32_t solve_lines(
+        const std::vector<Line> &lines,
+        const float radius,
+        const float x_opt,
+        const float y_opt,
+        const bool dir_opt,
+        float &x_result,
+        float &y_result
+    ) {
+        const float opt_sq {x_opt * x_opt + y_opt * y_opt};
+
+        if (dir_opt) {
+            x_result = x_opt * radius;
+            y_result = y_opt * radius;
+        }
+        else if (opt_sq > radius * radius) {
+            const float scale {radius / std::sqrt(opt_sq)};
+
+            x_result = x_opt * scale;
+            y_result = y_opt * scale;
+        }
+        else {
+            x_result = x_opt;
+            y_result = y_opt;
+        }
+
+        for (uint32_t i = 0; i < lines.size(); ++i) {
+            const Line &line {lines[i]};
+
+            if (
+                det(
+                    line.x_dir, line.y_dir,
+                    line.x_point - x_result, line.y_point - y_result
+                ) > 0
+            ) {
+                // The current result violates this line.
+                const float x_prev {x_result};
+                const float y_prev {y_result};
+
+                if (!solve_line(lines, i, radius, x_opt, y_opt, dir_opt, x_result, y_result)) {
+                    x_result = x_prev;
+                    y_result = y_prev;
+
+                    return i;
+                }
+            }
+        }
+
+        return lines.size();
+    }
+
+    // With the lines infeasible from `first_failed` on, find the velocity
+    // that minimizes the greatest violation of any line.
+    void solve_least_violating(
+        const std::vector<Line> &lines,
+        const uint32_t first_failed,
+        const float radius,
+        std::vector<Line> &projected,
+        float &x_result,
+        float &y_result
+    ) {
+        float distance {0};
+
+        for (uint32_t i = first_failed; i < lines.size(); ++i) {
+            const Line &line {lines[i]};
+
+            if (
+                det(
+                    line.x_dir, line.y_dir,
+                    line.x_point - x_result, line.y_point - y_result
+                ) <= distance
+            ) {
+                continue;
+            }
+
+            projected.clear();
+
+            for (uint32_t j = 0; j < i; ++j) {
+                const Line &other {lines[j]};
+
+                Line proj;
+
+                const float determinant {det(line.x_dir, line.y_dir, other.x_dir, other.y_dir)};
+
+                if (std::fabs(determinant) <= EPSILON) {
+                    if (line.x_dir * other.x_dir + line.y_dir * other.y_dir > 0) {
+                        // Same direction.
+                        continue;
+                    }
+
+                    proj.x_point = 0.5f * (line.x_point + other.x_point);
+                    proj.y_point = 0.5f * (line.y_point + other.y_point);
+                }
+                else {
+                    const float t {
+                        det(
+                            other.x_dir, other.y_dir,
+                            line.x_point - other.x_point, line.y_point - other.y_point
+                        ) / determinant
+                    };
+
+                    proj.x_point = line.x_point + t * line.x_dir;
+                    proj.y_point = line.y_point + t * line.y_dir;
+                }
+
+                const float x_dir {other.x_dir - line.x_dir};
+                const float y_dir {other.y_dir - line.y_dir};
+                const float length {std::sqrt(x_dir * x_dir + y_dir * y_dir)};
+
+                proj.x_dir = x_dir / length;
+                proj.y_dir = y_dir / length;
+
+                projected.push_back(proj);
+            }
+
+            const float x_prev {x_result};
+            const float y_prev {y_result};
+
+            if (
+                solve_lines(
+                    projected, radius, -line.y_dir, line.x_dir, true, x_result, y_result
+                ) < projected.size()
+            ) {
+                // Can only fail through rounding, in which case the previous
+                // result is already optimal.
+                x_result = x_prev;
+                y_result = y_prev;
+            }
+
+            distance = det(
+                line.x_dir, line.y_dir,
+                line.x_point - x_result, line.y_point - y_result
+            );
+        }
+    }
+}
+
+CrowdAvoidance::CrowdAvoidance(
+    const uint32_t width,
+    const uint32_t height,
+    const Params &params,
+    const uint32_t threads
+):
+    params(params),
+    grid(
+        width, height,
+        std::max<uint32_t>(static_cast<uint32_t>(std::ceil(params.neighbor_dist)), 1)
+    ),
+    pool(threads)
+{}
+
+uint32_t CrowdAvoidance::add_agent(const float x, const float y, const float max_speed_new) {
+    const uint32_t agent = pos_x.size();
+
+    pos_x.push_back(x);
+    pos_y.push_back(y);
+    vel_x.push_back(0);
+    vel_y.push_back(0);
+    pref_vel_x.push_back(0);
+    pref_vel_y.push_back(0);
+    max_speed.push_back(max_speed_new);
+    new_vel_x.push_back(0);
+    new_vel_y.push_back(0);
+
+    grid.insert(agent, x, y);
+
+    return agent;
+}
+
+void CrowdAvoidance::set_position(const uint32_t agent, const float x, const float y) {
+    pos_x[agent] = x;
+    pos_y[agent] = y;
+
+    grid.move(agent, x, y);
+}
+
+void CrowdAvoidance::solve_agent(
+    const uint32_t agent,
+    const float dt,
+    std::vector<std::pair<float, uint32_t>> &neighbors,
+    std::vector<Line> &lines,
+    std::vector<Line> &projected
+) {
+    const float x {pos_x[agent]};
+    const float y {pos_y[agent]};
+    const float vx {vel_x[agent]};
+    const float vy {vel_y[agent]};
+
+    // Keep the closest neighbors, nearest first.
+    neighbors.clear();
+
+    grid.query_radius(
+        x, y, params.neighbor_dist,
+        [&](const uint32_t other, const float x_other, const float y_other) {
+            if (other == agent || params.max_neighbors == 0) {
+                return;
+            }
+
+            const float dx {x_other - x};
+            const float dy {y_other - y};
+            const std::pair<float, uint32_t> neighbor {dx * dx + dy * dy, other};
+
+            if (neighbors.size() == params.max_neighbors) {
+                if (neighbor >= neighbors.back()) {
+                    return;
+                }
+
+                neighbors.pop_back();
+            }
+
+            neighbors.insert(
+                std::upper_bound(neighbors.begin(), neighbors.end(), neighbor),
+                neighbor
+            );
+        }
+    );
+
+    const float inv_time_horizon {1.0f / params.time_horizon};
+    const float combined_radius {params.radius * 2};
+    const float combined_radius_sq {combined_radius * combined_radius};
+
+    lines.clear();
+
+    for (const auto &[dist_sq, other] : neighbors) {
+        const float x_rel_pos {pos_x[other] - x};
+        const float y_rel_pos {pos_y[other] - y};
+        const float x_rel_vel {vx - vel_x[other]};
+        const float y_rel_vel {vy - vel_y[other]};
+
+        Line line;
+
+        // The smallest change in relative velocity that leaves the velocity
+        // obstacle.
+        float x_u;
+        float y_u;
+
+        if (dist_sq > combined_radius_sq) {
+            // From the relative velocity to the center of the cut-off circle.
+            const float x_w {x_rel_vel - inv_time_horizon * x_rel_pos};
+            const float y_w {y_rel_vel - inv_time_horizon * y_rel_pos};
+            const float w_length_sq {x_w * x_w + y_w * y_w};
+            const float dot {x_w * x_rel_pos + y_w * y_rel_pos};
+
+            if (dot < 0 && dot * dot > combined_radius_sq * w_length_sq) {
+                // Project onto the cut-off circle.
+                const float w_length {std::sqrt(w_length_sq)};
+                const float x_unit_w {x_w / w_length};
+                const float y_unit_w {y_w / w_length};
+
+                line.x_dir = y_unit_w;
+                line.y_dir = -x_unit_w;
+
+                x_u = (combined_radius * inv_time_horizon - w_length) * x_unit_w;
+                y_u = (combined_radius * inv_time_horizon - w_length) * y_unit_w;
+            }
+            else {
+                // Project onto the nearer leg of the cone.
+                const float leg {std::sqrt(dist_sq - combined_radius_sq)};
+
+                if (det(x_rel_pos, y_rel_pos, x_w, y_w) > 0) {
+                    line.x_dir = (x_rel_pos * leg - y_rel_pos * combined_radius) / dist_sq;
+                    line.y_dir = (x_rel_pos * combined_radius + y_rel_pos * leg) / dist_sq;
+                }
+                else {
+                    line.x_dir = -(x_rel_pos * leg + y_rel_pos * combined_radius) / dist_sq;
+                    line.y_dir = -(-x_rel_pos * combined_radius + y_rel_pos * leg) / dist_sq;
+                }
+
+                const float dot_leg {x_rel_vel * line.x_dir + y_rel_vel * line.y_dir};
+
+                x_u = dot_leg * line.x_dir - x_rel_vel;
+                y_u = dot_leg * line.y_dir - y_rel_vel;
+            }
+        }
+        else {
+            // Already colliding: get apart within this step.
+            const float inv_dt {1.0f / dt};
+            const float x_w {x_rel_vel - inv_dt * x_rel_pos};
+            const float y_w {y_rel_vel - inv_dt * y_rel_pos};
+            const float w_length {std::max(std::sqrt(x_w * x_w + y_w * y_w), EPSILON)};
+            const float x_unit_w {x_w / w_length};
+            const float y_unit_w {y_w / w_length};
+
+            line.x_dir = y_unit_w;
+            line.y_dir = -x_unit_w;
+
+            x_u = (combined_radius * inv_dt - w_length) * x_unit_w;
+            y_u = (combined_radius * inv_dt - w_length) * y_unit_w;
+        }
+
+        // Each agent takes half of the responsibility.
+        line.x_point = vx + 0.5f * x_u;
+        line.y_point = vy + 0.5f * y_u;
+
+        lines.push_back(line);
+    }
+
+    float x_result;
+    float y_result;
+
+    const uint32_t failed {
+        solve_lines(
+            lines, max_speed[agent], pref_vel_x[agent], pref_vel_y[agent], false,
+            x_result, y_result
+        )
+    };
+
+    if (failed < lines.size()) {
+        solve_least_violating(lines, failed, max_speed[agent], projected, x_result, y_result);
+    }
+
+    new_vel_x[agent] = x_result;
+    new_vel_y[agent] = y_result;
+}
+
+void CrowdAvoidance::solve_batch(const uint32_t first, const uint32_t last, const float dt) {
+    // Scratch space, reused between batches on each worker.
+    thread_local std::vector<std::pair<float, uint32_t>> neighbors;
+    thread_local std::vector<Line> lines;
+    thread_local std::vector<Line> projected;
+
+    for (uint32_t agent = first; agent < last; ++agent) {
+        solve_agent(agent, dt, neighbors, lines, projected);
+    }
+}
+
+void CrowdAvoidance::step(const float dt) {
+    TRACE_SCOPE("CrowdAvoidance::step");
+
+    const uint32_t num_agents {size()};
+
+    {
+        TRACE_SCOPE("CrowdAvoidance::solve");
+
+        std::latch solved {num_agents};
+
+        for (uint32_t first = 0; first < num_agents; first += BATCH_SIZE) {
+            const uint32_t last {std::min(num_agents, first + BATCH_SIZE)};
+
+            pool.submit(
+                [&, first, last]() {
+                    solve_batch(first, last, dt);
+
+                    solved.count_down(last - first);
+                }
+            );
+        }
+
+        solved.wait();
+    }
+
+    TRACE_SCOPE("CrowdAvoidance::integrate");
+
+    // Plain loops over the dense arrays, for the compiler to vectorize.
+    std::copy(new_vel_x.begin(), new_vel_x.end(), vel_x.begin());
+    std::copy(new_vel_y.begin(), new_vel_y.end(), vel_y.begin());
+
+    float *const __restrict px {pos_x.data()};
+    float *const __restrict py {pos_y.data()};
+    const float *const __restrict vx {vel_x.data()};
+    const float *const __restrict vy {vel_y.data()};
+
+    for (uint32_t i = 0; i < num_agents; ++i) {
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+    }
+
+    for (uint32_t i = 0; i < num_agents; ++i) {
+        grid.move(i, px[i], py[i]);
+    }
+}
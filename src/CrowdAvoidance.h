@@ -0,0 +1,135 @@
+#ifndef CROWDAVOIDANCE_H
+#define CROWDAVOIDANCE_H
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "SpatialGrid.h"
+#include "WorkerPool.h"
+
+// Local collision avoidance between agents, using optimal reciprocal
+// collision avoidance (ORCA).
+//
+// Each step, every agent picks the velocity closest to its preferred one, eg,
+// towards its next waypoint, that keeps it from colliding with its nearest
+// neighbors within the time horizon, assuming they each take half the
+// responsibility for avoiding each other. Each neighbor contributes one
+// half-plane constraint on the velocity, and the velocity is found with a
+// small incremental 2D linear program, falling back to the least-violating
+// velocity when the constraints cannot all be met, eg, in a dense crowd.
+//
+// Neighbors are found through a `SpatialGrid`, so a step costs time
+// proportional to the agents and their neighborhoods, not the square of the
+// agent count. The per-agent programs only read the previous step's state, so
+// they are solved in parallel batches on a worker pool.
+//
+// Only agents are avoided, not map cells; agents are expected to be steered
+// along paths around the map's obstacles, eg, by `AgentSim`, with this
+// adjusting their velocities locally. Positions are in cell units, as for
+// `Pos`, and velocities in cells per time unit.
+class CrowdAvoidance {
+public:
+    struct Params {
+        // The radius of every agent.
+        float radius {0.4f};
+        // Neighbors further than this are ignored.
+        float neighbor_dist {3.0f};
+        // Only the closest neighbors are considered. With none, agents
+        // ignore each other.
+        uint32_t max_neighbors {10};
+        // How far ahead, in time units, collisions are avoided. Larger is
+        // safer but less responsive.
+        float time_horizon {2.0f};
+    };
+
+    // A constraint on an agent's velocity: velocities to the left of the
+    // line through `point` along the unit vector `dir` are permitted.
+    struct Line {
+        float x_point;
+        float y_point;
+        float x_dir;
+        float y_dir;
+    };
+
+private:
+    // Agents per worker pool task.
+    static inline const uint32_t BATCH_SIZE {256};
+
+    const Params params;
+
+    // Agent state, indexed by agent id.
+    std::vector<float> pos_x;
+    std::vector<float> pos_y;
+    std::vector<float> vel_x;
+    std::vector<float> vel_y;
+    std::vector<float> pref_vel_x;
+    std::vector<float> pref_vel_y;
+    std::vector<float> max_speed;
+
+    // The velocities solved for this step.
+    std::vector<float> new_vel_x;
+    std::vector<float> new_vel_y;
+
+    SpatialGrid grid;
+
+    // Solve for the new velocity of every agent in [first, last).
+    void solve_batch(const uint32_t first, const uint32_t last, const float dt);
+
+    void solve_agent(
+        const uint32_t agent,
+        const float dt,
+        std::vector<std::pair<float, uint32_t>> &neighbors,
+        std::vector<Line> &lines,
+        std::vector<Line> &projected
+    );
+
+    // Declared last, so that it is destroyed, and its workers joined, first.
+    WorkerPool pool;
+
+public:
+    // Agents may roam a `width` by `height` cell map.
+    CrowdAvoidance(
+        const uint32_t width,
+        const uint32_t height,
+        const Params &params,
+        const uint32_t threads = std::thread::hardware_concurrency()
+    );
+
+    // Returns the new agent's id. The agent starts at rest.
+    uint32_t add_agent(const float x, const float y, const float max_speed_new);
+
+    void set_preferred_velocity(const uint32_t agent, const float vx, const float vy) {
+        pref_vel_x[agent] = vx;
+        pref_vel_y[agent] = vy;
+    }
+
+    // Move the agent, eg, to follow an externally updated `Pos`.
+    void set_position(const uint32_t agent, const float x, const float y);
+
+    // Solve every agent's velocity, then advance every agent by `dt` time
+    // units.
+    void step(const float dt);
+
+    uint32_t size() const {
+        return pos_x.size();
+    }
+
+    float get_x(const uint32_t agent) const {
+        return pos_x[agent];
+    }
+
+    float get_y(const uint32_t agent) const {
+        return pos_y[agent];
+    }
+
+    float get_vx(const uint32_t agent) const {
+        return vel_x[agent];
+    }
+
+    float get_vy(const uint32_t agent) const {
+        return vel_y[agent];
+    }
+};
+
+#endif
@@ -0,0 +1,464 @@
+#ifndef DISTANCEMATRIX_H
+#define DISTANCEMATRIX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "Map.h"
+#include "Terrain.h"
+#include "Trace.h"
+#include "Util.h"
+#include "WorkerPool.h"
+
+// A one-to-many search: a Dijkstra search from one source that stops as soon
+// as every given target is settled, or the nearest `k` of them, so that the
+// costs from one agent to many targets take a single search, rather than one
+// `Pathfind` per target. Steps cost the same as in `Pathfind`, and follow the
+// same corner rule, but costs are exact, as there is no heuristic to inflate.
+//
+// The search's dense per-cell state is kept between searches, and reset only
+// where the last search touched it, so that, once warmed up, searching does
+// not allocate. The path from the source to any cell settled by the last
+// search can be read back afterwards.
+//
+// Not thread-safe; use one per thread.
+template <typename map_t, typename Predicate>
+class DistanceSearch : public MapExplorer<map_t, Predicate, DistanceSearch> {
+public:
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    struct ExploredNode {
+        uint32_t idx;
+        float cost;
+
+        friend bool operator>(const ExploredNode &lhs, const ExploredNode &rhs) {
+            return lhs.cost > rhs.cost;
+        }
+    };
+
+private:
+    static inline const uint32_t NONE {UINT32_MAX};
+
+    map_t &map;
+
+    const TerrainCosts terrain_costs;
+
+    // Per cell; untouched cells are infinite, without parent and unmarked.
+    std::vector<float> costs;
+    std::vector<uint32_t> parents;
+    std::vector<uint8_t> settled;
+
+    // Per cell; the number of targets on the cell, if its stamp is current.
+    std::vector<uint32_t> target_stamps;
+    std::vector<uint32_t> target_counts;
+    uint32_t stamp {0};
+
+    std::vector<ExploredNode> to_explore;
+    std::vector<uint32_t> touched;
+    ExploredNode expanding {0, 0};
+
+    // Scratch for `nearest()`.
+    std::vector<float> nearest_costs;
+
+    // Forget the last search.
+    void reset() {
+        for (const uint32_t idx : touched) {
+            costs[idx] = INFINITY;
+            parents[idx] = NONE;
+            settled[idx] = false;
+        }
+
+        touched.clear();
+        to_explore.clear();
+
+        // Wrapping around would revive stale marks.
+        if (++stamp == 0) {
+            std::fill(target_stamps.begin(), target_stamps.end(), 0);
+
+            stamp = 1;
+        }
+    }
+
+    // Search from (x, y) until `wanted` targets have been settled, or every
+    // reachable cell has been. Targets must be marked first.
+    void search(const uint32_t x, const uint32_t y, uint32_t wanted);
+
+public:
+    const Predicate &is_accessible;
+
+    bool can_enter(const uint32_t idx) const {
+        return is_accessible(map.get_nodes()[idx]);
+    }
+
+    void push_node(const uint32_t idx, const ExploredNode &parent) {
+        const float cost {
+            parent.cost + terrain_costs[map.get_nodes()[idx].get_terrain()]
+        };
+
+        if (cost >= costs[idx]) {
+            return;
+        }
+
+        if (costs[idx] == INFINITY) {
+            touched.push_back(idx);
+        }
+
+        costs[idx] = cost;
+        parents[idx] = parent.idx;
+
+        to_explore.push_back({idx, cost});
+        std::push_heap(
+            to_explore.begin(), to_explore.end(), std::greater<ExploredNode>{}
+        );
+    }
+
+    // The search pops the node before expanding it, so there is nothing left
+    // to do here.
+    void pop_node() {}
+
+    const ExploredNode &get_next_node() const {
+        return expanding;
+    }
+
+    uint32_t get_map_width() const {
+        return map.width;
+    }
+
+    uint32_t get_map_height() const {
+        return map.height;
+    }
+
+    DistanceSearch(
+        map_t &map,
+        const Predicate &is_accessible,
+        const TerrainCosts &terrain_costs = DEFAULT_TERRAIN_COSTS
+    ):
+        map(map),
+        terrain_costs(terrain_costs),
+        costs(get_node_count(map.width, map.height), INFINITY),
+        parents(get_node_count(map.width, map.height), NONE),
+        settled(get_node_count(map.width, map.height), false),
+        target_stamps(get_node_count(map.width, map.height), 0),
+        target_counts(get_node_count(map.width, map.height), 0),
+        is_accessible(is_accessible)
+    {}
+
+    // Write the cost from (x, y) to each of `targets` into `out`, in the same
+    // order, or infinity where there is no path. If `k` is given, the search
+    // stops once the nearest `k` targets are settled, and the costs of the
+    // rest are infinite unless they happened to be settled too.
+    void costs_to(
+        const uint32_t x,
+        const uint32_t y,
+        const path_t &targets,
+        std::vector<float> &out,
+        const uint32_t k = UINT32_MAX
+    );
+
+    // Write the indices into `targets` and the costs of the nearest `k`
+    // targets reachable from (x, y) into `out`, nearest first.
+    void nearest(
+        const uint32_t x,
+        const uint32_t y,
+        const path_t &targets,
+        const uint32_t k,
+        std::vector<std::pair<uint32_t, float>> &out
+    );
+
+    // Write the path from the last search's source to (x, y) into `path`,
+    // end-first, as `Pathfind::get_path()` does. Left empty if the last search
+    // did not settle (x, y).
+    void get_path(const uint32_t x, const uint32_t y, path_t &path) const {
+        path.clear();
+
+        uint32_t idx {get_node_index(x, y, map.width)};
+
+        if (!settled[idx]) {
+            return;
+        }
+
+        for (; idx != NONE; idx = parents[idx]) {
+            path.push_back(get_node_xy(idx, map.width));
+        }
+    }
+};
+
+template <typename map_t, typename Predicate>
+void DistanceSearch<map_t, Predicate>::search(
+    const uint32_t x, const uint32_t y, uint32_t wanted
+) {
+    TRACE_SCOPE("DistanceSearch::search");
+
+    const uint32_t idx_start {get_node_index(x, y, map.width)};
+
+    if (!can_enter(idx_start)) {
+        return;
+    }
+
+    costs[idx_start] = 0;
+    touched.push_back(idx_start);
+    to_explore.push_back({idx_start, 0});
+
+    while (!to_explore.empty() && wanted > 0) {
+        std::pop_heap(
+            to_explore.begin(), to_explore.end(), std::greater<ExploredNode>{}
+        );
+
+        expanding = to_explore.back();
+
+        to_explore.pop_back();
+
+        // Superseded by a cheaper entry since it was pushed.
+        if (settled[expanding.idx]) {
+            continue;
+        }
+
+        settled[expanding.idx] = true;
+
+        if (target_stamps[expanding.idx] == stamp) {
+            wanted -= std::min(wanted, target_counts[expanding.idx]);
+        }
+
+        this->gen_neighbors();
+    }
+}
+
+template <typename map_t, typename Predicate>
+void DistanceSearch<map_t, Predicate>::costs_to(
+    const uint32_t x,
+    const uint32_t y,
+    const path_t &targets,
+    std::vector<float> &out,
+    const uint32_t k
+) {
+    reset();
+
+    for (const auto &[x_target, y_target] : targets) {
+        const uint32_t idx {get_node_index(x_target, y_target, map.width)};
+
+        if (target_stamps[idx] != stamp) {
+            target_stamps[idx] = stamp;
+            target_counts[idx] = 0;
+        }
+
+        ++target_counts[idx];
+    }
+
+    search(x, y, std::min<uint32_t>(k, targets.size()));
+
+    out.resize(targets.size());
+
+    for (uint32_t i = 0; i < targets.size(); ++i) {
+        const uint32_t idx {
+            get_node_index(targets[i].first, targets[i].second, map.width)
+        };
+
+        out[i] = settled[idx] ? costs[idx] : INFINITY;
+    }
+}
+
+template <typename map_t, typename Predicate>
+void DistanceSearch<map_t, Predicate>::nearest(
+    const uint32_t x,
+    const uint32_t y,
+    const path_t &targets,
+    const uint32_t k,
+    std::vector<std::pair<uint32_t, float>> &out
+) {
+    costs_to(x, y, targets, nearest_costs, k);
+
+    out.clear();
+
+    for (uint32_t i = 0; i < targets.size(); ++i) {
+        if (nearest_costs[i] != INFINITY) {
+            out.emplace_back(i, nearest_costs[i]);
+        }
+    }
+
+    // Ties at the cut may have settled a few more than `k`.
+    const uint32_t kept {std::min<uint32_t>(k, out.size())};
+
+    std::partial_sort(
+        out.begin(), out.begin() + kept, out.end(),
+        [](const auto &lhs, const auto &rhs) {
+            return lhs.second < rhs.second;
+        }
+    );
+
+    out.resize(kept);
+}
+
+// Many-to-many costs: the cost from each of a set of sources to each of a set
+// of targets, as a dense matrix, eg, for assigning agents to tasks.
+//
+// Each source runs one `DistanceSearch`, and the sources run in parallel on a
+// worker pool, one search state per worker. The regions of the endpoints are
+// looked up once, up front, so each search only waits on the targets in its
+// source's region, and sources with no target in their region skip searching
+// altogether. Paths are not kept; `get_path()` reconstructs one on demand.
+//
+// If a `region_profile` is given, regions are looked up and colored in its
+// layer, as in `Pathfind`, rather than in the map's nodes, whose labels may
+// have been colored with another predicate.
+template <typename map_t, typename Predicate>
+class DistanceMatrix {
+public:
+    typedef typename DistanceSearch<map_t, Predicate>::path_t path_t;
+
+private:
+    typedef DistanceSearch<map_t, Predicate> search_t;
+    typedef RegionColorer<map_t, Predicate> region_colorer_t;
+
+    map_t &map;
+    const Predicate &is_accessible;
+
+    // Where region labels are kept, if not in the map's nodes.
+    RegionLayer *const region_layer;
+
+    std::vector<std::unique_ptr<search_t>> searches;
+
+    WorkerPool pool;
+
+    // The region of (x, y), coloring it first if need be.
+    std::optional<uint64_t> get_region(const uint32_t x, const uint32_t y) {
+        const uint32_t idx {get_node_index(x, y, map.width)};
+
+        if (const auto region {region_colorer_t::get_region(map, idx, region_layer)}) {
+            return region;
+        }
+
+        region_colorer_t region_colorer(
+            map, x, y, is_accessible, std::nullopt, region_layer
+        );
+
+        return region_colorer.identify_region();
+    }
+
+public:
+    DistanceMatrix(
+        map_t &map,
+        const Predicate &is_accessible,
+        RegionProfile *region_profile = nullptr,
+        const TerrainCosts &terrain_costs = DEFAULT_TERRAIN_COSTS,
+        const uint32_t threads = std::thread::hardware_concurrency()
+    ):
+        map(map),
+        is_accessible(is_accessible),
+        region_layer(region_profile ? &region_profile->get() : nullptr),
+        pool(threads)
+    {
+        for (uint32_t i = 0; i < pool.size(); ++i) {
+            searches.push_back(
+                std::make_unique<search_t>(map, is_accessible, terrain_costs)
+            );
+        }
+    }
+
+    // Fill `matrix` with the cost from each of `sources` to each of
+    // `targets`, row by source, or infinity where there is no path.
+    void compute(
+        const path_t &sources, const path_t &targets, std::vector<float> &matrix
+    );
+
+    // The path from `source` to `target`, end-first, as
+    // `Pathfind::get_path()`, and of the cost `compute()` found for them.
+    // Empty if there is none. Must not run alongside `compute()`.
+    path_t get_path(
+        const std::pair<uint32_t, uint32_t> &source,
+        const std::pair<uint32_t, uint32_t> &target
+    ) {
+        search_t &search {*searches.front()};
+
+        std::vector<float> cost;
+        path_t path;
+
+        search.costs_to(source.first, source.second, {target}, cost);
+        search.get_path(target.first, target.second, path);
+
+        return path;
+    }
+};
+
+template <typename map_t, typename Predicate>
+void DistanceMatrix<map_t, Predicate>::compute(
+    const path_t &sources, const path_t &targets, std::vector<float> &matrix
+) {
+    TRACE_SCOPE("DistanceMatrix::compute");
+
+    const uint32_t num_targets {static_cast<uint32_t>(targets.size())};
+
+    matrix.assign(sources.size() * num_targets, INFINITY);
+
+    // Coloring writes to the map, so happens here, before the searches share
+    // it.
+    std::vector<std::optional<uint64_t>> target_regions;
+    std::vector<std::optional<uint64_t>> source_regions;
+
+    for (const auto &[x, y] : targets) {
+        target_regions.push_back(get_region(x, y));
+    }
+
+    for (const auto &[x, y] : sources) {
+        source_regions.push_back(get_region(x, y));
+    }
+
+    std::atomic<uint32_t> next_source {0};
+    std::latch done {static_cast<std::ptrdiff_t>(searches.size())};
+
+    for (const auto &search : searches) {
+        pool.submit(
+            [&, search = search.get()]() {
+                // This worker's targets for the current source, and where
+                // their costs go.
+                path_t reachable;
+                std::vector<uint32_t> columns;
+                std::vector<float> costs;
+
+                for (
+                    uint32_t source = next_source++;
+                    source < sources.size();
+                    source = next_source++
+                ) {
+                    reachable.clear();
+                    columns.clear();
+
+                    for (uint32_t target = 0; target < num_targets; ++target) {
+                        if (
+                            source_regions[source] &&
+                            source_regions[source] == target_regions[target]
+                        ) {
+                            reachable.push_back(targets[target]);
+                            columns.push_back(target);
+                        }
+                    }
+
+                    if (reachable.empty()) {
+                        continue;
+                    }
+
+                    const auto &[x, y] = sources[source];
+
+                    search->costs_to(x, y, reachable, costs);
+
+                    for (uint32_t i = 0; i < columns.size(); ++i) {
+                        matrix[source * num_targets + columns[i]] = costs[i];
+                    }
+                }
+
+                done.count_down();
+            }
+        );
+    }
+
+    done.wait();
+}
+
+#endif
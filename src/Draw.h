@@ -1,6 +1,7 @@
 #ifndef DRAW_H
 #define DRAW_H
 
+#include <iostream>
 #include <vector>
 
 #include "Map.h"
@@ -23,7 +24,7 @@ public:
         width(map.width),
         height(map.height)
     {
-        tiles.reserve(width * height);
+        tiles.resize(get_node_count(width, height));
 
         map.draw_map_to_frame(tiles);
 
@@ -0,0 +1,292 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Messages per thread ring buffer.
+    const uint32_t RING_CAPACITY {1024};
+
+    // How long the drain thread sleeps when every ring is empty.
+    const std::chrono::milliseconds DRAIN_INTERVAL {5};
+
+    const char *const LEVEL_NAMES[] {"DEBUG", "INFO", "WARN", "ERROR"};
+
+    struct LogRecord {
+        LogLevel level;
+        uint32_t length;
+        char text[LOG_MAX_MESSAGE];
+    };
+
+    // Single-producer (the owning thread), single-consumer (the drain
+    // thread).
+    struct LogRing {
+        std::atomic<uint64_t> head {0};
+        std::atomic<uint64_t> tail {0};
+        std::atomic<uint64_t> dropped {0};
+
+        // Set once the owning thread exits, after its last message.
+        std::atomic<bool> abandoned {false};
+
+        std::vector<LogRecord> records;
+
+        LogRing():
+            records(RING_CAPACITY)
+        {}
+    };
+
+    std::atomic<LogLevel> min_level {LogLevel::INFO};
+
+    void write_stdio(const LogLevel level, const char *text, const uint32_t length) {
+        std::FILE *out {level >= LogLevel::WARN ? stderr : stdout};
+
+        std::fprintf(
+            out, "[%s] %.*s\n",
+            LEVEL_NAMES[static_cast<uint8_t>(level)],
+            static_cast<int>(length), text
+        );
+    }
+
+    std::atomic<LogSink> sink {write_stdio};
+
+    class Logger {
+    private:
+        std::mutex rings_mu;
+        // Rings are kept after their threads exit until they are drained,
+        // then dropped.
+        std::vector<std::shared_ptr<LogRing>> rings;
+
+        // Total messages accepted into, and written out of, all rings.
+        std::atomic<uint64_t> accepted {0};
+        std::atomic<uint64_t> written {0};
+
+        std::atomic<bool> stopping {false};
+        std::thread drainer;
+
+        // Returns the number of messages written.
+        uint64_t drain_ring(LogRing &ring) {
+            const uint64_t tail {ring.tail.load(std::memory_order_relaxed)};
+            const uint64_t head {ring.head.load(std::memory_order_acquire)};
+
+            const LogSink write {sink.load(std::memory_order_acquire)};
+
+            for (uint64_t i = tail; i < head; ++i) {
+                const LogRecord &record {ring.records[i % RING_CAPACITY]};
+
+                write(record.level, record.text, record.length);
+            }
+
+            ring.tail.store(head, std::memory_order_release);
+
+            if (const uint64_t dropped {ring.dropped.exchange(0)}; dropped > 0) {
+                char text[LOG_MAX_MESSAGE];
+
+                const int length {
+                    std::snprintf(
+                        text, sizeof(text), "%llu log messages dropped (ring full)",
+                        static_cast<unsigned long long>(dropped)
+                    )
+                };
+
+                write(LogLevel::WARN, text, std::min<uint32_t>(length, sizeof(text) - 1));
+            }
+
+            return head - tail;
+        }
+
+        void drain_all() {
+            std::vector<std::shared_ptr<LogRing>> rings_snapshot;
+
+            {
+                std::scoped_lock<std::mutex> lock(rings_mu);
+
+                rings_snapshot = rings;
+            }
+
+            uint64_t drained {0};
+            bool any_abandoned {false};
+
+            for (const auto &ring : rings_snapshot) {
+                // Checked before draining, so that an abandoned ring is
+                // drained of every message its thread wrote.
+                const bool abandoned {ring->abandoned.load(std::memory_order_acquire)};
+
+                drained += drain_ring(*ring);
+                any_abandoned = any_abandoned || abandoned;
+            }
+
+            if (any_abandoned) {
+                std::scoped_lock<std::mutex> lock(rings_mu);
+
+                std::erase_if(
+                    rings,
+                    [](const std::shared_ptr<LogRing> &ring) {
+                        return ring->abandoned.load(std::memory_order_acquire) &&
+                            ring->tail.load(std::memory_order_relaxed) ==
+                                ring->head.load(std::memory_order_acquire) &&
+                            ring->dropped.load(std::memory_order_relaxed) == 0;
+                    }
+                );
+            }
+
+            if (drained > 0) {
+                std::fflush(stdout);
+                std::fflush(stderr);
+
+                written += drained;
+            }
+        }
+
+        void drain_loop() {
+            while (!stopping) {
+                const uint64_t before {written};
+
+                drain_all();
+
+                if (written == before) {
+                    std::this_thread::sleep_for(DRAIN_INTERVAL);
+                }
+            }
+
+            drain_all();
+        }
+
+    public:
+        Logger():
+            drainer(&Logger::drain_loop, this)
+        {}
+
+        ~Logger() {
+            stopping = true;
+
+            drainer.join();
+        }
+
+        std::shared_ptr<LogRing> register_ring() {
+            std::scoped_lock<std::mutex> lock(rings_mu);
+
+            return rings.emplace_back(std::make_shared<LogRing>());
+        }
+
+        void note_accepted() {
+            accepted.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void flush() {
+            const uint64_t target {accepted};
+
+            while (written < target) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    };
+
+    Logger &get_logger() {
+        static Logger logger;
+
+        return logger;
+    }
+
+    // A thread's ring, marked abandoned for the drain thread to drop once
+    // the thread exits.
+    struct ThreadRing {
+        std::shared_ptr<LogRing> ring {get_logger().register_ring()};
+
+        ~ThreadRing() {
+            ring->abandoned.store(true, std::memory_order_release);
+        }
+    };
+
+    LogRing &get_thread_ring() {
+        thread_local ThreadRing thread_ring;
+
+        return *thread_ring.ring;
+    }
+
+    uint64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+}
+
+void log_set_level(const LogLevel level) {
+    min_level = level;
+}
+
+LogLevel log_get_level() {
+    return min_level.load(std::memory_order_relaxed);
+}
+
+void log_write(const LogLevel level, const char *fmt, ...) {
+    if (level < log_get_level()) {
+        return;
+    }
+
+    LogRing &ring {get_thread_ring()};
+
+    const uint64_t head {ring.head.load(std::memory_order_relaxed)};
+    const uint64_t tail {ring.tail.load(std::memory_order_acquire)};
+
+    if (head - tail >= RING_CAPACITY) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+
+        return;
+    }
+
+    LogRecord &record {ring.records[head % RING_CAPACITY]};
+
+    va_list args;
+    va_start(args, fmt);
+    const int length {std::vsnprintf(record.text, sizeof(record.text), fmt, args)};
+    va_end(args);
+
+    record.level = level;
+    record.length = length < 0
+        ? 0
+        : std::min<uint32_t>(length, sizeof(record.text) - 1);
+
+    get_logger().note_accepted();
+
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void log_flush() {
+    get_logger().flush();
+}
+
+void log_set_sink(const LogSink sink_new) {
+    sink.store(sink_new ? sink_new : write_stdio, std::memory_order_release);
+}
+
+bool LogRateLimiter::allow() {
+    const uint64_t now {now_ms()};
+    uint64_t window_start {window_start_ms.load(std::memory_order_relaxed)};
+
+    if (
+        now - window_start >= 1000 &&
+        window_start_ms.compare_exchange_strong(window_start, now)
+    ) {
+        count = 0;
+
+        if (const uint32_t dropped {suppressed.exchange(0)}; dropped > 0) {
+            log_write(
+                LogLevel::WARN, "%u messages suppressed by rate limit", dropped
+            );
+        }
+    }
+
+    if (count.fetch_add(1, std::memory_order_relaxed) < max_per_second) {
+        return true;
+    }
+
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+
+    return false;
+}
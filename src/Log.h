@@ -0,0 +1,81 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdint>
+
+// Asynchronous, non-blocking logging.
+//
+// Each thread formats its messages into its own fixed-size lock-free ring
+// buffer, which a background thread drains to stdout (stderr for warnings and
+// errors). Logging never blocks and never flushes on the calling thread: if a
+// thread's ring is full, the message is dropped and counted, and the drop is
+// reported once the ring drains.
+//
+// Messages use printf-style formatting and are truncated to
+// `LOG_MAX_MESSAGE` bytes.
+
+enum class LogLevel : uint8_t {
+    DEBUG,
+    INFO,
+    WARN,
+    ERROR,
+    // Not a message level; set it to discard every message.
+    OFF,
+};
+
+const uint32_t LOG_MAX_MESSAGE {240};
+
+// Messages below this level are discarded before being formatted. Defaults to
+// `LogLevel::INFO`.
+void log_set_level(const LogLevel level);
+LogLevel log_get_level();
+
+void log_write(const LogLevel level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Blocks until every message logged before the call has been written out.
+void log_flush();
+
+// Receives each message as it is written out, on the drain thread, including
+// the reports of dropped messages. `text` is not NUL-terminated.
+typedef void (*LogSink)(const LogLevel level, const char *text, const uint32_t length);
+
+// Routes messages to `sink` instead of stdout and stderr, eg, to capture them
+// in tests. A null `sink` restores the default.
+void log_set_sink(const LogSink sink);
+
+// Allows at most `max_per_second` messages through per one-second window.
+// Messages over the budget are counted, and the count is logged when the next
+// window opens.
+class LogRateLimiter {
+private:
+    const uint32_t max_per_second;
+
+    std::atomic<uint64_t> window_start_ms {0};
+    std::atomic<uint32_t> count {0};
+    std::atomic<uint32_t> suppressed {0};
+
+public:
+    LogRateLimiter(const uint32_t max_per_second):
+        max_per_second(max_per_second)
+    {}
+
+    bool allow();
+};
+
+#define LOG_DEBUG(...) log_write(LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) log_write(LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARN(...) log_write(LogLevel::WARN, __VA_ARGS__)
+#define LOG_ERROR(...) log_write(LogLevel::ERROR, __VA_ARGS__)
+
+// Logs at `level`, limited to `max_per_second` messages per call site.
+#define LOG_RATE_LIMITED(level, max_per_second, ...) \
+    do { \
+        static LogRateLimiter log_rate_limiter {max_per_second}; \
+        if (level >= log_get_level() && log_rate_limiter.allow()) { \
+            log_write(level, __VA_ARGS__); \
+        } \
+    } while (false)
+
+#endif
@@ -2,8 +2,8 @@
 #define MAP_H
 
 #include <algorithm>
+#include <chrono>
 #include <functional>
-#include <iostream>
 #include <list>
 #include <mutex>
 #include <optional>
@@ -13,6 +13,15 @@
 
 #include <assert.h>
 
+#include "ClearanceLayer.h"
+#include "Log.h"
+#include "OccupancyLayer.h"
+#include "RectangleDecomposition.h"
+#include "RegionLayers.h"
+#include "Resumable.h"
+#include "SearchObserver.h"
+#include "Terrain.h"
+#include "Trace.h"
 #include "Util.h"
 
 struct Pos {
@@ -26,15 +35,13 @@ class Map;
 
 struct MapNode {
 public:
-    static inline const float DEFAULT_WEIGHT {1.3};
-
     const uint32_t x_coord;
     const uint32_t y_coord;
 
 private:
     bool blocking;
+    uint8_t terrain;
     std::optional<uint64_t> region;
-    float weight;
 
 public:
     MapNode(
@@ -42,13 +49,13 @@ public:
         const uint32_t y_coord,
         const bool blocking,
         const std::optional<uint64_t> region = std::nullopt,
-        const float weight = DEFAULT_WEIGHT
+        const uint8_t terrain = TERRAIN_GROUND
     ):
         x_coord(x_coord),
         y_coord(y_coord),
         blocking(blocking),
-        region(region),
-        weight(weight)
+        terrain(terrain),
+        region(region)
     {}
 
     bool get_blocking() const {
@@ -59,12 +66,14 @@ public:
         blocking = blocking_new;
     }
 
-    float get_weight() const {
-        return weight;
+    uint8_t get_terrain() const {
+        return terrain;
     }
 
-    void set_weight(const float weight_new) {
-        weight = weight_new;
+    void set_terrain(const uint8_t terrain_new) {
+        assert(terrain_new < TerrainCosts::MAX_CLASSES);
+
+        terrain = terrain_new;
     }
 
     const std::optional<uint64_t> &get_region() const {
@@ -101,6 +110,20 @@ public:
         gen.seed(2);
     }
 
+    // Adopt an already-populated set of nodes, eg, from a map file loader.
+    // The nodes must be in index order, per `get_node_index()`.
+    Map(
+        const uint32_t width,
+        const uint32_t height,
+        std::vector<node_t> &&nodes
+    ):
+        nodes(std::move(nodes)),
+        width(width),
+        height(height)
+    {
+        assert(this->nodes.size() == get_node_count(width, height));
+    }
+
     Map(Map &&other) noexcept:
         nodes(std::move(other.nodes)),
         width(other.width),
@@ -111,17 +134,29 @@ public:
         const uint32_t width = 64, const uint32_t height = 32
     ) {
         std::uniform_int_distribution<> rng(0, 100);
-        std::uniform_int_distribution<> rng_width(0, width);
-        std::uniform_int_distribution<> rng_height(0, height);
+        std::uniform_int_distribution<> rng_width(0, width - 1);
+        std::uniform_int_distribution<> rng_height(0, height - 1);
 
         Map map(width, height);
 
-        map.nodes.reserve(map.width * map.height);
+        // Drawn in row order, so that every cell layout gets the same map.
+        std::vector<bool> blocking(static_cast<size_t>(width) * height);
+
+        for (size_t i = 0; i < blocking.size(); ++i) {
+            blocking[i] = rng(Map::gen) > 65;
+        }
+
+        const uint32_t count {get_node_count(width, height)};
+
+        map.nodes.reserve(count);
 
-        for (uint32_t i = 0; i < map.nodes.capacity(); ++i) {
+        for (uint32_t i = 0; i < count; ++i) {
             const auto [x, y] = get_node_xy(i, map.width);
 
-            map.nodes.emplace_back(x, y, rng(Map::gen) > 65);
+            map.nodes.emplace_back(
+                x, y,
+                map.is_padding(x, y) || blocking[static_cast<size_t>(y) * width + x]
+            );
         }
 
         for (uint32_t i = 0; i < 10; ++i) {
@@ -142,25 +177,25 @@ public:
             for (uint32_t i_x = x_road; i_x <= x_extend; ++i_x) {
                 const auto idx = get_node_index(i_x, y_road, map.width);
 
-                map.nodes[idx].set_weight(0.7);
+                map.nodes[idx].set_terrain(TERRAIN_ROAD);
                 map.nodes[idx].set_blocking(false);
             }
             for (uint32_t i_y = y_road; i_y <= y_extend; ++i_y) {
                 const auto idx = get_node_index(x_road, i_y, map.width);
 
-                map.nodes[idx].set_weight(0.7);
+                map.nodes[idx].set_terrain(TERRAIN_ROAD);
                 map.nodes[idx].set_blocking(false);
             }
             for (uint32_t i_x = x_road; i_x <= x_extend; ++i_x) {
                 const auto idx = get_node_index(i_x, y_extend, map.width);
 
-                map.nodes[idx].set_weight(0.7);
+                map.nodes[idx].set_terrain(TERRAIN_ROAD);
                 map.nodes[idx].set_blocking(false);
             }
             for (uint32_t i_y = y_road; i_y <= y_extend; ++i_y) {
                 const auto idx = get_node_index(x_extend, i_y, map.width);
 
-                map.nodes[idx].set_weight(0.7);
+                map.nodes[idx].set_terrain(TERRAIN_ROAD);
                 map.nodes[idx].set_blocking(false);
             }
         }
@@ -195,7 +230,7 @@ public:
             y = rng_h(Map::gen);
 
             i = get_node_index(x, y, width);
-        } while (!nodes[i].get_blocking());
+        } while (nodes[i].get_blocking());
 
         return {x, y};
     }
@@ -204,6 +239,13 @@ public:
         return nodes[get_node_index(x, y, width)].get_blocking();
     }
 
+    // Whether (x, y) is one of the cells padding the map out to whole tiles
+    // in a tiled cell layout (see `CellLayout`), rather than a cell of the
+    // map. Padding cells are always blocked.
+    bool is_padding(const uint32_t x, const uint32_t y) const {
+        return x >= width || y >= height;
+    }
+
     const std::vector<node_t> &get_nodes() const {
         return nodes;
     }
@@ -231,8 +273,12 @@ protected:
 
         deriv_ptr->pop_node();
 
+        // Copied out, since pushing neighbors may move `cur_node` where
+        // the deriving class does not reserve for the whole map.
+        const uint32_t idx_node {cur_node.idx};
+
         const auto [x_node, y_node] = get_node_xy(
-            cur_node.idx, deriv_ptr->get_map_width()
+            idx_node, deriv_ptr->get_map_width()
         );
 
         for (int32_t d_y {-1}; d_y <= 1; ++d_y) {
@@ -266,19 +312,18 @@ protected:
                     continue;
                 }
 
+                // Stepping from the node's own index, rather than indexing
+                // the neighbor afresh, is cheap under every cell layout for
+                // steps that stay within a tile.
                 const uint32_t idx_neighbor_candidate {
-                    get_node_index(
-                        x_neighbor, y_neighbor,
+                    get_neighbor_index(
+                        idx_node, x_node, y_node, d_x, d_y,
                         deriv_ptr->get_map_width()
                     )
                 };
 
                 // First make sure the node is itself non-blocking.
-                if (
-                    deriv_ptr->is_accessible(
-                        deriv_ptr->get_map_nodes()[idx_neighbor_candidate]
-                    )
-                ) {
+                if (deriv_ptr->can_enter(idx_neighbor_candidate)) {
                     // Then make sure that, if this would be a diagonal move, we
                     // disallow it if it would be intersecting with an adjacent
                     // blocking node. That is, if the dots are open and the X's
@@ -303,40 +348,26 @@ protected:
                         // past the checks above), then we know that these
                         // adjacent nodes are also guaranteed-accessible.
                         {
-                            const uint32_t x_neigh_adj {x_node + d_x};
-                            const uint32_t y_neigh_adj {y_node};
-
                             const uint32_t idx_neigh_adj {
-                                get_node_index(
-                                    x_neigh_adj, y_neigh_adj,
+                                get_neighbor_index(
+                                    idx_node, x_node, y_node, d_x, 0,
                                     deriv_ptr->get_map_width()
                                 )
                             };
 
-                            if (
-                                !deriv_ptr->is_accessible(
-                                    deriv_ptr->get_map_nodes()[idx_neigh_adj]
-                                )
-                            ) {
+                            if (!deriv_ptr->can_enter(idx_neigh_adj)) {
                                 continue;
                             }
                         }
                         {
-                            const uint32_t x_neigh_adj {x_node};
-                            const uint32_t y_neigh_adj {y_node + d_y};
-
                             const uint32_t idx_neigh_adj {
-                                get_node_index(
-                                    x_neigh_adj, y_neigh_adj,
+                                get_neighbor_index(
+                                    idx_node, x_node, y_node, 0, d_y,
                                     deriv_ptr->get_map_width()
                                 )
                             };
 
-                            if (
-                                !deriv_ptr->is_accessible(
-                                    deriv_ptr->get_map_nodes()[idx_neigh_adj]
-                                )
-                            ) {
+                            if (!deriv_ptr->can_enter(idx_neigh_adj)) {
                                 continue;
                             }
                         }
@@ -388,6 +419,13 @@ private:
     const uint32_t x_start;
     const uint32_t y_start;
 
+    // Where labels are kept, if not in the map's nodes.
+    RegionLayer *const layer;
+
+    // If given, accessibility is read from here instead of `is_accessible`.
+    const ClearanceLayer *const clearance;
+    const uint8_t agent_size;
+
     uint32_t idx_unexplored {0};
 
     std::vector<ExploredNode> seen_nodes;
@@ -402,6 +440,24 @@ public:
 
     const Predicate &is_accessible;
 
+    // The region of node `idx`, from `layer` if given, else from the node.
+    static std::optional<uint64_t> get_region(
+        const map_t &map, const uint32_t idx, const RegionLayer *layer
+    ) {
+        if (layer) {
+            return layer->get_region(idx);
+        }
+
+        return map.get_nodes()[idx].get_region();
+    }
+
+    bool can_enter(const uint32_t idx) const {
+        if (clearance) {
+            return clearance->fits(idx, agent_size);
+        }
+
+        return is_accessible(map.get_nodes()[idx]);
+    }
 
     void push_node(
         const uint32_t idx,
@@ -430,7 +486,7 @@ public:
         return;
     }
 
-    const std::vector<typename map_t::node_t> &get_map_nodes() const {
+    decltype(auto) get_map_nodes() const {
         return map.get_nodes();
     }
 
@@ -443,19 +499,85 @@ public:
     }
 
 public:
+    // By default, enough space for the entire map is reserved up front. When
+    // many small regions are expected, a smaller `reserve_hint` avoids paying
+    // for that on every region.
+    //
+    // If a `layer` is given, region labels are read from and written to it
+    // instead of the map's nodes, which are then left untouched.
+    //
+    // If a `clearance` layer, computed with `is_accessible`, is given, the
+    // region is that of an agent of `agent_size`. Such regions must be kept
+    // in a `layer` of their own, eg, from `RegionProfile::get()`, unless
+    // `agent_size` is 1.
     RegionColorer(
         map_t &map,
         const uint32_t x_start,
         const uint32_t y_start,
-        const Predicate &is_accessible
+        const Predicate &is_accessible,
+        const std::optional<uint32_t> reserve_hint = std::nullopt,
+        RegionLayer *layer = nullptr,
+        const ClearanceLayer *clearance = nullptr,
+        const uint8_t agent_size = 1
     ):
         map(map),
         x_start(x_start),
         y_start(y_start),
+        layer(layer),
+        clearance(clearance),
+        agent_size(agent_size),
         is_accessible(is_accessible)
     {
-        seen_nodes.reserve(map.width * map.height);
-        seen_nodes_idx.reserve(map.width * map.height);
+        assert(clearance || agent_size == 1);
+        assert(layer || agent_size == 1);
+
+        const uint32_t reserve {
+            reserve_hint.value_or(get_node_count(map.width, map.height))
+        };
+
+        seen_nodes.reserve(reserve);
+        seen_nodes_idx.reserve(reserve);
+    }
+
+    // Assign a region to every accessible node in the map that does not
+    // already have one, in `layer` if given. After this, pathfinding with the
+    // same predicate (and layer) never writes to the map, so the map may be
+    // shared between pathfinding threads. As for the constructor, a
+    // `clearance` layer colors the regions of agents of `agent_size`.
+    static void color_all_regions(
+        map_t &map,
+        const Predicate &is_accessible,
+        RegionLayer *layer = nullptr,
+        const ClearanceLayer *clearance = nullptr,
+        const uint8_t agent_size = 1
+    ) {
+        const uint32_t num_nodes {get_node_count(map.width, map.height)};
+
+        for (uint32_t idx = 0; idx < num_nodes; ++idx) {
+            const bool accessible {
+                clearance ?
+                    clearance->fits(idx, agent_size) :
+                    is_accessible(map.get_nodes()[idx])
+            };
+
+            if (!accessible || get_region(map, idx, layer)) {
+                continue;
+            }
+
+            const auto [x, y] = get_node_xy(idx, map.width);
+
+            // Padding in a tiled cell layout; outside the map, even if the
+            // caller opened it up along with every other node.
+            if (x >= map.width || y >= map.height) {
+                continue;
+            }
+
+            RegionColorer region_colorer(
+                map, x, y, is_accessible, 64, layer, clearance, agent_size
+            );
+
+            region_colorer.identify_region();
+        }
     }
 
     // Return the existing region assignment of the start node if it exists, or
@@ -463,6 +585,8 @@ public:
     // nodes with a new unique color, and then return that color as the new
     // region assignment.
     std::optional<uint64_t> identify_region() {
+        TRACE_SCOPE("identify_region");
+
         auto start_ident = std::chrono::steady_clock::now();
 
         const uint32_t idx_node_start {
@@ -471,15 +595,13 @@ public:
 
         // If the start node is inaccessible (and thus does not have a
         // meaningful region), then there's nothing to do.
-        if (
-            !is_accessible(get_map_nodes()[idx_node_start])
-        ) {
+        if (!can_enter(idx_node_start)) {
             return std::nullopt;
         }
         // If the start node already has an assigned region, then we can just
         // return that.
-        else if (get_map_nodes()[idx_node_start].get_region()) {
-            return get_map_nodes()[idx_node_start].get_region();
+        else if (const auto region {get_region(map, idx_node_start, layer)}) {
+            return region;
         }
 
         // Explore all accessible nodes from the starting node. This tells us
@@ -496,10 +618,17 @@ public:
 
         // Inform all nodes in this region of their new region assignment.
 
-        auto &map_nodes = map.get_nodes_mut();
+        if (layer) {
+            for (const auto &node : seen_nodes) {
+                layer->set_region(node.idx, region_color);
+            }
+        }
+        else {
+            auto &&map_nodes = map.get_nodes_mut();
 
-        for (const auto &node : seen_nodes) {
-            map_nodes[node.idx].set_region(region_color);
+            for (const auto &node : seen_nodes) {
+                map_nodes[node.idx].set_region(region_color);
+            }
         }
 
         auto end_ident = std::chrono::steady_clock::now();
@@ -507,22 +636,45 @@ public:
             end_ident - start_ident
         );
 
-        std::cout
-            << "Identified region [" << region_color << "] at ["
-            << x_start << ", " << y_start << "]: [" << dur.count() << "] us" << std::endl;
+        // Coloring every region of a map can identify thousands of regions in
+        // quick succession.
+        LOG_RATE_LIMITED(
+            LogLevel::INFO, 20,
+            "Identified region [%llu] at [%u, %u]: [%lld] us",
+            static_cast<unsigned long long>(region_color),
+            x_start, y_start,
+            static_cast<long long>(dur.count())
+        );
 
         return region_color;
     }
 };
 
+// The optional layers and settings of a `Pathfind`, meant to be built with
+// designated initializers, eg, `{.occupancy = &occupancy}`, leaving the rest
+// at their defaults. See `Pathfind::Pathfind()` for what each one does.
+struct PathfindOptions {
+    SearchObserver *observer {nullptr};
+    const OccupancyLayer *occupancy {nullptr};
+    RegionProfile *region_profile {nullptr};
+    TerrainCosts terrain_costs {DEFAULT_TERRAIN_COSTS};
+    std::optional<uint32_t> reserve_hint {std::nullopt};
+    const ClearanceLayer *clearance {nullptr};
+    uint8_t agent_size {1};
+    const RectangleDecomposition *rectangles {nullptr};
+};
+
 // node_t represents a single node in the pathfinding graph. These are acquired
 // from interactions with map_t.
 //
-// Type map_t must define typedef node_t.
-//
-// Type map_t must implement member methods with signatures:
+// Type map_t must define typedef node_t, and public members `width` and
+// `height`.
 //
-// std::vector<typename map_t::node_t> next_nodes(const node_t &cur)
+// Type map_t must implement member methods `get_nodes()` and
+// `get_nodes_mut()`, returning a container (or a view) indexable by node
+// index, whose elements are (or are convertible to) node_t. node_t must
+// implement `get_terrain()`, `get_region()` and `set_region()`. See `Map` and
+// `MappedMap`.
 template <typename map_t, typename Predicate>
 class Pathfind : public MapExplorer<map_t, Predicate, Pathfind> {
 public:
@@ -558,10 +710,38 @@ public:
         }
     };
 
+    // Counters describing the most recent call to `get_path()` on the calling
+    // thread.
+    struct PerfCounters {
+        uint32_t count_push_node;
+        uint32_t count_novel_nodes;
+        uint32_t count_expanded_nodes;
+        uint32_t path_length;
+    };
+
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    // Bounds each slice of `get_path_sliced()`. The deadline is only checked
+    // between batches of expansions, so a slice may overrun it slightly.
+    struct SliceBudget {
+        uint32_t max_expansions {UINT32_MAX};
+        std::chrono::steady_clock::time_point deadline {
+            std::chrono::steady_clock::time_point::max()
+        };
+
+        // Set by each slice to the number of nodes it expanded.
+        uint32_t expanded {0};
+    };
+
 private:
-    static inline uint32_t count_push_node {0};
-    static inline uint32_t count_novel_nodes {0};
-    static inline uint32_t path_length {0};
+    // Node expansions per traced batch.
+    static inline const uint32_t NEIGHBOR_BATCH_SIZE {256};
+
+    // Per-thread, so that independent pathfinders may run concurrently.
+    static inline thread_local uint32_t count_push_node {0};
+    static inline thread_local uint32_t count_novel_nodes {0};
+    static inline thread_local uint32_t count_expanded_nodes {0};
+    static inline thread_local uint32_t path_length {0};
 
     map_t &map;
     const uint32_t x_start;
@@ -574,11 +754,51 @@ private:
 
     std::vector<std::reference_wrapper<const ExploredNode>> to_explore;
 
-public:
-    static inline std::unordered_set<uint32_t> static_seen_nodes_idx;
+    // Optional; only consulted when installed.
+    SearchObserver *const observer;
+    const OccupancyLayer *const occupancy;
+
+    // This predicate's region labels, if not kept in the map's nodes.
+    RegionLayer *const region_layer;
 
+    // If given, accessibility is read from here instead of `is_accessible`.
+    const ClearanceLayer *const clearance;
+    const uint8_t agent_size;
+
+    // If given, the search runs over its reduced graph.
+    const RectangleDecomposition *const rectangles;
+
+    // Held by value, so that the table sits alongside the search's state.
+    const TerrainCosts terrain_costs;
+
+    bool found_end {false};
+    // Set once the search generated as many nodes as `seen_nodes` can hold.
+    bool search_capped {false};
+
+    // The most nodes a search may generate: every node of the map, unless
+    // the map caps it, as a map too large to hold in memory does.
+    static uint32_t get_search_capacity(const map_t &map) {
+        const uint32_t num_nodes {get_node_count(map.width, map.height)};
+
+        if constexpr (requires { map.max_search_nodes(); }) {
+            return std::min(num_nodes, map.max_search_nodes());
+        }
+        else {
+            return num_nodes;
+        }
+    }
+
+public:
     const Predicate &is_accessible;
 
+    bool can_enter(const uint32_t idx) const {
+        if (clearance) {
+            return clearance->fits(idx, agent_size);
+        }
+
+        return is_accessible(map.get_nodes()[idx]);
+    }
+
     // Push a candidate neighbor node to the queue of nodes to explore next.
     //
     // NOTE: The `parent` argument is moved from.
@@ -588,11 +808,24 @@ public:
     ) {
         ++count_push_node;
 
+        if (
+            seen_nodes.size() == seen_nodes.capacity() &&
+            !seen_nodes_idx.contains(idx)
+        ) [[unlikely]] {
+            search_capped = true;
+
+            return;
+        }
+
         const auto [iter, inserted] = seen_nodes_idx.insert(idx);
 
         if (inserted) {
             ++count_novel_nodes;
 
+            if (observer) [[unlikely]] {
+                observer->on_generated(idx);
+            }
+
             const auto [x_new, y_new] {
                 get_node_xy(idx, map.width)
             };
@@ -619,13 +852,23 @@ public:
                     x_prev, y_prev, x_new, y_new
                 );
 
-                const double weight {get_map_nodes()[idx].get_weight()};
+                const double cost {
+                    terrain_costs[get_map_nodes()[idx].get_terrain()]
+                };
+
+                double dist_from_start {
+                    prev.dist_from_start + (dist_prev_to_new * cost)
+                };
+
+                if (occupancy) {
+                    dist_from_start += occupancy->get_cost(idx);
+                }
 
                 to_explore.emplace_back(
                     seen_nodes.emplace_back(
                         idx,
-                        prev.dist_from_start + (dist_prev_to_new * weight),
-                        heur_dist_to_end * weight,
+                        dist_from_start,
+                        heur_dist_to_end * cost,
                         std::move(parent)
                     )
                 );
@@ -667,7 +910,7 @@ public:
         return to_explore.at(0);
     }
 
-    const std::vector<typename map_t::node_t> &get_map_nodes() const {
+    decltype(auto) get_map_nodes() const {
         return map.get_nodes();
     }
 
@@ -681,35 +924,167 @@ public:
 
 
 public:
+    // Everything past `is_accessible` is in `options`, whose defaults give a
+    // plain search. If an `observer` is given, it is notified of the cells
+    // generated and expanded by `get_path()`. If an `occupancy` layer is
+    // given, its cost is added to the cost of entering each cell, so that the
+    // path prefers to go around other agents rather than through them. If a
+    // `region_profile` registered for `is_accessible` is given, the region
+    // pre-check uses its layers, rather than the map's nodes, so that
+    // searches with other predicates on the same map do not disturb it. Each
+    // cell costs `terrain_costs` of its terrain class to enter, per step.
+    //
+    // By default, the open list and seen set are sized for the entire map up
+    // front. For searches expected to stay local, a smaller `reserve_hint`
+    // avoids paying for that on every search.
+    //
+    // If the map provides `max_search_nodes()`, the search generates at most
+    // that many nodes, and finds no path if it would need more. If it provides
+    // `prefetch_toward()`, it is told where the frontier is, and where it is
+    // headed, before each batch of expansions.
+    //
+    // If a `clearance` layer, computed with `is_accessible`, is given, the
+    // path is for an agent of `agent_size`, ie, one covering that many cells
+    // down and to the right of each cell of the path. Its region pre-check
+    // then needs a `region_profile`, and is skipped without one unless
+    // `agent_size` is 1.
+    //
+    // If a `rectangles` decomposition, built with `is_accessible`, is given,
+    // the search only expands the perimeters of its rectangles, and crosses
+    // them with macro edges, which `get_path()` fills back in. An `occupancy`
+    // layer is then only consulted for the cells the search visits.
     Pathfind(
         map_t &map,
         const uint32_t x_start,
         const uint32_t y_start,
         const uint32_t x_end,
         const uint32_t y_end,
-        const Predicate &is_accessible
+        const Predicate &is_accessible,
+        const PathfindOptions &options = {}
     ):
         map(map),
         x_start(x_start),
         y_start(y_start),
         x_end(x_end),
         y_end(y_end),
+        observer(options.observer),
+        occupancy(options.occupancy),
+        region_layer(
+            options.region_profile
+                ? &options.region_profile->get(options.agent_size)
+                : nullptr
+        ),
+        clearance(options.clearance),
+        agent_size(options.agent_size),
+        rectangles(options.rectangles),
+        terrain_costs(options.terrain_costs),
         is_accessible(is_accessible)
     {
-        to_explore.reserve(map.width * map.height);
-        seen_nodes_idx.reserve(map.width * map.height);
-        seen_nodes.reserve(map.width * map.height);
+        assert(clearance || agent_size == 1);
+        assert(!clearance || !rectangles);
+
+        const uint32_t capacity {get_search_capacity(map)};
+        const uint32_t reserve {
+            std::min(options.reserve_hint.value_or(capacity), capacity)
+        };
+
+        to_explore.reserve(reserve);
+        seen_nodes_idx.reserve(reserve);
+        // Always the full capacity: `to_explore` refers into it, so it must
+        // never reallocate. Reserving it only claims address space.
+        seen_nodes.reserve(capacity);
     }
 
     std::vector<std::pair<uint32_t, uint32_t>> get_path() {
+        path_t path;
+
+        get_path(path);
+
+        return path;
+    }
+
+    // As `get_path()`, but writes the path into `path`, reusing its storage.
+    // `path` is left empty if there is no path.
+    void get_path(path_t &path) {
+        TRACE_SCOPE("get_path");
+
+        path.clear();
+
+        if (!start_search()) {
+            return;
+        }
+
+        uint32_t expanded {0};
+
+        expand_nodes(
+            UINT32_MAX, std::chrono::steady_clock::time_point::max(), expanded
+        );
+
+        build_path(path);
+    }
+
+    // A time-sliced `get_path()`, for spreading long searches across frames.
+    // Nothing runs until the first `resume()` of the returned coroutine. Each
+    // resume then expands nodes until `budget` is spent, and suspends with its
+    // open list intact, until the search completes with the path.
+    //
+    // The budget is re-read on every resume, so the caller may adjust it
+    // between slices. Both this pathfinder and the budget must outlive the
+    // coroutine. Identifying the region of an uncolored endpoint happens
+    // within the first slice and is not budgeted.
+    //
+    // Once the search completes, `get_perf()` describes it, even if other
+    // searches ran on this thread between its slices.
+    Resumable<path_t> get_path_sliced(SliceBudget &budget) {
+        budget.expanded = 0;
+
+        if (!start_search()) {
+            co_return path_t {};
+        }
+
+        while (
+            !expand_nodes(budget.max_expansions, budget.deadline, budget.expanded)
+        ) {
+            const PerfCounters perf {get_perf()};
+
+            co_await std::suspend_always {};
+
+            set_perf(perf);
+
+            budget.expanded = 0;
+        }
+
+        path_t path;
+
+        build_path(path);
+
+        co_return std::move(path);
+    }
+
+private:
+    static void set_perf(const PerfCounters &perf) {
+        count_push_node = perf.count_push_node;
+        count_novel_nodes = perf.count_novel_nodes;
+        count_expanded_nodes = perf.count_expanded_nodes;
+        path_length = perf.path_length;
+    }
+
+    // Reset the counters, check that the endpoints are mutually reachable,
+    // and seed the open list. Returns false if there can be no path.
+    bool start_search() {
         count_novel_nodes = 0;
         count_push_node = 0;
+        count_expanded_nodes = 0;
+        path_length = 0;
+
+        if (observer) {
+            observer->on_search_start(map.width, map.height);
+        }
 
         if (x_start == x_end && y_start == y_end) {
-            return {};
+            return false;
         }
 
-        const std::vector<typename map_t::node_t> &nodes {map.get_nodes()};
         const uint32_t map_width {map.width};
 
         const uint32_t idx_node_start {
@@ -719,36 +1094,45 @@ public:
             get_node_index(x_end, y_end, map_width)
         };
 
-        if (
-            !is_accessible(nodes[idx_node_start]) ||
-            !is_accessible(nodes[idx_node_end])
-        ) {
-            return {};
+        if (!can_enter(idx_node_start) || !can_enter(idx_node_end)) {
+            return false;
+        }
+
+        // Larger agents' regions cannot share the map's nodes with single
+        // cell agents'.
+        if (agent_size > 1 && !region_layer) {
+            push_node(idx_node_start, std::nullopt);
+
+            return true;
         }
 
         // Are the nodes in separate regions and thus inaccessible to each
         // other?
 
-        std::optional<uint64_t> region_start;
-        std::optional<uint64_t> region_end;
+        typedef RegionColorer<map_t, Predicate> region_colorer_t;
 
-        if (map.get_nodes()[idx_node_start].get_region()) {
-            region_start = map.get_nodes()[idx_node_start].get_region();
-        }
-        else {
-            RegionColorer<map_t, Predicate> region_colorer(
-                map, x_start, y_start, is_accessible
+        std::optional<uint64_t> region_start {
+            region_colorer_t::get_region(map, idx_node_start, region_layer)
+        };
+
+        if (!region_start) {
+            region_colorer_t region_colorer(
+                map, x_start, y_start, is_accessible, std::nullopt, region_layer,
+                clearance, agent_size
             );
 
             region_start = region_colorer.identify_region();
         }
 
-        if (map.get_nodes()[idx_node_end].get_region()) {
-            region_end = map.get_nodes()[idx_node_end].get_region();
-        }
-        else {
-            RegionColorer<map_t, Predicate> region_colorer(
-                map, x_end, y_end, is_accessible
+        // Only looked up now, as coloring the start may have colored it.
+        std::optional<uint64_t> region_end {
+            region_colorer_t::get_region(map, idx_node_end, region_layer)
+        };
+
+        if (!region_end) {
+            region_colorer_t region_colorer(
+                map, x_end, y_end, is_accessible, std::nullopt, region_layer,
+                clearance, agent_size
             );
 
             region_end = region_colorer.identify_region();
@@ -757,35 +1141,115 @@ public:
         if (
             !region_start || !region_end || *region_start != *region_end
         ) {
-            return {};
+            return false;
         }
 
         push_node(idx_node_start, std::nullopt);
 
-        while (to_explore.size() > 0) {
-            const ExploredNode &best_node {get_next_node()};
+        return true;
+    }
 
-            const auto &[x_best, y_best] = get_node_xy(
-                best_node.idx, map.width
-            );
+    // Expand up to `max_expansions` nodes, stopping early once `deadline` has
+    // passed, and add the number expanded to `expanded`. Returns true once the
+    // search is complete, ie, the end was reached, the open list exhausted, or
+    // the search capacity spent.
+    bool expand_nodes(
+        const uint32_t max_expansions,
+        const std::chrono::steady_clock::time_point deadline,
+        uint32_t &expanded
+    ) {
+        const bool has_deadline {
+            deadline != std::chrono::steady_clock::time_point::max()
+        };
+
+        uint32_t remaining {max_expansions};
 
-            if (x_best == x_end && y_best == y_end) {
+        while (
+            !found_end && !search_capped && to_explore.size() > 0 && remaining > 0
+        ) {
+            if (has_deadline && std::chrono::steady_clock::now() >= deadline) {
                 break;
             }
 
-            this->gen_neighbors();
+            // Expansions are traced in batches, since a span per expansion
+            // would cost more than the expansion itself.
+            TRACE_SCOPE("gen_neighbors batch");
+
+            if constexpr (
+                requires { map.prefetch_toward(x_end, y_end, x_end, y_end); }
+            ) {
+                const auto [x_best, y_best] = get_node_xy(
+                    get_next_node().idx, map.width
+                );
+
+                map.prefetch_toward(x_best, y_best, x_end, y_end);
+            }
+
+            const uint32_t batch_size {std::min(remaining, NEIGHBOR_BATCH_SIZE)};
+
+            for (
+                uint32_t i = 0;
+                i < batch_size && !search_capped && to_explore.size() > 0;
+                ++i
+            ) {
+                const ExploredNode &best_node {get_next_node()};
+
+                const auto &[x_best, y_best] = get_node_xy(
+                    best_node.idx, map.width
+                );
+
+                if (x_best == x_end && y_best == y_end) {
+                    found_end = true;
+
+                    break;
+                }
+
+                ++count_expanded_nodes;
+                ++expanded;
+                --remaining;
+
+                if (observer) [[unlikely]] {
+                    observer->on_expanded(best_node.idx);
+                }
+
+                if (rectangles) {
+                    gen_rectangle_neighbors();
+                }
+                else {
+                    this->gen_neighbors();
+                }
+            }
         }
 
-        if (to_explore.size() == 0) {
-            return {};
+        return found_end || search_capped || to_explore.size() == 0;
+    }
+
+    // As `MapExplorer::gen_neighbors()`, over the reduced graph of
+    // `rectangles`.
+    void gen_rectangle_neighbors() {
+        const ExploredNode &cur_node {get_next_node()};
+
+        pop_node();
+
+        rectangles->for_each_successor(
+            cur_node.idx, get_node_index(x_end, y_end, map.width),
+            [&](const uint32_t idx) {
+                push_node(idx, cur_node);
+            }
+        );
+    }
+
+    // Walk back from the end node to the start, appending to `path`. Only
+    // valid once the search is complete.
+    void build_path(path_t &path) {
+        if (to_explore.size() == 0 || search_capped) {
+            return;
         }
 
         std::optional<std::reference_wrapper<const ExploredNode>> path_node {
             get_next_node()
         };
 
-        std::vector<std::pair<uint32_t, uint32_t>> path;
-
         path.push_back(get_node_xy(path_node->get().idx, map.width));
 
         while (path_node->get().parent) {
@@ -796,21 +1260,28 @@ public:
             path_node = path_node->get().parent;
         }
 
-        path_length = path.size();
-
-        {
-            static_seen_nodes_idx = std::unordered_set<uint32_t>(
-                seen_nodes_idx.begin(), seen_nodes_idx.end()
-            );
+        if (rectangles) {
+            RectangleDecomposition::expand_path(path);
         }
 
-        return path;
+        path_length = path.size();
+    }
+
+public:
+    static PerfCounters get_perf() {
+        return {
+            count_push_node,
+            count_novel_nodes,
+            count_expanded_nodes,
+            path_length
+        };
     }
 
     static void print_perf() {
-        std::cout << "count_push_node  : " << count_push_node << std::endl;
-        std::cout << "count_novel_nodes: " << count_novel_nodes << std::endl;
-        std::cout << "path_length      : " << path_length << std::endl;
+        LOG_INFO("count_push_node     : %u", count_push_node);
+        LOG_INFO("count_novel_nodes   : %u", count_novel_nodes);
+        LOG_INFO("count_expanded_nodes: %u", count_expanded_nodes);
+        LOG_INFO("path_length         : %u", path_length);
 
         return;
     }
@@ -0,0 +1,39 @@
+#ifndef MAPCHUNK_H
+#define MAPCHUNK_H
+
+#include <array>
+#include <cstdint>
+
+// A square of `SIZE` x `SIZE` cells of a map kept in chunks, eg, a
+// `ChunkedMap`, stored row by row, whatever the `CellLayout`.
+struct MapChunk {
+    static inline constexpr uint32_t BITS {6};
+    static inline constexpr uint32_t SIZE {uint32_t {1} << BITS};
+    static inline constexpr uint32_t CELLS {SIZE * SIZE};
+
+    // One bit per cell; a set bit is a blocking cell.
+    std::array<uint64_t, CELLS / 64> blocking;
+    std::array<uint8_t, CELLS> terrain;
+
+    // The offset of the cell (x, y) of the chunk, each below `SIZE`.
+    static uint32_t offset(const uint32_t x, const uint32_t y) {
+        return (y << BITS) | x;
+    }
+
+    bool get_blocking(const uint32_t offset) const {
+        return (blocking[offset >> 6] >> (offset & 63)) & 1;
+    }
+
+    void set_blocking(const uint32_t offset, const bool blocking_new) {
+        const uint64_t bit {uint64_t {1} << (offset & 63)};
+
+        if (blocking_new) {
+            blocking[offset >> 6] |= bit;
+        }
+        else {
+            blocking[offset >> 6] &= ~bit;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,360 @@
+#include "MapFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const uint64_t SECTION_ALIGN {4096};
+
+    uint64_t align_up(const uint64_t value) {
+        return (value + SECTION_ALIGN - 1) & ~(SECTION_ALIGN - 1);
+    }
+
+    uint64_t blocking_bytes(const uint64_t cells) {
+        return ((cells + 63) / 64) * sizeof(uint64_t);
+    }
+}
+
+void write_map_file(
+    const Map &map,
+    const std::string &path,
+    const bool with_regions,
+    const std::vector<MapFileExtraSection> &extra_sections
+) {
+    const uint64_t cells {get_node_count(map.width, map.height)};
+    const auto &nodes {map.get_nodes()};
+
+    MapFileHeader header {};
+
+    std::memcpy(header.magic, MapFileHeader::MAGIC, sizeof(header.magic));
+    header.version = MapFileHeader::VERSION;
+    header.width = map.width;
+    header.height = map.height;
+    header.layout = CellLayout::ID;
+
+    std::vector<MapFileSection> sections;
+
+    sections.push_back({MapFileSection::BLOCKING, 0, 0, blocking_bytes(cells)});
+    sections.push_back({MapFileSection::TERRAIN, 0, 0, cells});
+
+    if (with_regions) {
+        sections.push_back(
+            {MapFileSection::REGIONS, 0, 0, cells * sizeof(uint32_t)}
+        );
+    }
+
+    for (const auto &extra : extra_sections) {
+        if (extra.kind < MapFileSection::ACCEL_BASE) {
+            throw std::runtime_error("Invalid acceleration section kind");
+        }
+
+        sections.push_back({extra.kind, 0, 0, extra.data.size()});
+    }
+
+    header.section_count = sections.size();
+
+    uint64_t offset {
+        align_up(sizeof(header) + sections.size() * sizeof(MapFileSection))
+    };
+
+    for (auto &section : sections) {
+        section.offset = offset;
+        offset = align_up(offset + section.size);
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    if (!out) {
+        throw std::runtime_error("Failed to open map file for writing: " + path);
+    }
+
+    const auto write_at = [&](const uint64_t at, const void *data, const size_t size) {
+        out.seekp(at);
+        out.write(static_cast<const char *>(data), size);
+    };
+
+    write_at(0, &header, sizeof(header));
+    write_at(
+        sizeof(header), sections.data(), sections.size() * sizeof(MapFileSection)
+    );
+
+    {
+        std::vector<uint64_t> bits((cells + 63) / 64, 0);
+
+        for (uint64_t i = 0; i < cells; ++i) {
+            if (nodes[i].get_blocking()) {
+                bits[i >> 6] |= uint64_t {1} << (i & 63);
+            }
+        }
+
+        write_at(sections[0].offset, bits.data(), sections[0].size);
+    }
+
+    {
+        std::vector<uint8_t> terrain(cells);
+
+        for (uint64_t i = 0; i < cells; ++i) {
+            terrain[i] = nodes[i].get_terrain();
+        }
+
+        write_at(sections[1].offset, terrain.data(), sections[1].size);
+    }
+
+    size_t next_section {2};
+
+    if (with_regions) {
+        std::vector<uint32_t> regions(cells, 0);
+
+        for (uint64_t i = 0; i < cells; ++i) {
+            if (const auto &region {nodes[i].get_region()}; region) {
+                if (*region > UINT32_MAX) {
+                    throw std::runtime_error("Region label exceeds 32 bits");
+                }
+
+                regions[i] = *region;
+            }
+        }
+
+        write_at(sections[next_section].offset, regions.data(), sections[next_section].size);
+
+        ++next_section;
+    }
+
+    for (const auto &extra : extra_sections) {
+        write_at(sections[next_section].offset, extra.data.data(), extra.data.size());
+
+        ++next_section;
+    }
+
+    // Pad the file out to the aligned end of the last section so that every
+    // section lies entirely within the mapping.
+    if (offset > 0) {
+        const char zero {0};
+
+        write_at(offset - 1, &zero, 1);
+    }
+
+    if (!out) {
+        throw std::runtime_error("Failed to write map file: " + path);
+    }
+}
+
+MappedMap MappedMap::open(const std::string &path) {
+    const int fd {::open(path.c_str(), O_RDONLY)};
+
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open map file: " + path);
+    }
+
+    auto close_guard = Guard(
+        [=]() {
+            ::close(fd);
+        }
+    );
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(MapFileHeader)) {
+        throw std::runtime_error("Map file is truncated: " + path);
+    }
+
+    MappedMap map;
+
+    map.mapping_size = st.st_size;
+
+    // A private, writable mapping: edits are copy-on-write and never reach the
+    // file.
+    map.mapping = mmap(
+        nullptr, map.mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0
+    );
+
+    if (map.mapping == MAP_FAILED) {
+        map.mapping = nullptr;
+
+        throw std::runtime_error("Failed to map map file: " + path);
+    }
+
+    unsigned char *base {static_cast<unsigned char *>(map.mapping)};
+
+    MapFileHeader header;
+
+    std::memcpy(&header, base, sizeof(header));
+
+    if (std::memcmp(header.magic, MapFileHeader::MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a map file: " + path);
+    }
+
+    if (header.version != MapFileHeader::VERSION) {
+        throw std::runtime_error(
+            "Unsupported map file version " + std::to_string(header.version) +
+            ": " + path
+        );
+    }
+
+    if (header.layout != CellLayout::ID) {
+        throw std::runtime_error(
+            "Map file cell layout " + std::to_string(header.layout) +
+            " does not match this build's " + std::to_string(CellLayout::ID) +
+            ": " + path
+        );
+    }
+
+    if (
+        sizeof(header) + header.section_count * sizeof(MapFileSection) >
+            map.mapping_size
+    ) {
+        throw std::runtime_error("Map file section table is truncated: " + path);
+    }
+
+    // Every cell index must fit in 32 bits, and a map without cells cannot be
+    // indexed at all.
+    if (
+        header.width == 0 || header.height == 0 ||
+        get_node_count_wide(header.width, header.height) > UINT32_MAX
+    ) {
+        throw std::runtime_error(
+            "Map file has invalid dimensions " + std::to_string(header.width) +
+            "x" + std::to_string(header.height) + ": " + path
+        );
+    }
+
+    map.width = header.width;
+    map.height = header.height;
+
+    map.sections.resize(header.section_count);
+
+    std::memcpy(
+        map.sections.data(),
+        base + sizeof(header),
+        header.section_count * sizeof(MapFileSection)
+    );
+
+    const uint64_t cells {get_node_count(map.width, map.height)};
+
+    for (const auto &section : map.sections) {
+        if (
+            section.offset % SECTION_ALIGN != 0 ||
+            section.size > map.mapping_size ||
+            section.offset > map.mapping_size - section.size
+        ) {
+            throw std::runtime_error("Map file section is out of bounds: " + path);
+        }
+
+        uint64_t expected_size {section.size};
+
+        switch (section.kind) {
+        case MapFileSection::BLOCKING:
+            expected_size = blocking_bytes(cells);
+            map.blocking = reinterpret_cast<uint64_t *>(base + section.offset);
+            break;
+
+        case MapFileSection::TERRAIN:
+            expected_size = cells;
+            map.terrain = base + section.offset;
+            break;
+
+        case MapFileSection::REGIONS:
+            expected_size = cells * sizeof(uint32_t);
+            map.regions = reinterpret_cast<uint32_t *>(base + section.offset);
+            map.has_file_regions = true;
+            break;
+
+        default:
+            break;
+        }
+
+        if (section.size != expected_size) {
+            throw std::runtime_error("Map file section has wrong size: " + path);
+        }
+    }
+
+    if (map.blocking == nullptr || map.terrain == nullptr) {
+        throw std::runtime_error("Map file is missing required sections: " + path);
+    }
+
+    if (map.regions == nullptr) {
+        map.anon_regions_size = cells * sizeof(uint32_t);
+
+        map.anon_regions = mmap(
+            nullptr, map.anon_regions_size,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+            -1, 0
+        );
+
+        if (map.anon_regions == MAP_FAILED) {
+            map.anon_regions = nullptr;
+
+            throw std::runtime_error("Failed to map region labels: " + path);
+        }
+
+        map.regions = static_cast<uint32_t *>(map.anon_regions);
+    }
+
+    return map;
+}
+
+MappedMap::MappedMap(MappedMap &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedMap &MappedMap::operator=(MappedMap &&other) noexcept {
+    if (this != &other) {
+        release();
+
+        mapping = std::exchange(other.mapping, nullptr);
+        mapping_size = std::exchange(other.mapping_size, 0);
+        anon_regions = std::exchange(other.anon_regions, nullptr);
+        anon_regions_size = std::exchange(other.anon_regions_size, 0);
+        blocking = std::exchange(other.blocking, nullptr);
+        terrain = std::exchange(other.terrain, nullptr);
+        regions = std::exchange(other.regions, nullptr);
+        sections = std::move(other.sections);
+        has_file_regions = other.has_file_regions;
+        width = std::exchange(other.width, 0);
+        height = std::exchange(other.height, 0);
+    }
+
+    return *this;
+}
+
+MappedMap::~MappedMap() {
+    release();
+}
+
+void MappedMap::release() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+    }
+
+    if (anon_regions != nullptr) {
+        munmap(anon_regions, anon_regions_size);
+        anon_regions = nullptr;
+    }
+}
+
+std::optional<std::pair<const unsigned char *, size_t>> MappedMap::get_section(
+    const uint32_t kind
+) const {
+    for (const auto &section : sections) {
+        if (section.kind == kind) {
+            return std::make_pair(
+                static_cast<const unsigned char *>(mapping) + section.offset,
+                static_cast<size_t>(section.size)
+            );
+        }
+    }
+
+    return std::nullopt;
+}
+
+void MappedMap::clear_regions() {
+    std::memset(regions, 0, get_node_count(width, height) * sizeof(uint32_t));
+}
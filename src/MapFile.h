@@ -0,0 +1,240 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Map.h"
+#include "Util.h"
+
+// A versioned, memory-mappable binary map format.
+//
+// The file is a fixed-size header, followed by a table of sections, followed
+// by the sections themselves. Every section begins on a page boundary so that
+// it can be used in-place once the file is mapped. All values are stored in
+// host (little-endian) byte order.
+//
+// Sections:
+//
+// BLOCKING (required): One bit per cell, in `get_node_index()` order, packed
+//     into 64-bit words. A set bit is a blocking cell. Like every per-cell
+//     section, it covers `get_node_count()` cells, padding included, so a
+//     file can only be read under the cell layout it was written with, which
+//     the header records.
+// TERRAIN (required): One byte per cell, the cell's terrain class (see
+//     `Terrain.h`).
+// REGIONS (optional): One uint32_t per cell. Zero is "no region". Labels are
+//     only meaningful for the accessibility predicate that produced them.
+// Anything at or above ACCEL_BASE (optional): Opaque precomputed acceleration
+//     data, interpreted by whichever component wrote it.
+
+struct MapFileHeader {
+    static inline const char MAGIC[8] {'P', 'F', 'M', 'A', 'P', '\0', '\0', '\0'};
+    // Version 1 stored quantized per-cell weights in place of terrain.
+    static inline const uint32_t VERSION {2};
+
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t section_count;
+    // The `CellLayout::ID` the cells are stored in. Zero, row-major, in files
+    // written before layouts were recorded.
+    uint32_t layout;
+    uint32_t reserved[9];
+};
+
+static_assert(sizeof(MapFileHeader) == 64);
+
+struct MapFileSection {
+    enum Kind : uint32_t {
+        BLOCKING = 1,
+        TERRAIN = 2,
+        REGIONS = 3,
+
+        ACCEL_BASE = 0x100,
+    };
+
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static_assert(sizeof(MapFileSection) == 24);
+
+// An opaque acceleration section to be written alongside the map.
+struct MapFileExtraSection {
+    uint32_t kind;
+    std::vector<unsigned char> data;
+};
+
+// Serialize the map. Region labels are only written if `with_regions` is set,
+// in which case every assigned region must fit in 32 bits.
+//
+// Throws std::runtime_error on I/O failure.
+void write_map_file(
+    const Map &map,
+    const std::string &path,
+    const bool with_regions = false,
+    const std::vector<MapFileExtraSection> &extra_sections = {}
+);
+
+// A map backed directly by a memory-mapped map file. Opening the file only
+// validates the header and section table, so the cost is independent of the
+// map size; cell data is paged in on first touch.
+//
+// The file is mapped privately, so any edits (blocking, terrain, region
+// labels) are made to copy-on-write pages of the mapping and are never written
+// back to the file. Only the pages actually edited are copied. If the file has
+// no region section, region labels live in an anonymous mapping which is
+// likewise only materialized as it is written.
+//
+// Satisfies the map_t requirements of `Pathfind` and `RegionColorer`.
+class MappedMap {
+public:
+    // A lightweight reference to a single cell of the mapped map.
+    class MappedNode {
+    private:
+        MappedMap *map;
+        uint32_t idx;
+
+    public:
+        MappedNode(MappedMap *map, const uint32_t idx):
+            map(map),
+            idx(idx)
+        {}
+
+        bool get_blocking() const {
+            return (map->blocking[idx >> 6] >> (idx & 63)) & 1;
+        }
+
+        void set_blocking(const bool blocking_new) {
+            const uint64_t bit {uint64_t {1} << (idx & 63)};
+
+            if (blocking_new) {
+                map->blocking[idx >> 6] |= bit;
+            }
+            else {
+                map->blocking[idx >> 6] &= ~bit;
+            }
+        }
+
+        uint8_t get_terrain() const {
+            return map->terrain[idx];
+        }
+
+        void set_terrain(const uint8_t terrain_new) {
+            assert(terrain_new < TerrainCosts::MAX_CLASSES);
+
+            map->terrain[idx] = terrain_new;
+        }
+
+        std::optional<uint64_t> get_region() const {
+            if (map->regions[idx] == 0) {
+                return std::nullopt;
+            }
+
+            return map->regions[idx];
+        }
+
+        void set_region(std::optional<uint64_t> &&region_new) {
+            assert(!region_new || *region_new <= UINT32_MAX);
+
+            map->regions[idx] = region_new ? *region_new : 0;
+        }
+    };
+
+    typedef MappedNode node_t;
+
+    // An indexable view over every cell of the mapped map.
+    class MappedNodes {
+    private:
+        MappedMap *map;
+
+    public:
+        MappedNodes(MappedMap *map):
+            map(map)
+        {}
+
+        node_t operator[](const uint32_t idx) const {
+            return node_t(map, idx);
+        }
+
+        size_t size() const {
+            return get_node_count(map->width, map->height);
+        }
+    };
+
+private:
+    void *mapping {nullptr};
+    size_t mapping_size {0};
+
+    void *anon_regions {nullptr};
+    size_t anon_regions_size {0};
+
+    uint64_t *blocking {nullptr};
+    uint8_t *terrain {nullptr};
+    uint32_t *regions {nullptr};
+
+    std::vector<MapFileSection> sections;
+
+    bool has_file_regions {false};
+
+    MappedMap() = default;
+
+    void release();
+
+public:
+    // The x-coordinate range.
+    uint32_t width {0};
+    // The y-coordinate range.
+    uint32_t height {0};
+
+    // Throws std::runtime_error if the file cannot be mapped, if its header
+    // or section table is invalid, or if it was written under another cell
+    // layout.
+    static MappedMap open(const std::string &path);
+
+    MappedMap(const MappedMap &) = delete;
+    MappedMap &operator=(const MappedMap &) = delete;
+
+    MappedMap(MappedMap &&other) noexcept;
+    MappedMap &operator=(MappedMap &&other) noexcept;
+
+    ~MappedMap();
+
+    bool is_blocking(const uint32_t x, const uint32_t y) const {
+        const uint32_t idx {get_node_index(x, y, width)};
+
+        return (blocking[idx >> 6] >> (idx & 63)) & 1;
+    }
+
+    MappedNodes get_nodes() const {
+        // The view hands out nodes that can be written through, but only
+        // `get_nodes_mut()` advertises that.
+        return MappedNodes(const_cast<MappedMap *>(this));
+    }
+
+    MappedNodes get_nodes_mut() {
+        return MappedNodes(this);
+    }
+
+    bool has_region_section() const {
+        return has_file_regions;
+    }
+
+    // Returns the raw bytes of the first section of the given kind, if
+    // present, eg, to retrieve a precomputed acceleration section.
+    std::optional<std::pair<const unsigned char *, size_t>> get_section(
+        const uint32_t kind
+    ) const;
+
+    void clear_regions();
+};
+
+#endif
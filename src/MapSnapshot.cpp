@@ -0,0 +1,170 @@
+#include "MapSnapshot.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+VersionedMap::Reader::Reader(VersionedMap &map):
+    map(map),
+    slot(
+        [&map]() {
+            for (uint32_t slot = 0; slot < MAX_READERS; ++slot) {
+                bool taken {false};
+
+                if (map.slots[slot].taken.compare_exchange_strong(taken, true)) {
+                    return slot;
+                }
+            }
+
+            throw std::runtime_error("Too many readers of one VersionedMap");
+        }()
+    )
+{}
+
+VersionedMap::Reader::~Reader() {
+    map.slots[slot].taken.store(false, std::memory_order_release);
+}
+
+VersionedMap::Pinned VersionedMap::Reader::pin() {
+    std::atomic<uint64_t> &epoch {map.slots[slot].epoch};
+
+    // Announce the epoch before loading the snapshot, so that whatever the
+    // snapshot loaded, it is retired no earlier than that epoch, and so not
+    // freed until this unpins. Both must be sequentially consistent: the
+    // editor swaps the snapshot, then bumps the epoch, then reads the slots.
+    epoch.store(map.epoch.load());
+
+    return Pinned(&epoch, map.current.load());
+}
+
+VersionedMap::~VersionedMap() {
+    const MapSnapshot *snapshot {current.load()};
+
+    for (const MapChunk *chunk : snapshot->chunks) {
+        delete chunk;
+    }
+
+    delete snapshot;
+}
+
+MapChunk &VersionedMap::get_draft_chunk(
+    const uint32_t x,
+    const uint32_t y,
+    uint32_t &offset
+) {
+    if (x >= width || y >= height) {
+        throw std::invalid_argument("Cell out of bounds of the map");
+    }
+
+    if (draft.empty()) {
+        draft = current.load()->chunks;
+    }
+
+    const uint32_t id {get_chunk_id(x, y)};
+
+    offset = MapChunk::offset(x & (MapChunk::SIZE - 1), y & (MapChunk::SIZE - 1));
+
+    if (!draft_copied[id]) {
+        auto copy {std::make_unique<MapChunk>(*draft[id])};
+
+        draft[id] = copy.get();
+        draft_copied[id] = true;
+        draft_copies.emplace_back(id, std::move(copy));
+
+        ++stats.copies;
+    }
+
+    // The draft's own copy by now, which no reader sees until published.
+    return *const_cast<MapChunk *>(draft[id]);
+}
+
+void VersionedMap::set_blocking(const uint32_t x, const uint32_t y, const bool blocking) {
+    std::lock_guard lock(edit_mu);
+
+    uint32_t offset;
+
+    get_draft_chunk(x, y, offset).set_blocking(offset, blocking);
+}
+
+void VersionedMap::set_terrain(const uint32_t x, const uint32_t y, const uint8_t terrain) {
+    assert(terrain < TerrainCosts::MAX_CLASSES);
+
+    std::lock_guard lock(edit_mu);
+
+    uint32_t offset;
+
+    get_draft_chunk(x, y, offset).terrain[offset] = terrain;
+}
+
+uint64_t VersionedMap::publish() {
+    std::lock_guard lock(edit_mu);
+
+    const MapSnapshot *last {current.load()};
+
+    if (draft.empty()) {
+        return last->version;
+    }
+
+    // The last snapshot may be freed before this returns.
+    const uint64_t version {last->version + 1};
+
+    Retired replaced {0, std::unique_ptr<const MapSnapshot>(last), {}};
+
+    replaced.chunks.reserve(draft_copies.size());
+
+    for (auto &[id, copy] : draft_copies) {
+        replaced.chunks.emplace_back(last->chunks[id]);
+        draft_copied[id] = false;
+
+        copy.release();
+    }
+
+    draft_copies.clear();
+
+    current.store(new MapSnapshot(width, height, version, std::move(draft)));
+    draft.clear();
+
+    // Readers that announce a later epoch than this are sure to see the new
+    // snapshot.
+    replaced.epoch = epoch.fetch_add(1);
+
+    retired.push_back(std::move(replaced));
+
+    ++stats.publishes;
+
+    reclaim_locked();
+
+    return version;
+}
+
+void VersionedMap::reclaim() {
+    std::lock_guard lock(edit_mu);
+
+    reclaim_locked();
+}
+
+void VersionedMap::reclaim_locked() {
+    uint64_t oldest {IDLE};
+
+    for (uint32_t slot = 0; slot < MAX_READERS; ++slot) {
+        oldest = std::min(oldest, slots[slot].epoch.load());
+    }
+
+    // Retired in epoch order, so stop at the first still visible.
+    uint32_t count {0};
+
+    while (count < retired.size() && retired[count].epoch < oldest) {
+        stats.reclaimed_chunks += retired[count].chunks.size();
+
+        ++count;
+    }
+
+    stats.reclaimed += count;
+
+    retired.erase(retired.begin(), retired.begin() + count);
+}
+
+uint32_t VersionedMap::get_retired_count() {
+    std::lock_guard lock(edit_mu);
+
+    return retired.size();
+}
@@ -0,0 +1,349 @@
+#ifndef MAPSNAPSHOT_H
+#define MAPSNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "MapChunk.h"
+#include "Terrain.h"
+#include "Util.h"
+
+class VersionedMap;
+
+// One immutable version of a `VersionedMap`, made of `MapChunk`s it shares
+// with the versions before and after it, but for those edited in between.
+//
+// Satisfies the map_t requirements of `Pathfind`, as a `const MapSnapshot`,
+// so any number of threads may search one snapshot at once, while the map is
+// edited. Since nothing may write to it, it keeps no region labels: every cell
+// reports the same region, and labels written to it are dropped, so that a
+// search never floods the map to check its endpoints are connected. Searches
+// that want that check may pass a `RegionProfile` of their own, kept per
+// snapshot.
+class MapSnapshot {
+public:
+    // A lightweight reference to a single cell of the snapshot.
+    class SnapshotNode {
+    private:
+        const MapSnapshot *snapshot;
+        uint32_t idx;
+
+    public:
+        SnapshotNode(const MapSnapshot *snapshot, const uint32_t idx):
+            snapshot(snapshot),
+            idx(idx)
+        {}
+
+        bool get_blocking() const {
+            uint32_t offset;
+
+            return snapshot->get_chunk(idx, offset).get_blocking(offset);
+        }
+
+        uint8_t get_terrain() const {
+            uint32_t offset;
+
+            return snapshot->get_chunk(idx, offset).terrain[offset];
+        }
+
+        std::optional<uint64_t> get_region() const {
+            return REGION;
+        }
+
+        void set_region(std::optional<uint64_t> &&) const {}
+    };
+
+    typedef SnapshotNode node_t;
+
+    // An indexable view over every cell of the snapshot.
+    class SnapshotNodes {
+    private:
+        const MapSnapshot *snapshot;
+
+    public:
+        SnapshotNodes(const MapSnapshot *snapshot):
+            snapshot(snapshot)
+        {}
+
+        node_t operator[](const uint32_t idx) const {
+            return node_t(snapshot, idx);
+        }
+
+        size_t size() const {
+            return get_node_count(snapshot->width, snapshot->height);
+        }
+    };
+
+private:
+    // The region every cell reports.
+    static inline const uint64_t REGION {1};
+
+    const uint32_t chunks_x;
+
+    // Per chunk, row by row. Owned by the `VersionedMap`.
+    const std::vector<const MapChunk *> chunks;
+
+    const MapChunk &get_chunk(const uint32_t idx, uint32_t &offset) const {
+        const auto [x, y] = get_node_xy(idx, width);
+
+        offset = MapChunk::offset(x & (MapChunk::SIZE - 1), y & (MapChunk::SIZE - 1));
+
+        return *chunks[(y >> MapChunk::BITS) * chunks_x + (x >> MapChunk::BITS)];
+    }
+
+    MapSnapshot(
+        const uint32_t width,
+        const uint32_t height,
+        const uint64_t version,
+        std::vector<const MapChunk *> &&chunks
+    ):
+        chunks_x((width + MapChunk::SIZE - 1) >> MapChunk::BITS),
+        chunks(std::move(chunks)),
+        width(width),
+        height(height),
+        version(version)
+    {}
+
+    friend VersionedMap;
+
+public:
+    // The x-coordinate range.
+    const uint32_t width;
+    // The y-coordinate range.
+    const uint32_t height;
+
+    // Counts up from 0 with every `VersionedMap::publish()`.
+    const uint64_t version;
+
+    MapSnapshot(const MapSnapshot &) = delete;
+    MapSnapshot &operator=(const MapSnapshot &) = delete;
+
+    bool is_blocking(const uint32_t x, const uint32_t y) const {
+        return get_nodes()[get_node_index(x, y, width)].get_blocking();
+    }
+
+    SnapshotNodes get_nodes() const {
+        return SnapshotNodes(this);
+    }
+
+    // Nodes are read-only, but for the region labels they drop, so this is
+    // the same view as `get_nodes()`.
+    SnapshotNodes get_nodes_mut() const {
+        return SnapshotNodes(this);
+    }
+
+    void clear_regions() const {}
+};
+
+// A map that can be edited while other threads search it, by way of
+// immutable `MapSnapshot`s.
+//
+// Readers pin the latest snapshot, search it for as long as they like, and
+// unpin it, without ever blocking or being blocked: pinning is two atomic
+// stores and a load. The editor stages edits, and `publish()` makes them the
+// next snapshot, copy-on-write: only the chunks it edited are copied, while
+// the rest are shared with the last snapshot, and a publish costs one chunk
+// copy per chunk touched, plus a copy of the table of chunk pointers, one per
+// `MapChunk::CELLS` cells.
+//
+// Snapshots, and the chunks they no longer share, are reclaimed by epoch, as
+// in RCU: each is retired at the epoch it was replaced in, and freed once
+// every reader pinned then has unpinned, so that reclamation never waits on
+// readers either.
+//
+// Readers each hold a `Reader`, one per thread. Edits and `publish()` must
+// come from one thread at a time.
+class VersionedMap {
+public:
+    // A pinned snapshot. The snapshot stays valid until this is destroyed.
+    class Pinned {
+    private:
+        std::atomic<uint64_t> *slot;
+        const MapSnapshot *snapshot;
+
+        Pinned(std::atomic<uint64_t> *slot, const MapSnapshot *snapshot):
+            slot(slot),
+            snapshot(snapshot)
+        {}
+
+        friend VersionedMap;
+
+    public:
+        Pinned(const Pinned &) = delete;
+        Pinned &operator=(const Pinned &) = delete;
+
+        ~Pinned() {
+            slot->store(IDLE, std::memory_order_release);
+        }
+
+        const MapSnapshot &operator*() const {
+            return *snapshot;
+        }
+
+        const MapSnapshot *operator->() const {
+            return snapshot;
+        }
+    };
+
+    // A registered reader, holding one of `MAX_READERS` slots, for one thread
+    // to pin snapshots with.
+    //
+    // Throws std::runtime_error if every slot is taken.
+    class Reader {
+    private:
+        VersionedMap &map;
+        const uint32_t slot;
+
+    public:
+        explicit Reader(VersionedMap &map);
+
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
+        ~Reader();
+
+        // Pin the latest snapshot. At most one snapshot may be pinned per
+        // reader at a time.
+        Pinned pin();
+    };
+
+    struct Stats {
+        uint64_t publishes;
+        // Chunks copied by edits, at most one per chunk per publish.
+        uint64_t copies;
+        // Snapshots freed once no longer pinned.
+        uint64_t reclaimed;
+        // Of the chunks they held, those freed with them.
+        uint64_t reclaimed_chunks;
+    };
+
+    static inline const uint32_t MAX_READERS {64};
+
+private:
+    // A slot's epoch while no snapshot is pinned.
+    static inline const uint64_t IDLE {UINT64_MAX};
+
+    // What a publish replaced, to be freed once no reader can still see it.
+    struct Retired {
+        uint64_t epoch;
+        std::unique_ptr<const MapSnapshot> snapshot;
+        std::vector<std::unique_ptr<const MapChunk>> chunks;
+    };
+
+    // Apart, so that readers pinning in one slot do not invalidate the cache
+    // line of the next.
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch {IDLE};
+        std::atomic<bool> taken {false};
+    };
+
+    const uint32_t chunks_x;
+    const uint32_t chunks_y;
+
+    std::atomic<uint64_t> epoch {0};
+    std::atomic<const MapSnapshot *> current;
+
+    std::unique_ptr<Slot[]> slots;
+
+    // The editor's state.
+    std::mutex edit_mu;
+    // The chunks of the next snapshot, if any edits are staged.
+    std::vector<const MapChunk *> draft;
+    // The chunks copied for the next snapshot, by chunk id.
+    std::vector<std::pair<uint32_t, std::unique_ptr<MapChunk>>> draft_copies;
+    // Per chunk; whether it is among `draft_copies`.
+    std::vector<bool> draft_copied;
+
+    std::vector<Retired> retired;
+
+    Stats stats {};
+
+    uint32_t get_chunk_id(const uint32_t x, const uint32_t y) const {
+        return (y >> MapChunk::BITS) * chunks_x + (x >> MapChunk::BITS);
+    }
+
+    // The chunk holding (x, y) in the draft, copied first if need be.
+    MapChunk &get_draft_chunk(const uint32_t x, const uint32_t y, uint32_t &offset);
+
+    // Free what no pinned reader can still see. Expects `edit_mu` held.
+    void reclaim_locked();
+
+public:
+    // Copy `map` into the first snapshot, version 0.
+    template <typename map_t>
+    explicit VersionedMap(const map_t &map);
+
+    VersionedMap(const VersionedMap &) = delete;
+    VersionedMap &operator=(const VersionedMap &) = delete;
+
+    // Every `Reader` must be gone by now.
+    ~VersionedMap();
+
+    // The x-coordinate range.
+    const uint32_t width;
+    // The y-coordinate range.
+    const uint32_t height;
+
+    // Stage edits for the next `publish()`. Readers see none of them until
+    // then.
+    void set_blocking(const uint32_t x, const uint32_t y, const bool blocking);
+    void set_terrain(const uint32_t x, const uint32_t y, const uint8_t terrain);
+
+    // Make the staged edits the latest snapshot, and retire the one it
+    // replaces, then free what was retired and is no longer pinned. Returns
+    // the new version, or the current one if nothing was staged.
+    uint64_t publish();
+
+    // Free what was retired and is no longer pinned, as `publish()` does.
+    void reclaim();
+
+    // The number of retired snapshots not yet freed.
+    uint32_t get_retired_count();
+
+    // Only to be called from the editor's thread.
+    const Stats &get_stats() const {
+        return stats;
+    }
+};
+
+template <typename map_t>
+VersionedMap::VersionedMap(const map_t &map):
+    chunks_x((map.width + MapChunk::SIZE - 1) >> MapChunk::BITS),
+    chunks_y((map.height + MapChunk::SIZE - 1) >> MapChunk::BITS),
+    slots(std::make_unique<Slot[]>(MAX_READERS)),
+    draft_copied(static_cast<size_t>(chunks_x) * chunks_y, false),
+    width(map.width),
+    height(map.height)
+{
+    std::vector<const MapChunk *> chunks(static_cast<size_t>(chunks_x) * chunks_y);
+
+    for (uint32_t id = 0; id < chunks.size(); ++id) {
+        auto chunk {std::make_unique<MapChunk>()};
+
+        const uint32_t x_base {(id % chunks_x) << MapChunk::BITS};
+        const uint32_t y_base {(id / chunks_x) << MapChunk::BITS};
+
+        chunk->blocking.fill(~uint64_t {0});
+        chunk->terrain.fill(TERRAIN_GROUND);
+
+        for (uint32_t y = y_base; y < std::min(y_base + MapChunk::SIZE, height); ++y) {
+            for (uint32_t x = x_base; x < std::min(x_base + MapChunk::SIZE, width); ++x) {
+                const auto node {map.get_nodes()[get_node_index(x, y, width)]};
+                const uint32_t offset {MapChunk::offset(x - x_base, y - y_base)};
+
+                chunk->set_blocking(offset, node.get_blocking());
+                chunk->terrain[offset] = node.get_terrain();
+            }
+        }
+
+        chunks[id] = chunk.release();
+    }
+
+    current = new MapSnapshot(width, height, 0, std::move(chunks));
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef MAPSPEC_H
+#define MAPSPEC_H
+
+#include <stdexcept>
+#include <string>
+
+#include "Map.h"
+#include "MapFile.h"
+#include "MovingAI.h"
+
+// Load a map described by a "map spec" string and invoke `fn` with it:
+//
+// `rand:<width>x<height>`: A `Map` from `Map::gen_rand_map()`. This is
+//     deterministic, so every process given the same spec sees the same map.
+// `<path>.pfmap`: A `MappedMap` over a memory-mapped map file.
+// `<path>`: A `Map` loaded from a Moving AI `.map` file.
+//
+// `fn` must accept both `Map &` and `MappedMap &` and return the same type
+// for each.
+//
+// Throws std::runtime_error if the map cannot be loaded.
+template <typename Fn>
+auto with_map_spec(const std::string &spec, Fn &&fn) {
+    const std::string rand_prefix {"rand:"};
+    const std::string pfmap_suffix {".pfmap"};
+
+    if (spec.rfind(rand_prefix, 0) == 0) {
+        const std::string dims {spec.substr(rand_prefix.size())};
+        const size_t sep {dims.find('x')};
+
+        if (sep == std::string::npos) {
+            throw std::runtime_error("Malformed map spec: " + spec);
+        }
+
+        Map map {
+            Map::gen_rand_map(
+                std::stoul(dims.substr(0, sep)), std::stoul(dims.substr(sep + 1))
+            )
+        };
+
+        return fn(map);
+    }
+    else if (
+        spec.size() > pfmap_suffix.size() &&
+        spec.compare(
+            spec.size() - pfmap_suffix.size(), pfmap_suffix.size(), pfmap_suffix
+        ) == 0
+    ) {
+        MappedMap map {MappedMap::open(spec)};
+
+        return fn(map);
+    }
+
+    Map map {load_movingai_map(spec)};
+
+    return fn(map);
+}
+
+#endif
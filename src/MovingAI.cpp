@@ -0,0 +1,163 @@
+#include "MovingAI.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    bool is_open_glyph(const char glyph) {
+        switch (glyph) {
+        case '.':
+        case 'G':
+        case 'S':
+            return true;
+
+        case '@':
+        case 'O':
+        case 'T':
+        case 'W':
+            return false;
+
+        default:
+            throw std::runtime_error(
+                std::string("Unrecognized map glyph: '") + glyph + "'"
+            );
+        }
+    }
+}
+
+Map load_movingai_map(std::istream &in) {
+    uint32_t width {0};
+    uint32_t height {0};
+
+    std::string token;
+
+    // The header is a sequence of "key value" lines terminated by a bare
+    // "map" line. The "type" is always "octile" in practice.
+    while (in >> token && token != "map") {
+        if (token == "type") {
+            in >> token;
+        }
+        else if (token == "height") {
+            in >> height;
+        }
+        else if (token == "width") {
+            in >> width;
+        }
+        else {
+            throw std::runtime_error("Unrecognized map header: " + token);
+        }
+    }
+
+    if (token != "map" || width == 0 || height == 0) {
+        throw std::runtime_error("Malformed map header");
+    }
+
+    std::vector<std::string> rows(height);
+
+    for (uint32_t y = 0; y < height; ++y) {
+        if (!(in >> rows[y]) || rows[y].size() < width) {
+            throw std::runtime_error(
+                "Map row " + std::to_string(y) + " is missing or truncated"
+            );
+        }
+    }
+
+    // In index order, which need not be row order (see `CellLayout`).
+    std::vector<MapNode> nodes;
+
+    const uint32_t count {get_node_count(width, height)};
+
+    nodes.reserve(count);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto [x, y] = get_node_xy(i, width);
+
+        nodes.emplace_back(
+            x, y, x >= width || y >= height || !is_open_glyph(rows[y][x])
+        );
+    }
+
+    return Map(width, height, std::move(nodes));
+}
+
+Map load_movingai_map(const std::string &path) {
+    std::ifstream in(path);
+
+    if (!in) {
+        throw std::runtime_error("Failed to open map: " + path);
+    }
+
+    return load_movingai_map(in);
+}
+
+std::vector<ScenarioEntry> load_movingai_scen(std::istream &in) {
+    std::string line;
+
+    if (!std::getline(in, line) || line.rfind("version", 0) != 0) {
+        throw std::runtime_error("Malformed scenario header");
+    }
+
+    std::vector<ScenarioEntry> entries;
+
+    while (std::getline(in, line)) {
+        if (line.empty() || line == "\r") {
+            continue;
+        }
+
+        std::istringstream fields(line);
+
+        ScenarioEntry entry;
+
+        if (
+            !(
+                fields
+                    >> entry.bucket
+                    >> entry.map_name
+                    >> entry.map_width
+                    >> entry.map_height
+                    >> entry.x_start
+                    >> entry.y_start
+                    >> entry.x_end
+                    >> entry.y_end
+                    >> entry.optimal_length
+            )
+        ) {
+            throw std::runtime_error("Malformed scenario line: " + line);
+        }
+
+        entries.push_back(std::move(entry));
+    }
+
+    return entries;
+}
+
+std::vector<ScenarioEntry> load_movingai_scen(const std::string &path) {
+    std::ifstream in(path);
+
+    if (!in) {
+        throw std::runtime_error("Failed to open scenario: " + path);
+    }
+
+    return load_movingai_scen(in);
+}
+
+double path_length_octile(
+    const std::vector<std::pair<uint32_t, uint32_t>> &path
+) {
+    double length {0};
+
+    for (size_t i = 1; i < path.size(); ++i) {
+        const auto [x_prev, y_prev] = path[i - 1];
+        const auto [x_cur, y_cur] = path[i];
+
+        if (x_prev != x_cur && y_prev != y_cur) {
+            length += 1.41421356237;
+        }
+        else {
+            length += 1;
+        }
+    }
+
+    return length;
+}
@@ -0,0 +1,53 @@
+#ifndef MOVINGAI_H
+#define MOVINGAI_H
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Map.h"
+
+// Loaders for the Moving AI Lab benchmark formats (the `.map` grid format and
+// the `.scen` scenario format), as used by the standard 2D grid pathfinding
+// benchmark sets.
+//
+// Cell glyphs are interpreted as follows:
+//
+// `.`, `G`, `S`: Open terrain (swamp is treated as ordinary open terrain).
+// `@`, `O`, `T`, `W`: Blocking (out-of-bounds, trees, water).
+//
+// Open cells are all plain ground, so that every cell costs the same, and the
+// paths found are directly comparable to the benchmark's octile costs.
+
+// A single query from a `.scen` file.
+struct ScenarioEntry {
+    uint32_t bucket;
+    std::string map_name;
+    uint32_t map_width;
+    uint32_t map_height;
+    uint32_t x_start;
+    uint32_t y_start;
+    uint32_t x_end;
+    uint32_t y_end;
+    // The optimal octile path cost, with diagonal moves costing sqrt(2) and
+    // no corner-cutting.
+    double optimal_length;
+};
+
+// Throws std::runtime_error on malformed input.
+Map load_movingai_map(std::istream &in);
+Map load_movingai_map(const std::string &path);
+
+// Throws std::runtime_error on malformed input.
+std::vector<ScenarioEntry> load_movingai_scen(std::istream &in);
+std::vector<ScenarioEntry> load_movingai_scen(const std::string &path);
+
+// The octile length of a path, as returned by `Pathfind::get_path()`, ie,
+// orthogonal steps cost 1 and diagonal steps cost sqrt(2).
+double path_length_octile(
+    const std::vector<std::pair<uint32_t, uint32_t>> &path
+);
+
+#endif
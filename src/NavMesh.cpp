@@ -0,0 +1,715 @@
+#include "NavMesh.h"
+
+namespace {
+    // As `Pathfind` reckons distance, where a diagonal step costs the same as
+    // a straight one.
+    float dist(const Pos &a, const Pos &b) {
+        return std::max(std::abs(b.x - a.x), std::abs(b.y - a.y));
+    }
+
+    float dist_euclidean(const Pos &a, const Pos &b) {
+        return std::hypot(b.x - a.x, b.y - a.y);
+    }
+
+    // Twice the signed area of the triangle (a, b, c); its sign tells which
+    // side of the line from `a` through `b` `c` is on.
+    float triarea2(const Pos &a, const Pos &b, const Pos &c) {
+        return (c.x - a.x) * (b.y - a.y) - (b.x - a.x) * (c.y - a.y);
+    }
+
+    bool equal(const Pos &a, const Pos &b) {
+        return std::abs(a.x - b.x) < 1e-4f && std::abs(a.y - b.y) < 1e-4f;
+    }
+}
+
+NavMesh::NavMesh(
+    const uint32_t width,
+    const uint32_t height,
+    const uint32_t tile_size,
+    const uint32_t threads
+):
+    width(width),
+    height(height),
+    tile_size(tile_size),
+    tiles_x((width + tile_size - 1) / tile_size),
+    tiles_y((height + tile_size - 1) / tile_size),
+    cell_class(get_node_count(width, height), BLOCKED_CLASS),
+    polygon_of(get_node_count(width, height), NONE),
+    tiles(tiles_x * tiles_y),
+    portal_base(tiles_x * tiles_y + 1, 0),
+    pool(threads)
+{}
+
+uint32_t NavMesh::size() const {
+    uint32_t count {0};
+
+    for (const Tile &tile : tiles) {
+        count += tile.polygons.size();
+    }
+
+    return count;
+}
+
+void NavMesh::partition_tile(const uint32_t t) {
+    const uint32_t x_min {(t % tiles_x) * tile_size};
+    const uint32_t y_min {(t / tiles_x) * tile_size};
+    const uint32_t x_max {std::min(x_min + tile_size, width) - 1};
+    const uint32_t y_max {std::min(y_min + tile_size, height) - 1};
+
+    const uint32_t base {t * tile_size * tile_size};
+
+    Tile &tile {tiles[t]};
+
+    tile.polygons.clear();
+
+    for (uint32_t y = y_min; y <= y_max; ++y) {
+        for (uint32_t x = x_min; x <= x_max; ++x) {
+            polygon_of[get_node_index(x, y, width)] = NONE;
+        }
+    }
+
+    partition_rectangles(
+        width, cell_class, polygon_of, NONE, x_min, y_min, x_max, y_max,
+        [&](
+            const uint32_t x_rect_min, const uint32_t y_rect_min,
+            const uint32_t x_rect_max, const uint32_t y_rect_max, const uint8_t cls
+        ) {
+            tile.polygons.push_back(
+                {x_rect_min, y_rect_min, x_rect_max, y_rect_max, cls}
+            );
+
+            return base + static_cast<uint32_t>(tile.polygons.size() - 1);
+        }
+    );
+}
+
+void NavMesh::link_tile(const uint32_t t) {
+    Tile &tile {tiles[t]};
+
+    tile.first_portal.clear();
+    tile.portals.clear();
+
+    // Add a portal for each run of cells of one polygon along the row or
+    // column `outside` of a side, from `lo` to `hi`, whose edge is on the line
+    // `edge`.
+    const auto add_side = [&](
+        const bool vertical,
+        const int64_t outside,
+        const uint32_t edge,
+        const uint32_t lo,
+        const uint32_t hi
+    ) {
+        if (outside < 0 || outside >= (vertical ? width : height)) {
+            return;
+        }
+
+        uint32_t run_id {NONE};
+        uint32_t run_start {lo};
+
+        for (uint32_t i = lo; i <= hi + 1; ++i) {
+            uint32_t id {NONE};
+
+            if (i <= hi) {
+                id = vertical ?
+                    polygon_of[get_node_index(outside, i, width)] :
+                    polygon_of[get_node_index(i, outside, width)];
+            }
+
+            if (id == run_id) {
+                continue;
+            }
+
+            if (run_id != NONE) {
+                tile.portals.push_back(
+                    vertical ?
+                        Portal {run_id, edge, run_start, edge, i} :
+                        Portal {run_id, run_start, edge, i, edge}
+                );
+            }
+
+            run_id = id;
+            run_start = i;
+        }
+    };
+
+    for (const Polygon &polygon : tile.polygons) {
+        tile.first_portal.push_back(tile.portals.size());
+
+        add_side(
+            true, int64_t{polygon.x_min} - 1, polygon.x_min,
+            polygon.y_min, polygon.y_max
+        );
+        add_side(
+            true, int64_t{polygon.x_max} + 1, polygon.x_max + 1,
+            polygon.y_min, polygon.y_max
+        );
+        add_side(
+            false, int64_t{polygon.y_min} - 1, polygon.y_min,
+            polygon.x_min, polygon.x_max
+        );
+        add_side(
+            false, int64_t{polygon.y_max} + 1, polygon.y_max + 1,
+            polygon.x_min, polygon.x_max
+        );
+    }
+
+    tile.first_portal.push_back(tile.portals.size());
+}
+
+void NavMesh::run_tiles(
+    const std::vector<uint32_t> &tile_ids,
+    void (NavMesh::*fn)(const uint32_t)
+) {
+    // Not worth waking the pool for.
+    if (tile_ids.size() == 1) {
+        (this->*fn)(tile_ids.front());
+
+        return;
+    }
+
+    const uint32_t workers {
+        std::min<uint32_t>(pool.size(), tile_ids.size())
+    };
+
+    std::atomic<uint32_t> next {0};
+    std::latch done {workers};
+
+    for (uint32_t i = 0; i < workers; ++i) {
+        pool.submit(
+            [&]() {
+                for (uint32_t j = next++; j < tile_ids.size(); j = next++) {
+                    (this->*fn)(tile_ids[j]);
+                }
+
+                done.count_down();
+            }
+        );
+    }
+
+    done.wait();
+}
+
+void NavMesh::rebuild_tiles(const std::vector<uint32_t> &tile_ids) {
+    TRACE_SCOPE("NavMesh::rebuild_tiles");
+
+    // Tiles write only their own cells, so partition independently.
+    run_tiles(tile_ids, &NavMesh::partition_tile);
+
+    std::vector<uint8_t> stale(tiles.size(), false);
+    std::vector<uint32_t> to_link;
+
+    const auto mark = [&](const int64_t x_tile, const int64_t y_tile) {
+        if (x_tile < 0 || y_tile < 0 || x_tile >= tiles_x || y_tile >= tiles_y) {
+            return;
+        }
+
+        const uint32_t t {static_cast<uint32_t>(y_tile * tiles_x + x_tile)};
+
+        if (!stale[t]) {
+            stale[t] = true;
+            to_link.push_back(t);
+        }
+    };
+
+    for (const uint32_t t : tile_ids) {
+        const int64_t x_tile {t % tiles_x};
+        const int64_t y_tile {t / tiles_x};
+
+        mark(x_tile, y_tile);
+        mark(x_tile - 1, y_tile);
+        mark(x_tile + 1, y_tile);
+        mark(x_tile, y_tile - 1);
+        mark(x_tile, y_tile + 1);
+    }
+
+    run_tiles(to_link, &NavMesh::link_tile);
+
+    for (uint32_t t = 0; t < tiles.size(); ++t) {
+        portal_base[t + 1] = portal_base[t] + tiles[t].portals.size();
+    }
+}
+
+NavMeshQuery::NavMeshQuery(
+    const NavMesh &mesh,
+    const TerrainCosts &terrain_costs
+):
+    mesh(mesh),
+    terrain_costs(terrain_costs),
+    costs(mesh.get_portal_count(), INFINITY),
+    parents(mesh.get_portal_count(), NONE),
+    entered(mesh.get_portal_count(), NONE),
+    crossings(mesh.get_portal_count()),
+    closed(mesh.get_portal_count(), false)
+{}
+
+void NavMeshQuery::reset() {
+    for (const uint32_t id : touched) {
+        costs[id] = INFINITY;
+        parents[id] = NONE;
+        closed[id] = false;
+    }
+
+    touched.clear();
+    to_explore.clear();
+
+    goal_cost = INFINITY;
+    goal_parent = NONE;
+
+    count_expanded = 0;
+
+    // Rebuilding tiles can add portals.
+    const uint32_t count {mesh.get_portal_count()};
+
+    assert(count < GOAL);
+
+    if (costs.size() < count) {
+        costs.resize(count, INFINITY);
+        parents.resize(count, NONE);
+        entered.resize(count, NONE);
+        crossings.resize(count);
+        closed.resize(count, false);
+    }
+}
+
+void NavMeshQuery::push_portals(
+    const uint32_t id, const uint32_t parent, const Pos &entry,
+    const float cost, const Pos &goal
+) {
+    const float step_cost {terrain_costs[mesh.get_polygon(id).terrain]};
+    const uint32_t first {mesh.get_first_portal_id(id)};
+
+    const auto portals {mesh.get_portals(id)};
+
+    for (uint32_t i = 0; i < portals.size(); ++i) {
+        const NavMesh::Portal &portal {portals[i]};
+        const uint32_t portal_id {first + i};
+
+        if (closed[portal_id]) {
+            continue;
+        }
+
+        // Where the straight line on to the goal crosses the portal, or the
+        // nearest point of it to that line.
+        Pos crossing {entry};
+
+        if (portal.x_a == portal.x_b) {
+            const float t {(portal.x_a - entry.x) / (goal.x - entry.x)};
+
+            crossing = {
+                static_cast<float>(portal.x_a),
+                t > 0 && t <= 1 ? entry.y + t * (goal.y - entry.y) : entry.y
+            };
+        }
+        else {
+            const float t {(portal.y_a - entry.y) / (goal.y - entry.y)};
+
+            crossing = {
+                t > 0 && t <= 1 ? entry.x + t * (goal.x - entry.x) : entry.x,
+                static_cast<float>(portal.y_a)
+            };
+        }
+
+        crossing.x = std::clamp<float>(crossing.x, portal.x_a, portal.x_b);
+        crossing.y = std::clamp<float>(crossing.y, portal.y_a, portal.y_b);
+
+        const float cost_new {cost + dist(entry, crossing) * step_cost};
+
+        if (cost_new >= costs[portal_id]) {
+            continue;
+        }
+
+        if (costs[portal_id] == INFINITY) {
+            touched.push_back(portal_id);
+        }
+
+        costs[portal_id] = cost_new;
+        parents[portal_id] = parent;
+        entered[portal_id] = portal.neighbor;
+        crossings[portal_id] = crossing;
+
+        // As in `Pathfind`, the heuristic is the Euclidean distance, which
+        // overestimates, times the cost of the polygon entered, trading a
+        // little optimality for far fewer expansions.
+        const float heuristic {
+            dist_euclidean(crossing, goal) *
+                terrain_costs[mesh.get_polygon(portal.neighbor).terrain]
+        };
+
+        to_explore.push_back({portal_id, cost_new + heuristic});
+        std::push_heap(
+            to_explore.begin(), to_explore.end(), std::greater<ExploredNode>{}
+        );
+    }
+}
+
+const NavMesh::Portal &NavMeshQuery::get_portal(
+    const uint32_t id, const uint32_t neighbor
+) const {
+    const auto portals {mesh.get_portals(id)};
+
+    // Two rectangles share at most one edge.
+    const auto portal {
+        std::find_if(
+            portals.begin(), portals.end(),
+            [&](const NavMesh::Portal &portal) {
+                return portal.neighbor == neighbor;
+            }
+        )
+    };
+
+    assert(portal != portals.end());
+
+    return *portal;
+}
+
+bool NavMeshQuery::find_corridor(
+    const uint32_t x_start, const uint32_t y_start,
+    const uint32_t x_end, const uint32_t y_end,
+    std::vector<uint32_t> &corridor
+) {
+    TRACE_SCOPE("NavMeshQuery::find_corridor");
+
+    reset();
+
+    corridor.clear();
+
+    const uint32_t id_start {mesh.get_polygon_id(x_start, y_start)};
+    const uint32_t id_goal {mesh.get_polygon_id(x_end, y_end)};
+
+    if (id_start == NONE || id_goal == NONE) {
+        return false;
+    }
+
+    // Polygons are convex, so nothing beats a straight line across one.
+    if (id_start == id_goal) {
+        corridor.push_back(id_start);
+
+        return true;
+    }
+
+    const Pos start {x_start + 0.5f, y_start + 0.5f};
+    const Pos goal {x_end + 0.5f, y_end + 0.5f};
+
+    push_portals(id_start, NONE, start, 0, goal);
+
+    bool found {false};
+
+    while (!to_explore.empty()) {
+        std::pop_heap(
+            to_explore.begin(), to_explore.end(), std::greater<ExploredNode>{}
+        );
+
+        const ExploredNode node {to_explore.back()};
+
+        to_explore.pop_back();
+
+        if (node.id == GOAL) {
+            found = true;
+
+            break;
+        }
+
+        // Superseded by a cheaper entry since it was pushed.
+        if (closed[node.id]) {
+            continue;
+        }
+
+        closed[node.id] = true;
+
+        ++count_expanded;
+
+        const uint32_t id {entered[node.id]};
+
+        if (id != id_goal) {
+            push_portals(id, node.id, crossings[node.id], costs[node.id], goal);
+
+            continue;
+        }
+
+        // The goal is reached straight across its own polygon.
+        const float step_cost {terrain_costs[mesh.get_polygon(id).terrain]};
+        const float cost {costs[node.id] + dist(crossings[node.id], goal) * step_cost};
+
+        if (cost < goal_cost) {
+            goal_cost = cost;
+            goal_parent = node.id;
+
+            to_explore.push_back({GOAL, cost});
+            std::push_heap(
+                to_explore.begin(), to_explore.end(), std::greater<ExploredNode>{}
+            );
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    for (
+        uint32_t portal_id = goal_parent;
+        portal_id != NONE;
+        portal_id = parents[portal_id]
+    ) {
+        corridor.push_back(entered[portal_id]);
+    }
+
+    corridor.push_back(id_start);
+
+    std::reverse(corridor.begin(), corridor.end());
+
+    return true;
+}
+
+void NavMeshQuery::find_waypoints(
+    const uint32_t x_start, const uint32_t y_start,
+    const uint32_t x_end, const uint32_t y_end,
+    const std::vector<uint32_t> &corridor,
+    std::vector<Pos> &waypoints
+) const {
+    TRACE_SCOPE("NavMeshQuery::find_waypoints");
+
+    const Pos start {x_start + 0.5f, y_start + 0.5f};
+    const Pos goal {x_end + 0.5f, y_end + 0.5f};
+
+    // The portals in the order they are crossed, as seen facing across them,
+    // between the endpoints, as portals of no width.
+    thread_local std::vector<std::pair<Pos, Pos>> lefts_rights;
+
+    lefts_rights.clear();
+    lefts_rights.emplace_back(start, start);
+
+    for (uint32_t i = 0; i + 1 < corridor.size(); ++i) {
+        const NavMesh::Portal &portal {get_portal(corridor[i], corridor[i + 1])};
+        const NavMesh::Polygon &next {mesh.get_polygon(corridor[i + 1])};
+
+        const Pos a {static_cast<float>(portal.x_a), static_cast<float>(portal.y_a)};
+        const Pos b {static_cast<float>(portal.x_b), static_cast<float>(portal.y_b)};
+
+        // Left is the side for which the cross product of the direction of
+        // travel and left minus right is positive: the far end of a portal
+        // crossed rightward, or the near end of one crossed downward.
+        const bool vertical {portal.x_a == portal.x_b};
+        const bool forward {
+            vertical ? next.x_min == portal.x_a : next.y_min == portal.y_a
+        };
+
+        if (vertical == forward) {
+            lefts_rights.emplace_back(b, a);
+        }
+        else {
+            lefts_rights.emplace_back(a, b);
+        }
+    }
+
+    lefts_rights.emplace_back(goal, goal);
+
+    waypoints.clear();
+    waypoints.push_back(start);
+
+    Pos apex {start};
+    Pos left {start};
+    Pos right {start};
+
+    uint32_t i_apex {0};
+    uint32_t i_left {0};
+    uint32_t i_right {0};
+
+    const auto add_corner = [&](const Pos &corner, const uint32_t i_corner) {
+        if (!equal(corner, waypoints.back())) {
+            waypoints.push_back(corner);
+        }
+
+        apex = corner;
+        left = corner;
+        right = corner;
+
+        i_apex = i_corner;
+        i_left = i_corner;
+        i_right = i_corner;
+    };
+
+    for (uint32_t i = 1; i < lefts_rights.size(); ++i) {
+        const auto &[left_new, right_new] = lefts_rights[i];
+
+        // Narrow the funnel from the right, unless that crosses over the
+        // left, in which case the left is a corner of the path.
+        if (triarea2(apex, right, right_new) <= 0) {
+            if (equal(apex, right) || triarea2(apex, left, right_new) > 0) {
+                right = right_new;
+                i_right = i;
+            }
+            else {
+                add_corner(left, i_left);
+
+                i = i_apex;
+
+                continue;
+            }
+        }
+
+        if (triarea2(apex, left, left_new) >= 0) {
+            if (equal(apex, left) || triarea2(apex, right, left_new) < 0) {
+                left = left_new;
+                i_left = i;
+            }
+            else {
+                add_corner(right, i_right);
+
+                i = i_apex;
+
+                continue;
+            }
+        }
+    }
+
+    if (!equal(waypoints.back(), goal)) {
+        waypoints.push_back(goal);
+    }
+}
+
+void NavMeshQuery::get_grid_path(
+    const std::vector<uint32_t> &corridor,
+    const std::vector<Pos> &waypoints,
+    path_t &path
+) const {
+    path.clear();
+
+    if (corridor.empty()) {
+        return;
+    }
+
+    std::pair<uint32_t, uint32_t> cell {
+        static_cast<uint32_t>(waypoints.front().x),
+        static_cast<uint32_t>(waypoints.front().y)
+    };
+
+    path.push_back(cell);
+
+    // Every cell of a polygon is open, so any line between two of them keeps
+    // to open cells, and never cuts a corner.
+    const auto add_line = [&](const std::pair<uint32_t, uint32_t> &to) {
+        const int64_t d_x {int64_t{to.first} - cell.first};
+        const int64_t d_y {int64_t{to.second} - cell.second};
+        const int64_t steps {std::max(std::abs(d_x), std::abs(d_y))};
+
+        for (int64_t step = 1; step <= steps; ++step) {
+            path.emplace_back(
+                cell.first + std::lround(static_cast<double>(d_x) * step / steps),
+                cell.second + std::lround(static_cast<double>(d_y) * step / steps)
+            );
+        }
+
+        cell = to;
+    };
+
+    // The waypoint segment the search for the next crossing starts from.
+    uint32_t segment {0};
+
+    for (uint32_t i = 0; i + 1 < corridor.size(); ++i) {
+        const NavMesh::Portal &portal {get_portal(corridor[i], corridor[i + 1])};
+        const NavMesh::Polygon &next {mesh.get_polygon(corridor[i + 1])};
+
+        const bool vertical {portal.x_a == portal.x_b};
+        const float line {static_cast<float>(vertical ? portal.x_a : portal.y_a)};
+
+        // Where along the portal the waypoints cross it.
+        float along {vertical ? waypoints[segment].y : waypoints[segment].x};
+
+        for (; segment + 1 < waypoints.size(); ++segment) {
+            const Pos &a {waypoints[segment]};
+            const Pos &b {waypoints[segment + 1]};
+
+            const float from {vertical ? a.x : a.y};
+            const float to {vertical ? b.x : b.y};
+
+            if ((from - line) * (to - line) > 0) {
+                continue;
+            }
+
+            const float a_along {vertical ? a.y : a.x};
+            const float b_along {vertical ? b.y : b.x};
+
+            along = from == to ?
+                a_along : a_along + (b_along - a_along) * (line - from) / (to - from);
+
+            break;
+        }
+
+        const uint32_t lo {vertical ? portal.y_a : portal.x_a};
+        const uint32_t hi {vertical ? portal.y_b : portal.x_b};
+
+        const uint32_t cross {
+            static_cast<uint32_t>(
+                std::clamp<int64_t>(std::floor(along), lo, int64_t{hi} - 1)
+            )
+        };
+
+        const uint32_t edge {vertical ? portal.x_a : portal.y_a};
+        const bool forward {vertical ? next.x_min == edge : next.y_min == edge};
+
+        const uint32_t exit {forward ? edge - 1 : edge};
+        const uint32_t enter {forward ? edge : edge - 1};
+
+        if (vertical) {
+            add_line({exit, cross});
+            add_line({enter, cross});
+        }
+        else {
+            add_line({cross, exit});
+            add_line({cross, enter});
+        }
+    }
+
+    add_line({
+        static_cast<uint32_t>(waypoints.back().x),
+        static_cast<uint32_t>(waypoints.back().y)
+    });
+
+    // Crossing a portal takes a straight step, so cut out the cells where a
+    // diagonal one would have done, ie, where the cells either side are
+    // neighbors, and the step between them cuts no corner.
+    const auto is_open = [&](const uint32_t x, const uint32_t y) {
+        return mesh.get_polygon_id(x, y) != NavMesh::NONE;
+    };
+
+    uint32_t kept {0};
+
+    for (uint32_t i = 0; i < path.size(); ++i) {
+        if (kept >= 1 && i + 1 < path.size()) {
+            const auto [x_prev, y_prev] = path[kept - 1];
+            const auto [x_next, y_next] = path[i + 1];
+
+            if (
+                dist_chebyshev(x_prev, y_prev, x_next, y_next) == 1 &&
+                is_open(x_prev, y_next) && is_open(x_next, y_prev)
+            ) {
+                continue;
+            }
+        }
+
+        path[kept++] = path[i];
+    }
+
+    path.resize(kept);
+
+    std::reverse(path.begin(), path.end());
+}
+
+NavMeshQuery::path_t NavMeshQuery::get_path(
+    const uint32_t x_start, const uint32_t y_start,
+    const uint32_t x_end, const uint32_t y_end
+) {
+    thread_local std::vector<uint32_t> corridor;
+    thread_local std::vector<Pos> waypoints;
+
+    path_t path;
+
+    if (!find_corridor(x_start, y_start, x_end, y_end, corridor)) {
+        return path;
+    }
+
+    find_waypoints(x_start, y_start, x_end, y_end, corridor, waypoints);
+    get_grid_path(corridor, waypoints, path);
+
+    return path;
+}
@@ -0,0 +1,344 @@
+#ifndef NAVMESH_H
+#define NAVMESH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <latch>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Map.h"
+#include "RectanglePartition.h"
+#include "Terrain.h"
+#include "Trace.h"
+#include "Util.h"
+#include "WorkerPool.h"
+
+// A navigation mesh over a map's open cells: convex polygons, joined by
+// portals, ie, the edges they share, so that a search crosses a large open
+// area in a few steps rather than a cell at a time (see `NavMeshQuery`).
+//
+// The map is cut into square tiles, and the open area of each tile is
+// partitioned on its own, so that tiles build in parallel, and an edit
+// rebuilds only the tiles it touches. The contours of a tile's open area run
+// along cell edges, so are rectilinear, and its convex partition is into
+// rectangles: each is grown greedily from the first uncovered open cell, right
+// as far as it can go, then down as far as the whole row can go, over cells of
+// a single terrain class, so that crossing a polygon costs the same per unit
+// of distance throughout. Polygons meet only along edges; two touching only at
+// a corner could only be crossed by cutting that corner.
+//
+// Positions are in cell-corner coordinates, ie, cell (x, y) spans
+// [x, x + 1] x [y, y + 1], and a cell's center is (x + 0.5, y + 0.5).
+//
+// Not thread-safe: the mesh must not be built or rebuilt while a query reads
+// it.
+class NavMesh {
+public:
+    static inline const uint32_t NONE {UINT32_MAX};
+
+    // A convex polygon of the mesh: the rectangle of cells
+    // [x_min, x_max] x [y_min, y_max], all of the one terrain class.
+    struct Polygon {
+        uint32_t x_min;
+        uint32_t y_min;
+        uint32_t x_max;
+        uint32_t y_max;
+        uint8_t terrain;
+    };
+
+    // An edge a polygon shares with `neighbor`, from (x_a, y_a) to
+    // (x_b, y_b), with x_a <= x_b and y_a <= y_b.
+    struct Portal {
+        uint32_t neighbor;
+        uint32_t x_a;
+        uint32_t y_a;
+        uint32_t x_b;
+        uint32_t y_b;
+    };
+
+private:
+    struct Tile {
+        std::vector<Polygon> polygons;
+        // Per polygon, where its portals start in `portals`, and one more for
+        // where the last polygon's end.
+        std::vector<uint32_t> first_portal;
+        std::vector<Portal> portals;
+    };
+
+    const uint32_t width;
+    const uint32_t height;
+    const uint32_t tile_size;
+    const uint32_t tiles_x;
+    const uint32_t tiles_y;
+
+    // Per cell; the terrain class, or `BLOCKED_CLASS`.
+    std::vector<uint8_t> cell_class;
+    // Per cell; the id of the polygon covering it, or `NONE`. The polygons of
+    // tile `t` take the ids from `t * tile_size * tile_size` up.
+    std::vector<uint32_t> polygon_of;
+
+    std::vector<Tile> tiles;
+    // Per tile, the id of its first portal, and one more for the count of
+    // portals. Ids are renumbered whenever tiles are rebuilt.
+    std::vector<uint32_t> portal_base;
+
+    WorkerPool pool;
+
+    uint32_t get_tile_of(const uint32_t id) const {
+        return id / (tile_size * tile_size);
+    }
+
+    // Partition the open cells of tile `t` afresh.
+    void partition_tile(const uint32_t t);
+
+    // Find the portals of every polygon of tile `t`. The tile and its
+    // neighbors must be partitioned.
+    void link_tile(const uint32_t t);
+
+    // Partition the given tiles, then relink them and their neighbors, whose
+    // portals into them are stale, spreading both passes over the pool.
+    void rebuild_tiles(const std::vector<uint32_t> &tile_ids);
+
+    // Run `fn(t)` for each of `tile_ids` on the pool, and wait for them all.
+    void run_tiles(
+        const std::vector<uint32_t> &tile_ids,
+        void (NavMesh::*fn)(const uint32_t)
+    );
+
+public:
+    NavMesh(
+        const uint32_t width,
+        const uint32_t height,
+        const uint32_t tile_size = 32,
+        const uint32_t threads = std::thread::hardware_concurrency()
+    );
+
+    // Build the mesh over the open cells of `map`, ie, those satisfying
+    // `is_accessible`, from scratch.
+    template <typename map_t, typename Predicate>
+    void build(const map_t &map, const Predicate &is_accessible);
+
+    // Bring the mesh up to date after the accessibility or terrain of the
+    // cells in [x_min, x_max] x [y_min, y_max] changed, rebuilding only the
+    // tiles overlapping them.
+    template <typename map_t, typename Predicate>
+    void rebuild(
+        const map_t &map, const Predicate &is_accessible,
+        const uint32_t x_min, const uint32_t y_min,
+        const uint32_t x_max, const uint32_t y_max
+    );
+
+    uint32_t get_width() const {
+        return width;
+    }
+
+    uint32_t get_height() const {
+        return height;
+    }
+
+    // The number of polygons.
+    uint32_t size() const;
+
+    // The number of portals, counting each side of an edge once. Portal ids
+    // run from 0 to this.
+    uint32_t get_portal_count() const {
+        return portal_base.back();
+    }
+
+    // The id of the polygon covering (x, y), or `NONE` if it is blocked.
+    uint32_t get_polygon_id(const uint32_t x, const uint32_t y) const {
+        return polygon_of[get_node_index(x, y, width)];
+    }
+
+    const Polygon &get_polygon(const uint32_t id) const {
+        const uint32_t t {get_tile_of(id)};
+
+        return tiles[t].polygons[id - t * tile_size * tile_size];
+    }
+
+    // The portals out of polygon `id`, whose ids run consecutively from
+    // `get_first_portal_id(id)`.
+    std::span<const Portal> get_portals(const uint32_t id) const {
+        const uint32_t t {get_tile_of(id)};
+        const uint32_t local {id - t * tile_size * tile_size};
+        const Tile &tile {tiles[t]};
+
+        return std::span<const Portal>(tile.portals).subspan(
+            tile.first_portal[local],
+            tile.first_portal[local + 1] - tile.first_portal[local]
+        );
+    }
+
+    uint32_t get_first_portal_id(const uint32_t id) const {
+        const uint32_t t {get_tile_of(id)};
+
+        return portal_base[t] + tiles[t].first_portal[id - t * tile_size * tile_size];
+    }
+};
+
+template <typename map_t, typename Predicate>
+void NavMesh::build(const map_t &map, const Predicate &is_accessible) {
+    read_cell_classes(map, is_accessible, cell_class, 0, 0, width - 1, height - 1);
+
+    std::vector<uint32_t> tile_ids(tiles.size());
+
+    for (uint32_t t = 0; t < tiles.size(); ++t) {
+        tile_ids[t] = t;
+    }
+
+    rebuild_tiles(tile_ids);
+}
+
+template <typename map_t, typename Predicate>
+void NavMesh::rebuild(
+    const map_t &map, const Predicate &is_accessible,
+    const uint32_t x_min, const uint32_t y_min,
+    const uint32_t x_max, const uint32_t y_max
+) {
+    const uint32_t x_last {std::min(x_max, width - 1)};
+    const uint32_t y_last {std::min(y_max, height - 1)};
+
+    read_cell_classes(map, is_accessible, cell_class, x_min, y_min, x_last, y_last);
+
+    std::vector<uint32_t> tile_ids;
+
+    for (uint32_t y_tile = y_min / tile_size; y_tile * tile_size <= y_last; ++y_tile) {
+        for (uint32_t x_tile = x_min / tile_size; x_tile * tile_size <= x_last; ++x_tile) {
+            tile_ids.push_back(y_tile * tiles_x + x_tile);
+        }
+    }
+
+    rebuild_tiles(tile_ids);
+}
+
+// A search over a `NavMesh`: an A* search over its portals, then a funnel
+// pass that pulls the path through the portals it crossed taut, and, if need
+// be, a conversion of the result back into a path of neighboring cells, as
+// `Pathfind::get_path()` finds.
+//
+// The search's nodes are portals, rather than polygons, since where a path
+// enters a polygon matters as much as that it does. It crosses each portal
+// where the straight line from where it crossed the previous one to the goal
+// does, or at the nearest point of the portal to that line, so that costs
+// follow the straight lines the funnel pass finds, rather than a zigzag
+// through portal midpoints. Costs are reckoned as in `Pathfind`: Chebyshev
+// distance, times the terrain cost of the polygon crossed. As the crossings
+// depend on the route taken, the search is not guaranteed optimal, though it
+// is close on open maps.
+//
+// The search's dense per-portal state is kept between searches, and reset
+// only where the last search touched it, so that, once warmed up, searching
+// does not allocate.
+//
+// Not thread-safe; use one per thread.
+class NavMeshQuery {
+public:
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+private:
+    static inline const uint32_t NONE {NavMesh::NONE};
+    // The id of the search's goal, once the goal's polygon has been reached.
+    static inline const uint32_t GOAL {NavMesh::NONE - 1};
+
+    struct ExploredNode {
+        uint32_t id;
+        // The cost so far, plus the heuristic.
+        float estimate;
+
+        friend bool operator>(const ExploredNode &lhs, const ExploredNode &rhs) {
+            return lhs.estimate > rhs.estimate;
+        }
+    };
+
+    const NavMesh &mesh;
+
+    const TerrainCosts terrain_costs;
+
+    // Per portal; untouched portals are infinite, without parent, and not
+    // closed. `entered` is the polygon the portal leads into, and `crossings`
+    // where the search crossed it.
+    std::vector<float> costs;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> entered;
+    std::vector<Pos> crossings;
+    std::vector<uint8_t> closed;
+
+    std::vector<ExploredNode> to_explore;
+    std::vector<uint32_t> touched;
+
+    // The cheapest way found into the goal, and the portal it crossed last.
+    float goal_cost {INFINITY};
+    uint32_t goal_parent {NONE};
+
+    uint32_t count_expanded {0};
+
+    // Forget the last search, and make room for every portal of the mesh.
+    void reset();
+
+    // Push the portals out of polygon `id`, entered at `entry` with `cost`
+    // through portal `parent`, toward `goal`.
+    void push_portals(
+        const uint32_t id, const uint32_t parent, const Pos &entry,
+        const float cost, const Pos &goal
+    );
+
+    // The portal from polygon `id` to polygon `neighbor`, which must share
+    // one.
+    const NavMesh::Portal &get_portal(const uint32_t id, const uint32_t neighbor) const;
+
+public:
+    NavMeshQuery(
+        const NavMesh &mesh,
+        const TerrainCosts &terrain_costs = DEFAULT_TERRAIN_COSTS
+    );
+
+    // Write the polygons a path from cell (x_start, y_start) to cell
+    // (x_end, y_end) passes through into `corridor`, start-first. False, with
+    // `corridor` empty, if there is no path.
+    bool find_corridor(
+        const uint32_t x_start, const uint32_t y_start,
+        const uint32_t x_end, const uint32_t y_end,
+        std::vector<uint32_t> &corridor
+    );
+
+    // Write the shortest path through `corridor` from the center of cell
+    // (x_start, y_start) to the center of cell (x_end, y_end) into
+    // `waypoints`, start-first: the endpoints, and the portal corners the path
+    // turns at, by the funnel algorithm.
+    void find_waypoints(
+        const uint32_t x_start, const uint32_t y_start,
+        const uint32_t x_end, const uint32_t y_end,
+        const std::vector<uint32_t> &corridor,
+        std::vector<Pos> &waypoints
+    ) const;
+
+    // Write a path of neighboring cells following `waypoints` through
+    // `corridor` into `path`, end-first, as `Pathfind::get_path()`. The path
+    // crosses each portal at the cell nearest where the waypoints do, and
+    // runs straight within each polygon, so it keeps to the corridor.
+    void get_grid_path(
+        const std::vector<uint32_t> &corridor,
+        const std::vector<Pos> &waypoints,
+        path_t &path
+    ) const;
+
+    // All three of the above: the path of cells from (x_start, y_start) to
+    // (x_end, y_end), end-first, or empty if there is none.
+    path_t get_path(
+        const uint32_t x_start, const uint32_t y_start,
+        const uint32_t x_end, const uint32_t y_end
+    );
+
+    // The number of portals the last search expanded.
+    uint32_t get_count_expanded() const {
+        return count_expanded;
+    }
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "OccupancyLayer.h"
+
+#include <algorithm>
+
+#include "Util.h"
+
+OccupancyLayer::OccupancyLayer(
+    const uint32_t width, const uint32_t height, const float cost_per_agent
+):
+    width(width),
+    height(height),
+    cost_per_agent(cost_per_agent),
+    costs(get_node_count(width, height), 0),
+    counts(get_node_count(width, height), 0)
+{}
+
+void OccupancyLayer::set(const uint32_t agent, const float x, const float y) {
+    const uint32_t idx {
+        get_node_index(
+            std::clamp<int64_t>(static_cast<int64_t>(x), 0, width - 1),
+            std::clamp<int64_t>(static_cast<int64_t>(y), 0, height - 1),
+            width
+        )
+    };
+
+    if (agent >= agent_cell.size()) {
+        agent_cell.resize(agent + 1, NONE);
+    }
+
+    const uint32_t idx_prev {agent_cell[agent]};
+
+    if (idx_prev == idx) [[likely]] {
+        return;
+    }
+
+    if (idx_prev != NONE) {
+        leave(idx_prev);
+    }
+
+    enter(idx);
+
+    agent_cell[agent] = idx;
+}
+
+void OccupancyLayer::remove(const uint32_t agent) {
+    if (agent >= agent_cell.size() || agent_cell[agent] == NONE) {
+        return;
+    }
+
+    leave(agent_cell[agent]);
+
+    agent_cell[agent] = NONE;
+}
+
+void OccupancyLayer::clear() {
+    for (const uint32_t idx : agent_cell) {
+        if (idx != NONE) {
+            costs[idx] = 0;
+            counts[idx] = 0;
+        }
+    }
+
+    agent_cell.clear();
+}
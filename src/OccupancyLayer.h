@@ -0,0 +1,64 @@
+#ifndef OCCUPANCYLAYER_H
+#define OCCUPANCYLAYER_H
+
+#include <cstdint>
+#include <vector>
+
+// A dynamic per-cell cost for the agents standing in each cell, layered over
+// a map without touching its nodes, so that searches can steer around crowds
+// while the static map and its region labels stay as they are.
+//
+// Agents are placed by id with `set()`, which costs O(1) and does nothing
+// more than a compare when the agent stays within its cell, so updating the
+// layer each tick costs time proportional to the agents that changed cell.
+// The cost of every cell is kept precomputed in a dense array, so a search
+// reads it with a single load.
+//
+// Not thread-safe: the layer must not be updated while a search reads it.
+class OccupancyLayer {
+public:
+    static inline const uint32_t NONE {UINT32_MAX};
+
+private:
+    const uint32_t width;
+    const uint32_t height;
+    const float cost_per_agent;
+
+    // Per cell.
+    std::vector<float> costs;
+    std::vector<uint32_t> counts;
+
+    // Per agent; the cell index it occupies, or `NONE`.
+    std::vector<uint32_t> agent_cell;
+
+    void enter(const uint32_t idx) {
+        costs[idx] = ++counts[idx] * cost_per_agent;
+    }
+
+    void leave(const uint32_t idx) {
+        costs[idx] = --counts[idx] * cost_per_agent;
+    }
+
+public:
+    // Each agent in a cell adds `cost_per_agent` to the cost of entering it.
+    OccupancyLayer(const uint32_t width, const uint32_t height, const float cost_per_agent);
+
+    // Place the agent at (x, y), in cell units as for `Pos`, moving it from
+    // wherever it was. Positions outside the map are clamped onto its edge.
+    void set(const uint32_t agent, const float x, const float y);
+
+    void remove(const uint32_t agent);
+
+    // Remove every agent.
+    void clear();
+
+    float get_cost(const uint32_t idx) const {
+        return costs[idx];
+    }
+
+    uint32_t get_count(const uint32_t idx) const {
+        return counts[idx];
+    }
+};
+
+#endif
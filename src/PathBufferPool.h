@@ -0,0 +1,115 @@
+#ifndef PATHBUFFERPOOL_H
+#define PATHBUFFERPOOL_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// A thread-safe pool of path buffers. Buffers keep their capacity when
+// returned, so once the pool has warmed up, computing and storing a path does
+// not allocate.
+//
+// Buffers hold a reference to the pool's free list, so they may safely
+// outlive the pool object itself, eg, as components of a registry that is
+// torn down later.
+class PathBufferPool {
+public:
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+private:
+    struct FreeList {
+        std::mutex mu;
+        std::vector<path_t> buffers;
+        const size_t max_buffers;
+
+        FreeList(const size_t max_buffers):
+            max_buffers(max_buffers)
+        {}
+    };
+
+    std::shared_ptr<FreeList> free_list;
+
+public:
+    // A pooled path, returned to its pool on destruction.
+    class Buffer {
+    private:
+        std::shared_ptr<FreeList> free_list;
+
+    public:
+        path_t path;
+
+        Buffer() = default;
+
+        Buffer(std::shared_ptr<FreeList> free_list, path_t &&path):
+            free_list(std::move(free_list)),
+            path(std::move(path))
+        {}
+
+        Buffer(Buffer &&) = default;
+        Buffer &operator=(Buffer &&other) {
+            if (this != &other) {
+                release();
+
+                free_list = std::move(other.free_list);
+                path = std::move(other.path);
+            }
+
+            return *this;
+        }
+
+        ~Buffer() {
+            release();
+        }
+
+        void release() {
+            if (!free_list) {
+                return;
+            }
+
+            path.clear();
+
+            {
+                std::scoped_lock<std::mutex> lock(free_list->mu);
+
+                if (free_list->buffers.size() < free_list->max_buffers) {
+                    free_list->buffers.push_back(std::move(path));
+                }
+            }
+
+            free_list.reset();
+            path = {};
+        }
+    };
+
+    // At most `max_buffers` idle buffers are retained; any more returned are
+    // freed.
+    PathBufferPool(const size_t max_buffers = 4096):
+        free_list(std::make_shared<FreeList>(max_buffers))
+    {}
+
+    // Returns an empty buffer, reusing an idle one if available.
+    Buffer acquire() {
+        path_t path;
+
+        {
+            std::scoped_lock<std::mutex> lock(free_list->mu);
+
+            if (!free_list->buffers.empty()) {
+                path = std::move(free_list->buffers.back());
+                free_list->buffers.pop_back();
+            }
+        }
+
+        return Buffer(free_list, std::move(path));
+    }
+
+    size_t idle() const {
+        std::scoped_lock<std::mutex> lock(free_list->mu);
+
+        return free_list->buffers.size();
+    }
+};
+
+#endif
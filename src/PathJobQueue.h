@@ -0,0 +1,181 @@
+#ifndef PATHJOBQUEUE_H
+#define PATHJOBQUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Map.h"
+#include "PathBufferPool.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+
+// Computes paths on background worker threads. The owner submits jobs and
+// periodically drains completed results, eg, once per frame, so neither side
+// ever waits on the other. Each job carries an opaque `Tag` which is handed
+// back with its result, eg, to identify the requesting entity.
+//
+// Result paths are drawn from a `PathBufferPool`, so a steady stream of
+// queries does not allocate path storage once the pool has warmed up.
+//
+// Every region of the map is colored on construction, so that the workers
+// only ever read the map. The map must not be edited while jobs are in
+// flight.
+template <typename map_t, typename Predicate, typename Tag>
+class PathJobQueue {
+public:
+    struct Job {
+        Tag tag;
+        uint32_t x_start;
+        uint32_t y_start;
+        uint32_t x_end;
+        uint32_t y_end;
+    };
+
+    struct Result {
+        Tag tag;
+        // Empty if there is no path.
+        PathBufferPool::Buffer path;
+    };
+
+private:
+    // Jobs per worker pool task. Large enough to amortize the task overhead,
+    // small enough to spread a burst of jobs across the pool.
+    static inline const uint32_t CHUNK_SIZE {16};
+
+    // Each search is sized for this many cells to start with, rather than
+    // the entire map, which would cost every job as much as the largest.
+    static inline const uint32_t QUERY_RESERVE {4096};
+
+    map_t &map;
+    const Predicate &is_accessible;
+
+    PathBufferPool buffers;
+
+    std::mutex done_mu;
+    std::vector<Result> done;
+
+    // Only touched by `drain()`; kept to reuse its storage.
+    std::vector<Result> draining;
+
+    std::atomic<uint32_t> in_flight_jobs {0};
+
+    // Declared last, so that it is destroyed (and its tasks drained) before
+    // anything those tasks refer to.
+    WorkerPool workers;
+
+    void run_chunk(
+        const std::shared_ptr<std::vector<Job>> &jobs,
+        const size_t first,
+        const size_t last
+    ) {
+        TRACE_SCOPE("path job chunk");
+
+        std::vector<Result> results;
+
+        results.reserve(last - first);
+
+        for (size_t i = first; i < last; ++i) {
+            const Job &job {(*jobs)[i]};
+
+            Result &result {results.emplace_back(job.tag, buffers.acquire())};
+
+            if (
+                job.x_start >= map.width || job.y_start >= map.height ||
+                job.x_end >= map.width || job.y_end >= map.height
+            ) {
+                continue;
+            }
+
+            Pathfind<map_t, Predicate> pathfinder(
+                map,
+                job.x_start, job.y_start,
+                job.x_end, job.y_end,
+                is_accessible,
+                {.reserve_hint = QUERY_RESERVE}
+            );
+
+            pathfinder.get_path(result.path.path);
+        }
+
+        {
+            std::scoped_lock<std::mutex> lock(done_mu);
+
+            std::move(results.begin(), results.end(), std::back_inserter(done));
+        }
+
+        in_flight_jobs -= last - first;
+    }
+
+public:
+    PathJobQueue(
+        map_t &map,
+        const Predicate &is_accessible,
+        const uint32_t num_threads = std::thread::hardware_concurrency()
+    ):
+        map(map),
+        is_accessible(is_accessible),
+        workers(num_threads)
+    {
+        RegionColorer<map_t, Predicate>::color_all_regions(map, is_accessible);
+    }
+
+    PathJobQueue(const PathJobQueue &) = delete;
+    PathJobQueue &operator=(const PathJobQueue &) = delete;
+
+    void submit(std::vector<Job> &&jobs_new) {
+        if (jobs_new.empty()) {
+            return;
+        }
+
+        in_flight_jobs += jobs_new.size();
+
+        const auto jobs {
+            std::make_shared<std::vector<Job>>(std::move(jobs_new))
+        };
+
+        for (size_t first = 0; first < jobs->size(); first += CHUNK_SIZE) {
+            const size_t last {std::min(jobs->size(), first + CHUNK_SIZE)};
+
+            workers.submit(
+                [this, jobs, first, last]() {
+                    run_chunk(jobs, first, last);
+                }
+            );
+        }
+    }
+
+    // Hand every result completed since the last drain to `fn`, as
+    // `fn(Result &&)`, on the calling thread. Returns the number of results.
+    template <typename F>
+    size_t drain(F &&fn) {
+        {
+            std::scoped_lock<std::mutex> lock(done_mu);
+
+            draining.swap(done);
+        }
+
+        for (auto &result : draining) {
+            fn(std::move(result));
+        }
+
+        const size_t count {draining.size()};
+
+        draining.clear();
+
+        return count;
+    }
+
+    // Jobs submitted whose results have not yet been completed. Completed
+    // results may still be awaiting `drain()`.
+    uint32_t in_flight() const {
+        return in_flight_jobs;
+    }
+};
+
+#endif
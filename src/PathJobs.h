@@ -0,0 +1,132 @@
+#ifndef PATHJOBS_H
+#define PATHJOBS_H
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "Map.h"
+#include "PathBufferPool.h"
+#include "PathJobQueue.h"
+#include "Trace.h"
+
+#include <entt/entt.hpp>
+
+// Asks `PathJobSystem` for a path from the entity's `Pos` to the given cell.
+struct PathRequest {
+    uint32_t x_end;
+    uint32_t y_end;
+};
+
+// Attached by `PathJobSystem` while an entity's request is being computed.
+struct PathPending {
+    uint32_t ticket;
+};
+
+// Attached by `PathJobSystem`, replacing the entity's `PathRequest`, once its
+// path is ready. The path runs from the end back to the start, and is empty
+// if the end is unreachable.
+struct PathResult {
+    PathBufferPool::Buffer path;
+};
+
+// Computes paths for entities asynchronously. Each `update()`, eg, once per
+// frame, dispatches every new `PathRequest` to background workers, and
+// attaches every path completed since the previous update as a `PathResult`.
+// The calling thread never waits on a search, so the cost of an update is
+// proportional to the requests and results it handles.
+//
+// A result is dropped if its entity was destroyed, or re-requested via
+// `request()`, while the search was in flight.
+//
+// See `PathJobQueue` for the restrictions on the map.
+template <typename map_t, typename Predicate>
+class PathJobSystem {
+private:
+    struct Tag {
+        entt::entity entity;
+        uint32_t ticket;
+    };
+
+    typedef PathJobQueue<map_t, Predicate, Tag> queue_t;
+
+    queue_t queue;
+
+    uint32_t next_ticket {0};
+
+public:
+    PathJobSystem(
+        map_t &map,
+        const Predicate &is_accessible,
+        const uint32_t num_threads = std::thread::hardware_concurrency()
+    ):
+        queue(map, is_accessible, num_threads)
+    {}
+
+    // Request a new path for the entity, superseding any request or result it
+    // already has.
+    static void request(
+        entt::registry &registry,
+        const entt::entity entity,
+        const uint32_t x_end,
+        const uint32_t y_end
+    ) {
+        registry.remove<PathPending, PathResult>(entity);
+        registry.emplace_or_replace<PathRequest>(entity, x_end, y_end);
+    }
+
+    void update(entt::registry &registry) {
+        TRACE_SCOPE("PathJobSystem::update");
+
+        queue.drain(
+            [&](typename queue_t::Result &&result) {
+                const entt::entity entity {result.tag.entity};
+
+                if (!registry.valid(entity)) {
+                    return;
+                }
+
+                const PathPending *pending {registry.try_get<PathPending>(entity)};
+
+                if (pending == nullptr || pending->ticket != result.tag.ticket) {
+                    return;
+                }
+
+                registry.remove<PathRequest, PathPending>(entity);
+                registry.emplace_or_replace<PathResult>(
+                    entity, std::move(result.path)
+                );
+            }
+        );
+
+        const auto view {
+            registry.view<const Pos, const PathRequest>(entt::exclude<PathPending>)
+        };
+
+        std::vector<typename queue_t::Job> jobs;
+
+        for (const auto &[entity, pos, req] : view.each()) {
+            jobs.push_back(
+                {
+                    {entity, next_ticket++},
+                    static_cast<uint32_t>(pos.x), static_cast<uint32_t>(pos.y),
+                    req.x_end, req.y_end
+                }
+            );
+        }
+
+        // Tagged after the loop, since adding an excluded component would
+        // invalidate the view being iterated.
+        for (const auto &job : jobs) {
+            registry.emplace<PathPending>(job.tag.entity, job.tag.ticket);
+        }
+
+        queue.submit(std::move(jobs));
+    }
+
+    uint32_t in_flight() const {
+        return queue.in_flight();
+    }
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef PATHSCHEDULER_H
+#define PATHSCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include "Map.h"
+#include "Trace.h"
+
+// Runs many time-sliced path queries (see `Pathfind::get_path_sliced()`)
+// under a fixed per-tick budget, eg, once per frame, so that no single tick
+// pays for a long search.
+//
+// In-flight queries are served round-robin: each tick splits its expansion
+// budget evenly between them, resuming each in turn from where the previous
+// tick left off, until either the budget or the tick's time allowance is
+// spent. A query that finishes hands its path to its callback, from within
+// `tick()`.
+//
+// The map must outlive the scheduler, and must not be edited while queries
+// are in flight.
+template <typename map_t, typename Predicate>
+class PathScheduler {
+public:
+    typedef Pathfind<map_t, Predicate> pathfind_t;
+    typedef typename pathfind_t::path_t path_t;
+
+    struct TickStats {
+        // Queries given a slice during the tick.
+        uint32_t resumed {0};
+        // Queries that completed during the tick.
+        uint32_t completed {0};
+        uint32_t expanded {0};
+    };
+
+private:
+    // Slices smaller than this are not worth the resume overhead.
+    static inline const uint32_t MIN_SLICE_EXPANSIONS {64};
+
+    struct Query {
+        const uint64_t id;
+        typename pathfind_t::SliceBudget budget;
+        std::unique_ptr<pathfind_t> pathfinder;
+        Resumable<path_t> task;
+        std::function<void(path_t &&)> on_done;
+
+        Query(
+            const uint64_t id,
+            std::unique_ptr<pathfind_t> &&pathfinder,
+            std::function<void(path_t &&)> &&on_done
+        ):
+            id(id),
+            pathfinder(std::move(pathfinder)),
+            task(this->pathfinder->get_path_sliced(budget)),
+            on_done(std::move(on_done))
+        {}
+    };
+
+    map_t &map;
+    const Predicate &is_accessible;
+    const OccupancyLayer *const occupancy;
+
+    // Each query is heap-allocated so that its pathfinder and budget stay put
+    // while its coroutine refers to them.
+    std::deque<std::unique_ptr<Query>> queries;
+
+    uint64_t next_id {1};
+
+public:
+    // If an `occupancy` layer is given, every query steers around the agents
+    // in it. The layer may be updated between ticks; each query sees the
+    // costs as they stand when its search reaches a cell.
+    PathScheduler(
+        map_t &map,
+        const Predicate &is_accessible,
+        const OccupancyLayer *occupancy = nullptr
+    ):
+        map(map),
+        is_accessible(is_accessible),
+        occupancy(occupancy)
+    {}
+
+    // Queue a query. Returns an id which may be passed to `cancel()`. If an
+    // `observer` is given, it sees this query's search as it progresses.
+    uint64_t submit(
+        const uint32_t x_start,
+        const uint32_t y_start,
+        const uint32_t x_end,
+        const uint32_t y_end,
+        std::function<void(path_t &&)> &&on_done,
+        SearchObserver *observer = nullptr
+    ) {
+        const uint64_t id {next_id++};
+
+        queries.push_back(
+            std::make_unique<Query>(
+                id,
+                std::make_unique<pathfind_t>(
+                    map, x_start, y_start, x_end, y_end, is_accessible,
+                    PathfindOptions {.observer = observer, .occupancy = occupancy}
+                ),
+                std::move(on_done)
+            )
+        );
+
+        return id;
+    }
+
+    // Abandon an in-flight query; its callback is never invoked. Returns
+    // false if there is no such query, eg, because it already completed.
+    bool cancel(const uint64_t id) {
+        return std::erase_if(
+            queries,
+            [=](const auto &query) {
+                return query->id == id;
+            }
+        ) > 0;
+    }
+
+    // Advance the in-flight queries by at most `max_expansions` node
+    // expansions in total, stopping early once `max_time` has elapsed.
+    TickStats tick(
+        const uint32_t max_expansions,
+        const std::chrono::microseconds max_time
+    ) {
+        TRACE_SCOPE("PathScheduler::tick");
+
+        TickStats stats;
+
+        const auto deadline {std::chrono::steady_clock::now() + max_time};
+
+        uint32_t remaining {max_expansions};
+
+        // Visit each query at most once, so that a query is never resumed
+        // twice in a tick while another waits.
+        for (
+            size_t visits = queries.size();
+            visits > 0 && remaining > 0 &&
+                std::chrono::steady_clock::now() < deadline;
+            --visits
+        ) {
+            std::unique_ptr<Query> query {std::move(queries.front())};
+
+            queries.pop_front();
+
+            query->budget.max_expansions = std::min(
+                remaining,
+                std::max(MIN_SLICE_EXPANSIONS, remaining / static_cast<uint32_t>(visits))
+            );
+            query->budget.deadline = deadline;
+
+            const bool done {query->task.resume()};
+
+            ++stats.resumed;
+            stats.expanded += query->budget.expanded;
+            remaining -= std::min(remaining, query->budget.expanded);
+
+            if (done) {
+                ++stats.completed;
+
+                query->on_done(query->task.take_result());
+            }
+            else {
+                queries.push_back(std::move(query));
+            }
+        }
+
+        return stats;
+    }
+
+    size_t in_flight() const {
+        return queries.size();
+    }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "PathServer.h"
+
+void ServerConnection::write_responses() {
+    trace_set_thread_name("connection writer");
+
+    bool failed {false};
+
+    std::unique_lock<std::mutex> lock(write_mu);
+
+    while (true) {
+        write_cv.wait(
+            lock,
+            [&]() {
+                return !frames.empty() || (reader_done && outstanding == 0);
+            }
+        );
+
+        if (frames.empty()) {
+            return;
+        }
+
+        const std::vector<unsigned char> frame {std::move(frames.front())};
+
+        frames.pop_front();
+
+        lock.unlock();
+
+        // A failed write means the client went away; its reader will notice
+        // and wind down the connection. The rest of the responses are
+        // dropped.
+        failed = failed || !write_all(fd, frame.data(), frame.size());
+
+        inflight.release();
+
+        lock.lock();
+
+        --outstanding;
+    }
+}
+
+void ServerBatch::send_response() {
+    TRACE_SCOPE("send_response");
+
+    std::vector<unsigned char> frame;
+
+    // Placeholder for the length prefix.
+    append_u32(frame, 0);
+    append_u32(frame, batch_id);
+    append_u32(frame, queries.size());
+
+    for (const auto &path : paths) {
+        encode_path(frame, path);
+    }
+
+    const uint32_t payload_size = frame.size() - 4;
+
+    for (uint32_t i = 0; i < 4; ++i) {
+        frame[i] = static_cast<unsigned char>(payload_size >> (i * 8));
+    }
+
+    {
+        std::scoped_lock<std::mutex> lock(conn->write_mu);
+
+        conn->frames.push_back(std::move(frame));
+    }
+
+    conn->write_cv.notify_one();
+}
@@ -0,0 +1,317 @@
+#ifndef PATHSERVER_H
+#define PATHSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Log.h"
+#include "Map.h"
+#include "QueryProtocol.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+
+// One client of a `PathServer`. Shared by its reader thread, its writer
+// thread, and the batches it has in flight; the socket is closed once all of
+// them are done with it.
+struct ServerConnection {
+    // Batches a connection may have in flight before its reader stops reading
+    // further requests.
+    static inline const uint32_t MAX_INFLIGHT_BATCHES {64};
+
+    const int fd;
+
+    // Set once both its reader and writer are done.
+    std::atomic<bool> done {false};
+    std::counting_semaphore<MAX_INFLIGHT_BATCHES> inflight {
+        MAX_INFLIGHT_BATCHES
+    };
+
+    // Guards the rest.
+    std::mutex write_mu;
+    std::condition_variable write_cv;
+    // Responses for the writer to send, in order of completion.
+    std::deque<std::vector<unsigned char>> frames;
+    // Batches read but not yet written.
+    uint32_t outstanding {0};
+    bool reader_done {false};
+
+    ServerConnection(const int fd):
+        fd(fd)
+    {}
+
+    ~ServerConnection() {
+        ::close(fd);
+    }
+
+    // Write out the responses until the reader is done, and every batch it
+    // read has been answered.
+    void write_responses();
+};
+
+// A request batch, until its response has been queued.
+struct ServerBatch {
+    const std::shared_ptr<ServerConnection> conn;
+    const uint32_t batch_id;
+    const std::vector<PathQuery> queries;
+
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> paths;
+    std::atomic<uint32_t> remaining;
+
+    ServerBatch(
+        std::shared_ptr<ServerConnection> conn,
+        const uint32_t batch_id,
+        std::vector<PathQuery> &&queries
+    ):
+        conn(std::move(conn)),
+        batch_id(batch_id),
+        queries(std::move(queries)),
+        paths(this->queries.size()),
+        remaining(this->queries.size())
+    {}
+
+    // Queue the response for the connection's writer.
+    void send_response();
+};
+
+// Answers batches of path queries over a Unix domain socket (see
+// `QueryProtocol.h`). Cells are open unless blocking.
+//
+// Each connection has a reader thread that decodes request batches and fans
+// them out to a shared worker pool in chunks, without waiting for earlier
+// batches to complete, so that a client may pipeline many batches. Whichever
+// worker completes the last chunk of a batch queues its response for the
+// connection's writer thread, so responses may arrive out of order; clients
+// match them up by batch id. Only the writer blocks on the socket, so a client
+// that stops reading stalls nothing but its own connection.
+//
+// Every region of the map is colored, and the socket is listening, once this
+// is constructed; the map must not be edited while it serves.
+template <typename map_t>
+class PathServer {
+private:
+    // Queries per worker pool task. Large enough to amortize the task
+    // overhead, small enough to spread a batch across the pool.
+    static inline const uint32_t CHUNK_SIZE {16};
+
+    // Each search is sized for this many cells to start with, rather than
+    // the entire map.
+    static inline const uint32_t QUERY_RESERVE {4096};
+
+    static inline const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    map_t &map;
+    const std::string socket_path;
+
+    WorkerPool pool;
+
+    int listen_fd {-1};
+
+    void run_chunk(
+        const std::shared_ptr<ServerBatch> &batch,
+        const uint32_t first,
+        const uint32_t last
+    ) {
+        TRACE_SCOPE("query chunk");
+
+        for (uint32_t i = first; i < last; ++i) {
+            const PathQuery &query {batch->queries[i]};
+
+            if (
+                query.x_start >= map.width || query.y_start >= map.height ||
+                query.x_end >= map.width || query.y_end >= map.height
+            ) {
+                continue;
+            }
+
+            Pathfind<map_t, decltype(block_lamb)> pathfinder(
+                map,
+                query.x_start, query.y_start,
+                query.x_end, query.y_end,
+                block_lamb,
+                {.reserve_hint = QUERY_RESERVE}
+            );
+
+            batch->paths[i] = pathfinder.get_path();
+        }
+
+        const uint32_t count {last - first};
+
+        if (batch->remaining.fetch_sub(count) == count) {
+            batch->send_response();
+        }
+    }
+
+    void handle_connection(std::shared_ptr<ServerConnection> conn) {
+        trace_set_thread_name("connection reader");
+
+        std::thread writer(&ServerConnection::write_responses, conn.get());
+
+        std::vector<unsigned char> payload;
+
+        while (read_frame(conn->fd, payload)) {
+            uint32_t batch_id;
+            std::vector<PathQuery> queries;
+
+            try {
+                std::tie(batch_id, queries) = decode_request(payload);
+            } catch (std::exception& e) {
+                LOG_WARN("Dropping connection: %s", e.what());
+
+                break;
+            }
+
+            conn->inflight.acquire();
+
+            {
+                std::scoped_lock<std::mutex> lock(conn->write_mu);
+
+                ++conn->outstanding;
+            }
+
+            auto batch {
+                std::make_shared<ServerBatch>(conn, batch_id, std::move(queries))
+            };
+
+            const uint32_t count = batch->queries.size();
+
+            if (count == 0) {
+                batch->send_response();
+
+                continue;
+            }
+
+            for (uint32_t first = 0; first < count; first += CHUNK_SIZE) {
+                const uint32_t last {std::min(count, first + CHUNK_SIZE)};
+
+                pool.submit(
+                    [this, batch, first, last]() {
+                        run_chunk(batch, first, last);
+                    }
+                );
+            }
+        }
+
+        // Outstanding batches keep the connection (and its fd) alive until
+        // their responses have been attempted.
+        {
+            std::scoped_lock<std::mutex> lock(conn->write_mu);
+
+            conn->reader_done = true;
+        }
+
+        conn->write_cv.notify_one();
+
+        writer.join();
+
+        conn->done = true;
+    }
+
+public:
+    // Throws std::runtime_error if the socket cannot be listened on.
+    PathServer(map_t &map, const std::string &socket_path, const uint32_t threads):
+        map(map),
+        socket_path(socket_path),
+        pool(threads)
+    {
+        const auto start_color = std::chrono::steady_clock::now();
+
+        // Pathfinding only ever writes to the map to record newly-found
+        // regions, so coloring everything up front makes the map safe to
+        // share between the workers.
+        RegionColorer<map_t, decltype(block_lamb)>::color_all_regions(
+            map, block_lamb
+        );
+
+        const auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_color
+        );
+
+        LOG_INFO("Colored regions in [%lld] ms", static_cast<long long>(dur.count()));
+
+        listen_fd = listen_unix(socket_path);
+    }
+
+    PathServer(const PathServer &) = delete;
+    PathServer &operator=(const PathServer &) = delete;
+
+    ~PathServer() {
+        ::close(listen_fd);
+        ::unlink(socket_path.c_str());
+    }
+
+    // Serve connections until `stop_requested` is set, then disconnect every
+    // client, including any that stopped reading, and return once their
+    // threads have finished.
+    void serve(const std::atomic<bool> &stop_requested) {
+        LOG_INFO(
+            "Serving [%ux%u] map on [%s] with [%u] workers",
+            map.width, map.height, socket_path.c_str(), pool.size()
+        );
+
+        std::vector<std::pair<std::shared_ptr<ServerConnection>, std::thread>> conns;
+
+        while (!stop_requested) {
+            // Reap connections whose clients have gone away.
+            std::erase_if(
+                conns,
+                [](auto &conn) {
+                    if (conn.first->done) {
+                        conn.second.join();
+
+                        return true;
+                    }
+
+                    return false;
+                }
+            );
+
+            pollfd pfd {listen_fd, POLLIN, 0};
+
+            if (::poll(&pfd, 1, 200) <= 0) {
+                continue;
+            }
+
+            const int fd {::accept(listen_fd, nullptr, nullptr)};
+
+            if (fd < 0) {
+                continue;
+            }
+
+            auto conn {std::make_shared<ServerConnection>(fd)};
+
+            conns.emplace_back(
+                conn, std::thread(&PathServer::handle_connection, this, conn)
+            );
+        }
+
+        LOG_INFO("Shutting down...");
+
+        // Wake any readers blocked on their sockets, and any writers blocked
+        // on clients that stopped reading.
+        for (const auto &conn : conns) {
+            ::shutdown(conn.first->fd, SHUT_RDWR);
+        }
+
+        for (auto &conn : conns) {
+            conn.second.join();
+        }
+    }
+};
+
+#endif
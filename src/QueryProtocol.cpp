@@ -0,0 +1,282 @@
+#include "QueryProtocol.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    sockaddr_un make_addr(const std::string &path) {
+        sockaddr_un addr {};
+
+        if (path.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("Socket path too long: " + path);
+        }
+
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        return addr;
+    }
+
+    uint8_t direction_code(const int32_t d_x, const int32_t d_y) {
+        for (uint8_t code = 0; code < 8; ++code) {
+            if (DIRECTIONS[code].first == d_x && DIRECTIONS[code].second == d_y) {
+                return code;
+            }
+        }
+
+        throw std::runtime_error("Path contains a non-adjacent step");
+    }
+}
+
+void append_u32(std::vector<unsigned char> &out, const uint32_t value) {
+    const unsigned char bytes[4] {
+        static_cast<unsigned char>(value),
+        static_cast<unsigned char>(value >> 8),
+        static_cast<unsigned char>(value >> 16),
+        static_cast<unsigned char>(value >> 24),
+    };
+
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+uint32_t consume_u32(const unsigned char *&cursor, const unsigned char *end) {
+    if (end - cursor < 4) {
+        throw std::runtime_error("Truncated message");
+    }
+
+    const uint32_t value {
+        static_cast<uint32_t>(cursor[0]) |
+        static_cast<uint32_t>(cursor[1]) << 8 |
+        static_cast<uint32_t>(cursor[2]) << 16 |
+        static_cast<uint32_t>(cursor[3]) << 24
+    };
+
+    cursor += 4;
+
+    return value;
+}
+
+std::vector<unsigned char> encode_request(
+    const uint32_t batch_id, const std::vector<PathQuery> &queries
+) {
+    std::vector<unsigned char> frame;
+
+    frame.reserve(12 + queries.size() * sizeof(PathQuery));
+
+    append_u32(frame, 8 + queries.size() * sizeof(PathQuery));
+    append_u32(frame, batch_id);
+    append_u32(frame, queries.size());
+
+    for (const auto &query : queries) {
+        append_u32(frame, query.x_start);
+        append_u32(frame, query.y_start);
+        append_u32(frame, query.x_end);
+        append_u32(frame, query.y_end);
+    }
+
+    return frame;
+}
+
+std::pair<uint32_t, std::vector<PathQuery>> decode_request(
+    const std::vector<unsigned char> &payload
+) {
+    const unsigned char *cursor {payload.data()};
+    const unsigned char *end {payload.data() + payload.size()};
+
+    const uint32_t batch_id {consume_u32(cursor, end)};
+    const uint32_t count {consume_u32(cursor, end)};
+
+    if (static_cast<size_t>(end - cursor) != count * sizeof(PathQuery)) {
+        throw std::runtime_error("Request length does not match query count");
+    }
+
+    std::vector<PathQuery> queries(count);
+
+    for (auto &query : queries) {
+        query.x_start = consume_u32(cursor, end);
+        query.y_start = consume_u32(cursor, end);
+        query.x_end = consume_u32(cursor, end);
+        query.y_end = consume_u32(cursor, end);
+    }
+
+    return {batch_id, std::move(queries)};
+}
+
+void encode_path(
+    std::vector<unsigned char> &out,
+    const std::vector<std::pair<uint32_t, uint32_t>> &path
+) {
+    append_u32(out, path.size());
+
+    if (path.empty()) {
+        return;
+    }
+
+    // The path is ordered from end to start, so walk it backwards.
+    append_u32(out, path.back().first);
+    append_u32(out, path.back().second);
+
+    for (size_t i = path.size() - 1; i > 0; --i) {
+        const auto [x_from, y_from] = path[i];
+        const auto [x_to, y_to] = path[i - 1];
+
+        out.push_back(
+            direction_code(
+                static_cast<int32_t>(x_to) - static_cast<int32_t>(x_from),
+                static_cast<int32_t>(y_to) - static_cast<int32_t>(y_from)
+            )
+        );
+    }
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> decode_path(
+    const unsigned char *&cursor, const unsigned char *end
+) {
+    const uint32_t count {consume_u32(cursor, end)};
+
+    std::vector<std::pair<uint32_t, uint32_t>> path;
+
+    if (count == 0) {
+        return path;
+    }
+
+    if (static_cast<size_t>(end - cursor) < 8 + (count - 1)) {
+        throw std::runtime_error("Truncated path");
+    }
+
+    path.reserve(count);
+
+    uint32_t x {consume_u32(cursor, end)};
+    uint32_t y {consume_u32(cursor, end)};
+
+    path.emplace_back(x, y);
+
+    for (uint32_t i = 1; i < count; ++i) {
+        const uint8_t code {*cursor++};
+
+        if (code >= 8) {
+            throw std::runtime_error("Invalid direction code");
+        }
+
+        x += DIRECTIONS[code].first;
+        y += DIRECTIONS[code].second;
+
+        path.emplace_back(x, y);
+    }
+
+    return path;
+}
+
+bool read_exact(const int fd, void *buf, const size_t size) {
+    size_t done {0};
+
+    while (done < size) {
+        const ssize_t got {
+            ::read(fd, static_cast<unsigned char *>(buf) + done, size - done)
+        };
+
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (got <= 0) {
+            return false;
+        }
+
+        done += got;
+    }
+
+    return true;
+}
+
+bool write_all(const int fd, const void *buf, const size_t size) {
+    size_t done {0};
+
+    while (done < size) {
+        const ssize_t put {
+            ::send(
+                fd,
+                static_cast<const unsigned char *>(buf) + done,
+                size - done,
+                MSG_NOSIGNAL
+            )
+        };
+
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (put <= 0) {
+            return false;
+        }
+
+        done += put;
+    }
+
+    return true;
+}
+
+bool read_frame(const int fd, std::vector<unsigned char> &payload) {
+    unsigned char prefix[4];
+
+    if (!read_exact(fd, prefix, sizeof(prefix))) {
+        return false;
+    }
+
+    const unsigned char *cursor {prefix};
+    const uint32_t size {consume_u32(cursor, prefix + sizeof(prefix))};
+
+    if (size > MAX_FRAME_SIZE) {
+        return false;
+    }
+
+    payload.resize(size);
+
+    return read_exact(fd, payload.data(), size);
+}
+
+int listen_unix(const std::string &path) {
+    const sockaddr_un addr {make_addr(path)};
+
+    const int fd {::socket(AF_UNIX, SOCK_STREAM, 0)};
+
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create socket");
+    }
+
+    ::unlink(path.c_str());
+
+    if (
+        ::bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0
+    ) {
+        ::close(fd);
+
+        throw std::runtime_error("Failed to listen on socket: " + path);
+    }
+
+    return fd;
+}
+
+int connect_unix(const std::string &path) {
+    const sockaddr_un addr {make_addr(path)};
+
+    const int fd {::socket(AF_UNIX, SOCK_STREAM, 0)};
+
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create socket");
+    }
+
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+
+        throw std::runtime_error("Failed to connect to socket: " + path);
+    }
+
+    return fd;
+}
@@ -0,0 +1,89 @@
+#ifndef QUERYPROTOCOL_H
+#define QUERYPROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Wire protocol for the headless query server.
+//
+// Every message is a frame: a uint32_t payload length followed by the
+// payload. All integers are little-endian.
+//
+// Request payload:
+//
+//   uint32_t batch_id
+//   uint32_t count
+//   count * { uint32_t x_start, y_start, x_end, y_end }
+//
+// Response payload:
+//
+//   uint32_t batch_id
+//   uint32_t count
+//   count * encoded path, in request order
+//
+// An encoded path is a uint32_t point count, then, if non-zero, the uint32_t
+// x and y of the first point, then one direction code byte per subsequent
+// step (see `DIRECTIONS`). Points are in travel order, from start to end. A
+// point count of zero means no path (including when start and end coincide,
+// matching `Pathfind::get_path()`).
+
+struct PathQuery {
+    uint32_t x_start;
+    uint32_t y_start;
+    uint32_t x_end;
+    uint32_t y_end;
+};
+
+// Frames larger than this are rejected as malformed.
+const uint32_t MAX_FRAME_SIZE {64 * 1024 * 1024};
+
+// Step offsets, indexed by direction code.
+const std::pair<int32_t, int32_t> DIRECTIONS[8] {
+    { 1,  0}, { 1,  1}, { 0,  1}, {-1,  1},
+    {-1,  0}, {-1, -1}, { 0, -1}, { 1, -1},
+};
+
+void append_u32(std::vector<unsigned char> &out, const uint32_t value);
+
+// Reads a uint32_t at `cursor`, advancing it. Throws std::runtime_error if
+// that would pass `end`.
+uint32_t consume_u32(const unsigned char *&cursor, const unsigned char *end);
+
+// Builds a complete request frame, including the length prefix.
+std::vector<unsigned char> encode_request(
+    const uint32_t batch_id, const std::vector<PathQuery> &queries
+);
+
+// Parses a request payload (without the length prefix).
+std::pair<uint32_t, std::vector<PathQuery>> decode_request(
+    const std::vector<unsigned char> &payload
+);
+
+// Appends the encoding of a path, as returned by `Pathfind::get_path()`, ie,
+// ordered from end to start.
+void encode_path(
+    std::vector<unsigned char> &out,
+    const std::vector<std::pair<uint32_t, uint32_t>> &path
+);
+
+// Decodes a path, returning its points in travel order.
+std::vector<std::pair<uint32_t, uint32_t>> decode_path(
+    const unsigned char *&cursor, const unsigned char *end
+);
+
+// Blocking socket helpers. These return false on EOF or error.
+bool read_exact(const int fd, void *buf, const size_t size);
+bool write_all(const int fd, const void *buf, const size_t size);
+
+// Reads one frame's payload. Returns false on EOF, error or oversize frame.
+bool read_frame(const int fd, std::vector<unsigned char> &payload);
+
+// Throws std::runtime_error on failure. `listen_unix()` replaces any stale
+// socket file at `path`.
+int listen_unix(const std::string &path);
+int connect_unix(const std::string &path);
+
+#endif
@@ -0,0 +1,600 @@
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "ClearanceLayer.h"
+#include "Map.h"
+#include "Terrain.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Answers "which cells can be reached from here for at most this cost"
+// queries, eg, for movement ranges, with the same step costs and corner rule
+// as `Pathfind`.
+//
+// Each query is a Dijkstra search bounded by its cost, which writes into a
+// buffer owned by the caller: either a dense per-cell cost buffer, or a bitset
+// of one bit per cell. All scratch space lives in the `Reachability` and is
+// reused, so once the first few queries have grown it, queries never
+// allocate, and thousands can run per frame.
+//
+// When every open cell within range costs the same to enter, as on open
+// ground, the query instead runs as a bit-parallel wavefront: the reached
+// cells are kept one bit per cell, and each step grows the whole wavefront by
+// one cell, 64 cells per word operation. To find such areas cheaply, the
+// `Reachability` keeps bitsets of the open cells and of the cells whose cost
+// differs from open ground's, which `update()` refreshes after the map
+// changes.
+//
+// Not thread-safe; use one per thread.
+template <typename map_t, typename Predicate>
+class Reachability : public MapExplorer<map_t, Predicate, Reachability> {
+public:
+    // The cells written by a query: every reached cell lies within
+    // [x_min, x_max] x [y_min, y_max]. Empty if nothing was reached, ie, the
+    // start is inaccessible.
+    struct Range {
+        uint32_t x_min {1};
+        uint32_t y_min {1};
+        uint32_t x_max {0};
+        uint32_t y_max {0};
+
+        // The number of reached cells.
+        uint32_t count {0};
+
+        bool empty() const {
+            return x_min > x_max;
+        }
+    };
+
+    struct ExploredNode {
+        uint32_t idx;
+        float cost;
+
+        friend bool operator>(const ExploredNode &lhs, const ExploredNode &rhs) {
+            return lhs.cost > rhs.cost;
+        }
+    };
+
+private:
+    static inline const uint32_t WORD_BITS {64};
+
+    map_t &map;
+
+    const TerrainCosts terrain_costs;
+
+    // If given, accessibility is read from here instead of `is_accessible`.
+    const ClearanceLayer *const clearance;
+    const uint8_t agent_size;
+
+    const uint32_t words_per_row;
+
+    // One bit per cell, row by row, each row starting on a fresh word.
+    std::vector<uint64_t> open_bits;
+    std::vector<uint64_t> costly_bits;
+
+    // Bitsets for the wavefront, and a dense cost buffer for searches whose
+    // caller wants a bitset. Untouched cells of `scratch_costs` are infinite.
+    std::vector<uint64_t> wave;
+    std::vector<uint64_t> wave_next;
+    std::vector<float> scratch_costs;
+
+    // The current search.
+    std::vector<ExploredNode> to_explore;
+    std::vector<uint32_t> touched;
+    ExploredNode expanding {0, 0};
+    float *costs {nullptr};
+    float max_cost {0};
+    Range range;
+
+    void set_bit(
+        std::vector<uint64_t> &bits, const uint32_t x, const uint32_t y, const bool value
+    ) const {
+        uint64_t &word {bits[y * words_per_row + x / WORD_BITS]};
+        const uint64_t mask {uint64_t{1} << (x % WORD_BITS)};
+
+        word = value ? (word | mask) : (word & ~mask);
+    }
+
+    void include(const uint32_t x, const uint32_t y) {
+        if (range.empty()) {
+            range.x_min = range.x_max = x;
+            range.y_min = range.y_max = y;
+
+            return;
+        }
+
+        range.x_min = std::min(range.x_min, x);
+        range.y_min = std::min(range.y_min, y);
+        range.x_max = std::max(range.x_max, x);
+        range.y_max = std::max(range.y_max, y);
+    }
+
+    // The number of uniform steps affordable for `max_cost`, or 0 if the area
+    // within that many steps of (x, y) is not uniform, in which case the
+    // search must fall back to Dijkstra.
+    uint32_t get_uniform_steps(
+        const uint32_t x, const uint32_t y, const float max_cost
+    ) const;
+
+    // Grow the wavefront from (x, y) by `steps`, into `wave`, calling
+    // `on_reached(x, y, step)` for every cell as it is first reached.
+    template <typename F>
+    void run_wavefront(
+        const uint32_t x, const uint32_t y, const uint32_t steps, F &&on_reached
+    );
+
+    void run_dijkstra(const uint32_t x, const uint32_t y);
+
+public:
+    const Predicate &is_accessible;
+
+    bool can_enter(const uint32_t idx) const {
+        if (clearance) {
+            return clearance->fits(idx, agent_size);
+        }
+
+        return is_accessible(map.get_nodes()[idx]);
+    }
+
+    void push_node(const uint32_t idx, const ExploredNode &parent) {
+        const float cost {
+            parent.cost + terrain_costs[map.get_nodes()[idx].get_terrain()]
+        };
+
+        if (cost > max_cost || cost >= costs[idx]) {
+            return;
+        }
+
+        if (costs[idx] == INFINITY) {
+            touched.push_back(idx);
+        }
+
+        costs[idx] = cost;
+
+        to_explore.push_back({idx, cost});
+        std::push_heap(
+            to_explore.begin(), to_explore.end(), std::greater<ExploredNode>{}
+        );
+    }
+
+    // The search pops the node before expanding it, so there is nothing left
+    // to do here.
+    void pop_node() {}
+
+    const ExploredNode &get_next_node() const {
+        return expanding;
+    }
+
+    uint32_t get_map_width() const {
+        return map.width;
+    }
+
+    uint32_t get_map_height() const {
+        return map.height;
+    }
+
+    // As for `Pathfind`, cells cost `terrain_costs` of their terrain class to
+    // enter, and a `clearance` layer, computed with `is_accessible`, makes the
+    // queries those of an agent of `agent_size`.
+    Reachability(
+        map_t &map,
+        const Predicate &is_accessible,
+        const TerrainCosts &terrain_costs = DEFAULT_TERRAIN_COSTS,
+        const ClearanceLayer *clearance = nullptr,
+        const uint8_t agent_size = 1
+    ):
+        map(map),
+        terrain_costs(terrain_costs),
+        clearance(clearance),
+        agent_size(agent_size),
+        words_per_row((map.width + WORD_BITS - 1) / WORD_BITS),
+        open_bits(get_bitset_words()),
+        costly_bits(get_bitset_words()),
+        wave(get_bitset_words()),
+        wave_next(get_bitset_words()),
+        scratch_costs(get_node_count(map.width, map.height), INFINITY),
+        is_accessible(is_accessible)
+    {
+        assert(clearance || agent_size == 1);
+
+        update(0, 0, map.width - 1, map.height - 1);
+    }
+
+    // The size of a bitset for `cells_within()`.
+    uint32_t get_bitset_words() const {
+        return words_per_row * map.height;
+    }
+
+    bool test(
+        const std::vector<uint64_t> &bits, const uint32_t x, const uint32_t y
+    ) const {
+        return bits[y * words_per_row + x / WORD_BITS] >> (x % WORD_BITS) & 1;
+    }
+
+    // Refresh the cached accessibility and costs of the cells in the
+    // rectangle [x_min, x_max] x [y_min, y_max], after they changed. With a
+    // clearance layer, pass the cells edited in the map; the cells up and to
+    // the left whose clearance the edit changed are refreshed too.
+    void update(
+        uint32_t x_min, uint32_t y_min, const uint32_t x_max, const uint32_t y_max
+    ) {
+        if (clearance) {
+            x_min -= std::min<uint32_t>(x_min, agent_size - 1);
+            y_min -= std::min<uint32_t>(y_min, agent_size - 1);
+        }
+
+        const float cost_ground {terrain_costs[TERRAIN_GROUND]};
+
+        for (uint32_t y = y_min; y <= std::min(y_max, map.height - 1); ++y) {
+            for (uint32_t x = x_min; x <= std::min(x_max, map.width - 1); ++x) {
+                const uint32_t idx {get_node_index(x, y, map.width)};
+
+                set_bit(open_bits, x, y, can_enter(idx));
+                set_bit(
+                    costly_bits, x, y,
+                    terrain_costs[map.get_nodes()[idx].get_terrain()] != cost_ground
+                );
+            }
+        }
+    }
+
+    // Write the cost of reaching each cell within `max_cost` of (x, y) into
+    // `costs`, which holds `get_node_count()` entries, in node index order.
+    // Cells outside the returned range are left untouched, and cells within
+    // it that were not reached must already be infinite, so clear the range
+    // with `clear()` before reusing the buffer.
+    Range costs_within(
+        const uint32_t x,
+        const uint32_t y,
+        const float max_cost,
+        std::vector<float> &costs
+    );
+
+    // As `costs_within()`, but sets the bit of each reached cell in `bits`,
+    // which holds `get_bitset_words()` words, and must be clear within the
+    // returned range.
+    Range cells_within(
+        const uint32_t x,
+        const uint32_t y,
+        const float max_cost,
+        std::vector<uint64_t> &bits
+    );
+
+    // Reset the cells within `range`, and only those, for reuse.
+    void clear(std::vector<float> &costs, const Range &range) const {
+        for (uint32_t y = range.y_min; y <= range.y_max && !range.empty(); ++y) {
+            // Each row of the range is contiguous only in a row-major layout.
+            if constexpr (std::is_same_v<CellLayout, RowMajorLayout>) {
+                std::fill(
+                    costs.begin() + get_node_index(range.x_min, y, map.width),
+                    costs.begin() + get_node_index(range.x_max, y, map.width) + 1,
+                    INFINITY
+                );
+            }
+            else {
+                for (uint32_t x = range.x_min; x <= range.x_max; ++x) {
+                    costs[get_node_index(x, y, map.width)] = INFINITY;
+                }
+            }
+        }
+    }
+
+    void clear(std::vector<uint64_t> &bits, const Range &range) const {
+        if (range.empty()) {
+            return;
+        }
+
+        // The bits of the first and last words of each row that are in range.
+        const uint64_t mask_first {~uint64_t {0} << (range.x_min % WORD_BITS)};
+        const uint64_t mask_last {~uint64_t {0} >> (WORD_BITS - 1 - range.x_max % WORD_BITS)};
+
+        const uint32_t word_first {range.x_min / WORD_BITS};
+        const uint32_t word_last {range.x_max / WORD_BITS};
+
+        for (uint32_t y = range.y_min; y <= range.y_max; ++y) {
+            uint64_t *const row {bits.data() + y * words_per_row};
+
+            if (word_first == word_last) {
+                row[word_first] &= ~(mask_first & mask_last);
+
+                continue;
+            }
+
+            row[word_first] &= ~mask_first;
+
+            std::fill(row + word_first + 1, row + word_last, 0);
+
+            row[word_last] &= ~mask_last;
+        }
+    }
+};
+
+template <typename map_t, typename Predicate>
+uint32_t Reachability<map_t, Predicate>::get_uniform_steps(
+    const uint32_t x, const uint32_t y, const float max_cost
+) const {
+    const float cost_step {terrain_costs[TERRAIN_GROUND]};
+
+    if (cost_step <= 0) {
+        return 0;
+    }
+
+    uint32_t steps {static_cast<uint32_t>(
+        std::min<float>(max_cost / cost_step, std::max(map.width, map.height))
+    )};
+
+    // Agree exactly with the sums of step costs that Dijkstra would compare.
+    while (steps > 0 && steps * cost_step > max_cost) {
+        --steps;
+    }
+
+    const uint32_t x_min {x - std::min(x, steps)};
+    const uint32_t y_min {y - std::min(y, steps)};
+    const uint32_t x_max {std::min(x + steps, map.width - 1)};
+    const uint32_t y_max {std::min(y + steps, map.height - 1)};
+
+    for (uint32_t y_row = y_min; y_row <= y_max; ++y_row) {
+        const uint32_t row {y_row * words_per_row};
+
+        for (uint32_t word = x_min / WORD_BITS; word <= x_max / WORD_BITS; ++word) {
+            // Costly cells only matter if they are open; costly walls are
+            // just walls.
+            if (costly_bits[row + word] & open_bits[row + word]) {
+                return 0;
+            }
+        }
+    }
+
+    return steps;
+}
+
+template <typename map_t, typename Predicate>
+template <typename F>
+void Reachability<map_t, Predicate>::run_wavefront(
+    const uint32_t x, const uint32_t y, const uint32_t steps, F &&on_reached
+) {
+    TRACE_SCOPE("run_wavefront");
+
+    const uint32_t y_min {y - std::min(y, steps)};
+    const uint32_t y_max {std::min(y + steps, map.height - 1)};
+    const uint32_t word_min {(x - std::min(x, steps)) / WORD_BITS};
+    const uint32_t word_max {std::min(x + steps, map.width - 1) / WORD_BITS};
+
+    for (uint32_t y_row = y_min; y_row <= y_max; ++y_row) {
+        const uint32_t row {y_row * words_per_row};
+
+        std::fill(
+            wave.begin() + row + word_min, wave.begin() + row + word_max + 1, 0
+        );
+    }
+
+    set_bit(wave, x, y, true);
+    on_reached(x, y, 0);
+
+    const auto word_at = [&](
+        const std::vector<uint64_t> &bits, const uint32_t y_row, const uint32_t word
+    ) -> uint64_t {
+        if (y_row < y_min || y_row > y_max || word < word_min || word > word_max) {
+            return 0;
+        }
+
+        return bits[y_row * words_per_row + word];
+    };
+
+    for (uint32_t step = 1; step <= steps; ++step) {
+        // The wavefront can only have grown this far by now.
+        const uint32_t y_lo {std::max(y_min, y - std::min(y, step))};
+        const uint32_t y_hi {std::min(y_max, y + step)};
+
+        bool grew {false};
+
+        for (uint32_t y_row = y_lo; y_row <= y_hi; ++y_row) {
+            for (uint32_t word = word_min; word <= word_max; ++word) {
+                // The reached cells of the rows above and below that are
+                // open in this row's column, ie, that could step vertically
+                // into it, shifted by one cell either way for diagonal steps.
+                const auto vertical = [&](
+                    const uint32_t y_other, const uint32_t w
+                ) -> uint64_t {
+                    return word_at(wave, y_other, w) & word_at(open_bits, y_row, w);
+                };
+
+                // Shift a row one cell right, ie, towards higher x, and left.
+                const auto shifted = [&](const auto &get) -> uint64_t {
+                    return
+                        (get(word) << 1) | (get(word - 1) >> (WORD_BITS - 1)) |
+                        (get(word) >> 1) | (get(word + 1) << (WORD_BITS - 1));
+                };
+
+                const uint64_t open {word_at(open_bits, y_row, word)};
+                const uint64_t cur {word_at(wave, y_row, word)};
+
+                const auto same_row = [&](const uint32_t w) {
+                    return word_at(wave, y_row, w);
+                };
+                const auto from_above = [&](const uint32_t w) {
+                    return y_row > 0 ? vertical(y_row - 1, w) : 0;
+                };
+                const auto from_below = [&](const uint32_t w) {
+                    return vertical(y_row + 1, w);
+                };
+
+                const uint64_t above_open {
+                    y_row > 0 ? word_at(open_bits, y_row - 1, word) : 0
+                };
+                const uint64_t below_open {word_at(open_bits, y_row + 1, word)};
+
+                const uint64_t next {
+                    cur | (
+                        open & (
+                            shifted(same_row) |
+                            from_above(word) |
+                            from_below(word) |
+                            (shifted(from_above) & above_open) |
+                            (shifted(from_below) & below_open)
+                        )
+                    )
+                };
+
+                wave_next[y_row * words_per_row + word] = next;
+
+                for (uint64_t fresh = next & ~cur; fresh != 0; fresh &= fresh - 1) {
+                    on_reached(word * WORD_BITS + std::countr_zero(fresh), y_row, step);
+
+                    grew = true;
+                }
+            }
+        }
+
+        for (uint32_t y_row = y_lo; y_row <= y_hi; ++y_row) {
+            const uint32_t row {y_row * words_per_row};
+
+            std::copy(
+                wave_next.begin() + row + word_min,
+                wave_next.begin() + row + word_max + 1,
+                wave.begin() + row + word_min
+            );
+        }
+
+        if (!grew) {
+            break;
+        }
+    }
+}
+
+template <typename map_t, typename Predicate>
+void Reachability<map_t, Predicate>::run_dijkstra(const uint32_t x, const uint32_t y) {
+    TRACE_SCOPE("run_dijkstra");
+
+    const uint32_t idx_start {get_node_index(x, y, map.width)};
+
+    to_explore.clear();
+    touched.clear();
+
+    costs[idx_start] = 0;
+    touched.push_back(idx_start);
+    to_explore.push_back({idx_start, 0});
+
+    while (!to_explore.empty()) {
+        std::pop_heap(
+            to_explore.begin(), to_explore.end(), std::greater<ExploredNode>{}
+        );
+
+        expanding = to_explore.back();
+
+        to_explore.pop_back();
+
+        // Superseded by a cheaper entry since it was pushed.
+        if (expanding.cost > costs[expanding.idx]) {
+            continue;
+        }
+
+        this->gen_neighbors();
+    }
+
+    for (const uint32_t idx : touched) {
+        const auto [x_cell, y_cell] = get_node_xy(idx, map.width);
+
+        include(x_cell, y_cell);
+    }
+
+    range.count = touched.size();
+}
+
+template <typename map_t, typename Predicate>
+typename Reachability<map_t, Predicate>::Range
+Reachability<map_t, Predicate>::costs_within(
+    const uint32_t x, const uint32_t y, const float max_cost, std::vector<float> &costs
+) {
+    range = Range {};
+
+    if (!can_enter(get_node_index(x, y, map.width)) || max_cost < 0) {
+        return range;
+    }
+
+    if (const uint32_t steps {get_uniform_steps(x, y, max_cost)}) {
+        const float cost_step {terrain_costs[TERRAIN_GROUND]};
+
+        run_wavefront(
+            x, y, steps,
+            [&](const uint32_t x_cell, const uint32_t y_cell, const uint32_t step) {
+                costs[get_node_index(x_cell, y_cell, map.width)] = step * cost_step;
+
+                include(x_cell, y_cell);
+
+                ++range.count;
+            }
+        );
+
+        return range;
+    }
+
+    this->costs = costs.data();
+    this->max_cost = max_cost;
+
+    run_dijkstra(x, y);
+
+    return range;
+}
+
+template <typename map_t, typename Predicate>
+typename Reachability<map_t, Predicate>::Range
+Reachability<map_t, Predicate>::cells_within(
+    const uint32_t x, const uint32_t y, const float max_cost, std::vector<uint64_t> &bits
+) {
+    range = Range {};
+
+    if (!can_enter(get_node_index(x, y, map.width)) || max_cost < 0) {
+        return range;
+    }
+
+    if (const uint32_t steps {get_uniform_steps(x, y, max_cost)}) {
+        run_wavefront(
+            x, y, steps,
+            [&](const uint32_t x_cell, const uint32_t y_cell, const uint32_t) {
+                include(x_cell, y_cell);
+
+                ++range.count;
+            }
+        );
+
+        for (uint32_t y_row = range.y_min; y_row <= range.y_max; ++y_row) {
+            const uint32_t row {y_row * words_per_row};
+
+            for (
+                uint32_t word = range.x_min / WORD_BITS;
+                word <= range.x_max / WORD_BITS;
+                ++word
+            ) {
+                bits[row + word] |= wave[row + word];
+            }
+        }
+
+        return range;
+    }
+
+    this->costs = scratch_costs.data();
+    this->max_cost = max_cost;
+
+    run_dijkstra(x, y);
+
+    for (const uint32_t idx : touched) {
+        const auto [x_cell, y_cell] = get_node_xy(idx, map.width);
+
+        set_bit(bits, x_cell, y_cell, true);
+
+        scratch_costs[idx] = INFINITY;
+    }
+
+    return range;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "RectangleDecomposition.h"
+
+RectangleDecomposition::RectangleDecomposition(
+    const uint32_t width, const uint32_t height
+):
+    width(width),
+    height(height),
+    cell_class(get_node_count(width, height), BLOCKED_CLASS),
+    rect_of(get_node_count(width, height), NONE)
+{}
+
+void RectangleDecomposition::decompose(
+    const uint32_t x_min, const uint32_t y_min,
+    const uint32_t x_max, const uint32_t y_max
+) {
+    partition_rectangles(
+        width, cell_class, rect_of, NONE, x_min, y_min, x_max, y_max,
+        [&](
+            const uint32_t x_rect_min, const uint32_t y_rect_min,
+            const uint32_t x_rect_max, const uint32_t y_rect_max, uint8_t
+        ) {
+            const Rect rect {x_rect_min, y_rect_min, x_rect_max, y_rect_max};
+
+            if (free_ids.empty()) {
+                rects.push_back(rect);
+
+                return static_cast<uint32_t>(rects.size() - 1);
+            }
+
+            const uint32_t id {free_ids.back()};
+
+            free_ids.pop_back();
+
+            rects[id] = rect;
+
+            return id;
+        }
+    );
+}
+
+void RectangleDecomposition::dissolve(const uint32_t id) {
+    const Rect &rect {rects[id]};
+
+    for (uint32_t y = rect.y_min; y <= rect.y_max; ++y) {
+        for (uint32_t x = rect.x_min; x <= rect.x_max; ++x) {
+            rect_of[get_node_index(x, y, width)] = NONE;
+        }
+    }
+
+    free_ids.push_back(id);
+}
+
+void RectangleDecomposition::expand_path(path_t &path) {
+    thread_local path_t expanded;
+
+    expanded.clear();
+
+    for (uint32_t i = 0; i < path.size(); ++i) {
+        if (i == 0) {
+            expanded.push_back(path[i]);
+
+            continue;
+        }
+
+        // Macro edges only join cells of one rectangle, all open, so any
+        // path between them will do: diagonally until level, then straight.
+        auto [x, y] = path[i - 1];
+        const auto [x_to, y_to] = path[i];
+
+        while (x != x_to || y != y_to) {
+            x += (x < x_to) - (x > x_to);
+            y += (y < y_to) - (y > y_to);
+
+            expanded.emplace_back(x, y);
+        }
+    }
+
+    path.swap(expanded);
+}
@@ -0,0 +1,293 @@
+#ifndef RECTANGLEDECOMPOSITION_H
+#define RECTANGLEDECOMPOSITION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "RectanglePartition.h"
+#include "Util.h"
+
+// A decomposition of a map's open cells into empty rectangles, for
+// rectangular symmetry reduction: a search that only expands the perimeters
+// of the rectangles, and crosses them with macro edges, rather than expanding
+// every one of the many equal-cost paths through their interiors (see
+// `Pathfind`).
+//
+// Each rectangle holds cells of a single terrain class, so crossing it costs
+// the same per step throughout, and a macro edge between two of its cells
+// costs the Chebyshev distance between them times that cost, just as the
+// steps it stands for would.
+//
+// Rectangles are found greedily: from each uncovered open cell, in index
+// order, the rectangle is grown right as far as it can go, then down as far
+// as the whole row can go. After the map changes, `repair()` dissolves only
+// the rectangles overlapping the change and decomposes their cells afresh.
+// Repeated repairs leave the decomposition more fragmented than a fresh
+// `build()` would, which stays correct, but slower to search.
+//
+// Not thread-safe: the decomposition must not be built or repaired while a
+// search reads it.
+class RectangleDecomposition {
+public:
+    static inline const uint32_t NONE {UINT32_MAX};
+
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    struct Rect {
+        uint32_t x_min;
+        uint32_t y_min;
+        uint32_t x_max;
+        uint32_t y_max;
+
+        bool is_interior(const uint32_t x, const uint32_t y) const {
+            return x > x_min && x < x_max && y > y_min && y < y_max;
+        }
+    };
+
+private:
+    const uint32_t width;
+    const uint32_t height;
+
+    // Per cell; the terrain class, or `BLOCKED_CLASS`.
+    std::vector<uint8_t> cell_class;
+    // Per cell; the id of the rectangle covering it, or `NONE`.
+    std::vector<uint32_t> rect_of;
+
+    // By id. The ids of dissolved rectangles are reused.
+    std::vector<Rect> rects;
+    std::vector<uint32_t> free_ids;
+
+    bool is_open(const int64_t x, const int64_t y) const {
+        return
+            x >= 0 && y >= 0 && x < width && y < height &&
+            cell_class[get_node_index(x, y, width)] != BLOCKED_CLASS;
+    }
+
+    // Cover every uncovered open cell in [x_min, x_max] x [y_min, y_max].
+    void decompose(
+        const uint32_t x_min, const uint32_t y_min,
+        const uint32_t x_max, const uint32_t y_max
+    );
+
+    void dissolve(const uint32_t id);
+
+public:
+    RectangleDecomposition(const uint32_t width, const uint32_t height);
+
+    // Decompose the open cells of `map`, ie, those satisfying `is_accessible`,
+    // from scratch.
+    template <typename map_t, typename Predicate>
+    void build(const map_t &map, const Predicate &is_accessible);
+
+    // Bring the decomposition up to date after the accessibility or terrain
+    // of the cells in [x_min, x_max] x [y_min, y_max] changed.
+    template <typename map_t, typename Predicate>
+    void repair(
+        const map_t &map, const Predicate &is_accessible,
+        const uint32_t x_min, const uint32_t y_min,
+        const uint32_t x_max, const uint32_t y_max
+    );
+
+    // The id of the rectangle covering cell `idx`, or `NONE` if it is
+    // blocked.
+    uint32_t get_rect_id(const uint32_t idx) const {
+        return rect_of[idx];
+    }
+
+    const Rect &get_rect(const uint32_t id) const {
+        return rects[id];
+    }
+
+    // The number of rectangles.
+    uint32_t size() const {
+        return rects.size() - free_ids.size();
+    }
+
+    // Invoke `fn(idx)` for every successor of open cell `idx` in the reduced
+    // search graph:
+    //
+    // - From a perimeter cell, its ordinary neighbors, under the usual corner
+    //   rule, except those in the interior of its own rectangle. Then the
+    //   macro edges across its rectangle: to every cell of the opposite side
+    //   no further along it than the rectangle is across, and along each
+    //   diagonal into the rectangle, to the cell where it meets the
+    //   perimeter.
+    // - From an interior cell, which can only be a search's start, every
+    //   cell of its rectangle's perimeter.
+    //
+    // Either way, `idx_goal` too, if it is in the same rectangle, so that an
+    // interior goal is reachable.
+    template <typename F>
+    void for_each_successor(
+        const uint32_t idx, const uint32_t idx_goal, F &&fn
+    ) const;
+
+    // Fill in the cells skipped by the macro edges of a path through the
+    // reduced graph, as found by `Pathfind`, in place.
+    static void expand_path(path_t &path);
+};
+
+template <typename map_t, typename Predicate>
+void RectangleDecomposition::build(
+    const map_t &map, const Predicate &is_accessible
+) {
+    std::fill(rect_of.begin(), rect_of.end(), NONE);
+
+    rects.clear();
+    free_ids.clear();
+
+    read_cell_classes(map, is_accessible, cell_class, 0, 0, width - 1, height - 1);
+
+    decompose(0, 0, width - 1, height - 1);
+}
+
+template <typename map_t, typename Predicate>
+void RectangleDecomposition::repair(
+    const map_t &map, const Predicate &is_accessible,
+    const uint32_t x_min, const uint32_t y_min,
+    const uint32_t x_max, const uint32_t y_max
+) {
+    const uint32_t x_last {std::min(x_max, width - 1)};
+    const uint32_t y_last {std::min(y_max, height - 1)};
+
+    // The cells to decompose afresh: the change, and every rectangle
+    // overlapping it.
+    Rect area {x_min, y_min, x_last, y_last};
+
+    for (uint32_t y = y_min; y <= y_last; ++y) {
+        for (uint32_t x = x_min; x <= x_last; ++x) {
+            const uint32_t id {rect_of[get_node_index(x, y, width)]};
+
+            if (id == NONE) {
+                continue;
+            }
+
+            const Rect &rect {rects[id]};
+
+            area.x_min = std::min(area.x_min, rect.x_min);
+            area.y_min = std::min(area.y_min, rect.y_min);
+            area.x_max = std::max(area.x_max, rect.x_max);
+            area.y_max = std::max(area.y_max, rect.y_max);
+
+            dissolve(id);
+        }
+    }
+
+    read_cell_classes(map, is_accessible, cell_class, x_min, y_min, x_last, y_last);
+
+    decompose(area.x_min, area.y_min, area.x_max, area.y_max);
+}
+
+template <typename F>
+void RectangleDecomposition::for_each_successor(
+    const uint32_t idx, const uint32_t idx_goal, F &&fn
+) const {
+    const uint32_t id {rect_of[idx]};
+    const Rect &rect {rects[id]};
+
+    const auto [x_node, y_node] = get_node_xy(idx, width);
+
+    const int64_t x {x_node};
+    const int64_t y {y_node};
+
+    if (idx_goal != idx && rect_of[idx_goal] == id) {
+        fn(idx_goal);
+    }
+
+    const auto emit = [&](const int64_t x_to, const int64_t y_to) {
+        fn(get_node_index(x_to, y_to, width));
+    };
+
+    if (rect.is_interior(x, y)) {
+        for (uint32_t x_side = rect.x_min; x_side <= rect.x_max; ++x_side) {
+            emit(x_side, rect.y_min);
+            emit(x_side, rect.y_max);
+        }
+        for (uint32_t y_side = rect.y_min + 1; y_side < rect.y_max; ++y_side) {
+            emit(rect.x_min, y_side);
+            emit(rect.x_max, y_side);
+        }
+
+        return;
+    }
+
+    // Ordinary steps, as in `MapExplorer::gen_neighbors()`.
+    for (int64_t d_y = -1; d_y <= 1; ++d_y) {
+        for (int64_t d_x = -1; d_x <= 1; ++d_x) {
+            if (
+                (d_x == 0 && d_y == 0) ||
+                !is_open(x + d_x, y + d_y) ||
+                (
+                    d_x != 0 && d_y != 0 &&
+                    (!is_open(x + d_x, y) || !is_open(x, y + d_y))
+                ) ||
+                (rect_of[get_node_index(x + d_x, y + d_y, width)] == id &&
+                    rect.is_interior(x + d_x, y + d_y))
+            ) {
+                continue;
+            }
+
+            emit(x + d_x, y + d_y);
+        }
+    }
+
+    const int64_t across {rect.x_max - rect.x_min};
+    const int64_t down {rect.y_max - rect.y_min};
+
+    // Macro edges shorter than two steps are ordinary steps.
+    const auto emit_diagonal = [&](
+        const int64_t steps, const int64_t d_x, const int64_t d_y
+    ) {
+        if (steps > 1) {
+            emit(x + steps * d_x, y + steps * d_y);
+        }
+    };
+
+    if (across > 1) {
+        for (const int64_t side : {int64_t{rect.x_min}, int64_t{rect.x_max}}) {
+            if (x != side) {
+                continue;
+            }
+
+            const int64_t x_opposite {side == rect.x_min ? rect.x_max : rect.x_min};
+            const int64_t d_x {side == rect.x_min ? 1 : -1};
+
+            for (
+                int64_t y_to = std::max<int64_t>(rect.y_min, y - across);
+                y_to <= std::min<int64_t>(rect.y_max, y + across);
+                ++y_to
+            ) {
+                emit(x_opposite, y_to);
+            }
+
+            emit_diagonal(std::min(y - rect.y_min, across), d_x, -1);
+            emit_diagonal(std::min(rect.y_max - y, across), d_x, 1);
+        }
+    }
+
+    if (down > 1) {
+        for (const int64_t side : {int64_t{rect.y_min}, int64_t{rect.y_max}}) {
+            if (y != side) {
+                continue;
+            }
+
+            const int64_t y_opposite {side == rect.y_min ? rect.y_max : rect.y_min};
+            const int64_t d_y {side == rect.y_min ? 1 : -1};
+
+            for (
+                int64_t x_to = std::max<int64_t>(rect.x_min, x - down);
+                x_to <= std::min<int64_t>(rect.x_max, x + down);
+                ++x_to
+            ) {
+                emit(x_to, y_opposite);
+            }
+
+            emit_diagonal(std::min(x - rect.x_min, down), -1, d_y);
+            emit_diagonal(std::min(rect.x_max - x, down), 1, d_y);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef RECTANGLEPARTITION_H
+#define RECTANGLEPARTITION_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Util.h"
+
+// The greedy partition of a map's open cells into rectangles, each of cells
+// of a single terrain class, that both `RectangleDecomposition` and `NavMesh`
+// are built on.
+
+// The class of a blocked cell.
+inline constexpr uint8_t BLOCKED_CLASS {UINT8_MAX};
+
+// Set the class of each cell in [x_min, x_max] x [y_min, y_max] of `map` in
+// `cell_class`: its terrain class if it satisfies `is_accessible`, or else
+// `BLOCKED_CLASS`.
+template <typename map_t, typename Predicate>
+void read_cell_classes(
+    const map_t &map, const Predicate &is_accessible,
+    std::vector<uint8_t> &cell_class,
+    const uint32_t x_min, const uint32_t y_min,
+    const uint32_t x_max, const uint32_t y_max
+) {
+    const auto &nodes {map.get_nodes()};
+
+    for (uint32_t y = y_min; y <= y_max; ++y) {
+        for (uint32_t x = x_min; x <= x_max; ++x) {
+            const uint32_t idx {get_node_index(x, y, map.width)};
+
+            cell_class[idx] = is_accessible(nodes[idx]) ?
+                nodes[idx].get_terrain() : BLOCKED_CLASS;
+        }
+    }
+}
+
+// Cover every uncovered open cell in [x_min, x_max] x [y_min, y_max] with
+// rectangles within it. From each uncovered open cell, in index order, the
+// rectangle is grown right as far as it can go, then down as far as the
+// whole row can go, over uncovered cells of the same class.
+//
+// `owner` holds, per cell, the id of the rectangle covering it, or `none`.
+// `add(x_min, y_min, x_max, y_max, cls)` records each rectangle, and returns
+// its id.
+template <typename Add>
+void partition_rectangles(
+    const uint32_t width,
+    const std::vector<uint8_t> &cell_class,
+    std::vector<uint32_t> &owner,
+    const uint32_t none,
+    const uint32_t x_min, const uint32_t y_min,
+    const uint32_t x_max, const uint32_t y_max,
+    Add &&add
+) {
+    const auto is_free = [&](
+        const uint32_t x, const uint32_t y, const uint8_t cls
+    ) {
+        const uint32_t idx {get_node_index(x, y, width)};
+
+        return cell_class[idx] == cls && owner[idx] == none;
+    };
+
+    for (uint32_t y = y_min; y <= y_max; ++y) {
+        for (uint32_t x = x_min; x <= x_max; ++x) {
+            const uint8_t cls {cell_class[get_node_index(x, y, width)]};
+
+            if (cls == BLOCKED_CLASS || !is_free(x, y, cls)) {
+                continue;
+            }
+
+            uint32_t x_rect_max {x};
+            uint32_t y_rect_max {y};
+
+            while (x_rect_max < x_max && is_free(x_rect_max + 1, y, cls)) {
+                ++x_rect_max;
+            }
+
+            while (y_rect_max < y_max) {
+                bool row_free {true};
+
+                for (uint32_t x_row = x; x_row <= x_rect_max && row_free; ++x_row) {
+                    row_free = is_free(x_row, y_rect_max + 1, cls);
+                }
+
+                if (!row_free) {
+                    break;
+                }
+
+                ++y_rect_max;
+            }
+
+            const uint32_t id {add(x, y, x_rect_max, y_rect_max, cls)};
+
+            for (uint32_t y_rect = y; y_rect <= y_rect_max; ++y_rect) {
+                for (uint32_t x_rect = x; x_rect <= x_rect_max; ++x_rect) {
+                    owner[get_node_index(x_rect, y_rect, width)] = id;
+                }
+            }
+
+            // The rest of the rectangle's first row is covered now.
+            x = x_rect_max;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef REGIONLAYERS_H
+#define REGIONLAYERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "Util.h"
+
+// Region labels for one movement profile, ie, one accessibility predicate,
+// stored apart from the map's nodes in a dense per-cell array.
+//
+// Each label is stamped with the layer's version when written, and only
+// labels stamped with the current version count, so `invalidate()` drops
+// every label in O(1), eg, after the map changes.
+class RegionLayer {
+private:
+    struct Label {
+        uint64_t version;
+        uint64_t region;
+    };
+
+    std::vector<Label> labels;
+
+    // Starts at 1, so that the zeroed labels are invalid.
+    uint64_t version {1};
+
+public:
+    RegionLayer(const uint32_t num_nodes):
+        labels(num_nodes, Label{0, 0})
+    {}
+
+    std::optional<uint64_t> get_region(const uint32_t idx) const {
+        const Label &label {labels[idx]};
+
+        if (label.version != version) {
+            return std::nullopt;
+        }
+
+        return label.region;
+    }
+
+    void set_region(const uint32_t idx, const uint64_t region) {
+        labels[idx] = Label{version, region};
+    }
+
+    void invalidate() {
+        ++version;
+    }
+
+    uint64_t get_version() const {
+        return version;
+    }
+};
+
+// The region layers of one movement profile, ie, one accessibility predicate,
+// one per agent size. Created with `RegionLayers::register_profile()`; the
+// caller must use it only with searches of that one predicate. Layers are
+// created on first use.
+//
+// Looking up a layer is thread-safe. The layers themselves follow the rules of
+// `MapNode` regions: once a layer is fully colored, eg, with
+// `RegionColorer::color_all_regions()`, searches only read it, and may share
+// it between threads.
+class RegionProfile {
+private:
+    const uint32_t num_nodes;
+
+    std::mutex mu;
+    std::vector<std::unique_ptr<RegionLayer>> layers;
+
+public:
+    RegionProfile(const uint32_t num_nodes):
+        num_nodes(num_nodes)
+    {}
+
+    // The layer for agents of `agent_size` (see `ClearanceLayer`), whose
+    // regions are smaller than a single cell agent's.
+    RegionLayer &get(const uint8_t agent_size = 1) {
+        std::scoped_lock<std::mutex> lock(mu);
+
+        if (agent_size >= layers.size()) {
+            layers.resize(agent_size + 1);
+        }
+
+        if (!layers[agent_size]) {
+            layers[agent_size] = std::make_unique<RegionLayer>(num_nodes);
+        }
+
+        return *layers[agent_size];
+    }
+
+    void invalidate() {
+        std::scoped_lock<std::mutex> lock(mu);
+
+        for (auto &layer : layers) {
+            if (layer) {
+                layer->invalidate();
+            }
+        }
+    }
+};
+
+// The region profiles of every movement profile on one map, so that agents
+// with different accessibility predicates can share the map without
+// overwriting each other's labels, as they would in `MapNode::region`.
+//
+// Profiles are registered explicitly, once per predicate, rather than found
+// by the predicate's type: two predicates of one type, eg, two capturing
+// lambdas or two `std::function`s, may well accept different cells.
+class RegionLayers {
+private:
+    const uint32_t num_nodes;
+
+    std::mutex mu;
+    std::vector<std::unique_ptr<RegionProfile>> profiles;
+
+public:
+    RegionLayers(const uint32_t width, const uint32_t height):
+        num_nodes(get_node_count(width, height))
+    {}
+
+    // A new profile, with labels of its own. It lives as long as the
+    // `RegionLayers`.
+    RegionProfile &register_profile() {
+        std::scoped_lock<std::mutex> lock(mu);
+
+        profiles.push_back(std::make_unique<RegionProfile>(num_nodes));
+
+        return *profiles.back();
+    }
+
+    // Drop the labels of every profile, eg, after the map changes.
+    void invalidate_all() {
+        std::scoped_lock<std::mutex> lock(mu);
+
+        for (auto &profile : profiles) {
+            profile->invalidate();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "ReservationTable.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+ReservationTable::ReservationTable(
+    const uint32_t window, const uint32_t max_per_step
+):
+    window(window),
+    // Kept at most half full, so probe sequences stay short.
+    slot_capacity(std::bit_ceil(std::max(max_per_step, 8u) * 2)),
+    entries(new std::atomic<uint64_t>[static_cast<size_t>(window) * slot_capacity])
+{
+    if (window == 0) {
+        throw std::runtime_error("Reservation window must be non-empty");
+    }
+
+    for (uint32_t t = 0; t < window; ++t) {
+        clear_slot(t);
+    }
+}
+
+void ReservationTable::clear_slot(const uint32_t t) {
+    std::atomic<uint64_t> *slot {get_slot(t)};
+
+    for (uint32_t i = 0; i < slot_capacity; ++i) {
+        slot[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+uint32_t ReservationTable::get_agent(const uint32_t cell, const uint32_t t) const {
+    if (!in_window(t)) {
+        return NO_AGENT;
+    }
+
+    const std::atomic<uint64_t> *slot {get_slot(t)};
+    const uint64_t key {static_cast<uint64_t>(cell + 1) << 32};
+
+    for (uint32_t i = 0, pos = hash(cell); i < slot_capacity; ++i) {
+        const uint64_t entry {slot[pos].load(std::memory_order_acquire)};
+
+        if (entry == 0) {
+            break;
+        }
+
+        if ((entry & ~uint64_t {UINT32_MAX}) == key) {
+            const uint32_t agent = static_cast<uint32_t>(entry);
+
+            if (agent != NO_AGENT) {
+                return agent;
+            }
+        }
+
+        pos = (pos + 1) & (slot_capacity - 1);
+    }
+
+    return NO_AGENT;
+}
+
+bool ReservationTable::reserve(
+    const uint32_t cell, const uint32_t t, const uint32_t agent
+) {
+    if (!in_window(t)) {
+        return false;
+    }
+
+    std::atomic<uint64_t> *slot {get_slot(t)};
+    const uint64_t key {static_cast<uint64_t>(cell + 1) << 32};
+
+    // The entry holding `cell` in the probe sequence, other than `own`, or
+    // NONE if none does.
+    const auto find_holder = [&](const uint32_t own, uint64_t &holder_entry) {
+        for (uint32_t i = 0, pos = hash(cell); i < slot_capacity; ++i) {
+            const uint64_t entry {slot[pos].load()};
+
+            if (entry == 0) {
+                break;
+            }
+
+            if (
+                pos != own && (entry & ~uint64_t {UINT32_MAX}) == key &&
+                static_cast<uint32_t>(entry) != NO_AGENT
+            ) {
+                holder_entry = entry;
+
+                return pos;
+            }
+
+            pos = (pos + 1) & (slot_capacity - 1);
+        }
+
+        return NONE;
+    };
+
+    while (true) {
+        // Claim the first released entry of the probe sequence, or else the
+        // first empty one, but only once the whole sequence is known not to
+        // hold the cell.
+        uint32_t free_pos {NONE};
+        uint64_t free_entry {0};
+        uint32_t pos {hash(cell)};
+
+        for (uint32_t i = 0; i < slot_capacity; ++i) {
+            const uint64_t entry {slot[pos].load()};
+
+            if (entry == 0) {
+                if (free_pos == NONE) {
+                    free_pos = pos;
+                    free_entry = 0;
+                }
+
+                break;
+            }
+
+            const uint32_t holder = static_cast<uint32_t>(entry);
+
+            if (holder == NO_AGENT) {
+                if (free_pos == NONE) {
+                    free_pos = pos;
+                    free_entry = entry;
+                }
+            }
+            else if ((entry & ~uint64_t {UINT32_MAX}) == key) {
+                return holder == agent;
+            }
+
+            pos = (pos + 1) & (slot_capacity - 1);
+        }
+
+        if (free_pos == NONE) {
+            return false;
+        }
+
+        if (!slot[free_pos].compare_exchange_strong(free_entry, pack(cell, agent))) {
+            // Lost the race for this entry; look again.
+            continue;
+        }
+
+        // Another agent may have claimed an entry for the same cell that
+        // this one had already probed past, when it was released or empty.
+        // Both then see the other, since every access here is sequentially
+        // consistent, and at least one backs off; if both do, both retry.
+        uint64_t holder_entry;
+
+        if (find_holder(free_pos, holder_entry) == NONE) {
+            return true;
+        }
+
+        slot[free_pos].store(pack(cell, NO_AGENT));
+
+        if (static_cast<uint32_t>(holder_entry) == agent) {
+            return true;
+        }
+    }
+}
+
+void ReservationTable::release(
+    const uint32_t cell, const uint32_t t, const uint32_t agent
+) {
+    if (!in_window(t)) {
+        return;
+    }
+
+    std::atomic<uint64_t> *slot {get_slot(t)};
+
+    for (uint32_t i = 0, pos = hash(cell); i < slot_capacity; ++i) {
+        uint64_t entry {pack(cell, agent)};
+
+        if (
+            slot[pos].compare_exchange_strong(
+                entry, pack(cell, NO_AGENT), std::memory_order_acq_rel
+            )
+        ) {
+            return;
+        }
+
+        if (entry == 0) {
+            return;
+        }
+
+        pos = (pos + 1) & (slot_capacity - 1);
+    }
+}
+
+void ReservationTable::advance(const uint32_t base_time_new) {
+    if (base_time_new <= base_time) {
+        return;
+    }
+
+    const uint32_t expired {std::min(base_time_new - base_time, window)};
+
+    for (uint32_t i = 0; i < expired; ++i) {
+        clear_slot(base_time + i);
+    }
+
+    base_time = base_time_new;
+}
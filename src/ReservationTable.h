@@ -0,0 +1,88 @@
+#ifndef RESERVATIONTABLE_H
+#define RESERVATIONTABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Records which agent occupies which cell at which time step, over a sliding
+// window of time steps, for cooperative pathfinding (see
+// `CooperativePathfind`).
+//
+// The window is a ring of time slots, each an open-addressed hash table of
+// cell reservations, all in a single flat array. Advancing the window only
+// clears the slots that fall out of it. Reservations and lookups are
+// lock-free, so agents may plan and reserve from several threads at once;
+// advancing the window must not race with anything else.
+class ReservationTable {
+public:
+    // Returned by `get_agent()` for an unreserved cell. Not a valid agent id.
+    static inline const uint32_t NO_AGENT {UINT32_MAX};
+
+private:
+    static inline const uint32_t NONE {UINT32_MAX};
+
+    // Each entry packs the reserved cell (plus one, so that zero is an empty
+    // entry) into the high word and the agent into the low word. Released
+    // entries have their agent set to NO_AGENT, rather than being emptied, so
+    // that probe sequences stay intact, and are reused by later reservations.
+    static uint64_t pack(const uint32_t cell, const uint32_t agent) {
+        return (static_cast<uint64_t>(cell + 1) << 32) | agent;
+    }
+
+    const uint32_t window;
+    const uint32_t slot_capacity;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> entries;
+
+    uint32_t base_time {0};
+
+    std::atomic<uint64_t> *get_slot(const uint32_t t) const {
+        return &entries[static_cast<size_t>(t % window) * slot_capacity];
+    }
+
+    uint32_t hash(const uint32_t cell) const {
+        return (cell * 2654435761u) & (slot_capacity - 1);
+    }
+
+    void clear_slot(const uint32_t t);
+
+public:
+    // `max_per_step` bounds the reservations made for any single time step,
+    // ie, roughly the number of agents.
+    ReservationTable(const uint32_t window, const uint32_t max_per_step);
+
+    ReservationTable(const ReservationTable &) = delete;
+    ReservationTable &operator=(const ReservationTable &) = delete;
+
+    uint32_t get_window() const {
+        return window;
+    }
+
+    uint32_t get_base_time() const {
+        return base_time;
+    }
+
+    // Whether time step `t` lies within the window, and so may be reserved.
+    bool in_window(const uint32_t t) const {
+        return t >= base_time && t - base_time < window;
+    }
+
+    // The agent holding `cell` at time `t`, or NO_AGENT if none does or `t`
+    // is outside the window.
+    uint32_t get_agent(const uint32_t cell, const uint32_t t) const;
+
+    // Reserve `cell` at time `t` for `agent`. Returns false if another agent
+    // holds it, if `t` is outside the window, or if the slot is full.
+    // Reserving a cell the agent already holds succeeds.
+    bool reserve(const uint32_t cell, const uint32_t t, const uint32_t agent);
+
+    // Release a reservation made by `agent`, if any.
+    void release(const uint32_t cell, const uint32_t t, const uint32_t agent);
+
+    // Slide the window forward so that it starts at `base_time_new`,
+    // discarding every reservation before it.
+    void advance(const uint32_t base_time_new);
+};
+
+#endif
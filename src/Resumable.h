@@ -0,0 +1,109 @@
+#ifndef RESUMABLE_H
+#define RESUMABLE_H
+
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// A lazily-started coroutine that runs in slices. Each call to `resume()` runs
+// the coroutine until it next suspends (`co_await std::suspend_always {}`) or
+// completes (`co_return value;`), so long-running work can be spread across
+// many calls, eg, one per frame.
+//
+// Destroying a Resumable that has not completed abandons the coroutine and
+// destroys its frame.
+template <typename T>
+class Resumable {
+public:
+    struct promise_type {
+        std::optional<T> result;
+        std::exception_ptr exception;
+
+        Resumable get_return_object() {
+            return Resumable(
+                std::coroutine_handle<promise_type>::from_promise(*this)
+            );
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept {
+            return {};
+        }
+
+        void return_value(T &&value) {
+            result.emplace(std::move(value));
+        }
+
+        void unhandled_exception() {
+            exception = std::current_exception();
+        }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Resumable(std::coroutine_handle<promise_type> handle):
+        handle(handle)
+    {}
+
+public:
+    Resumable(const Resumable &) = delete;
+    Resumable &operator=(const Resumable &) = delete;
+
+    Resumable(Resumable &&other) noexcept:
+        handle(std::exchange(other.handle, nullptr))
+    {}
+
+    Resumable &operator=(Resumable &&other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+
+            handle = std::exchange(other.handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~Resumable() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    // Run the next slice. Returns true once the coroutine has completed.
+    //
+    // Rethrows any exception that escaped the coroutine.
+    bool resume() {
+        assert(handle);
+
+        if (!handle.done()) {
+            handle.resume();
+        }
+
+        if (handle.promise().exception) {
+            std::rethrow_exception(handle.promise().exception);
+        }
+
+        return handle.done();
+    }
+
+    bool done() const {
+        return handle.done();
+    }
+
+    // Take the result of a completed coroutine.
+    T take_result() {
+        assert(handle.done() && handle.promise().result);
+
+        return std::move(*handle.promise().result);
+    }
+};
+
+#endif
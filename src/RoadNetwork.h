@@ -0,0 +1,600 @@
+#ifndef ROADNETWORK_H
+#define ROADNETWORK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Map.h"
+#include "SpatialGrid.h"
+#include "Terrain.h"
+#include "Trace.h"
+#include "Util.h"
+
+// A transit layer for long-distance queries over a map's road network.
+//
+// Road cells (accessible cells of class `TERRAIN_ROAD`) are reduced to a small
+// overlay graph: its nodes are the junctions and dead ends of the roads, and
+// its edges the stretches of road between them. The shortest distances
+// between every pair of junctions are precomputed.
+//
+// A long query is then answered as "walk to the road, ride it, walk off": two
+// short local `Pathfind` searches between the endpoints and nearby road cells,
+// stitched to a road path looked up from the overlay. Only when the roads are
+// estimated to be no quicker than walking directly, or a leg fails, does the
+// query fall back to a full `Pathfind` search. Paths found via the roads are
+// not guaranteed to be optimal.
+//
+// Roads are taken to be 4-connected, and one cell wide: any road cell without
+// exactly two road neighbors is a junction, so nearly every cell of a road two
+// or more cells wide is one. Building the layer costs time and memory
+// quadratic in the number of junctions, 8 bytes per pair of them, so a warning
+// is logged beyond `MANY_JUNCTIONS`. The layer is built once from the map as
+// it stands, and must be rebuilt if the roads change.
+template <typename map_t, typename Predicate>
+class RoadNetwork {
+public:
+    typedef Pathfind<map_t, Predicate> pathfind_t;
+    typedef typename pathfind_t::path_t path_t;
+
+    static inline const uint32_t NONE {UINT32_MAX};
+
+private:
+    // Road cells considered when boarding or leaving the roads.
+    static inline const uint32_t ACCESS_CANDIDATES {4};
+
+    // Beyond this many junctions, the all-pairs tables take over 32 MB.
+    static inline const uint32_t MANY_JUNCTIONS {2048};
+
+    // The local searches to and from the roads are sized for this many cells
+    // to start with, rather than the entire map.
+    static inline const uint32_t LEG_RESERVE {4096};
+
+    // A stretch of road between two junctions, as a list of cells from
+    // junction `a` to junction `b` inclusive.
+    struct Edge {
+        uint32_t a;
+        uint32_t b;
+        std::vector<uint32_t> cells;
+    };
+
+    // Where a road cell lies in the overlay: at junction `node`, or else
+    // `offset` cells along `edge`.
+    struct RoadCell {
+        uint32_t node {NONE};
+        uint32_t edge {NONE};
+        uint32_t offset {0};
+    };
+
+    // A way from a road cell onto the overlay graph.
+    struct Exit {
+        uint32_t node;
+        float cost;
+    };
+
+    map_t &map;
+    const Predicate &is_accessible;
+    const TerrainCosts terrain_costs;
+
+    // Queries shorter than this, in cells, go straight to `Pathfind`.
+    const float min_transit_dist;
+
+    std::unordered_map<uint32_t, RoadCell> road_cells;
+
+    // Overlay nodes' cell indices.
+    std::vector<uint32_t> nodes;
+    std::vector<Edge> edges;
+    // Per node, the edges incident to it.
+    std::vector<std::vector<uint32_t>> node_edges;
+
+    // All-pairs shortest road distances, and the edge by which the shortest
+    // path from the row's node enters the column's node.
+    std::vector<float> dist;
+    std::vector<uint32_t> entry_edge;
+
+    // Road cells, by their cell index.
+    SpatialGrid road_grid;
+
+    bool is_road(const uint32_t idx) const {
+        const auto &node = map.get_nodes()[idx];
+
+        return node.get_terrain() == TERRAIN_ROAD && is_accessible(node);
+    }
+
+    // Append the 4-connected road neighbors of cell `idx` to `out`.
+    void get_road_neighbors(const uint32_t idx, std::vector<uint32_t> &out) const {
+        const auto [x, y] = get_node_xy(idx, map.width);
+
+        out.clear();
+
+        const auto visit = [&](const int32_t d_x, const int32_t d_y) {
+            const uint32_t idx_neighbor {
+                get_neighbor_index(idx, x, y, d_x, d_y, map.width)
+            };
+
+            if (is_road(idx_neighbor)) {
+                out.push_back(idx_neighbor);
+            }
+        };
+
+        if (x > 0) {
+            visit(-1, 0);
+        }
+
+        if (x + 1 < map.width) {
+            visit(1, 0);
+        }
+
+        if (y > 0) {
+            visit(0, -1);
+        }
+
+        if (y + 1 < map.height) {
+            visit(0, 1);
+        }
+    }
+
+    float road_cost(const uint32_t steps) const {
+        return steps * terrain_costs[TERRAIN_ROAD];
+    }
+
+    uint32_t add_node(const uint32_t idx) {
+        const uint32_t node = nodes.size();
+
+        nodes.push_back(idx);
+        node_edges.emplace_back();
+
+        road_cells[idx].node = node;
+
+        return node;
+    }
+
+    // Follow the road from junction `node` through its neighbor `first` to
+    // the next junction, and record the stretch as an edge, unless it has
+    // been recorded already from its other end.
+    void trace_edge(const uint32_t node, const uint32_t first) {
+        const RoadCell &first_cell {road_cells.at(first)};
+
+        if (first_cell.edge != NONE) {
+            return;
+        }
+
+        if (first_cell.node != NONE && first_cell.node < node) {
+            return;
+        }
+
+        Edge edge {node, NONE, {nodes[node]}};
+
+        std::vector<uint32_t> neighbors;
+
+        uint32_t prev {nodes[node]};
+        uint32_t cur {first};
+
+        while (road_cells.at(cur).node == NONE) {
+            edge.cells.push_back(cur);
+
+            get_road_neighbors(cur, neighbors);
+
+            // Away from junctions, roads do not branch.
+            const uint32_t next {neighbors[0] == prev ? neighbors[1] : neighbors[0]};
+
+            prev = cur;
+            cur = next;
+        }
+
+        edge.cells.push_back(cur);
+        edge.b = road_cells.at(cur).node;
+
+        const uint32_t id = edges.size();
+
+        for (uint32_t offset = 1; offset + 1 < edge.cells.size(); ++offset) {
+            RoadCell &cell {road_cells.at(edge.cells[offset])};
+
+            cell.edge = id;
+            cell.offset = offset;
+        }
+
+        node_edges[edge.a].push_back(id);
+
+        if (edge.b != edge.a) {
+            node_edges[edge.b].push_back(id);
+        }
+
+        edges.push_back(std::move(edge));
+    }
+
+    void build() {
+        TRACE_SCOPE("RoadNetwork::build");
+
+        const uint32_t num_cells {get_node_count(map.width, map.height)};
+
+        std::vector<uint32_t> neighbors;
+
+        for (uint32_t idx = 0; idx < num_cells; ++idx) {
+            if (!is_road(idx)) {
+                continue;
+            }
+
+            const auto [x, y] = get_node_xy(idx, map.width);
+
+            // Padding in a tiled cell layout.
+            if (x >= map.width || y >= map.height) {
+                continue;
+            }
+
+            road_cells.emplace(idx, RoadCell {});
+            road_grid.insert(idx, x + 0.5f, y + 0.5f);
+        }
+
+        // Junctions and dead ends.
+        for (const auto &[idx, cell] : road_cells) {
+            get_road_neighbors(idx, neighbors);
+
+            if (neighbors.size() != 2) {
+                add_node(idx);
+            }
+        }
+
+        const auto trace_from = [&](const uint32_t node) {
+            std::vector<uint32_t> firsts;
+
+            get_road_neighbors(nodes[node], firsts);
+
+            for (const uint32_t first : firsts) {
+                trace_edge(node, first);
+            }
+        };
+
+        for (uint32_t node = 0; node < nodes.size(); ++node) {
+            trace_from(node);
+        }
+
+        // Loops of road without any junction get one, so they are reachable.
+        for (auto &[idx, cell] : road_cells) {
+            if (cell.node == NONE && cell.edge == NONE) {
+                trace_from(add_node(idx));
+            }
+        }
+
+        if (nodes.size() > MANY_JUNCTIONS) {
+            LOG_WARN(
+                "Road network has [%zu] junctions, for [%zu] MB of distances; "
+                "are its roads more than one cell wide?",
+                nodes.size(),
+                nodes.size() * nodes.size() * (sizeof(float) + sizeof(uint32_t)) >> 20
+            );
+        }
+
+        compute_distances();
+
+        LOG_INFO(
+            "Road network: %zu road cells, %zu junctions, %zu edges",
+            road_cells.size(), nodes.size(), edges.size()
+        );
+    }
+
+    // Dijkstra from every node over the overlay.
+    void compute_distances() {
+        TRACE_SCOPE("RoadNetwork::compute_distances");
+
+        const uint32_t num_nodes = nodes.size();
+
+        dist.assign(static_cast<size_t>(num_nodes) * num_nodes, std::numeric_limits<float>::infinity());
+        entry_edge.assign(static_cast<size_t>(num_nodes) * num_nodes, NONE);
+
+        typedef std::pair<float, uint32_t> entry_t;
+
+        for (uint32_t source = 0; source < num_nodes; ++source) {
+            float *const row_dist {&dist[static_cast<size_t>(source) * num_nodes]};
+            uint32_t *const row_entry {&entry_edge[static_cast<size_t>(source) * num_nodes]};
+
+            std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> open;
+
+            row_dist[source] = 0;
+            open.push({0, source});
+
+            while (!open.empty()) {
+                const auto [d, node] = open.top();
+
+                open.pop();
+
+                if (d > row_dist[node]) {
+                    continue;
+                }
+
+                for (const uint32_t id : node_edges[node]) {
+                    const Edge &edge {edges[id]};
+                    const uint32_t other {edge.a == node ? edge.b : edge.a};
+                    const float d_other {d + road_cost(edge.cells.size() - 1)};
+
+                    if (d_other < row_dist[other]) {
+                        row_dist[other] = d_other;
+                        row_entry[other] = id;
+
+                        open.push({d_other, other});
+                    }
+                }
+            }
+        }
+    }
+
+    float get_dist(const uint32_t from, const uint32_t to) const {
+        return dist[static_cast<size_t>(from) * nodes.size() + to];
+    }
+
+    // The ways onto the overlay from road cell `idx`: its junction, or both
+    // ends of its edge.
+    void get_exits(const uint32_t idx, std::vector<Exit> &out) const {
+        const RoadCell &cell {road_cells.at(idx)};
+
+        out.clear();
+
+        if (cell.node != NONE) {
+            out.push_back({cell.node, 0});
+
+            return;
+        }
+
+        const Edge &edge {edges[cell.edge]};
+
+        out.push_back({edge.a, road_cost(cell.offset)});
+        out.push_back({edge.b, road_cost(edge.cells.size() - 1 - cell.offset)});
+    }
+
+    // Append to `path` the road cells from road cell `idx` to its exit at
+    // `node`, excluding `idx` itself.
+    void append_to_exit(const uint32_t idx, const uint32_t node, path_t &path) const {
+        const RoadCell &cell {road_cells.at(idx)};
+
+        if (cell.node != NONE) {
+            return;
+        }
+
+        const Edge &edge {edges[cell.edge]};
+
+        if (edge.a == node) {
+            for (uint32_t i = cell.offset; i-- > 0;) {
+                path.push_back(get_node_xy(edge.cells[i], map.width));
+            }
+        }
+        else {
+            for (uint32_t i = cell.offset + 1; i < edge.cells.size(); ++i) {
+                path.push_back(get_node_xy(edge.cells[i], map.width));
+            }
+        }
+    }
+
+    // Append to `path` the road cells from junction `from` to junction `to`,
+    // excluding `from`.
+    void append_road(const uint32_t from, const uint32_t to, path_t &path) const {
+        std::vector<uint32_t> hops;
+
+        for (uint32_t node = to; node != from;) {
+            const uint32_t id {entry_edge[static_cast<size_t>(from) * nodes.size() + node]};
+
+            hops.push_back(id);
+
+            node = edges[id].a == node ? edges[id].b : edges[id].a;
+        }
+
+        uint32_t node {from};
+
+        for (auto iter = hops.rbegin(); iter != hops.rend(); ++iter) {
+            const Edge &edge {edges[*iter]};
+
+            if (edge.a == node) {
+                for (uint32_t i = 1; i < edge.cells.size(); ++i) {
+                    path.push_back(get_node_xy(edge.cells[i], map.width));
+                }
+
+                node = edge.b;
+            }
+            else {
+                for (uint32_t i = edge.cells.size() - 1; i-- > 0;) {
+                    path.push_back(get_node_xy(edge.cells[i], map.width));
+                }
+
+                node = edge.a;
+            }
+        }
+    }
+
+    // Up to `ACCESS_CANDIDATES` road cells nearest to (x, y), nearest first.
+    void get_access_candidates(
+        const uint32_t x, const uint32_t y, std::vector<uint32_t> &out
+    ) const {
+        std::vector<std::pair<float, uint32_t>> found;
+
+        const float x_center {x + 0.5f};
+        const float y_center {y + 0.5f};
+
+        for (
+            float radius = 8;
+            found.size() < ACCESS_CANDIDATES && radius < 2.0f * std::max(map.width, map.height);
+            radius *= 2
+        ) {
+            found.clear();
+
+            road_grid.query_radius(
+                x_center, y_center, radius,
+                [&](const uint32_t idx, const float x_road, const float y_road) {
+                    const float dx {x_road - x_center};
+                    const float dy {y_road - y_center};
+
+                    found.push_back({dx * dx + dy * dy, idx});
+                }
+            );
+        }
+
+        const size_t count {std::min<size_t>(found.size(), ACCESS_CANDIDATES)};
+
+        std::partial_sort(found.begin(), found.begin() + count, found.end());
+
+        out.clear();
+
+        for (size_t i = 0; i < count; ++i) {
+            out.push_back(found[i].second);
+        }
+    }
+
+    // A travel-order path between two cells with `Pathfind`. A leg that
+    // starts where it ends, eg, when a query's endpoint is on the road, is
+    // just that cell.
+    path_t walk(
+        const uint32_t x_start, const uint32_t y_start,
+        const uint32_t x_end, const uint32_t y_end
+    ) const {
+        if (x_start == x_end && y_start == y_end) {
+            return {{x_start, y_start}};
+        }
+
+        pathfind_t pathfinder(
+            map, x_start, y_start, x_end, y_end, is_accessible,
+            {.terrain_costs = terrain_costs, .reserve_hint = LEG_RESERVE}
+        );
+
+        path_t path {pathfinder.get_path()};
+
+        std::reverse(path.begin(), path.end());
+
+        return path;
+    }
+
+public:
+    // Queries between cells closer than `min_transit_dist` are not worth
+    // routing over the roads, and go straight to `Pathfind`.
+    RoadNetwork(
+        map_t &map,
+        const Predicate &is_accessible,
+        const TerrainCosts &terrain_costs = DEFAULT_TERRAIN_COSTS,
+        const float min_transit_dist = 64
+    ):
+        map(map),
+        is_accessible(is_accessible),
+        terrain_costs(terrain_costs),
+        min_transit_dist(min_transit_dist),
+        road_grid(map.width, map.height)
+    {
+        build();
+    }
+
+    uint32_t num_junctions() const {
+        return nodes.size();
+    }
+
+    // As `Pathfind::get_path()`, ie, the path is returned end first, and is
+    // empty if there is none.
+    path_t get_path(
+        const uint32_t x_start, const uint32_t y_start,
+        const uint32_t x_end, const uint32_t y_end
+    ) const {
+        TRACE_SCOPE("RoadNetwork::get_path");
+
+        const float direct {
+            static_cast<float>(dist_euclidean(x_start, y_start, x_end, y_end))
+        };
+
+        std::vector<uint32_t> boarding;
+        std::vector<uint32_t> alighting;
+
+        if (direct >= min_transit_dist && !nodes.empty()) {
+            get_access_candidates(x_start, y_start, boarding);
+            get_access_candidates(x_end, y_end, alighting);
+        }
+
+        // Estimate each combination of boarding and alighting cells, walking
+        // the legs in a straight line over open ground.
+        const float walk_cost {terrain_costs[TERRAIN_GROUND]};
+
+        float best {direct * walk_cost};
+        uint32_t best_board {NONE};
+        uint32_t best_alight {NONE};
+        Exit best_exit_board {};
+        Exit best_exit_alight {};
+
+        std::vector<Exit> exits_board;
+        std::vector<Exit> exits_alight;
+
+        for (const uint32_t board : boarding) {
+            const auto [x_board, y_board] = get_node_xy(board, map.width);
+            const float leg_board {
+                static_cast<float>(dist_euclidean(x_start, y_start, x_board, y_board)) * walk_cost
+            };
+
+            get_exits(board, exits_board);
+
+            for (const uint32_t alight : alighting) {
+                const auto [x_alight, y_alight] = get_node_xy(alight, map.width);
+                const float leg_alight {
+                    static_cast<float>(dist_euclidean(x_alight, y_alight, x_end, y_end)) * walk_cost
+                };
+
+                get_exits(alight, exits_alight);
+
+                for (const Exit &exit_board : exits_board) {
+                    for (const Exit &exit_alight : exits_alight) {
+                        const float cost {
+                            leg_board + exit_board.cost
+                                + get_dist(exit_board.node, exit_alight.node)
+                                + exit_alight.cost + leg_alight
+                        };
+
+                        if (cost < best) {
+                            best = cost;
+                            best_board = board;
+                            best_alight = alight;
+                            best_exit_board = exit_board;
+                            best_exit_alight = exit_alight;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (best_board != NONE) {
+            const auto [x_board, y_board] = get_node_xy(best_board, map.width);
+            const auto [x_alight, y_alight] = get_node_xy(best_alight, map.width);
+
+            path_t path {walk(x_start, y_start, x_board, y_board)};
+            const path_t leg_alight {walk(x_alight, y_alight, x_end, y_end)};
+
+            if (!path.empty() && !leg_alight.empty()) {
+                append_to_exit(best_board, best_exit_board.node, path);
+                append_road(best_exit_board.node, best_exit_alight.node, path);
+
+                // The cells from the alighting cell to its exit, reversed.
+                path_t to_exit;
+
+                append_to_exit(best_alight, best_exit_alight.node, to_exit);
+
+                std::reverse(to_exit.begin(), to_exit.end());
+
+                if (!to_exit.empty()) {
+                    // The exit junction is already on the path.
+                    path.insert(path.end(), to_exit.begin() + 1, to_exit.end());
+                    path.push_back({x_alight, y_alight});
+                }
+
+                path.insert(path.end(), leg_alight.begin() + 1, leg_alight.end());
+
+                std::reverse(path.begin(), path.end());
+
+                return path;
+            }
+        }
+
+        pathfind_t pathfinder(
+            map, x_start, y_start, x_end, y_end, is_accessible,
+            {.terrain_costs = terrain_costs}
+        );
+
+        return pathfinder.get_path();
+    }
+};
+
+#endif
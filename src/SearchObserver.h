@@ -0,0 +1,65 @@
+#ifndef SEARCHOBSERVER_H
+#define SEARCHOBSERVER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Util.h"
+
+// Receives events from a running search, eg, to visualize which cells a
+// `Pathfind` explored. Searches only emit events when an observer is
+// installed, so there is no cost otherwise.
+class SearchObserver {
+public:
+    virtual ~SearchObserver() = default;
+
+    // Called once at the start of each search.
+    virtual void on_search_start(const uint32_t width, const uint32_t height) {}
+
+    // Called the first time the search reaches a cell.
+    virtual void on_generated(const uint32_t idx) {}
+
+    // Called when the search expands a cell's neighbors.
+    virtual void on_expanded(const uint32_t idx) {}
+};
+
+// Records the cells generated by the most recent search, both as a bitset for
+// membership tests and as a list for iteration. Storage is reused between
+// searches, and resetting it costs time proportional to the previous
+// search's cells, not the map's.
+class ExploredCellsObserver : public SearchObserver {
+private:
+    std::vector<uint64_t> generated_bits;
+    std::vector<uint32_t> generated;
+
+public:
+    void on_search_start(const uint32_t width, const uint32_t height) override {
+        const size_t words {(size_t {get_node_count(width, height)} + 63) / 64};
+
+        if (generated_bits.size() != words) {
+            generated_bits.assign(words, 0);
+        }
+        else {
+            for (const uint32_t idx : generated) {
+                generated_bits[idx >> 6] = 0;
+            }
+        }
+
+        generated.clear();
+    }
+
+    void on_generated(const uint32_t idx) override {
+        generated_bits[idx >> 6] |= uint64_t {1} << (idx & 63);
+        generated.push_back(idx);
+    }
+
+    bool was_generated(const uint32_t idx) const {
+        return (generated_bits[idx >> 6] >> (idx & 63)) & 1;
+    }
+
+    const std::vector<uint32_t> &get_generated() const {
+        return generated;
+    }
+};
+
+#endif
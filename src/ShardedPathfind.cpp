@@ -0,0 +1,891 @@
+#include "ShardedPathfind.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "DistanceMatrix.h"
+#include "Log.h"
+#include "QueryProtocol.h"
+
+namespace {
+    // Requests from the coordinator to a worker. Coordinates are the
+    // shard's own, from its top-left cell.
+    enum ShardOp : uint32_t {
+        // -> The entry costs of the top, bottom, left and right edges.
+        OP_PERIMETER,
+        // count, count * { x, y } -> The costs between every pair of them.
+        OP_SET_NODES,
+        // x, y, x_extra, y_extra -> The costs from (x, y) to every node, then
+        // to (x_extra, y_extra), unless x_extra is UINT32_MAX.
+        OP_COSTS_FROM,
+        // x, y -> The costs from every node to (x, y).
+        OP_COSTS_TO,
+        // count, count * { x_start, y_start, x_end, y_end } -> count encoded
+        // paths.
+        OP_PATHS,
+        // x, y, blocking -> Nothing.
+        OP_SET_BLOCKING,
+    };
+
+    const auto open_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef DistanceSearch<Map, decltype(open_lamb)> search_t;
+
+    void append_float(std::vector<unsigned char> &out, const float value) {
+        append_u32(out, std::bit_cast<uint32_t>(value));
+    }
+
+    float consume_float(const unsigned char *&cursor, const unsigned char *end) {
+        return std::bit_cast<float>(consume_u32(cursor, end));
+    }
+
+    // The cost of entering (x, y), or infinity if it is blocking.
+    float get_entry_cost(
+        const Map &map,
+        const uint32_t x,
+        const uint32_t y,
+        const TerrainCosts &terrain_costs
+    ) {
+        const MapNode &node {map.get_nodes()[get_node_index(x, y, map.width)]};
+
+        return node.get_blocking() ? INFINITY : terrain_costs[node.get_terrain()];
+    }
+
+    // The transitions across an entrance spanning [begin, end): the middle,
+    // or both ends if it is at least `long_run` long.
+    template <typename Fn>
+    void for_each_transition(
+        const uint32_t begin, const uint32_t end, const uint32_t long_run, Fn &&fn
+    ) {
+        if (end - begin < long_run) {
+            fn(begin + (end - begin) / 2);
+        }
+        else {
+            fn(begin);
+            fn(end - 1);
+        }
+    }
+}
+
+void ShardedPathfind::serve_shard(
+    Map &map, const int fd, const TerrainCosts &terrain_costs,
+    const uint32_t threads
+) {
+    search_t search(map, open_lamb, terrain_costs);
+    // For the costs between border nodes, which an edit inside the shard
+    // invalidates wholesale, so are worth spreading across the cores this
+    // worker has to itself.
+    DistanceMatrix<Map, decltype(open_lamb)> matrix(
+        map, open_lamb, nullptr, terrain_costs, threads
+    );
+
+    path_t nodes;
+    path_t targets;
+    path_t path;
+    std::vector<float> costs;
+
+    std::vector<unsigned char> payload;
+    std::vector<unsigned char> out;
+
+    const auto entry_cost = [&](const uint32_t x, const uint32_t y) {
+        return get_entry_cost(map, x, y, terrain_costs);
+    };
+
+    while (read_frame(fd, payload)) {
+        const unsigned char *cursor {payload.data()};
+        const unsigned char *const end {payload.data() + payload.size()};
+
+        out.clear();
+        // Only allocates for the first reply. Without it, GCC's release (LTO)
+        // build warns that the placeholder below may overflow an empty buffer.
+        out.reserve(4);
+
+        // Placeholder for the length prefix.
+        append_u32(out, 0);
+
+        switch (consume_u32(cursor, end)) {
+            case OP_PERIMETER: {
+                for (uint32_t x = 0; x < map.width; ++x) {
+                    append_float(out, entry_cost(x, 0));
+                }
+                for (uint32_t x = 0; x < map.width; ++x) {
+                    append_float(out, entry_cost(x, map.height - 1));
+                }
+                for (uint32_t y = 0; y < map.height; ++y) {
+                    append_float(out, entry_cost(0, y));
+                }
+                for (uint32_t y = 0; y < map.height; ++y) {
+                    append_float(out, entry_cost(map.width - 1, y));
+                }
+
+                break;
+            }
+            case OP_SET_NODES: {
+                nodes.resize(consume_u32(cursor, end));
+
+                for (auto &[x, y] : nodes) {
+                    x = consume_u32(cursor, end);
+                    y = consume_u32(cursor, end);
+                }
+
+                matrix.compute(nodes, nodes, costs);
+
+                for (const float cost : costs) {
+                    append_float(out, cost);
+                }
+
+                break;
+            }
+            case OP_COSTS_FROM: {
+                const uint32_t x {consume_u32(cursor, end)};
+                const uint32_t y {consume_u32(cursor, end)};
+                const uint32_t x_extra {consume_u32(cursor, end)};
+                const uint32_t y_extra {consume_u32(cursor, end)};
+
+                targets = nodes;
+
+                if (x_extra != UINT32_MAX) {
+                    targets.emplace_back(x_extra, y_extra);
+                }
+
+                search.costs_to(x, y, targets, costs);
+
+                if (x_extra == UINT32_MAX) {
+                    costs.push_back(INFINITY);
+                }
+
+                for (const float cost : costs) {
+                    append_float(out, cost);
+                }
+
+                break;
+            }
+            case OP_COSTS_TO: {
+                const uint32_t x {consume_u32(cursor, end)};
+                const uint32_t y {consume_u32(cursor, end)};
+
+                // A path costs what entering its cells after the first does,
+                // and the corner rule is symmetric, so the cost of the path
+                // reversed differs only by the costs of its two ends.
+                search.costs_to(x, y, nodes, costs);
+
+                for (uint32_t i = 0; i < nodes.size(); ++i) {
+                    const auto &[x_node, y_node] = nodes[i];
+
+                    append_float(
+                        out,
+                        costs[i] == INFINITY
+                            ? INFINITY
+                            : costs[i] - entry_cost(x_node, y_node) + entry_cost(x, y)
+                    );
+                }
+
+                break;
+            }
+            case OP_PATHS: {
+                const uint32_t count {consume_u32(cursor, end)};
+
+                for (uint32_t i = 0; i < count; ++i) {
+                    const uint32_t x_start {consume_u32(cursor, end)};
+                    const uint32_t y_start {consume_u32(cursor, end)};
+                    const uint32_t x_end {consume_u32(cursor, end)};
+                    const uint32_t y_end {consume_u32(cursor, end)};
+
+                    search.costs_to(x_start, y_start, {{x_end, y_end}}, costs);
+                    search.get_path(x_end, y_end, path);
+
+                    encode_path(out, path);
+                }
+
+                break;
+            }
+            case OP_SET_BLOCKING: {
+                const uint32_t x {consume_u32(cursor, end)};
+                const uint32_t y {consume_u32(cursor, end)};
+
+                map.get_nodes_mut()[get_node_index(x, y, map.width)].set_blocking(
+                    consume_u32(cursor, end)
+                );
+
+                // `matrix` colors regions lazily; let it find them afresh.
+                map.clear_regions();
+
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown shard request");
+        }
+
+        const uint32_t payload_size = out.size() - 4;
+
+        for (uint32_t i = 0; i < 4; ++i) {
+            out[i] = static_cast<unsigned char>(payload_size >> (i * 8));
+        }
+
+        if (!write_all(fd, out.data(), out.size())) {
+            return;
+        }
+    }
+}
+
+void ShardedPathfind::spawn(const std::function<Map(const Shard &shard)> &extract) {
+    shards.resize(static_cast<size_t>(shards_x) * shards_y);
+
+    for (uint32_t s = 0; s < shards.size(); ++s) {
+        Shard &shard {shards[s]};
+
+        shard.x_min = (s % shards_x) * shard_size;
+        shard.y_min = (s / shards_x) * shard_size;
+        shard.width = std::min(shard_size, width - shard.x_min);
+        shard.height = std::min(shard_size, height - shard.y_min);
+
+        int fds[2];
+
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            shut_down();
+
+            throw std::runtime_error("Failed to create shard socket pair");
+        }
+
+        const pid_t pid {::fork()};
+
+        if (pid < 0) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+
+            shut_down();
+
+            throw std::runtime_error("Failed to fork shard worker");
+        }
+
+        if (pid == 0) {
+            // The worker. Hold no socket but its own, so that every other
+            // worker sees the coordinator hang up, and leave without running
+            // the coordinator's destructors, or flushing its buffers.
+            ::close(fds[0]);
+
+            for (uint32_t prev = 0; prev < s; ++prev) {
+                ::close(shards[prev].fd);
+            }
+
+            // The logger's drain thread is not forked along with this one,
+            // so nothing logged here would be written out.
+            log_set_level(LogLevel::OFF);
+
+            int status {0};
+
+            try {
+                Map map {extract(shard)};
+
+                serve_shard(map, fds[1], terrain_costs, worker_threads);
+            } catch (const std::exception &e) {
+                std::fprintf(stderr, "[ERROR] Shard worker failed: %s\n", e.what());
+
+                status = 1;
+            }
+
+            ::_exit(status);
+        }
+
+        ::close(fds[1]);
+
+        shard.pid = pid;
+        shard.fd = fds[0];
+    }
+
+    try {
+        std::vector<unsigned char> payload;
+
+        append_u32(payload, OP_PERIMETER);
+
+        for (const Shard &shard : shards) {
+            send(shard, payload);
+        }
+
+        for (Shard &shard : shards) {
+            fetch_perimeter(shard);
+        }
+
+        rebuild_border(std::vector<bool>(shards.size(), true));
+    } catch (...) {
+        shut_down();
+
+        throw;
+    }
+}
+
+ShardedPathfind::~ShardedPathfind() {
+    shut_down();
+}
+
+void ShardedPathfind::shut_down() {
+    for (Shard &shard : shards) {
+        if (shard.fd >= 0) {
+            ::close(shard.fd);
+
+            shard.fd = -1;
+        }
+    }
+
+    for (Shard &shard : shards) {
+        if (shard.pid > 0) {
+            ::waitpid(shard.pid, nullptr, 0);
+
+            shard.pid = -1;
+        }
+    }
+}
+
+void ShardedPathfind::send(
+    const Shard &shard, const std::vector<unsigned char> &payload
+) const {
+    std::vector<unsigned char> frame;
+
+    frame.reserve(4 + payload.size());
+
+    append_u32(frame, payload.size());
+    frame.insert(frame.end(), payload.begin(), payload.end());
+
+    if (!write_all(shard.fd, frame.data(), frame.size())) {
+        throw std::runtime_error("Shard worker went away");
+    }
+}
+
+std::vector<unsigned char> ShardedPathfind::receive(const Shard &shard) const {
+    std::vector<unsigned char> payload;
+
+    if (!read_frame(shard.fd, payload)) {
+        throw std::runtime_error("Shard worker went away");
+    }
+
+    return payload;
+}
+
+// Expects the request to have been sent.
+void ShardedPathfind::fetch_perimeter(Shard &shard) {
+    const std::vector<unsigned char> payload {receive(shard)};
+
+    const unsigned char *cursor {payload.data()};
+    const unsigned char *const end {payload.data() + payload.size()};
+
+    for (auto *edge : {&shard.top, &shard.bottom}) {
+        edge->resize(shard.width);
+
+        for (float &cost : *edge) {
+            cost = consume_float(cursor, end);
+        }
+    }
+
+    for (auto *edge : {&shard.left, &shard.right}) {
+        edge->resize(shard.height);
+
+        for (float &cost : *edge) {
+            cost = consume_float(cursor, end);
+        }
+    }
+}
+
+void ShardedPathfind::rebuild_border(std::vector<bool> &&stale) {
+    std::vector<std::vector<BorderNode>> nodes(shards.size());
+    // Per shard; the node at each of its cells, by cell index.
+    std::vector<std::unordered_map<uint32_t, uint32_t>> node_at(shards.size());
+
+    const auto add_node = [&](const uint32_t s, const uint32_t x, const uint32_t y) {
+        const auto [iter, inserted] = node_at[s].try_emplace(
+            get_node_index(x, y, width), nodes[s].size()
+        );
+
+        if (inserted) {
+            nodes[s].push_back({x, y, {}});
+        }
+
+        return iter->second;
+    };
+
+    const auto add_transition = [&](
+        const uint32_t s, const uint32_t x_s, const uint32_t y_s, const float cost_s,
+        const uint32_t t, const uint32_t x_t, const uint32_t y_t, const float cost_t
+    ) {
+        const uint32_t node_s {add_node(s, x_s, y_s)};
+        const uint32_t node_t {add_node(t, x_t, y_t)};
+
+        nodes[s][node_s].crossings.push_back({t, node_t, cost_t});
+        nodes[t][node_t].crossings.push_back({s, node_s, cost_s});
+    };
+
+    // Scan `count` facing pairs of cells for runs where both are open.
+    const auto for_each_entrance = [&](
+        const uint32_t count,
+        const std::vector<float> &side_s,
+        const std::vector<float> &side_t,
+        const auto &fn
+    ) {
+        uint32_t begin {0};
+
+        for (uint32_t i = 0; i <= count; ++i) {
+            if (i < count && side_s[i] != INFINITY && side_t[i] != INFINITY) {
+                continue;
+            }
+
+            if (i > begin) {
+                for_each_transition(begin, i, LONG_ENTRANCE, fn);
+            }
+
+            begin = i + 1;
+        }
+    };
+
+    for (uint32_t s = 0; s < shards.size(); ++s) {
+        const Shard &shard {shards[s]};
+
+        if (s % shards_x + 1 < shards_x) {
+            const uint32_t t {s + 1};
+            const Shard &next {shards[t]};
+
+            for_each_entrance(
+                shard.height, shard.right, next.left,
+                [&](const uint32_t y) {
+                    add_transition(
+                        s, shard.x_min + shard.width - 1, shard.y_min + y, shard.right[y],
+                        t, next.x_min, next.y_min + y, next.left[y]
+                    );
+                }
+            );
+        }
+
+        if (s / shards_x + 1 < shards_y) {
+            const uint32_t t {s + shards_x};
+            const Shard &next {shards[t]};
+
+            for_each_entrance(
+                shard.width, shard.bottom, next.top,
+                [&](const uint32_t x) {
+                    add_transition(
+                        s, shard.x_min + x, shard.y_min + shard.height - 1, shard.bottom[x],
+                        t, next.x_min + x, next.y_min, next.top[x]
+                    );
+                }
+            );
+        }
+    }
+
+    count_border_nodes = 0;
+
+    for (uint32_t s = 0; s < shards.size(); ++s) {
+        Shard &shard {shards[s]};
+
+        const bool moved {
+            !std::equal(
+                nodes[s].begin(), nodes[s].end(),
+                shard.nodes.begin(), shard.nodes.end(),
+                [](const BorderNode &lhs, const BorderNode &rhs) {
+                    return lhs.x == rhs.x && lhs.y == rhs.y;
+                }
+            )
+        };
+
+        stale[s] = stale[s] || moved;
+
+        shard.nodes = std::move(nodes[s]);
+        shard.first_node = count_border_nodes;
+
+        count_border_nodes += shard.nodes.size();
+    }
+
+    node_shards.clear();
+
+    for (uint32_t s = 0; s < shards.size(); ++s) {
+        node_shards.insert(node_shards.end(), shards[s].nodes.size(), s);
+    }
+
+    for (uint32_t s = 0; s < shards.size(); ++s) {
+        if (stale[s]) {
+            send_nodes(shards[s]);
+        }
+    }
+
+    for (uint32_t s = 0; s < shards.size(); ++s) {
+        if (stale[s]) {
+            receive_costs(shards[s]);
+        }
+    }
+}
+
+void ShardedPathfind::send_nodes(const Shard &shard) const {
+    std::vector<unsigned char> payload;
+
+    append_u32(payload, OP_SET_NODES);
+    append_u32(payload, shard.nodes.size());
+
+    for (const BorderNode &node : shard.nodes) {
+        append_u32(payload, node.x - shard.x_min);
+        append_u32(payload, node.y - shard.y_min);
+    }
+
+    send(shard, payload);
+}
+
+void ShardedPathfind::receive_costs(Shard &shard) {
+    const std::vector<unsigned char> payload {receive(shard)};
+
+    const unsigned char *cursor {payload.data()};
+    const unsigned char *const end {payload.data() + payload.size()};
+
+    shard.costs.resize(shard.nodes.size() * shard.nodes.size());
+
+    for (float &cost : shard.costs) {
+        cost = consume_float(cursor, end);
+    }
+}
+
+void ShardedPathfind::check_usable() const {
+    if (failed) {
+        throw std::runtime_error("Shard workers were shut down by an earlier failure");
+    }
+}
+
+ShardedPathfind::path_t ShardedPathfind::get_path(
+    const uint32_t x_start,
+    const uint32_t y_start,
+    const uint32_t x_end,
+    const uint32_t y_end
+) {
+    check_usable();
+
+    count_refined_shards = 0;
+
+    if (
+        x_start >= width || y_start >= height || x_end >= width || y_end >= height ||
+        (x_start == x_end && y_start == y_end)
+    ) {
+        return path_t();
+    }
+
+    // A failure partway leaves replies unread, which later requests would
+    // read as theirs.
+    try {
+        return find_path(x_start, y_start, x_end, y_end);
+    } catch (...) {
+        failed = true;
+
+        shut_down();
+
+        throw;
+    }
+}
+
+ShardedPathfind::path_t ShardedPathfind::find_path(
+    const uint32_t x_start,
+    const uint32_t y_start,
+    const uint32_t x_end,
+    const uint32_t y_end
+) {
+    path_t path;
+
+    const uint32_t s_start {get_shard(x_start, y_start)};
+    const uint32_t s_end {get_shard(x_end, y_end)};
+
+    Shard &shard_start {shards[s_start]};
+    Shard &shard_end {shards[s_end]};
+
+    {
+        std::vector<unsigned char> payload;
+
+        append_u32(payload, OP_COSTS_FROM);
+        append_u32(payload, x_start - shard_start.x_min);
+        append_u32(payload, y_start - shard_start.y_min);
+        append_u32(payload, s_start == s_end ? x_end - shard_start.x_min : UINT32_MAX);
+        append_u32(payload, s_start == s_end ? y_end - shard_start.y_min : UINT32_MAX);
+
+        send(shard_start, payload);
+    }
+
+    // Sent even if the end shares the start's shard, since the route may
+    // still leave the shard and come back.
+    {
+        std::vector<unsigned char> payload;
+
+        append_u32(payload, OP_COSTS_TO);
+        append_u32(payload, x_end - shard_end.x_min);
+        append_u32(payload, y_end - shard_end.y_min);
+
+        send(shard_end, payload);
+    }
+
+    std::vector<float> costs_from_start;
+    std::vector<float> costs_to_end;
+    float cost_direct;
+
+    {
+        const std::vector<unsigned char> payload {receive(shard_start)};
+
+        const unsigned char *cursor {payload.data()};
+        const unsigned char *const end {payload.data() + payload.size()};
+
+        for (uint32_t i = 0; i < shard_start.nodes.size(); ++i) {
+            costs_from_start.push_back(consume_float(cursor, end));
+        }
+
+        cost_direct = consume_float(cursor, end);
+    }
+
+    {
+        const std::vector<unsigned char> payload {receive(shard_end)};
+
+        const unsigned char *cursor {payload.data()};
+        const unsigned char *const end {payload.data() + payload.size()};
+
+        for (uint32_t i = 0; i < shard_end.nodes.size(); ++i) {
+            costs_to_end.push_back(consume_float(cursor, end));
+        }
+    }
+
+    // Dijkstra over the border graph, from the start to the end.
+    const uint32_t id_start {count_border_nodes};
+    const uint32_t id_end {count_border_nodes + 1};
+    const uint32_t NONE {UINT32_MAX};
+
+    search_costs.assign(count_border_nodes + 2, INFINITY);
+    search_parents.assign(count_border_nodes + 2, NONE);
+
+    typedef std::pair<float, uint32_t> entry_t;
+
+    std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> to_explore;
+
+    const auto relax = [&](const uint32_t from, const uint32_t to, const float cost) {
+        if (cost < search_costs[to]) {
+            search_costs[to] = cost;
+            search_parents[to] = from;
+
+            to_explore.emplace(cost, to);
+        }
+    };
+
+    search_costs[id_start] = 0;
+
+    to_explore.emplace(0, id_start);
+
+    while (!to_explore.empty()) {
+        const auto [cost, id] = to_explore.top();
+
+        to_explore.pop();
+
+        if (cost > search_costs[id]) {
+            continue;
+        }
+
+        if (id == id_end) {
+            break;
+        }
+
+        if (id == id_start) {
+            for (uint32_t i = 0; i < shard_start.nodes.size(); ++i) {
+                relax(id, shard_start.first_node + i, costs_from_start[i]);
+            }
+
+            relax(id, id_end, cost_direct);
+
+            continue;
+        }
+
+        const uint32_t s {node_shards[id]};
+        const Shard &shard {shards[s]};
+        const uint32_t i {id - shard.first_node};
+        const uint32_t n {static_cast<uint32_t>(shard.nodes.size())};
+
+        for (uint32_t j = 0; j < n; ++j) {
+            relax(id, shard.first_node + j, cost + shard.costs[i * n + j]);
+        }
+
+        for (const Crossing &crossing : shard.nodes[i].crossings) {
+            relax(
+                id, shards[crossing.shard].first_node + crossing.node,
+                cost + crossing.cost
+            );
+        }
+
+        if (s == s_end) {
+            relax(id, id_end, cost + costs_to_end[i]);
+        }
+    }
+
+    if (search_costs[id_end] == INFINITY) {
+        return path;
+    }
+
+    // The route's points, from the end back to the start.
+    path_t points {{x_end, y_end}};
+
+    for (
+        uint32_t id = search_parents[id_end]; id != id_start; id = search_parents[id]
+    ) {
+        const Shard &shard {shards[node_shards[id]]};
+        const BorderNode &node {shard.nodes[id - shard.first_node]};
+
+        points.emplace_back(node.x, node.y);
+    }
+
+    points.emplace_back(x_start, y_start);
+
+    std::reverse(points.begin(), points.end());
+
+    // Refine each leg in the shard it runs within, batching the legs of each
+    // shard into one request, and sending them all before waiting on any.
+    std::vector<std::vector<uint32_t>> legs_of(shards.size());
+
+    for (uint32_t k = 0; k + 1 < points.size(); ++k) {
+        const auto [x_from, y_from] = points[k];
+        const auto [x_to, y_to] = points[k + 1];
+
+        const uint32_t s {get_shard(x_from, y_from)};
+
+        if (s == get_shard(x_to, y_to) && (x_from != x_to || y_from != y_to)) {
+            legs_of[s].push_back(k);
+        }
+    }
+
+    for (uint32_t s = 0; s < shards.size(); ++s) {
+        if (legs_of[s].empty()) {
+            continue;
+        }
+
+        const Shard &shard {shards[s]};
+
+        std::vector<unsigned char> payload;
+
+        append_u32(payload, OP_PATHS);
+        append_u32(payload, legs_of[s].size());
+
+        for (const uint32_t k : legs_of[s]) {
+            append_u32(payload, points[k].first - shard.x_min);
+            append_u32(payload, points[k].second - shard.y_min);
+            append_u32(payload, points[k + 1].first - shard.x_min);
+            append_u32(payload, points[k + 1].second - shard.y_min);
+        }
+
+        send(shard, payload);
+
+        ++count_refined_shards;
+    }
+
+    // Per leg; its refined path, in travel order, in map coordinates.
+    std::vector<path_t> refined(points.size());
+
+    for (uint32_t s = 0; s < shards.size(); ++s) {
+        if (legs_of[s].empty()) {
+            continue;
+        }
+
+        const Shard &shard {shards[s]};
+
+        const std::vector<unsigned char> payload {receive(shard)};
+
+        const unsigned char *cursor {payload.data()};
+        const unsigned char *const end {payload.data() + payload.size()};
+
+        for (const uint32_t k : legs_of[s]) {
+            refined[k] = decode_path(cursor, end);
+
+            if (refined[k].empty()) {
+                throw std::runtime_error("Shard worker found no path for a leg");
+            }
+
+            for (auto &[x, y] : refined[k]) {
+                x += shard.x_min;
+                y += shard.y_min;
+            }
+        }
+    }
+
+    path.push_back(points.front());
+
+    for (uint32_t k = 0; k + 1 < points.size(); ++k) {
+        if (refined[k].empty()) {
+            // A step across a shard edge, or none at all.
+            if (points[k + 1] != path.back()) {
+                path.push_back(points[k + 1]);
+            }
+
+            continue;
+        }
+
+        path.insert(path.end(), refined[k].begin() + 1, refined[k].end());
+    }
+
+    std::reverse(path.begin(), path.end());
+
+    return path;
+}
+
+void ShardedPathfind::set_blocking(
+    const uint32_t x, const uint32_t y, const bool blocking
+) {
+    check_usable();
+
+    if (x >= width || y >= height) {
+        throw std::invalid_argument("Cell out of bounds of the map");
+    }
+
+    try {
+        update_blocking(x, y, blocking);
+    } catch (...) {
+        failed = true;
+
+        shut_down();
+
+        throw;
+    }
+}
+
+void ShardedPathfind::update_blocking(
+    const uint32_t x, const uint32_t y, const bool blocking
+) {
+    const uint32_t s {get_shard(x, y)};
+
+    Shard &shard {shards[s]};
+
+    std::vector<unsigned char> payload;
+
+    append_u32(payload, OP_SET_BLOCKING);
+    append_u32(payload, x - shard.x_min);
+    append_u32(payload, y - shard.y_min);
+    append_u32(payload, blocking);
+
+    send(shard, payload);
+    receive(shard);
+
+    std::vector<bool> stale(shards.size(), false);
+
+    stale[s] = true;
+
+    const bool on_edge {
+        x == shard.x_min || x == shard.x_min + shard.width - 1 ||
+        y == shard.y_min || y == shard.y_min + shard.height - 1
+    };
+
+    if (on_edge) {
+        payload.clear();
+
+        append_u32(payload, OP_PERIMETER);
+
+        send(shard, payload);
+        fetch_perimeter(shard);
+
+        rebuild_border(std::move(stale));
+    }
+    else {
+        send_nodes(shard);
+        receive_costs(shard);
+    }
+}
@@ -0,0 +1,271 @@
+#ifndef SHARDEDPATHFIND_H
+#define SHARDEDPATHFIND_H
+
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "Map.h"
+#include "Terrain.h"
+#include "Util.h"
+
+// Pathfinding over a map partitioned into square shards, each owned by its
+// own worker process, so that the map need not fit in one process, and the
+// searches of one query spread across cores.
+//
+// This process coordinates. It keeps only a graph over the shard borders, in
+// the manner of HPA*: wherever an open cell on one side of a shard edge faces
+// an open cell on the other, the run of such pairs is an entrance, with a
+// transition across it at its middle, or, for long runs, at both ends. The
+// border nodes are the cells of those transitions. Each worker computes the
+// exact costs between the border nodes of its shard, within the shard, and
+// the coordinator links the nodes of neighboring shards with the transitions.
+//
+// A query asks the workers of the start and end shards for the costs from the
+// start to their border nodes, and from them to the end, then searches the
+// border graph. Only the shards the route passes through then refine it, in
+// parallel, each filling in the path between the border nodes it enters and
+// leaves by. Paths are as `DistanceSearch` finds them within each shard, so
+// cost no less than the optimal path, and, since routes only cross shard
+// edges at transitions, a little more.
+//
+// The coordinator talks to each worker over a Unix socket pair, in the frames
+// of `QueryProtocol.h`, and the workers are forked from this process, so they
+// start with the map already in memory, and only copy out their shard. A
+// memory-mapped `MappedMap` is only paged in by each worker for its own shard.
+// Cells are open unless blocking.
+//
+// Not thread-safe. The workers exit when this is destroyed, or once any
+// request fails, since a failure partway through a request can leave replies
+// unread; every later request then throws.
+class ShardedPathfind {
+public:
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+private:
+    // Entrances at least this long get a transition at each end.
+    static inline const uint32_t LONG_ENTRANCE {6};
+
+    // A step from a border node to one of a neighboring shard.
+    struct Crossing {
+        uint32_t shard;
+        uint32_t node;
+        // The cost of entering the node across the edge.
+        float cost;
+    };
+
+    struct BorderNode {
+        uint32_t x;
+        uint32_t y;
+
+        std::vector<Crossing> crossings;
+    };
+
+    struct Shard {
+        pid_t pid {-1};
+        int fd {-1};
+
+        // Its cells, [x_min, x_min + width) x [y_min, y_min + height).
+        uint32_t x_min;
+        uint32_t y_min;
+        uint32_t width;
+        uint32_t height;
+
+        // The cost of entering each cell of each edge, or infinity if it is
+        // blocking, left to right, or top to bottom.
+        std::vector<float> top;
+        std::vector<float> bottom;
+        std::vector<float> left;
+        std::vector<float> right;
+
+        std::vector<BorderNode> nodes;
+        // The cost from each of `nodes` to each, within the shard, row by
+        // source.
+        std::vector<float> costs;
+
+        // The id of its first node in the border graph search.
+        uint32_t first_node;
+    };
+
+    const uint32_t shard_size;
+    const uint32_t shards_x;
+    const uint32_t shards_y;
+    const TerrainCosts terrain_costs;
+    // The threads each worker computes border costs on.
+    const uint32_t worker_threads;
+
+    std::vector<Shard> shards;
+
+    uint32_t count_border_nodes {0};
+    // Per border node, by its id in the border graph search; its shard.
+    std::vector<uint32_t> node_shards;
+    uint32_t count_refined_shards {0};
+
+    // Whether a request failed, and the workers were shut down.
+    bool failed {false};
+
+    // Scratch for the border graph search, one entry per node, then the
+    // start and the end.
+    std::vector<float> search_costs;
+    std::vector<uint32_t> search_parents;
+
+    // Serve requests for the shard `map` from `fd` until the coordinator
+    // hangs up. Runs in the worker process.
+    static void serve_shard(
+        Map &map, const int fd, const TerrainCosts &terrain_costs,
+        const uint32_t threads
+    );
+
+    // Fork a worker per shard, each serving the `Map` that `extract()`
+    // copies its shard into.
+    void spawn(const std::function<Map(const Shard &shard)> &extract);
+
+    // Close the workers' sockets, and reap them.
+    void shut_down();
+
+    void send(const Shard &shard, const std::vector<unsigned char> &payload) const;
+    std::vector<unsigned char> receive(const Shard &shard) const;
+
+    uint32_t get_shard(const uint32_t x, const uint32_t y) const {
+        return (y / shard_size) * shards_x + x / shard_size;
+    }
+
+    void fetch_perimeter(Shard &shard);
+
+    // Rebuild every shard's border nodes from the perimeters, and have the
+    // workers compute costs for those in `stale` and those whose nodes moved.
+    void rebuild_border(std::vector<bool> &&stale);
+
+    void send_nodes(const Shard &shard) const;
+    void receive_costs(Shard &shard);
+
+    // Throws std::runtime_error if the workers were shut down.
+    void check_usable() const;
+
+    // `get_path()` and `set_blocking()` for valid arguments.
+    path_t find_path(
+        const uint32_t x_start,
+        const uint32_t y_start,
+        const uint32_t x_end,
+        const uint32_t y_end
+    );
+    void update_blocking(const uint32_t x, const uint32_t y, const bool blocking);
+
+public:
+    // Partition `map` into shards of `shard_size` x `shard_size` cells, fork
+    // a worker for each, and build the border graph. The map is only read
+    // while constructing; afterwards, edits go through `set_blocking()`.
+    //
+    // Each worker computes the costs between its border nodes on
+    // `worker_threads` threads; by default, the cores divided among the
+    // shards, and at least one.
+    //
+    // Throws std::runtime_error if a worker cannot be started or fails.
+    template <typename map_t>
+    ShardedPathfind(
+        const map_t &map,
+        const uint32_t shard_size,
+        const TerrainCosts &terrain_costs = DEFAULT_TERRAIN_COSTS,
+        const uint32_t worker_threads = 0
+    );
+
+    ShardedPathfind(const ShardedPathfind &) = delete;
+    ShardedPathfind &operator=(const ShardedPathfind &) = delete;
+
+    ~ShardedPathfind();
+
+    // The x-coordinate range.
+    const uint32_t width;
+    // The y-coordinate range.
+    const uint32_t height;
+
+    // As `Pathfind::get_path()`: end-first, and empty if there is no path, or
+    // the start and end coincide.
+    //
+    // Throws std::runtime_error if a worker fails, or failed before.
+    path_t get_path(
+        const uint32_t x_start,
+        const uint32_t y_start,
+        const uint32_t x_end,
+        const uint32_t y_end
+    );
+
+    // Block or clear a cell in the shard that owns it. That shard recomputes
+    // the costs between its border nodes, and, if the cell is on its edge,
+    // so do the neighbors whose entrances it changed.
+    //
+    // Throws std::invalid_argument if the cell is out of bounds, and
+    // std::runtime_error if a worker fails, or failed before.
+    void set_blocking(const uint32_t x, const uint32_t y, const bool blocking);
+
+    uint32_t get_shard_count() const {
+        return shards.size();
+    }
+
+    uint32_t get_border_node_count() const {
+        return count_border_nodes;
+    }
+
+    // The number of shards that refined the last path.
+    uint32_t get_refined_shard_count() const {
+        return count_refined_shards;
+    }
+};
+
+template <typename map_t>
+ShardedPathfind::ShardedPathfind(
+    const map_t &map,
+    const uint32_t shard_size,
+    const TerrainCosts &terrain_costs,
+    const uint32_t worker_threads
+):
+    shard_size(std::max(shard_size, 1u)),
+    shards_x((map.width + this->shard_size - 1) / this->shard_size),
+    shards_y((map.height + this->shard_size - 1) / this->shard_size),
+    terrain_costs(terrain_costs),
+    worker_threads(
+        worker_threads != 0 ?
+            worker_threads :
+            std::max(1u, std::thread::hardware_concurrency() / (shards_x * shards_y))
+    ),
+    width(map.width),
+    height(map.height)
+{
+    spawn(
+        [&map](const Shard &shard) {
+            std::vector<MapNode> nodes;
+
+            const uint32_t count {get_node_count(shard.width, shard.height)};
+
+            nodes.reserve(count);
+
+            for (uint32_t i = 0; i < count; ++i) {
+                const auto [x, y] = get_node_xy(i, shard.width);
+
+                if (x >= shard.width || y >= shard.height) {
+                    nodes.emplace_back(x, y, true);
+
+                    continue;
+                }
+
+                const auto node {
+                    map.get_nodes()[
+                        get_node_index(shard.x_min + x, shard.y_min + y, map.width)
+                    ]
+                };
+
+                nodes.emplace_back(
+                    x, y, node.get_blocking(), std::nullopt, node.get_terrain()
+                );
+            }
+
+            return Map(shard.width, shard.height, std::move(nodes));
+        }
+    );
+}
+
+#endif
@@ -0,0 +1,85 @@
+#include "SpatialGrid.h"
+
+#include <assert.h>
+
+SpatialGrid::SpatialGrid(
+    const uint32_t width, const uint32_t height, const uint32_t bucket_size
+):
+    bucket_size(std::max<uint32_t>(bucket_size, 1)),
+    buckets_wide(std::max<uint32_t>((width + this->bucket_size - 1) / this->bucket_size, 1)),
+    buckets_high(std::max<uint32_t>((height + this->bucket_size - 1) / this->bucket_size, 1)),
+    bucket_head(buckets_wide * buckets_high, NONE)
+{}
+
+void SpatialGrid::link(const uint32_t id, const uint32_t bucket) {
+    const uint32_t head {bucket_head[bucket]};
+
+    entity_bucket[id] = bucket;
+    entity_prev[id] = NONE;
+    entity_next[id] = head;
+
+    if (head != NONE) {
+        entity_prev[head] = id;
+    }
+
+    bucket_head[bucket] = id;
+}
+
+void SpatialGrid::unlink(const uint32_t id) {
+    const uint32_t prev {entity_prev[id]};
+    const uint32_t next {entity_next[id]};
+
+    if (prev != NONE) {
+        entity_next[prev] = next;
+    }
+    else {
+        bucket_head[entity_bucket[id]] = next;
+    }
+
+    if (next != NONE) {
+        entity_prev[next] = prev;
+    }
+
+    entity_bucket[id] = NONE;
+}
+
+void SpatialGrid::insert(const uint32_t id, const float x, const float y) {
+    assert(!contains(id));
+
+    if (id >= entity_bucket.size()) {
+        entity_bucket.resize(id + 1, NONE);
+        entity_next.resize(id + 1, NONE);
+        entity_prev.resize(id + 1, NONE);
+        entity_x.resize(id + 1, 0);
+        entity_y.resize(id + 1, 0);
+    }
+
+    entity_x[id] = x;
+    entity_y[id] = y;
+
+    link(id, get_bucket(x, y));
+
+    ++count;
+}
+
+void SpatialGrid::move(const uint32_t id, const float x, const float y) {
+    assert(contains(id));
+
+    entity_x[id] = x;
+    entity_y[id] = y;
+
+    const uint32_t bucket {get_bucket(x, y)};
+
+    if (bucket != entity_bucket[id]) {
+        unlink(id);
+        link(id, bucket);
+    }
+}
+
+void SpatialGrid::remove(const uint32_t id) {
+    assert(contains(id));
+
+    unlink(id);
+
+    --count;
+}
@@ -0,0 +1,162 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A uniform-grid spatial index of point entities, eg, agent positions.
+//
+// The map is divided into square buckets of `bucket_size` cells. Each bucket
+// heads an intrusive doubly-linked list of the entities inside it, threaded
+// through flat per-entity arrays, so inserting, moving and removing an entity
+// are all O(1) and never allocate once the arrays have grown to cover the
+// entity ids in use. Queries only visit the buckets overlapping the query
+// area, so their cost depends on the entities found there rather than on the
+// total entity count.
+//
+// Entities are identified by small dense integer ids chosen by the caller, eg,
+// agent ids. Positions are in cell units, as for `Pos`.
+class SpatialGrid {
+public:
+    static inline const uint32_t NONE {UINT32_MAX};
+
+private:
+    const uint32_t bucket_size;
+    const uint32_t buckets_wide;
+    const uint32_t buckets_high;
+
+    // The first entity in each bucket.
+    std::vector<uint32_t> bucket_head;
+
+    // Per entity.
+    std::vector<uint32_t> entity_bucket;
+    std::vector<uint32_t> entity_next;
+    std::vector<uint32_t> entity_prev;
+    std::vector<float> entity_x;
+    std::vector<float> entity_y;
+
+    uint32_t count {0};
+
+    uint32_t bucket_coord(const float coord, const uint32_t buckets) const {
+        const int32_t bucket = static_cast<int32_t>(std::floor(coord)) / static_cast<int32_t>(bucket_size);
+
+        return std::clamp<int32_t>(bucket, 0, buckets - 1);
+    }
+
+    uint32_t get_bucket(const float x, const float y) const {
+        return bucket_coord(y, buckets_high) * buckets_wide + bucket_coord(x, buckets_wide);
+    }
+
+    void link(const uint32_t id, const uint32_t bucket);
+
+    void unlink(const uint32_t id);
+
+public:
+    // Index entities over a `width` by `height` cell map. Positions outside
+    // the map are clamped into the edge buckets.
+    SpatialGrid(const uint32_t width, const uint32_t height, const uint32_t bucket_size = 8);
+
+    void insert(const uint32_t id, const float x, const float y);
+
+    // Only relinks the entity if it changed bucket.
+    void move(const uint32_t id, const float x, const float y);
+
+    void remove(const uint32_t id);
+
+    bool contains(const uint32_t id) const {
+        return id < entity_bucket.size() && entity_bucket[id] != NONE;
+    }
+
+    uint32_t size() const {
+        return count;
+    }
+
+    // Invoke `fn(id, x, y)` for every entity inside the rectangle
+    // [x_min, x_max] x [y_min, y_max].
+    template <typename F>
+    void query_rect(
+        const float x_min, const float y_min,
+        const float x_max, const float y_max,
+        F &&fn
+    ) const;
+
+    // Invoke `fn(id, x, y)` for every entity within `radius` of (x, y).
+    template <typename F>
+    void query_radius(const float x, const float y, const float radius, F &&fn) const {
+        const float radius_sq {radius * radius};
+
+        query_rect(
+            x - radius, y - radius, x + radius, y + radius,
+            [&](const uint32_t id, const float x_entity, const float y_entity) {
+                const float dx {x_entity - x};
+                const float dy {y_entity - y};
+
+                if (dx * dx + dy * dy <= radius_sq) {
+                    fn(id, x_entity, y_entity);
+                }
+            }
+        );
+    }
+
+    // Invoke `fn(id, x, y)` for every entity inside cell (x, y).
+    template <typename F>
+    void query_cell(const uint32_t x, const uint32_t y, F &&fn) const {
+        query_rect(
+            x, y, x + 1, y + 1,
+            [&](const uint32_t id, const float x_entity, const float y_entity) {
+                if (
+                    static_cast<uint32_t>(x_entity) == x &&
+                    static_cast<uint32_t>(y_entity) == y
+                ) {
+                    fn(id, x_entity, y_entity);
+                }
+            }
+        );
+    }
+};
+
+template <typename F>
+void SpatialGrid::query_rect(
+    const float x_min, const float y_min,
+    const float x_max, const float y_max,
+    F &&fn
+) const {
+    if (x_min > x_max || y_min > y_max) {
+        return;
+    }
+
+    const uint32_t bx_min {bucket_coord(x_min, buckets_wide)};
+    const uint32_t bx_max {bucket_coord(x_max, buckets_wide)};
+    const uint32_t by_min {bucket_coord(y_min, buckets_high)};
+    const uint32_t by_max {bucket_coord(y_max, buckets_high)};
+
+    for (uint32_t by = by_min; by <= by_max; ++by) {
+        for (uint32_t bx = bx_min; bx <= bx_max; ++bx) {
+            // Only buckets on the edge of the query need their entities
+            // checked against it.
+            const bool edge {
+                bx == bx_min || bx == bx_max || by == by_min || by == by_max
+            };
+
+            for (
+                uint32_t id = bucket_head[by * buckets_wide + bx];
+                id != NONE;
+                id = entity_next[id]
+            ) {
+                const float x {entity_x[id]};
+                const float y {entity_y[id]};
+
+                if (
+                    !edge ||
+                    (x >= x_min && x <= x_max && y >= y_min && y <= y_max)
+                ) {
+                    fn(id, x, y);
+                }
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+
+// The terrain class of a map cell. Cells store only their class; what it
+// costs to cross a class is up to each agent's `TerrainCosts`, so that, eg,
+// wheeled and foot units can share one map.
+enum Terrain : uint8_t {
+    TERRAIN_GROUND = 0,
+    TERRAIN_ROAD = 1,
+};
+
+// An agent's cost multiplier for crossing each terrain class. The table is
+// small enough to stay cache-resident during a search, so that the cost of a
+// cell is two loads: its class, then the table entry.
+//
+// Built from the costs of the first few classes, from ground up; any class
+// without a cost of its own costs as much as ground, rather than nothing.
+// Tables for fixed profiles can be declared `constexpr`.
+//
+// Classes are only checked against `MAX_CLASSES` where they are set, and only
+// in debug builds: map files and chunks are used in place, without reading
+// every cell to check it. A class of `MAX_CLASSES` or more therefore aliases
+// the class it is congruent to, modulo `MAX_CLASSES`, eg, 17 costs as much as
+// road, rather than read past the table.
+struct TerrainCosts {
+    static inline constexpr uint32_t MAX_CLASSES {16};
+
+    // So that masking a class keeps it within the table.
+    static_assert((MAX_CLASSES & (MAX_CLASSES - 1)) == 0);
+
+    std::array<float, MAX_CLASSES> costs;
+
+    // Throws std::invalid_argument if there are no costs, or more than
+    // `MAX_CLASSES`; in a constant expression, that fails to compile.
+    constexpr TerrainCosts(const std::initializer_list<float> listed):
+        costs()
+    {
+        if (listed.size() == 0 || listed.size() > MAX_CLASSES) {
+            throw std::invalid_argument("Terrain costs must list 1 to 16 classes");
+        }
+
+        costs.fill(*listed.begin());
+
+        std::copy(listed.begin(), listed.end(), costs.begin());
+    }
+
+    // Classes beyond the table wrap around; see above.
+    constexpr float operator[](const uint8_t terrain) const {
+        return costs[terrain & (MAX_CLASSES - 1)];
+    }
+};
+
+// Costs for ordinary foot traffic: roads are quicker than open ground.
+inline constexpr TerrainCosts DEFAULT_TERRAIN_COSTS {{1.3f, 0.7f}};
+
+#endif
@@ -0,0 +1,223 @@
+#include "Trace.h"
+
+#include <cstdlib>
+
+#ifdef PATHFINDING_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    // Spans per thread ring buffer.
+    const uint32_t RING_CAPACITY {1 << 16};
+
+    // Rings of exited threads kept for export, beyond which the oldest are
+    // dropped.
+    const uint32_t MAX_ABANDONED_RINGS {32};
+
+    struct TraceEvent {
+        const char *name;
+        uint64_t start_ns;
+        uint64_t dur_ns;
+    };
+
+    struct TraceRing {
+        const uint32_t tid;
+        std::atomic<const char *> thread_name {nullptr};
+
+        // Total spans ever recorded; the ring holds the most recent
+        // `RING_CAPACITY` of them.
+        std::atomic<uint64_t> head {0};
+        std::vector<TraceEvent> events;
+
+        // Set once the owning thread exits, after its last span.
+        std::atomic<bool> abandoned {false};
+
+        TraceRing(const uint32_t tid):
+            tid(tid),
+            events(RING_CAPACITY)
+        {}
+    };
+
+    const std::chrono::steady_clock::time_point trace_epoch {
+        std::chrono::steady_clock::now()
+    };
+
+    std::mutex rings_mu;
+    // Rings are kept alive after their threads exit, so that their spans can
+    // still be exported, until they have been, or until too many other
+    // threads have exited since.
+    std::vector<std::shared_ptr<TraceRing>> rings;
+    uint32_t next_tid {1};
+
+    // A thread's ring, marked abandoned once the thread exits.
+    struct ThreadRing {
+        std::shared_ptr<TraceRing> ring {
+            []() {
+                std::scoped_lock<std::mutex> lock(rings_mu);
+
+                return rings.emplace_back(std::make_shared<TraceRing>(next_tid++));
+            }()
+        };
+
+        ~ThreadRing() {
+            std::scoped_lock<std::mutex> lock(rings_mu);
+
+            ring->abandoned.store(true, std::memory_order_release);
+
+            const auto count_abandoned {
+                std::count_if(
+                    rings.begin(), rings.end(),
+                    [](const std::shared_ptr<TraceRing> &ring) {
+                        return ring->abandoned.load(std::memory_order_relaxed);
+                    }
+                )
+            };
+
+            if (count_abandoned > static_cast<ptrdiff_t>(MAX_ABANDONED_RINGS)) {
+                rings.erase(
+                    std::find_if(
+                        rings.begin(), rings.end(),
+                        [](const std::shared_ptr<TraceRing> &ring) {
+                            return ring->abandoned.load(std::memory_order_relaxed);
+                        }
+                    )
+                );
+            }
+        }
+    };
+
+    TraceRing &get_thread_ring() {
+        thread_local ThreadRing thread_ring;
+
+        return *thread_ring.ring;
+    }
+}
+
+uint64_t TraceSpan::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_epoch
+    ).count();
+}
+
+TraceSpan::~TraceSpan() {
+    const uint64_t end_ns {now_ns()};
+
+    TraceRing &ring {get_thread_ring()};
+
+    const uint64_t head {ring.head.load(std::memory_order_relaxed)};
+
+    ring.events[head % RING_CAPACITY] = {name, start_ns, end_ns - start_ns};
+
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void trace_set_thread_name(const char *name) {
+    get_thread_ring().thread_name = name;
+}
+
+bool trace_export_chrome(const std::string &path) {
+    std::ofstream out(path, std::ios::trunc);
+
+    if (!out) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<TraceRing>> rings_snapshot;
+    // Rings of threads that had exited by the snapshot, and so will have
+    // every span exported.
+    std::vector<std::shared_ptr<TraceRing>> rings_done;
+
+    {
+        std::scoped_lock<std::mutex> lock(rings_mu);
+
+        rings_snapshot = rings;
+
+        for (const auto &ring : rings) {
+            if (ring->abandoned.load(std::memory_order_acquire)) {
+                rings_done.push_back(ring);
+            }
+        }
+    }
+
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+
+    bool first {true};
+
+    const auto separator = [&]() -> const char * {
+        if (first) {
+            first = false;
+
+            return "\n";
+        }
+
+        return ",\n";
+    };
+
+    for (const auto &ring : rings_snapshot) {
+        if (const char *thread_name {ring->thread_name}; thread_name) {
+            out
+                << separator()
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << ring->tid << ",\"args\":{\"name\":\"" << thread_name
+                << "\"}}";
+        }
+
+        const uint64_t head {ring->head.load(std::memory_order_acquire)};
+        const uint64_t tail {head > RING_CAPACITY ? head - RING_CAPACITY : 0};
+
+        for (uint64_t i = tail; i < head; ++i) {
+            const TraceEvent &event {ring->events[i % RING_CAPACITY]};
+
+            // Chrome trace timestamps are in (fractional) microseconds.
+            out
+                << separator()
+                << "{\"name\":\"" << event.name
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+                << ",\"ts\":" << event.start_ns / 1000.0
+                << ",\"dur\":" << event.dur_ns / 1000.0 << "}";
+        }
+    }
+
+    out << "\n]}\n";
+
+    if (!out) {
+        return false;
+    }
+
+    {
+        std::scoped_lock<std::mutex> lock(rings_mu);
+
+        std::erase_if(
+            rings,
+            [&](const std::shared_ptr<TraceRing> &ring) {
+                return std::find(rings_done.begin(), rings_done.end(), ring) !=
+                    rings_done.end();
+            }
+        );
+    }
+
+    return true;
+}
+
+#else
+
+void trace_set_thread_name(const char *name) {}
+
+bool trace_export_chrome(const std::string &path) {
+    return true;
+}
+
+#endif
+
+void trace_export_chrome_from_env() {
+    if (const char *path {std::getenv("PATHFINDING_TRACE_FILE")}; path) {
+        trace_export_chrome(path);
+    }
+}
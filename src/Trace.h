@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+// Lightweight scoped tracing, exportable as Chrome trace JSON (viewable in
+// `chrome://tracing` or Perfetto).
+//
+// Tracing is compiled in only when `PATHFINDING_TRACE` is defined (see the
+// `TRACE` Makefile variable). Otherwise the macros below expand to nothing,
+// and the functions are no-ops, so call sites need no guards of their own.
+//
+// Each thread records completed spans into its own fixed-size ring buffer, so
+// recording takes no locks and never allocates after a thread's first span.
+// When a ring fills, its oldest spans are overwritten. The rings of exited
+// threads are freed once exported, and only those of the 32 most recently
+// exited are kept until then.
+//
+// Span names must be string literals (or otherwise outlive the trace).
+
+// Sets the name shown for the calling thread in exported traces.
+void trace_set_thread_name(const char *name);
+
+// Writes every thread's recorded spans to `path` as Chrome trace JSON, then
+// frees the rings of threads that had exited; their spans are not exported
+// again. For an exact trace, call this while traced threads are quiescent;
+// spans recorded concurrently with the export may be torn.
+//
+// Returns false if the file could not be written.
+bool trace_export_chrome(const std::string &path);
+
+// Exports to the path in the `PATHFINDING_TRACE_FILE` environment variable,
+// if it is set.
+void trace_export_chrome_from_env();
+
+#ifdef PATHFINDING_TRACE
+
+class TraceSpan {
+private:
+    const char *const name;
+    const uint64_t start_ns;
+
+public:
+    static uint64_t now_ns();
+
+    TraceSpan(const char *name):
+        name(name),
+        start_ns(now_ns())
+    {}
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    ~TraceSpan();
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Records a span named `name` covering the rest of the enclosing scope.
+#define TRACE_SCOPE(name) \
+    const TraceSpan TRACE_CONCAT(trace_span_, __LINE__) {name}
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (false)
+
+#endif
+
+#endif
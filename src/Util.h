@@ -8,13 +8,244 @@
 
 #include <assert.h>
 
-uint32_t get_node_index(
+// Cell layouts: how the cell (x, y) of a map `width` cells wide maps to its
+// index in the map's nodes and in every per-cell array kept alongside them.
+//
+// Each layout provides:
+//
+// - `index(x, y, width)` and `xy(i, width)`, which invert each other.
+// - `count(width, height)`, the size of the index space, which padded layouts
+//   round up to whole tiles. Padding cells lie outside the map, are blocked,
+//   and are never reached by a search.
+// - `count_wide(width, height)`, the same in 64 bits, which cannot wrap.
+// - `step(idx, x, y, d_x, d_y, width)`, the index of the neighbor
+//   (x + d_x, y + d_y) of cell `idx` at (x, y), for steps of at most one cell
+//   along each axis that stay within the map.
+
+// Rows one after another. The default.
+struct RowMajorLayout {
+    // Stored in map files, so that a file is only read in the layout it was
+    // written in.
+    static constexpr uint32_t ID {0};
+
+    static uint32_t index(const uint32_t x, const uint32_t y, const uint32_t width) {
+        return y * width + x;
+    }
+
+    static std::pair<uint32_t, uint32_t> xy(const uint32_t i, const uint32_t width) {
+        const uint32_t y = i / width;
+        const uint32_t x = i - (y * width);
+
+        return {x, y};
+    }
+
+    static uint32_t count(const uint32_t width, const uint32_t height) {
+        return width * height;
+    }
+
+    static uint64_t count_wide(const uint32_t width, const uint32_t height) {
+        return uint64_t {width} * height;
+    }
+
+    static uint32_t step(
+        const uint32_t idx, const uint32_t, const uint32_t,
+        const int32_t d_x, const int32_t d_y, const uint32_t width
+    ) {
+        return idx + static_cast<uint32_t>(d_y * static_cast<int32_t>(width) + d_x);
+    }
+};
+
+// Square tiles of 2^TILE_BITS cells a side, one after another in row order,
+// with `Within` laying out the cells of each tile. Every step but those
+// leaving a tile stays within a few cache lines of the cell it is from, so a
+// search's neighbors, and its open regions, are compact in memory.
+template <uint32_t TILE_BITS, typename Within>
+struct TiledLayoutBase {
+    static_assert(TILE_BITS >= 1 && TILE_BITS <= 8);
+
+    static constexpr uint32_t TILE {uint32_t {1} << TILE_BITS};
+    static constexpr uint32_t MASK {TILE - 1};
+    static constexpr uint32_t ID {Within::KIND | (TILE_BITS << 8)};
+
+    static uint32_t tiles_across(const uint32_t width) {
+        return (width + MASK) >> TILE_BITS;
+    }
+
+    static uint32_t index(const uint32_t x, const uint32_t y, const uint32_t width) {
+        const uint32_t tile {(y >> TILE_BITS) * tiles_across(width) + (x >> TILE_BITS)};
+
+        return (tile << (2 * TILE_BITS)) | Within::index(x & MASK, y & MASK);
+    }
+
+    static std::pair<uint32_t, uint32_t> xy(const uint32_t i, const uint32_t width) {
+        const uint32_t tile {i >> (2 * TILE_BITS)};
+        const uint32_t across {tiles_across(width)};
+        const uint32_t y_tile {tile / across};
+        const uint32_t x_tile {tile - y_tile * across};
+
+        const auto [x, y] = Within::xy(i & (TILE * TILE - 1));
+
+        return {(x_tile << TILE_BITS) | x, (y_tile << TILE_BITS) | y};
+    }
+
+    static uint32_t count(const uint32_t width, const uint32_t height) {
+        return (tiles_across(width) * tiles_across(height)) << (2 * TILE_BITS);
+    }
+
+    static uint64_t count_wide(const uint32_t width, const uint32_t height) {
+        const uint64_t across {(uint64_t {width} + MASK) >> TILE_BITS};
+        const uint64_t down {(uint64_t {height} + MASK) >> TILE_BITS};
+
+        return (across * down) << (2 * TILE_BITS);
+    }
+
+    static uint32_t step(
+        const uint32_t idx, const uint32_t x, const uint32_t y,
+        const int32_t d_x, const int32_t d_y, const uint32_t width
+    ) {
+        const uint32_t x_in {(x & MASK) + d_x};
+        const uint32_t y_in {(y & MASK) + d_y};
+
+        // Unsigned, so a step out of either side of the tile is out of range.
+        if (x_in > MASK || y_in > MASK) {
+            return index(x + d_x, y + d_y, width);
+        }
+
+        const uint32_t in_tile {TILE * TILE - 1};
+
+        return (idx & ~in_tile) | Within::step(idx & in_tile, d_x, d_y);
+    }
+};
+
+// Rows within each tile.
+template <uint32_t TILE_BITS>
+struct TileRows {
+    static constexpr uint32_t KIND {1};
+    static constexpr uint32_t MASK {(uint32_t {1} << TILE_BITS) - 1};
+
+    static uint32_t index(const uint32_t x, const uint32_t y) {
+        return (y << TILE_BITS) | x;
+    }
+
+    static std::pair<uint32_t, uint32_t> xy(const uint32_t i) {
+        return {i & MASK, i >> TILE_BITS};
+    }
+
+    static uint32_t step(const uint32_t i, const int32_t d_x, const int32_t d_y) {
+        return i + static_cast<uint32_t>(d_y * (int32_t {1} << TILE_BITS) + d_x);
+    }
+};
+
+// Z-order within each tile: the bits of x and y interleaved, x lowest, so
+// that every aligned square of cells, down to 2x2, is contiguous.
+template <uint32_t TILE_BITS>
+struct TileMorton {
+    static constexpr uint32_t KIND {2};
+    static constexpr uint32_t BITS_X {0x5555 & ((uint32_t {1} << (2 * TILE_BITS)) - 1)};
+    static constexpr uint32_t BITS_Y {BITS_X << 1};
+
+    static uint32_t spread(uint32_t v) {
+        v = (v | (v << 4)) & 0x0F0F;
+        v = (v | (v << 2)) & 0x3333;
+        v = (v | (v << 1)) & 0x5555;
+
+        return v;
+    }
+
+    static uint32_t compact(uint32_t v) {
+        v &= 0x5555;
+        v = (v | (v >> 1)) & 0x3333;
+        v = (v | (v >> 2)) & 0x0F0F;
+        v = (v | (v >> 4)) & 0x00FF;
+
+        return v;
+    }
+
+    static uint32_t index(const uint32_t x, const uint32_t y) {
+        return spread(x) | (spread(y) << 1);
+    }
+
+    static std::pair<uint32_t, uint32_t> xy(const uint32_t i) {
+        return {compact(i), compact(i >> 1)};
+    }
+
+    // Add -1, 0 or 1 to the coordinate held in the bits `bits` of `i`,
+    // without decoding it: filling the bits between with ones carries an
+    // increment straight across them, and clearing them borrows likewise.
+    static uint32_t add(const uint32_t i, const uint32_t bits, const int32_t d) {
+        if (d > 0) {
+            return ((i | ~bits) + 1) & bits;
+        }
+        if (d < 0) {
+            return ((i & bits) - 1) & bits;
+        }
+
+        return i & bits;
+    }
+
+    static uint32_t step(const uint32_t i, const int32_t d_x, const int32_t d_y) {
+        return add(i, BITS_X, d_x) | add(i, BITS_Y, d_y);
+    }
+};
+
+template <uint32_t TILE_BITS>
+using TiledLayout = TiledLayoutBase<TILE_BITS, TileRows<TILE_BITS>>;
+
+template <uint32_t TILE_BITS>
+using MortonLayout = TiledLayoutBase<TILE_BITS, TileMorton<TILE_BITS>>;
+
+// The layout in use, chosen at build time (see `make LAYOUT=`).
+#ifndef PATHFINDING_LAYOUT_TILE_BITS
+#define PATHFINDING_LAYOUT_TILE_BITS 4
+#endif
+
+#if defined(PATHFINDING_LAYOUT_TILED)
+typedef TiledLayout<PATHFINDING_LAYOUT_TILE_BITS> CellLayout;
+#elif defined(PATHFINDING_LAYOUT_MORTON)
+typedef MortonLayout<PATHFINDING_LAYOUT_TILE_BITS> CellLayout;
+#else
+typedef RowMajorLayout CellLayout;
+#endif
+
+inline uint32_t get_node_index(
     const uint32_t x, const uint32_t y, const uint32_t width
-);
+) {
+    assert(width > 0);
+    assert(x < width);
+
+    return CellLayout::index(x, y, width);
+}
 
-std::pair<uint32_t, uint32_t> get_node_xy(
+inline std::pair<uint32_t, uint32_t> get_node_xy(
     const uint32_t i, const uint32_t width
-);
+) {
+    return CellLayout::xy(i, width);
+}
+
+// The size of the index space of a map of `width` x `height` cells, ie, of
+// its nodes and of any per-cell array indexed by `get_node_index()`.
+inline uint32_t get_node_count(const uint32_t width, const uint32_t height) {
+    return CellLayout::count(width, height);
+}
+
+// As `get_node_count()`, but without wrapping, eg, to check that dimensions
+// read from a file give an index space that fits in 32 bits.
+inline uint64_t get_node_count_wide(const uint32_t width, const uint32_t height) {
+    return CellLayout::count_wide(width, height);
+}
+
+// The index of the neighbor (x + d_x, y + d_y) of cell `idx` at (x, y); see
+// `CellLayout::step()`.
+inline uint32_t get_neighbor_index(
+    const uint32_t idx, const uint32_t x, const uint32_t y,
+    const int32_t d_x, const int32_t d_y, const uint32_t width
+) {
+    const uint32_t idx_neighbor {CellLayout::step(idx, x, y, d_x, d_y, width)};
+
+    assert(idx_neighbor == get_node_index(x + d_x, y + d_y, width));
+
+    return idx_neighbor;
+}
 
 double dist_euclidean(
     const uint32_t x1, const uint32_t y1,
@@ -0,0 +1,89 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed-size pool of worker threads consuming a shared FIFO of tasks.
+//
+// Destroying the pool runs every task already submitted before joining the
+// workers.
+class WorkerPool {
+private:
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    bool stopping {false};
+
+    std::vector<std::thread> workers;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mu);
+
+                cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+public:
+    WorkerPool(const uint32_t num_threads = std::thread::hardware_concurrency()) {
+        const uint32_t num_workers {num_threads > 0 ? num_threads : 1};
+
+        workers.reserve(num_workers);
+
+        for (uint32_t i = 0; i < num_workers; ++i) {
+            workers.emplace_back(&WorkerPool::work, this);
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    ~WorkerPool() {
+        {
+            std::scoped_lock<std::mutex> lock(mu);
+
+            stopping = true;
+        }
+
+        cv.notify_all();
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    void submit(std::function<void()> &&task) {
+        {
+            std::scoped_lock<std::mutex> lock(mu);
+
+            tasks.push_back(std::move(task));
+        }
+
+        cv.notify_one();
+    }
+
+    uint32_t size() const {
+        return workers.size();
+    }
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AgentSim.h"
+#include "Map.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless benchmark of `AgentSim`. Computes a set of paths on a
+// `gen_rand_map()` map, sets a large number of agents moving along them, then
+// steps the simulation at a fixed time step and reports the cost per tick.
+// Agents that arrive are sent back along another path, and partway through
+// the run a number of cells are blocked, to exercise the replan events.
+//
+// Usage:
+//
+//   main_bench_agents <agents> [ticks] [paths]
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    // Simulated seconds per tick.
+    const float TICK {1.0f / 60.0f};
+
+    int bench(
+        const uint32_t num_agents, const uint32_t ticks, const uint32_t num_paths
+    ) {
+        Map map {Map::gen_rand_map(512, 512)};
+
+        RegionColorer<Map, decltype(block_lamb)>::color_all_regions(map, block_lamb);
+
+        std::mt19937 gen {2};
+
+        AgentSim sim;
+
+        std::vector<uint32_t> path_ids;
+
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            for (
+                uint32_t tries = 0;
+                path_ids.size() < num_paths && tries < num_paths * 4;
+                ++tries
+            ) {
+                const auto [x_start, y_start] = map.get_rand_open_xy();
+                const auto [x_end, y_end] = map.get_rand_open_xy();
+
+                Pathfind<Map, decltype(block_lamb)> pathfinder(
+                    map, x_start, y_start, x_end, y_end, block_lamb
+                );
+
+                auto path {pathfinder.get_path()};
+
+                if (path.size() < 2) {
+                    continue;
+                }
+
+                std::reverse(path.begin(), path.end());
+
+                path_ids.push_back(sim.add_path(path));
+            }
+
+            const auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start
+            );
+
+            std::cout
+                << "Computed " << path_ids.size() << " paths in "
+                << dur.count() << " ms" << std::endl;
+        }
+
+        if (path_ids.empty()) {
+            std::cerr << "Found no paths." << std::endl;
+
+            return 1;
+        }
+
+        std::uniform_int_distribution<size_t> rng_path(0, path_ids.size() - 1);
+        std::uniform_real_distribution<float> rng_speed(2.0f, 8.0f);
+
+        for (uint32_t i = 0; i < num_agents; ++i) {
+            const uint32_t agent {sim.add_agent(0, 0, rng_speed(gen))};
+
+            sim.set_path(agent, path_ids[rng_path(gen)]);
+        }
+
+        std::vector<std::chrono::nanoseconds> durs;
+
+        durs.reserve(ticks);
+
+        uint64_t arrived {0};
+        uint64_t blocked {0};
+
+        for (uint32_t tick = 0; tick < ticks; ++tick) {
+            if (tick == ticks / 2) {
+                // Drop obstacles onto a sample of path cells.
+                for (uint32_t i = 0; i < 256; ++i) {
+                    const auto [x, y] = map.get_rand_open_xy();
+
+                    map.get_nodes_mut()[get_node_index(x, y, map.width)].set_blocking(true);
+                }
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+
+            sim.step(
+                TICK,
+                [&](const uint32_t x, const uint32_t y) {
+                    return map.is_blocking(x, y);
+                }
+            );
+
+            durs.push_back(std::chrono::steady_clock::now() - start);
+
+            sim.drain_events(
+                [&](const AgentSim::Event &event) {
+                    if (event.kind == AgentSim::Event::ARRIVED) {
+                        ++arrived;
+
+                        sim.set_path(event.agent, path_ids[rng_path(gen)]);
+                    }
+                    else {
+                        ++blocked;
+
+                        // A real owner would replan from here; the benchmark
+                        // just parks the agent.
+                        sim.clear_path(event.agent);
+                    }
+                }
+            );
+        }
+
+        std::sort(durs.begin(), durs.end());
+
+        const auto ms = [](const std::chrono::nanoseconds dur) {
+            return dur.count() / 1e6;
+        };
+
+        const double p50_ns = durs[durs.size() / 2].count();
+
+        std::cout
+            << std::fixed << std::setprecision(3)
+            << "agents              : " << num_agents << std::endl
+            << "ticks               : " << ticks << std::endl
+            << "tick p50 (ms)       : " << ms(durs[durs.size() / 2]) << std::endl
+            << "tick p99 (ms)       : "
+            << ms(durs[std::min(durs.size() - 1, durs.size() * 99 / 100)]) << std::endl
+            << "tick max (ms)       : " << ms(durs.back()) << std::endl
+            << "ns / agent / tick   : " << p50_ns / num_agents << std::endl
+            << "arrived events      : " << arrived << std::endl
+            << "blocked events      : " << blocked << std::endl;
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 4) {
+        std::cerr
+            << "Usage: " << argv[0] << " <agents> [ticks] [paths]" << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        return bench(
+            std::stoul(argv[1]),
+            argc > 2 ? std::stoul(argv[2]) : 600,
+            argc > 3 ? std::stoul(argv[3]) : 256
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
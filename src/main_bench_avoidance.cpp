@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CrowdAvoidance.h"
+#include "SpatialGrid.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless benchmark of `CrowdAvoidance`. Scatters agents over an open square
+// sized for roughly one agent per four cells, and sends each towards a random
+// goal, replacing goals as they are reached. Steps the crowd at a fixed time
+// step, and reports the throughput in agents per millisecond, along with the
+// pairs of agents left overlapping at the end.
+//
+// Usage:
+//
+//   main_bench_avoidance <agents> [steps] [threads]
+//
+// eg, `main_bench_avoidance 10000` and `main_bench_avoidance 100000`.
+
+namespace {
+    // Simulated seconds per step.
+    const float STEP {0.1f};
+
+    const float MAX_SPEED {1.5f};
+
+    // Count the pairs of agents closer than `min_dist`.
+    uint64_t count_overlaps(
+        const CrowdAvoidance &crowd, const uint32_t side, const float min_dist
+    ) {
+        SpatialGrid grid(side, side, 4);
+
+        for (uint32_t i = 0; i < crowd.size(); ++i) {
+            grid.insert(i, crowd.get_x(i), crowd.get_y(i));
+        }
+
+        uint64_t overlaps {0};
+
+        for (uint32_t i = 0; i < crowd.size(); ++i) {
+            grid.query_radius(
+                crowd.get_x(i), crowd.get_y(i), min_dist,
+                [&](const uint32_t other, const float, const float) {
+                    overlaps += other > i;
+                }
+            );
+        }
+
+        return overlaps;
+    }
+
+    int bench(const uint32_t num_agents, const uint32_t steps, const uint32_t threads) {
+        const uint32_t side {
+            std::max<uint32_t>(static_cast<uint32_t>(std::sqrt(num_agents * 4.0)), 8)
+        };
+
+        const CrowdAvoidance::Params params;
+
+        CrowdAvoidance crowd(side, side, params, threads);
+
+        std::mt19937 gen {2};
+        std::uniform_real_distribution<float> rng_pos(0, side);
+
+        std::vector<float> goal_x(num_agents);
+        std::vector<float> goal_y(num_agents);
+
+        for (uint32_t i = 0; i < num_agents; ++i) {
+            crowd.add_agent(rng_pos(gen), rng_pos(gen), MAX_SPEED);
+
+            goal_x[i] = rng_pos(gen);
+            goal_y[i] = rng_pos(gen);
+        }
+
+        std::cout
+            << num_agents << " agents on " << side << "x" << side << ", "
+            << threads << " threads" << std::endl;
+
+        std::vector<std::chrono::nanoseconds> durs;
+
+        durs.reserve(steps);
+
+        uint64_t goals_reached {0};
+
+        for (uint32_t step = 0; step < steps; ++step) {
+            for (uint32_t i = 0; i < num_agents; ++i) {
+                float dx {goal_x[i] - crowd.get_x(i)};
+                float dy {goal_y[i] - crowd.get_y(i)};
+                float dist {std::sqrt(dx * dx + dy * dy)};
+
+                if (dist < 1.0f) {
+                    ++goals_reached;
+
+                    goal_x[i] = rng_pos(gen);
+                    goal_y[i] = rng_pos(gen);
+
+                    dx = goal_x[i] - crowd.get_x(i);
+                    dy = goal_y[i] - crowd.get_y(i);
+                    dist = std::sqrt(dx * dx + dy * dy);
+                }
+
+                const float scale {MAX_SPEED / std::max(dist, 1e-6f)};
+
+                crowd.set_preferred_velocity(i, dx * scale, dy * scale);
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+
+            crowd.step(STEP);
+
+            durs.push_back(std::chrono::steady_clock::now() - start);
+        }
+
+        std::chrono::nanoseconds total {0};
+
+        for (const auto dur : durs) {
+            total += dur;
+        }
+
+        std::sort(durs.begin(), durs.end());
+
+        const auto ms = [](const std::chrono::nanoseconds dur) {
+            return dur.count() / 1e6;
+        };
+
+        std::cout
+            << std::fixed << std::setprecision(3)
+            << "steps               : " << steps << std::endl
+            << "step p50 (ms)       : " << ms(durs[durs.size() / 2]) << std::endl
+            << "step max (ms)       : " << ms(durs.back()) << std::endl
+            << "agents / ms         : "
+            << static_cast<double>(num_agents) * steps / ms(total) << std::endl
+            << "goals reached       : " << goals_reached << std::endl
+            << "overlapping pairs   : "
+            << count_overlaps(crowd, side, params.radius * 2 * 0.9f) << std::endl;
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 4) {
+        std::cerr
+            << "Usage: " << argv[0] << " <agents> [steps] [threads]" << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        const uint32_t steps = argc > 2 ? std::stoul(argv[2]) : 100;
+
+        if (steps == 0) {
+            std::cerr << "Steps must be positive." << std::endl;
+
+            return 1;
+        }
+
+        return bench(
+            std::stoul(argv[1]),
+            steps,
+            argc > 3
+                ? static_cast<uint32_t>(std::stoul(argv[3]))
+                : std::thread::hardware_concurrency()
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ChunkedMap.h"
+#include "Map.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless benchmark of the chunked map. Searches a procedurally generated
+// world, far larger than the chunk budget, with random queries between
+// endpoints a bounded distance apart, dropping a box near each start so that
+// edited chunks are written back to a chunk store in a scratch directory and
+// later read back from it. Reports the latency of the queries, how the
+// chunks were paged, and the memory the resident chunks take against that of
+// the whole world.
+//
+// Usage:
+//
+//   main_bench_chunked <width> <height> <queries> [budget] [max-distance]
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    // A few boxes per chunk, placed by a hash of its coordinates, so that any
+    // chunk can be generated again, on any thread, without the others.
+    void gen_chunk(const uint32_t x_chunk, const uint32_t y_chunk, MapChunk &chunk) {
+        std::mt19937 gen {(x_chunk * 0x9e3779b9u) ^ (y_chunk * 0x85ebca6bu)};
+
+        std::uniform_int_distribution<uint32_t> rng_pos(0, MapChunk::SIZE - 1);
+        std::uniform_int_distribution<uint32_t> rng_side(1, 9);
+
+        chunk.blocking.fill(0);
+        chunk.terrain.fill(TERRAIN_GROUND);
+
+        for (uint32_t box = 0; box < MapChunk::CELLS / 100; ++box) {
+            const uint32_t x_min {rng_pos(gen)};
+            const uint32_t y_min {rng_pos(gen)};
+            const uint32_t x_max {std::min(MapChunk::SIZE - 1, x_min + rng_side(gen))};
+            const uint32_t y_max {std::min(MapChunk::SIZE - 1, y_min + rng_side(gen))};
+
+            for (uint32_t y = y_min; y <= y_max; ++y) {
+                for (uint32_t x = x_min; x <= x_max; ++x) {
+                    chunk.set_blocking(MapChunk::offset(x, y), true);
+                }
+            }
+        }
+    }
+
+    double us(const std::chrono::nanoseconds dur) {
+        return dur.count() / 1000.0;
+    }
+
+    int bench(
+        const uint32_t width,
+        const uint32_t height,
+        const uint32_t num_queries,
+        const uint32_t budget,
+        const uint32_t max_distance
+    ) {
+        const std::filesystem::path dir {
+            std::filesystem::temp_directory_path() / "main_bench_chunked"
+        };
+
+        std::filesystem::remove_all(dir);
+
+        auto dir_guard = Guard(
+            [&]() {
+                std::filesystem::remove_all(dir);
+            }
+        );
+
+        ChunkStore store(dir);
+
+        // Cap searches at the cells of the square the queries span, so that
+        // a query for an enclosed goal gives up rather than page in the world.
+        ChunkedMap map(
+            width, height, store, budget, gen_chunk, 4,
+            4 * max_distance * max_distance
+        );
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << "world " << width << "x" << height << ", budget " << budget
+            << " chunks of " << MapChunk::SIZE << "x" << MapChunk::SIZE << std::endl;
+
+        std::mt19937 gen {2};
+
+        std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+        std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+        std::uniform_int_distribution<int32_t> rng_offset(
+            -static_cast<int32_t>(max_distance), max_distance
+        );
+
+        std::vector<std::chrono::nanoseconds> durs;
+        uint64_t expanded {0};
+        uint32_t found {0};
+
+        while (durs.size() < num_queries) {
+            const uint32_t x_start {rng_x(gen)};
+            const uint32_t y_start {rng_y(gen)};
+            const uint32_t x_end {
+                static_cast<uint32_t>(
+                    std::clamp<int64_t>(x_start + rng_offset(gen), 0, width - 1)
+                )
+            };
+            const uint32_t y_end {
+                static_cast<uint32_t>(
+                    std::clamp<int64_t>(y_start + rng_offset(gen), 0, height - 1)
+                )
+            };
+
+            if (map.is_blocking(x_start, y_start) || map.is_blocking(x_end, y_end)) {
+                continue;
+            }
+
+            // Edit the start's chunk, so that it is written back once evicted.
+            const uint32_t x_box {x_start ^ 1};
+
+            if (x_box < width && !(x_box == x_end && y_start == y_end)) {
+                map.get_nodes_mut()[get_node_index(x_box, y_start, width)].set_blocking(
+                    true
+                );
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+
+            Pathfind<ChunkedMap, decltype(block_lamb)> pathfinder(
+                map, x_start, y_start, x_end, y_end, block_lamb,
+                {.reserve_hint = 1 << 16}
+            );
+
+            found += !pathfinder.get_path().empty();
+
+            durs.push_back(std::chrono::steady_clock::now() - start);
+            expanded += pathfinder.get_perf().count_expanded_nodes;
+        }
+
+        std::sort(durs.begin(), durs.end());
+
+        const ChunkedMap::Stats &stats {map.get_stats()};
+
+        std::cout
+            << "pathfind" << std::endl
+            << "  latency p50 (us)  : " << us(durs[durs.size() / 2]) << std::endl
+            << "  latency p99 (us)  : "
+            << us(durs[std::min(durs.size() - 1, durs.size() * 99 / 100)]) << std::endl
+            << "  latency max (us)  : " << us(durs.back()) << std::endl
+            << "  expanded / query  : "
+            << static_cast<double>(expanded) / num_queries << std::endl
+            << "  paths found       : " << found << " / " << num_queries << std::endl
+            << "chunks" << std::endl
+            << "  loads             : " << stats.loads << std::endl
+            << "  prefetched        : " << stats.prefetched << std::endl
+            << "  evictions         : " << stats.evictions << std::endl
+            << "  writes            : " << stats.writes << std::endl
+            << "  resident          : " << map.get_resident_count() << std::endl
+            << "  resident (MiB)    : "
+            << map.get_resident_count() * sizeof(MapChunk) / 1048576.0 << std::endl
+            << "  whole world (MiB) : "
+            << static_cast<double>(width) * height * sizeof(MapChunk) / MapChunk::CELLS /
+                1048576.0
+            << std::endl;
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4 || argc > 6) {
+        std::cerr
+            << "Usage: " << argv[0]
+            << " <width> <height> <queries> [budget] [max-distance]" << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        return bench(
+            std::stoul(argv[1]), std::stoul(argv[2]), std::stoul(argv[3]),
+            argc >= 5 ? std::stoul(argv[4]) : 256,
+            argc >= 6 ? std::stoul(argv[5]) : 512
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <latch>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "CooperativePathfind.h"
+#include "Map.h"
+#include "ReservationTable.h"
+#include "Trace.h"
+#include "Util.h"
+#include "WorkerPool.h"
+
+// Headless benchmark of cooperative multi-agent pathfinding. Places agents on
+// distinct open cells of a `gen_rand_map()` map, each with a random goal, then
+// plans every agent twice: independently with `Pathfind`, and cooperatively
+// against a shared reservation table, planning agents in parallel. Reports the
+// planning time and the collisions left within the reservation window.
+//
+// Usage:
+//
+//   main_bench_cooperative <width> <height> <agents> [window] [threads]
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    struct Agent {
+        uint32_t x_start;
+        uint32_t y_start;
+        uint32_t x_end;
+        uint32_t y_end;
+    };
+
+    // Agents per worker pool task.
+    const uint32_t CHUNK_SIZE {16};
+
+    // Run `fn(i)` for every agent on the pool, and wait for them all.
+    template <typename Fn>
+    void for_each_agent(WorkerPool &pool, const uint32_t num_agents, Fn &&fn) {
+        std::latch done {num_agents};
+
+        for (uint32_t first = 0; first < num_agents; first += CHUNK_SIZE) {
+            const uint32_t last {std::min(num_agents, first + CHUNK_SIZE)};
+
+            pool.submit(
+                [&, first, last]() {
+                    for (uint32_t i = first; i < last; ++i) {
+                        fn(i);
+                    }
+
+                    done.count_down(last - first);
+                }
+            );
+        }
+
+        done.wait();
+    }
+
+    // Count the agents that share a cell with an earlier agent, per time step,
+    // within the first `window` steps. Paths are in travel order, one cell per
+    // step, and agents are taken to stay at the end of their paths. Agents
+    // without a path stay at their start.
+    uint64_t count_collisions(
+        const Map &map,
+        const std::vector<Agent> &agents,
+        const std::vector<path_t> &paths,
+        const uint32_t window
+    ) {
+        std::unordered_map<uint64_t, uint32_t> occupied;
+
+        uint64_t collisions {0};
+
+        for (uint32_t i = 0; i < agents.size(); ++i) {
+            for (uint32_t t = 0; t < window; ++t) {
+                const auto [x, y] = paths[i].empty()
+                    ? std::make_pair(agents[i].x_start, agents[i].y_start)
+                    : paths[i][std::min<size_t>(t, paths[i].size() - 1)];
+
+                const uint64_t key {
+                    (static_cast<uint64_t>(t) << 32) | get_node_index(x, y, map.width)
+                };
+
+                if (occupied[key]++ > 0) {
+                    ++collisions;
+                }
+            }
+        }
+
+        return collisions;
+    }
+
+    void report(
+        const std::string &name,
+        const std::chrono::microseconds dur,
+        const Map &map,
+        const std::vector<Agent> &agents,
+        const std::vector<path_t> &paths,
+        const uint32_t window
+    ) {
+        uint64_t found {0};
+        uint64_t total_steps {0};
+
+        for (const auto &path : paths) {
+            if (!path.empty()) {
+                ++found;
+                total_steps += path.size() - 1;
+            }
+        }
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << name << std::endl
+            << "  planning time (ms): " << dur.count() / 1000.0 << std::endl
+            << "  per agent (us)    : "
+            << dur.count() / static_cast<double>(std::max<size_t>(agents.size(), 1))
+            << std::endl
+            << "  found             : " << found << std::endl
+            << "  steps / agent     : "
+            << total_steps / static_cast<double>(std::max<uint64_t>(found, 1))
+            << std::endl
+            << "  collisions        : "
+            << count_collisions(map, agents, paths, window) << std::endl;
+    }
+
+    int bench(
+        const uint32_t width,
+        const uint32_t height,
+        const uint32_t num_agents,
+        const uint32_t window,
+        const uint32_t threads
+    ) {
+        Map map {Map::gen_rand_map(width, height)};
+
+        RegionColorer<Map, decltype(block_lamb)>::color_all_regions(map, block_lamb);
+
+        std::vector<uint32_t> open_cells;
+
+        for (uint32_t idx = 0; idx < map.get_nodes().size(); ++idx) {
+            if (!map.get_nodes()[idx].get_blocking()) {
+                open_cells.push_back(idx);
+            }
+        }
+
+        if (open_cells.size() < num_agents) {
+            std::cerr << "Map has too few open cells for the agents." << std::endl;
+
+            return 1;
+        }
+
+        std::mt19937 gen {2};
+
+        std::shuffle(open_cells.begin(), open_cells.end(), gen);
+
+        std::uniform_int_distribution<size_t> rng(0, open_cells.size() - 1);
+
+        // Goals are drawn from the same region as the start, so that every
+        // agent has somewhere to go.
+        std::vector<Agent> agents;
+
+        agents.reserve(num_agents);
+
+        for (uint32_t i = 0; i < num_agents; ++i) {
+            const auto [x_start, y_start] = get_node_xy(open_cells[i], map.width);
+            const auto region {map.get_nodes()[open_cells[i]].get_region()};
+
+            uint32_t idx_end {open_cells[rng(gen)]};
+
+            for (
+                uint32_t tries = 0;
+                tries < 64 && map.get_nodes()[idx_end].get_region() != region;
+                ++tries
+            ) {
+                idx_end = open_cells[rng(gen)];
+            }
+
+            const auto [x_end, y_end] = get_node_xy(idx_end, map.width);
+
+            agents.push_back({x_start, y_start, x_end, y_end});
+        }
+
+        std::cout
+            << "gen_rand_map " << width << "x" << height << ", "
+            << num_agents << " agents, window " << window << ", "
+            << threads << " threads" << std::endl;
+
+        WorkerPool pool(threads);
+
+        {
+            std::vector<path_t> paths(num_agents);
+
+            const auto start = std::chrono::steady_clock::now();
+
+            for_each_agent(
+                pool, num_agents,
+                [&](const uint32_t i) {
+                    const Agent &agent {agents[i]};
+
+                    Pathfind<Map, decltype(block_lamb)> pathfinder(
+                        map,
+                        agent.x_start, agent.y_start,
+                        agent.x_end, agent.y_end,
+                        block_lamb
+                    );
+
+                    paths[i] = pathfinder.get_path();
+
+                    // Into travel order, to match the cooperative plans.
+                    std::reverse(paths[i].begin(), paths[i].end());
+                }
+            );
+
+            report(
+                "independent",
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start
+                ),
+                map, agents, paths, window
+            );
+        }
+
+        {
+            std::vector<path_t> paths(num_agents);
+
+            ReservationTable reservations(window, num_agents);
+
+            const auto start = std::chrono::steady_clock::now();
+
+            // Every agent holds its start cell until it is planned, so that
+            // earlier agents do not plan through it.
+            for (uint32_t i = 0; i < num_agents; ++i) {
+                reservations.reserve(open_cells[i], 0, i);
+            }
+
+            for_each_agent(
+                pool, num_agents,
+                [&](const uint32_t i) {
+                    const Agent &agent {agents[i]};
+
+                    CooperativePathfind<Map, decltype(block_lamb)> pathfinder(
+                        map, reservations, i,
+                        agent.x_start, agent.y_start,
+                        agent.x_end, agent.y_end,
+                        0,
+                        block_lamb
+                    );
+
+                    paths[i] = pathfinder.get_path();
+                }
+            );
+
+            report(
+                "cooperative",
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start
+                ),
+                map, agents, paths, window
+            );
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4 || argc > 6) {
+        std::cerr
+            << "Usage: " << argv[0]
+            << " <width> <height> <agents> [window] [threads]" << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        return bench(
+            std::stoul(argv[1]),
+            std::stoul(argv[2]),
+            std::stoul(argv[3]),
+            argc > 4 ? std::stoul(argv[4]) : 32,
+            argc > 5
+                ? static_cast<uint32_t>(std::stoul(argv[5]))
+                : std::thread::hardware_concurrency()
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
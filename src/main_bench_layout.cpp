@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ClearanceLayer.h"
+#include "Log.h"
+#include "Map.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless benchmark of the cell layout (see `CellLayout` in `Util.h`). The
+// layout is chosen at build time, so build once per `make LAYOUT=` and
+// compare the runs. Generates an open map scattered with boxes, the same
+// under every layout, then times coloring its regions, which floods the whole
+// map, computing its clearance, and random queries with `Pathfind`, and
+// reports the latency of each along with the cache misses it incurred, where
+// the kernel lets us count them.
+//
+// Usage:
+//
+//   main_bench_layout <width> <height> <queries>
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    // Hardware cache miss counters for this thread, or none if the kernel
+    // does not allow them, eg, under `perf_event_paranoid` or in a VM.
+    class CacheMissCounters {
+    private:
+        // Last-level cache misses, and L1 data cache read misses.
+        std::array<int, 2> fds {-1, -1};
+
+        static int open_counter(const uint32_t type, const uint64_t config) {
+            perf_event_attr attr;
+
+            std::memset(&attr, 0, sizeof(attr));
+
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+
+    public:
+        CacheMissCounters() {
+            fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+            fds[1] = open_counter(
+                PERF_TYPE_HW_CACHE,
+                PERF_COUNT_HW_CACHE_L1D |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+            );
+
+            for (const int fd : fds) {
+                if (fd >= 0) {
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+        }
+
+        CacheMissCounters(const CacheMissCounters &) = delete;
+        CacheMissCounters &operator=(const CacheMissCounters &) = delete;
+
+        ~CacheMissCounters() {
+            for (const int fd : fds) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+        }
+
+        // The running count of each counter, or -1 for those unavailable.
+        std::array<int64_t, 2> read_all() const {
+            std::array<int64_t, 2> counts {-1, -1};
+
+            for (uint32_t i = 0; i < fds.size(); ++i) {
+                uint64_t count;
+
+                if (fds[i] >= 0 && read(fds[i], &count, sizeof(count)) == sizeof(count)) {
+                    counts[i] = count;
+                }
+            }
+
+            return counts;
+        }
+    };
+
+    const char *layout_name() {
+        if constexpr (std::is_same_v<CellLayout, RowMajorLayout>) {
+            return "row-major";
+        }
+        else if constexpr (
+            std::is_same_v<CellLayout, TiledLayout<PATHFINDING_LAYOUT_TILE_BITS>>
+        ) {
+            return "tiled";
+        }
+        else {
+            return "morton";
+        }
+    }
+
+    double us(const std::chrono::nanoseconds dur) {
+        return dur.count() / 1000.0;
+    }
+
+    // Print the misses counted since `before`, per `per` units of work.
+    void report_misses(
+        const CacheMissCounters &counters,
+        const std::array<int64_t, 2> &before,
+        const double per
+    ) {
+        const auto after {counters.read_all()};
+        const std::array<const char *, 2> names {
+            "  LLC misses       : ", "  L1D read misses  : "
+        };
+
+        for (uint32_t i = 0; i < after.size(); ++i) {
+            std::cout << names[i];
+
+            if (after[i] < 0 || before[i] < 0) {
+                std::cout << "n/a" << std::endl;
+            }
+            else {
+                std::cout << (after[i] - before[i]) / per << std::endl;
+            }
+        }
+    }
+
+    int bench(const uint32_t width, const uint32_t height, const uint32_t num_queries) {
+        Map map {Map::gen_rand_map(width, height)};
+
+        for (auto &node : map.get_nodes_mut()) {
+            node.set_blocking(map.is_padding(node.x_coord, node.y_coord));
+        }
+
+        std::mt19937 gen {2};
+
+        std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+        std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+        std::uniform_int_distribution<uint32_t> rng_side(1, 9);
+
+        for (uint32_t box = 0; box < width / 10 * height / 10; ++box) {
+            const uint32_t x_min {rng_x(gen)};
+            const uint32_t y_min {rng_y(gen)};
+            const uint32_t x_max {std::min(width - 1, x_min + rng_side(gen))};
+            const uint32_t y_max {std::min(height - 1, y_min + rng_side(gen))};
+
+            for (uint32_t y = y_min; y <= y_max; ++y) {
+                for (uint32_t x = x_min; x <= x_max; ++x) {
+                    map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(true);
+                }
+            }
+        }
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << "layout " << layout_name() << ", map " << width << "x" << height
+            << ", " << get_node_count(width, height) - width * height
+            << " padding cells" << std::endl;
+
+        // Coloring logs every region it finds.
+        log_set_level(LogLevel::WARN);
+
+        const CacheMissCounters counters;
+
+        {
+            const auto misses {counters.read_all()};
+            const auto start = std::chrono::steady_clock::now();
+
+            RegionColorer<Map, decltype(block_lamb)>::color_all_regions(map, block_lamb);
+
+            std::cout
+                << "color regions (us)  : "
+                << us(std::chrono::steady_clock::now() - start) << std::endl;
+
+            report_misses(counters, misses, 1);
+        }
+
+        {
+            ClearanceLayer clearance(width, height);
+
+            const auto misses {counters.read_all()};
+            const auto start = std::chrono::steady_clock::now();
+
+            clearance.compute(map, block_lamb);
+
+            std::cout
+                << "clearance (us)      : "
+                << us(std::chrono::steady_clock::now() - start) << std::endl;
+
+            report_misses(counters, misses, 1);
+        }
+
+        std::vector<std::chrono::nanoseconds> durs;
+        uint64_t expanded {0};
+
+        const auto misses {counters.read_all()};
+
+        while (durs.size() < num_queries) {
+            const uint32_t x_start {rng_x(gen)};
+            const uint32_t y_start {rng_y(gen)};
+            const uint32_t x_end {rng_x(gen)};
+            const uint32_t y_end {rng_y(gen)};
+
+            if (map.is_blocking(x_start, y_start) || map.is_blocking(x_end, y_end)) {
+                continue;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+
+            // Reserve for a typical search rather than the whole map, which
+            // would dwarf the search itself on large maps.
+            Pathfind<Map, decltype(block_lamb)> pathfinder(
+                map, x_start, y_start, x_end, y_end, block_lamb,
+                {.reserve_hint = 1 << 16}
+            );
+
+            pathfinder.get_path();
+
+            durs.push_back(std::chrono::steady_clock::now() - start);
+            expanded += pathfinder.get_perf().count_expanded_nodes;
+        }
+
+        std::sort(durs.begin(), durs.end());
+
+        std::cout
+            << "pathfind" << std::endl
+            << "  latency p50 (us)  : " << us(durs[durs.size() / 2]) << std::endl
+            << "  latency p99 (us)  : "
+            << us(durs[std::min(durs.size() - 1, durs.size() * 99 / 100)]) << std::endl
+            << "  expanded / query  : "
+            << static_cast<double>(expanded) / num_queries << std::endl;
+
+        report_misses(counters, misses, num_queries);
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        std::cerr
+            << "Usage: " << argv[0] << " <width> <height> <queries>" << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        return bench(std::stoul(argv[1]), std::stoul(argv[2]), std::stoul(argv[3]));
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Map.h"
+#include "NavMesh.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless benchmark of the navigation mesh. Generates an open map scattered
+// with boxes, builds a `NavMesh` over it on one thread and on several, times
+// rebuilding tiles after small edits, then runs the same random queries with
+// plain `Pathfind` and with a `NavMeshQuery`, and reports the latency and
+// search size of each, along with how much costlier the mesh paths are.
+//
+// Usage:
+//
+//   main_bench_navmesh <width> <height> <queries> [threads]
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    // The cost of a path as `Pathfind` reckons it, or -1 if it is not a valid
+    // path, ie, a chain of open, neighboring cells that cuts no corners.
+    double path_cost(const Map &map, const path_t &path) {
+        double cost {0};
+
+        for (uint32_t i = 1; i < path.size(); ++i) {
+            const auto [x_prev, y_prev] = path[i - 1];
+            const auto [x, y] = path[i];
+
+            if (
+                dist_chebyshev(x_prev, y_prev, x, y) != 1 ||
+                map.is_blocking(x, y) ||
+                map.is_blocking(x_prev, y) ||
+                map.is_blocking(x, y_prev)
+            ) {
+                return -1;
+            }
+
+            cost += DEFAULT_TERRAIN_COSTS[
+                map.get_nodes()[get_node_index(x, y, map.width)].get_terrain()
+            ];
+        }
+
+        return cost;
+    }
+
+    // Block the cells of a random box of side 2 to 10, or clear them if
+    // `blocking` is false; returns its bounds.
+    std::array<uint32_t, 4> set_box(
+        Map &map, std::mt19937 &gen, const bool blocking
+    ) {
+        std::uniform_int_distribution<uint32_t> rng_x(0, map.width - 1);
+        std::uniform_int_distribution<uint32_t> rng_y(0, map.height - 1);
+        std::uniform_int_distribution<uint32_t> rng_side(1, 9);
+
+        const uint32_t x_min {rng_x(gen)};
+        const uint32_t y_min {rng_y(gen)};
+        const uint32_t x_max {std::min(map.width - 1, x_min + rng_side(gen))};
+        const uint32_t y_max {std::min(map.height - 1, y_min + rng_side(gen))};
+
+        for (uint32_t y = y_min; y <= y_max; ++y) {
+            for (uint32_t x = x_min; x <= x_max; ++x) {
+                const uint32_t idx {get_node_index(x, y, map.width)};
+
+                map.get_nodes_mut()[idx].set_blocking(blocking);
+            }
+        }
+
+        return {x_min, y_min, x_max, y_max};
+    }
+
+    double us(const std::chrono::nanoseconds dur) {
+        return dur.count() / 1000.0;
+    }
+
+    void report(
+        const std::string &name,
+        std::vector<std::chrono::nanoseconds> &durs,
+        const uint64_t total_expanded
+    ) {
+        std::sort(durs.begin(), durs.end());
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << name << std::endl
+            << "  latency p50 (us)  : " << us(durs[durs.size() / 2]) << std::endl
+            << "  latency p99 (us)  : "
+            << us(durs[std::min(durs.size() - 1, durs.size() * 99 / 100)]) << std::endl
+            << "  latency max (us)  : " << us(durs.back()) << std::endl
+            << "  expanded / query  : "
+            << static_cast<double>(total_expanded) / durs.size() << std::endl;
+    }
+
+    int bench(
+        const uint32_t width,
+        const uint32_t height,
+        const uint32_t num_queries,
+        const uint32_t threads
+    ) {
+        Map map {Map::gen_rand_map(width, height)};
+
+        for (auto &node : map.get_nodes_mut()) {
+            node.set_blocking(false);
+            node.set_terrain(TERRAIN_GROUND);
+        }
+
+        std::mt19937 gen {2};
+
+        for (uint32_t box = 0; box < width * height / 1000; ++box) {
+            set_box(map, gen, true);
+        }
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << "open map " << width << "x" << height << ", "
+            << width * height / 1000 << " boxes" << std::endl;
+
+        for (const uint32_t build_threads : {1u, threads}) {
+            NavMesh mesh(width, height, 32, build_threads);
+
+            const auto start = std::chrono::steady_clock::now();
+
+            mesh.build(map, block_lamb);
+
+            std::cout
+                << "build, " << build_threads << " thread(s) (us): "
+                << us(std::chrono::steady_clock::now() - start) << std::endl;
+        }
+
+        NavMesh mesh(width, height, 32, threads);
+
+        mesh.build(map, block_lamb);
+
+        std::cout
+            << "cells             : " << width * height << std::endl
+            << "polygons          : " << mesh.size() << std::endl
+            << "portals           : " << mesh.get_portal_count() << std::endl;
+
+        // Alternately drop and clear boxes, rebuilding as we go.
+        std::vector<std::chrono::nanoseconds> durs_rebuild;
+
+        for (uint32_t edit = 0; edit < 100; ++edit) {
+            const auto [x_min, y_min, x_max, y_max] = set_box(map, gen, edit % 2 == 0);
+
+            const auto start = std::chrono::steady_clock::now();
+
+            mesh.rebuild(map, block_lamb, x_min, y_min, x_max, y_max);
+
+            durs_rebuild.push_back(std::chrono::steady_clock::now() - start);
+        }
+
+        std::sort(durs_rebuild.begin(), durs_rebuild.end());
+
+        std::cout
+            << "rebuild p50 (us)  : " << us(durs_rebuild[durs_rebuild.size() / 2])
+            << std::endl;
+
+        map.clear_regions();
+
+        std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+        std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+
+        NavMeshQuery query(mesh);
+
+        std::vector<std::chrono::nanoseconds> durs_direct;
+        std::vector<std::chrono::nanoseconds> durs_mesh;
+
+        uint64_t expanded_direct {0};
+        uint64_t expanded_mesh {0};
+
+        double cost_direct {0};
+        double cost_mesh {0};
+        uint32_t invalid {0};
+
+        while (durs_direct.size() < num_queries) {
+            const uint32_t x_start {rng_x(gen)};
+            const uint32_t y_start {rng_y(gen)};
+            const uint32_t x_end {rng_x(gen)};
+            const uint32_t y_end {rng_y(gen)};
+
+            if (map.is_blocking(x_start, y_start) || map.is_blocking(x_end, y_end)) {
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+
+            Pathfind<Map, decltype(block_lamb)> pathfinder(
+                map, x_start, y_start, x_end, y_end, block_lamb
+            );
+
+            const path_t path_direct {pathfinder.get_path()};
+
+            durs_direct.push_back(std::chrono::steady_clock::now() - start);
+            expanded_direct += pathfinder.get_perf().count_expanded_nodes;
+
+            start = std::chrono::steady_clock::now();
+
+            const path_t path_mesh {query.get_path(x_start, y_start, x_end, y_end)};
+
+            durs_mesh.push_back(std::chrono::steady_clock::now() - start);
+            expanded_mesh += query.get_count_expanded();
+
+            if (path_direct.empty() != path_mesh.empty()) {
+                ++invalid;
+
+                continue;
+            }
+
+            const double cost {path_cost(map, path_mesh)};
+
+            if (cost < 0) {
+                ++invalid;
+
+                continue;
+            }
+
+            cost_direct += path_cost(map, path_direct);
+            cost_mesh += cost;
+        }
+
+        report("pathfind", durs_direct, expanded_direct);
+        report("navmesh", durs_mesh, expanded_mesh);
+
+        std::cout
+            << "cost ratio          : " << cost_mesh / cost_direct << std::endl
+            << "invalid paths       : " << invalid << std::endl;
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4 && argc != 5) {
+        std::cerr
+            << "Usage: " << argv[0] << " <width> <height> <queries> [threads]"
+            << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        return bench(
+            std::stoul(argv[1]), std::stoul(argv[2]), std::stoul(argv[3]),
+            argc == 5 ? std::stoul(argv[4]) : std::thread::hardware_concurrency()
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Map.h"
+#include "MapFile.h"
+#include "MapSpec.h"
+#include "MovingAI.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless pathfinding benchmark. Has no SDL/GPU dependency, so it can be run
+// on build hosts and servers.
+//
+// Usage:
+//
+//   main_bench_pathfinding [--rect] <file.map|file.pfmap> <file.scen>
+//   main_bench_pathfinding [--rect] --rand <width> <height> <queries>
+//   main_bench_pathfinding --convert <file.map> <file.pfmap>
+//
+// With `--rect`, the queries also run over a `RectangleDecomposition` of the
+// map, and both sets of results are reported.
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    struct QueryResult {
+        std::chrono::nanoseconds dur;
+        uint32_t count_expanded_nodes;
+        uint32_t count_novel_nodes;
+        bool found;
+        // Only meaningful when the optimal length is known and a path was
+        // found.
+        double deviation;
+    };
+
+    double percentile_us(
+        const std::vector<std::chrono::nanoseconds> &sorted_durs,
+        const double pct
+    ) {
+        if (sorted_durs.empty()) {
+            return 0;
+        }
+
+        const size_t rank {
+            std::min(
+                sorted_durs.size() - 1,
+                static_cast<size_t>(
+                    std::ceil(pct / 100.0 * sorted_durs.size())
+                ) - (pct > 0 ? 1 : 0)
+            )
+        };
+
+        return sorted_durs[rank].count() / 1000.0;
+    }
+
+    template <typename map_t>
+    QueryResult run_query(
+        map_t &map,
+        const uint32_t x_start, const uint32_t y_start,
+        const uint32_t x_end, const uint32_t y_end,
+        const std::optional<double> optimal_length,
+        const RectangleDecomposition *rectangles
+    ) {
+        typedef Pathfind<map_t, decltype(block_lamb)> pathfind_t;
+
+        const auto start_query = std::chrono::steady_clock::now();
+
+        pathfind_t pathfinder(
+            map, x_start, y_start, x_end, y_end, block_lamb,
+            {.rectangles = rectangles}
+        );
+
+        const auto path {pathfinder.get_path()};
+
+        const auto end_query = std::chrono::steady_clock::now();
+
+        const auto perf {pathfind_t::get_perf()};
+
+        QueryResult result {
+            end_query - start_query,
+            perf.count_expanded_nodes,
+            perf.count_novel_nodes,
+            // A query from a cell to itself is trivially solved with an empty
+            // path.
+            path.size() > 0 || (x_start == x_end && y_start == y_end),
+            0
+        };
+
+        if (result.found && optimal_length && *optimal_length > 0) {
+            result.deviation = (
+                path_length_octile(path) - *optimal_length
+            ) / *optimal_length;
+        }
+
+        return result;
+    }
+
+    void report(
+        const std::string &name,
+        const std::vector<QueryResult> &results,
+        const bool has_optimal
+    ) {
+        std::vector<std::chrono::nanoseconds> durs;
+
+        durs.reserve(results.size());
+
+        uint64_t total_expanded {0};
+        uint64_t total_novel {0};
+        uint32_t found {0};
+        uint32_t suboptimal {0};
+        double total_deviation {0};
+        double max_deviation {0};
+
+        for (const auto &result : results) {
+            durs.push_back(result.dur);
+
+            total_expanded += result.count_expanded_nodes;
+            total_novel += result.count_novel_nodes;
+
+            if (result.found) {
+                ++found;
+
+                total_deviation += result.deviation;
+                max_deviation = std::max(max_deviation, result.deviation);
+
+                // Allow for the rounding in the scenario file's costs.
+                if (result.deviation > 1e-6) {
+                    ++suboptimal;
+                }
+            }
+        }
+
+        std::sort(durs.begin(), durs.end());
+
+        const double num {
+            static_cast<double>(std::max<size_t>(results.size(), 1))
+        };
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << name << std::endl
+            << "  queries          : " << results.size() << std::endl
+            << "  found            : " << found << std::endl
+            << "  latency p50 (us) : " << percentile_us(durs, 50) << std::endl
+            << "  latency p90 (us) : " << percentile_us(durs, 90) << std::endl
+            << "  latency p99 (us) : " << percentile_us(durs, 99) << std::endl
+            << "  latency p99.9(us): " << percentile_us(durs, 99.9) << std::endl
+            << "  latency max (us) : " << percentile_us(durs, 100) << std::endl
+            << "  expanded / query : " << total_expanded / num << std::endl
+            << "  generated / query: " << total_novel / num << std::endl;
+
+        if (has_optimal) {
+            std::cout
+                << "  suboptimal       : " << suboptimal << std::endl
+                << "  cost dev mean (%): "
+                << 100.0 * total_deviation / std::max<uint32_t>(found, 1)
+                << std::endl
+                << "  cost dev max (%) : " << 100.0 * max_deviation
+                << std::endl;
+        }
+    }
+
+    void print_load_time(
+        const std::chrono::steady_clock::time_point start_load
+    ) {
+        const auto dur = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_load
+        );
+
+        std::cout << "Map load time (us): " << dur.count() << std::endl;
+    }
+
+    // Decompose `map` for `--rect`, reporting how long it took.
+    template <typename map_t>
+    std::unique_ptr<RectangleDecomposition> build_rectangles(const map_t &map) {
+        const auto start_build = std::chrono::steady_clock::now();
+
+        auto rectangles {
+            std::make_unique<RectangleDecomposition>(map.width, map.height)
+        };
+
+        rectangles->build(map, block_lamb);
+
+        const auto dur = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_build
+        );
+
+        std::cout
+            << "Decomposed into " << rectangles->size() << " rectangles (us): "
+            << dur.count() << std::endl;
+
+        return rectangles;
+    }
+
+    template <typename map_t>
+    int bench_scenario_map(
+        map_t &map, const std::string &scen_path, const bool rect
+    ) {
+        const auto entries {load_movingai_scen(scen_path)};
+
+        // Reject the whole scenario before timing any of it.
+        for (const auto &entry : entries) {
+            if (entry.map_width != map.width || entry.map_height != map.height) {
+                continue;
+            }
+
+            if (
+                entry.x_start >= map.width || entry.y_start >= map.height ||
+                entry.x_end >= map.width || entry.y_end >= map.height
+            ) {
+                throw std::runtime_error(
+                    "Scenario query out of bounds of the map: " + scen_path
+                );
+            }
+        }
+
+        const auto rectangles {rect ? build_rectangles(map) : nullptr};
+
+        // Plain search, then over the rectangles, if any.
+        std::vector<const RectangleDecomposition *> modes {nullptr};
+
+        if (rectangles) {
+            modes.push_back(rectangles.get());
+        }
+
+        for (const RectangleDecomposition *mode : modes) {
+            std::vector<QueryResult> results;
+
+            results.reserve(entries.size());
+
+            for (const auto &entry : entries) {
+                if (entry.map_width != map.width || entry.map_height != map.height) {
+                    std::cerr
+                        << "Skipping scenario for mismatched map: "
+                        << entry.map_name << std::endl;
+
+                    continue;
+                }
+
+                results.push_back(
+                    run_query(
+                        map,
+                        entry.x_start, entry.y_start,
+                        entry.x_end, entry.y_end,
+                        entry.optimal_length,
+                        mode
+                    )
+                );
+            }
+
+            report(mode ? scen_path + " (rectangles)" : scen_path, results, true);
+        }
+
+        return 0;
+    }
+
+    int bench_scenario(
+        const std::string &map_path, const std::string &scen_path, const bool rect
+    ) {
+        const auto start_load = std::chrono::steady_clock::now();
+
+        return with_map_spec(
+            map_path,
+            [&](auto &map) {
+                print_load_time(start_load);
+
+                return bench_scenario_map(map, scen_path, rect);
+            }
+        );
+    }
+
+    int convert(const std::string &map_path, const std::string &out_path) {
+        write_map_file(load_movingai_map(map_path), out_path);
+
+        return 0;
+    }
+
+    int bench_rand(
+        const uint32_t width, const uint32_t height, const uint32_t queries,
+        const bool rect
+    ) {
+        Map map {Map::gen_rand_map(width, height)};
+
+        std::vector<std::pair<uint32_t, uint32_t>> open_spaces;
+
+        for (const auto &node : map.get_nodes()) {
+            if (!node.get_blocking()) {
+                open_spaces.emplace_back(node.x_coord, node.y_coord);
+            }
+        }
+
+        if (open_spaces.empty()) {
+            std::cerr << "Generated map has no open cells." << std::endl;
+
+            return 1;
+        }
+
+        std::mt19937 gen {2};
+        std::uniform_int_distribution<size_t> rng(0, open_spaces.size() - 1);
+
+        std::vector<std::pair<uint32_t, uint32_t>> endpoints;
+
+        endpoints.reserve(queries * 2);
+
+        for (uint32_t i = 0; i < queries * 2; ++i) {
+            endpoints.push_back(open_spaces[rng(gen)]);
+        }
+
+        const auto rectangles {rect ? build_rectangles(map) : nullptr};
+
+        const std::string name {
+            "gen_rand_map " + std::to_string(width) + "x" + std::to_string(height)
+        };
+
+        // Plain search, then over the rectangles, if any.
+        std::vector<const RectangleDecomposition *> modes {nullptr};
+
+        if (rectangles) {
+            modes.push_back(rectangles.get());
+        }
+
+        for (const RectangleDecomposition *mode : modes) {
+            std::vector<QueryResult> results;
+
+            results.reserve(queries);
+
+            for (uint32_t i = 0; i < queries; ++i) {
+                const auto [x_start, y_start] = endpoints[i * 2];
+                const auto [x_end, y_end] = endpoints[i * 2 + 1];
+
+                results.push_back(
+                    run_query(
+                        map, x_start, y_start, x_end, y_end, std::nullopt, mode
+                    )
+                );
+            }
+
+            report(mode ? name + " (rectangles)" : name, results, false);
+        }
+
+        return 0;
+    }
+
+    void print_usage(const char *argv0) {
+        std::cerr
+            << "Usage:" << std::endl
+            << "  " << argv0 << " [--rect] <file.map|file.pfmap> <file.scen>"
+            << std::endl
+            << "  " << argv0 << " [--rect] --rand <width> <height> <queries>"
+            << std::endl
+            << "  " << argv0 << " --convert <file.map> <file.pfmap>"
+            << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    const char *const argv0 {argv[0]};
+    const bool rect {argc > 1 && std::string(argv[1]) == "--rect"};
+
+    if (rect) {
+        --argc;
+        ++argv;
+    }
+
+    try {
+        if (argc == 3) {
+            return bench_scenario(argv[1], argv[2], rect);
+        }
+        else if (argc == 4 && !rect && std::string(argv[1]) == "--convert") {
+            return convert(argv[2], argv[3]);
+        }
+        else if (argc == 5 && std::string(argv[1]) == "--rand") {
+            return bench_rand(
+                std::stoul(argv[2]), std::stoul(argv[3]), std::stoul(argv[4]),
+                rect
+            );
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+
+    print_usage(argv0);
+
+    return 1;
+}
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Log.h"
+#include "Map.h"
+#include "ShardedPathfind.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless benchmark of sharded pathfinding. Generates an open map scattered
+// with boxes, partitions it into shards served by worker processes, and times
+// the start-up, random queries with plain `Pathfind` in this process and with
+// `ShardedPathfind`, and edits inside shards and on their edges, which differ
+// in how much of the border graph they refresh. Reports the latency of each,
+// how many shards refined each path, and how much costlier the sharded paths
+// are.
+//
+// Usage:
+//
+//   main_bench_sharded <width> <height> <queries> [shard-size]
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    // The cost of a path as `Pathfind` reckons it.
+    double path_cost(const Map &map, const path_t &path) {
+        double cost {0};
+
+        for (uint32_t i = 0; i + 1 < path.size(); ++i) {
+            const auto [x, y] = path[i];
+
+            cost += DEFAULT_TERRAIN_COSTS[
+                map.get_nodes()[get_node_index(x, y, map.width)].get_terrain()
+            ];
+        }
+
+        return cost;
+    }
+
+    double us(const std::chrono::nanoseconds dur) {
+        return dur.count() / 1000.0;
+    }
+
+    void report(const std::string &name, std::vector<std::chrono::nanoseconds> &durs) {
+        std::sort(durs.begin(), durs.end());
+
+        std::cout
+            << name << std::endl
+            << "  latency p50 (us)  : " << us(durs[durs.size() / 2]) << std::endl
+            << "  latency p99 (us)  : "
+            << us(durs[std::min(durs.size() - 1, durs.size() * 99 / 100)]) << std::endl;
+    }
+
+    int bench(
+        const uint32_t width,
+        const uint32_t height,
+        const uint32_t num_queries,
+        const uint32_t shard_size
+    ) {
+        Map map {Map::gen_rand_map(width, height)};
+
+        for (auto &node : map.get_nodes_mut()) {
+            node.set_blocking(map.is_padding(node.x_coord, node.y_coord));
+        }
+
+        std::mt19937 gen {2};
+
+        std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+        std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+        std::uniform_int_distribution<uint32_t> rng_side(1, 9);
+
+        for (uint32_t box = 0; box < width / 10 * height / 10; ++box) {
+            const uint32_t x_min {rng_x(gen)};
+            const uint32_t y_min {rng_y(gen)};
+            const uint32_t x_max {std::min(width - 1, x_min + rng_side(gen))};
+            const uint32_t y_max {std::min(height - 1, y_min + rng_side(gen))};
+
+            for (uint32_t y = y_min; y <= y_max; ++y) {
+                for (uint32_t x = x_min; x <= x_max; ++x) {
+                    map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(true);
+                }
+            }
+        }
+
+        const auto start_spawn = std::chrono::steady_clock::now();
+
+        ShardedPathfind sharded(map, shard_size);
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << "map " << width << "x" << height << ", "
+            << sharded.get_shard_count() << " shards of " << shard_size << "x"
+            << shard_size << std::endl
+            << "start-up (us)       : "
+            << us(std::chrono::steady_clock::now() - start_spawn) << std::endl
+            << "border nodes        : " << sharded.get_border_node_count() << std::endl;
+
+        // Coloring logs every region it finds.
+        log_set_level(LogLevel::WARN);
+
+        std::vector<std::chrono::nanoseconds> durs_plain;
+        std::vector<std::chrono::nanoseconds> durs_sharded;
+
+        uint64_t refined {0};
+        double cost_plain {0};
+        double cost_sharded {0};
+        uint32_t mismatched {0};
+
+        while (durs_plain.size() < num_queries) {
+            const uint32_t x_start {rng_x(gen)};
+            const uint32_t y_start {rng_y(gen)};
+            const uint32_t x_end {rng_x(gen)};
+            const uint32_t y_end {rng_y(gen)};
+
+            if (map.is_blocking(x_start, y_start) || map.is_blocking(x_end, y_end)) {
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+
+            Pathfind<Map, decltype(block_lamb)> pathfinder(
+                map, x_start, y_start, x_end, y_end, block_lamb,
+                {.reserve_hint = 1 << 16}
+            );
+
+            const path_t path_plain {pathfinder.get_path()};
+
+            durs_plain.push_back(std::chrono::steady_clock::now() - start);
+
+            start = std::chrono::steady_clock::now();
+
+            const path_t path_sharded {sharded.get_path(x_start, y_start, x_end, y_end)};
+
+            durs_sharded.push_back(std::chrono::steady_clock::now() - start);
+            refined += sharded.get_refined_shard_count();
+
+            if (path_plain.empty() != path_sharded.empty()) {
+                ++mismatched;
+
+                continue;
+            }
+
+            cost_plain += path_cost(map, path_plain);
+            cost_sharded += path_cost(map, path_sharded);
+        }
+
+        report("pathfind", durs_plain);
+        report("sharded", durs_sharded);
+
+        std::cout
+            << "  refined / query   : "
+            << static_cast<double>(refined) / num_queries << std::endl
+            << "cost ratio          : " << cost_sharded / cost_plain << std::endl
+            << "mismatched paths    : " << mismatched << std::endl;
+
+        // Toggle cells inside shards, then on their edges, restoring each.
+        for (const bool on_edge : {false, true}) {
+            std::vector<std::chrono::nanoseconds> durs;
+
+            while (durs.size() < 100) {
+                const uint32_t x {
+                    on_edge ? std::min(width - 1, rng_x(gen) / shard_size * shard_size)
+                        : rng_x(gen)
+                };
+                const uint32_t y {rng_y(gen)};
+
+                const uint32_t x_in_shard {x % shard_size};
+
+                if (!on_edge && (x_in_shard == 0 || x_in_shard == shard_size - 1)) {
+                    continue;
+                }
+
+                const bool blocking {map.is_blocking(x, y)};
+
+                const auto start = std::chrono::steady_clock::now();
+
+                sharded.set_blocking(x, y, !blocking);
+
+                durs.push_back(std::chrono::steady_clock::now() - start);
+
+                sharded.set_blocking(x, y, blocking);
+            }
+
+            report(on_edge ? "edit on shard edge" : "edit inside shard", durs);
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4 && argc != 5) {
+        std::cerr
+            << "Usage: " << argv[0] << " <width> <height> <queries> [shard-size]"
+            << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        return bench(
+            std::stoul(argv[1]), std::stoul(argv[2]), std::stoul(argv[3]),
+            argc == 5 ? std::stoul(argv[4]) : 128
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Map.h"
+#include "MapSnapshot.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless benchmark of searching a map while it is edited. Generates an open
+// map scattered with boxes, and has reader threads run random queries, each
+// against the snapshot it pinned, while the editor drops and lifts boxes and
+// publishes a new version after each. Reports the latency of the queries and
+// of publishing, how many chunks each publish copied, and how much memory the
+// retired versions took before they were reclaimed.
+//
+// Usage:
+//
+//   main_bench_snapshot <width> <height> <queries> [readers] [box-size]
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    double us(const std::chrono::nanoseconds dur) {
+        return dur.count() / 1000.0;
+    }
+
+    void report(const std::string &name, std::vector<std::chrono::nanoseconds> &durs) {
+        std::sort(durs.begin(), durs.end());
+
+        std::cout
+            << name << std::endl
+            << "  latency p50 (us)  : " << us(durs[durs.size() / 2]) << std::endl
+            << "  latency p99 (us)  : "
+            << us(durs[std::min(durs.size() - 1, durs.size() * 99 / 100)]) << std::endl
+            << "  latency max (us)  : " << us(durs.back()) << std::endl;
+    }
+
+    int bench(
+        const uint32_t width,
+        const uint32_t height,
+        const uint32_t num_queries,
+        const uint32_t num_readers,
+        const uint32_t box_size
+    ) {
+        Map map {Map::gen_rand_map(width, height)};
+
+        for (auto &node : map.get_nodes_mut()) {
+            node.set_blocking(map.is_padding(node.x_coord, node.y_coord));
+        }
+
+        std::mt19937 gen {2};
+
+        std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+        std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+        std::uniform_int_distribution<uint32_t> rng_side(1, 9);
+
+        for (uint32_t box = 0; box < width / 10 * height / 10; ++box) {
+            const uint32_t x_min {rng_x(gen)};
+            const uint32_t y_min {rng_y(gen)};
+            const uint32_t x_max {std::min(width - 1, x_min + rng_side(gen))};
+            const uint32_t y_max {std::min(height - 1, y_min + rng_side(gen))};
+
+            for (uint32_t y = y_min; y <= y_max; ++y) {
+                for (uint32_t x = x_min; x <= x_max; ++x) {
+                    map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(true);
+                }
+            }
+        }
+
+        if (num_readers == 0 || num_readers > VersionedMap::MAX_READERS) {
+            throw std::invalid_argument("Readers out of range");
+        }
+
+        VersionedMap versioned(map);
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << "map " << width << "x" << height << ", " << num_readers
+            << " readers, boxes of " << box_size << "x" << box_size << std::endl;
+
+        std::atomic<uint32_t> count_queries {0};
+        std::vector<std::vector<std::chrono::nanoseconds>> durs_readers(num_readers);
+        std::vector<uint64_t> versions_seen(num_readers, 0);
+
+        std::vector<std::thread> readers;
+
+        for (uint32_t i = 0; i < num_readers; ++i) {
+            readers.emplace_back(
+                [&, i]() {
+                    VersionedMap::Reader reader(versioned);
+
+                    std::mt19937 gen {3 + i};
+
+                    std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+                    std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+
+                    uint64_t version_last {UINT64_MAX};
+
+                    while (count_queries.fetch_add(1) < num_queries) {
+                        const uint32_t x_start {rng_x(gen)};
+                        const uint32_t y_start {rng_y(gen)};
+                        const uint32_t x_end {rng_x(gen)};
+                        const uint32_t y_end {rng_y(gen)};
+
+                        const auto start = std::chrono::steady_clock::now();
+
+                        const auto pinned {reader.pin()};
+
+                        Pathfind<const MapSnapshot, decltype(block_lamb)> pathfinder(
+                            *pinned, x_start, y_start, x_end, y_end, block_lamb,
+                            {.reserve_hint = 1 << 16}
+                        );
+
+                        pathfinder.get_path();
+
+                        durs_readers[i].push_back(
+                            std::chrono::steady_clock::now() - start
+                        );
+
+                        versions_seen[i] += pinned->version != version_last;
+                        version_last = pinned->version;
+                    }
+                }
+            );
+        }
+
+        // Edit until the readers are done, alternately dropping a box and
+        // lifting the last one, a publish about every millisecond.
+        std::vector<std::chrono::nanoseconds> durs_publish;
+        uint64_t retired_max {0};
+        uint32_t x_box {0};
+        uint32_t y_box {0};
+
+        while (count_queries.load() < num_queries) {
+            const bool drop {durs_publish.size() % 2 == 0};
+
+            if (drop) {
+                x_box = rng_x(gen) / box_size * box_size;
+                y_box = rng_y(gen) / box_size * box_size;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+
+            for (uint32_t y = y_box; y < std::min(height, y_box + box_size); ++y) {
+                for (uint32_t x = x_box; x < std::min(width, x_box + box_size); ++x) {
+                    versioned.set_blocking(x, y, drop || map.is_blocking(x, y));
+                }
+            }
+
+            versioned.publish();
+
+            durs_publish.push_back(std::chrono::steady_clock::now() - start);
+            retired_max = std::max<uint64_t>(retired_max, versioned.get_retired_count());
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        for (auto &reader : readers) {
+            reader.join();
+        }
+
+        versioned.reclaim();
+
+        std::vector<std::chrono::nanoseconds> durs;
+        uint64_t versions {0};
+
+        for (uint32_t i = 0; i < num_readers; ++i) {
+            durs.insert(durs.end(), durs_readers[i].begin(), durs_readers[i].end());
+            versions += versions_seen[i];
+        }
+
+        report("pathfind", durs);
+
+        std::cout
+            << "  versions seen     : " << versions << std::endl;
+
+        report("edit and publish", durs_publish);
+
+        const VersionedMap::Stats &stats {versioned.get_stats()};
+
+        std::cout
+            << "  publishes         : " << stats.publishes << std::endl
+            << "  copies / publish  : "
+            << static_cast<double>(stats.copies) / stats.publishes << std::endl
+            << "reclamation" << std::endl
+            << "  reclaimed         : " << stats.reclaimed << std::endl
+            << "  reclaimed (MiB)   : "
+            << stats.reclaimed_chunks * sizeof(MapChunk) / 1048576.0 << std::endl
+            << "  retired at most   : " << retired_max << std::endl
+            << "  still retired     : " << versioned.get_retired_count() << std::endl
+            << "  whole map (MiB)   : "
+            << static_cast<double>(width) * height * sizeof(MapChunk) / MapChunk::CELLS /
+                1048576.0
+            << std::endl;
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4 || argc > 6) {
+        std::cerr
+            << "Usage: " << argv[0]
+            << " <width> <height> <queries> [readers] [box-size]" << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        return bench(
+            std::stoul(argv[1]), std::stoul(argv[2]), std::stoul(argv[3]),
+            argc >= 5 ? std::stoul(argv[4]) : 2,
+            argc >= 6 ? std::stoul(argv[5]) : 16
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
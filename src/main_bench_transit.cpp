@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Map.h"
+#include "RoadNetwork.h"
+#include "Trace.h"
+#include "Util.h"
+
+// Headless benchmark of the road-network transit layer. Runs the same long
+// random queries on a `gen_rand_map()` map with plain `Pathfind` and with a
+// `RoadNetwork`, and reports the latency of each, along with how much costlier
+// the transit paths are.
+//
+// Usage:
+//
+//   main_bench_transit <width> <height> <queries>
+
+namespace {
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    // The cost of a path as `Pathfind` reckons it, or -1 if it is not a valid
+    // path, ie, a chain of open, neighboring cells.
+    double path_cost(const Map &map, const path_t &path) {
+        double cost {0};
+
+        for (uint32_t i = 1; i < path.size(); ++i) {
+            const auto [x_prev, y_prev] = path[i - 1];
+            const auto [x, y] = path[i];
+            const double step {dist_chebyshev(x_prev, y_prev, x, y)};
+
+            if (step != 1 || map.is_blocking(x, y)) {
+                return -1;
+            }
+
+            cost += step * DEFAULT_TERRAIN_COSTS[
+                map.get_nodes()[get_node_index(x, y, map.width)].get_terrain()
+            ];
+        }
+
+        return cost;
+    }
+
+    void report(const std::string &name, std::vector<std::chrono::nanoseconds> &durs) {
+        std::sort(durs.begin(), durs.end());
+
+        const auto us = [](const std::chrono::nanoseconds dur) {
+            return dur.count() / 1000.0;
+        };
+
+        std::cout
+            << std::fixed << std::setprecision(2)
+            << name << std::endl
+            << "  latency p50 (us)  : " << us(durs[durs.size() / 2]) << std::endl
+            << "  latency p99 (us)  : "
+            << us(durs[std::min(durs.size() - 1, durs.size() * 99 / 100)]) << std::endl
+            << "  latency max (us)  : " << us(durs.back()) << std::endl;
+    }
+
+    int bench(const uint32_t width, const uint32_t height, const uint32_t num_queries) {
+        Map map {Map::gen_rand_map(width, height)};
+
+        RegionColorer<Map, decltype(block_lamb)>::color_all_regions(map, block_lamb);
+
+        std::vector<std::pair<uint32_t, uint32_t>> open_cells;
+
+        for (const auto &node : map.get_nodes()) {
+            if (!node.get_blocking()) {
+                open_cells.emplace_back(node.x_coord, node.y_coord);
+            }
+        }
+
+        std::mt19937 gen {2};
+        std::uniform_int_distribution<size_t> rng(0, open_cells.size() - 1);
+
+        // Long queries only: endpoints in the same region, at least half the
+        // map apart.
+        struct Query {
+            uint32_t x_start;
+            uint32_t y_start;
+            uint32_t x_end;
+            uint32_t y_end;
+        };
+
+        std::vector<Query> queries;
+
+        const double min_dist {std::max(width, height) / 2.0};
+
+        for (
+            uint64_t tries = 0;
+            queries.size() < num_queries && tries < num_queries * 1000ull;
+            ++tries
+        ) {
+            const auto [x_start, y_start] = open_cells[rng(gen)];
+            const auto [x_end, y_end] = open_cells[rng(gen)];
+
+            if (
+                dist_euclidean(x_start, y_start, x_end, y_end) < min_dist ||
+                map.get_nodes()[get_node_index(x_start, y_start, width)].get_region() !=
+                    map.get_nodes()[get_node_index(x_end, y_end, width)].get_region()
+            ) {
+                continue;
+            }
+
+            queries.push_back({x_start, y_start, x_end, y_end});
+        }
+
+        if (queries.empty()) {
+            std::cerr << "Found no long queries." << std::endl;
+
+            return 1;
+        }
+
+        const auto start_build = std::chrono::steady_clock::now();
+
+        RoadNetwork<Map, decltype(block_lamb)> roads(map, block_lamb);
+
+        const auto dur_build = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_build
+        );
+
+        std::cout
+            << "gen_rand_map " << width << "x" << height << ", "
+            << queries.size() << " queries, " << roads.num_junctions()
+            << " junctions, built in " << dur_build.count() << " ms" << std::endl;
+
+        std::vector<std::chrono::nanoseconds> durs_direct;
+        std::vector<std::chrono::nanoseconds> durs_transit;
+
+        double cost_direct {0};
+        double cost_transit {0};
+        uint32_t invalid {0};
+
+        for (const Query &query : queries) {
+            auto start = std::chrono::steady_clock::now();
+
+            Pathfind<Map, decltype(block_lamb)> pathfinder(
+                map, query.x_start, query.y_start, query.x_end, query.y_end, block_lamb
+            );
+
+            const path_t path_direct {pathfinder.get_path()};
+
+            durs_direct.push_back(std::chrono::steady_clock::now() - start);
+
+            start = std::chrono::steady_clock::now();
+
+            const path_t path_transit {
+                roads.get_path(query.x_start, query.y_start, query.x_end, query.y_end)
+            };
+
+            durs_transit.push_back(std::chrono::steady_clock::now() - start);
+
+            const double cost {path_cost(map, path_transit)};
+
+            if (
+                path_transit.empty() ||
+                cost < 0 ||
+                path_transit.back() != std::make_pair(query.x_start, query.y_start) ||
+                path_transit.front() != std::make_pair(query.x_end, query.y_end)
+            ) {
+                ++invalid;
+
+                continue;
+            }
+
+            cost_direct += path_cost(map, path_direct);
+            cost_transit += cost;
+        }
+
+        report("pathfind", durs_direct);
+        report("transit", durs_transit);
+
+        std::cout
+            << "cost ratio          : " << cost_transit / cost_direct << std::endl
+            << "invalid paths       : " << invalid << std::endl;
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        std::cerr
+            << "Usage: " << argv[0] << " <width> <height> <queries>" << std::endl;
+
+        return 1;
+    }
+
+    auto trace_guard = Guard(
+        []() {
+            trace_export_chrome_from_env();
+        }
+    );
+
+    try {
+        return bench(std::stoul(argv[1]), std::stoul(argv[2]), std::stoul(argv[3]));
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
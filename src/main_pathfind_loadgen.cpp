@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Map.h"
+#include "MapSpec.h"
+#include "QueryProtocol.h"
+
+// Load generator for `main_pathfind_server`. Opens a number of connections,
+// each of which keeps a fixed number of query batches in flight for the
+// duration of the run, then reports throughput and batch latency.
+//
+// The map spec must match the server's, so that queries are drawn from open
+// cells.
+//
+// Usage:
+//
+//   main_pathfind_loadgen <socket-path> <map-spec> [connections] [batch-size]
+//       [depth] [seconds]
+
+namespace {
+    const uint32_t MAX_DEPTH {1024};
+
+    struct ConnStats {
+        uint64_t queries {0};
+        uint64_t found {0};
+        std::vector<std::chrono::microseconds> latencies;
+    };
+
+    void run_connection(
+        const std::string &socket_path,
+        const std::vector<std::pair<uint32_t, uint32_t>> &open_spaces,
+        const uint32_t seed,
+        const uint32_t batch_size,
+        const uint32_t depth,
+        const std::chrono::steady_clock::time_point deadline,
+        ConnStats &stats
+    ) {
+        const int fd {connect_unix(socket_path)};
+
+        std::mutex mu;
+        std::unordered_map<uint32_t, std::chrono::steady_clock::time_point> sent;
+        std::counting_semaphore<MAX_DEPTH> window(depth);
+        std::atomic<uint32_t> outstanding {0};
+        std::atomic<bool> sending_done {false};
+
+        std::thread receiver(
+            [&]() {
+                std::vector<unsigned char> payload;
+
+                while (!sending_done || outstanding > 0) {
+                    if (!read_frame(fd, payload)) {
+                        break;
+                    }
+
+                    const auto now = std::chrono::steady_clock::now();
+
+                    const unsigned char *cursor {payload.data()};
+                    const unsigned char *end {payload.data() + payload.size()};
+
+                    const uint32_t batch_id {consume_u32(cursor, end)};
+                    const uint32_t count {consume_u32(cursor, end)};
+
+                    for (uint32_t i = 0; i < count; ++i) {
+                        if (!decode_path(cursor, end).empty()) {
+                            ++stats.found;
+                        }
+                    }
+
+                    stats.queries += count;
+
+                    {
+                        std::scoped_lock<std::mutex> lock(mu);
+
+                        const auto iter {sent.find(batch_id)};
+
+                        if (iter != sent.end()) {
+                            stats.latencies.push_back(
+                                std::chrono::duration_cast<std::chrono::microseconds>(
+                                    now - iter->second
+                                )
+                            );
+
+                            sent.erase(iter);
+                        }
+                    }
+
+                    --outstanding;
+                    window.release();
+                }
+            }
+        );
+
+        std::mt19937 gen {seed};
+        std::uniform_int_distribution<size_t> rng(0, open_spaces.size() - 1);
+
+        std::vector<PathQuery> queries(batch_size);
+
+        for (uint32_t batch_id = 0; std::chrono::steady_clock::now() < deadline; ++batch_id) {
+            for (auto &query : queries) {
+                const auto [x_start, y_start] = open_spaces[rng(gen)];
+                const auto [x_end, y_end] = open_spaces[rng(gen)];
+
+                query = {x_start, y_start, x_end, y_end};
+            }
+
+            const auto frame {encode_request(batch_id, queries)};
+
+            window.acquire();
+
+            ++outstanding;
+
+            {
+                std::scoped_lock<std::mutex> lock(mu);
+
+                sent[batch_id] = std::chrono::steady_clock::now();
+            }
+
+            if (!write_all(fd, frame.data(), frame.size())) {
+                --outstanding;
+
+                break;
+            }
+        }
+
+        sending_done = true;
+
+        if (outstanding == 0) {
+            // The receiver may be blocked waiting for a response that will
+            // never come.
+            ::shutdown(fd, SHUT_RD);
+        }
+
+        receiver.join();
+
+        ::close(fd);
+    }
+
+    template <typename map_t>
+    int run(
+        map_t &map,
+        const std::string &socket_path,
+        const uint32_t connections,
+        const uint32_t batch_size,
+        const uint32_t depth,
+        const uint32_t seconds
+    ) {
+        std::vector<std::pair<uint32_t, uint32_t>> open_spaces;
+
+        for (uint32_t y = 0; y < map.height; ++y) {
+            for (uint32_t x = 0; x < map.width; ++x) {
+                if (!map.is_blocking(x, y)) {
+                    open_spaces.emplace_back(x, y);
+                }
+            }
+        }
+
+        if (open_spaces.empty()) {
+            std::cerr << "Map has no open cells." << std::endl;
+
+            return 1;
+        }
+
+        std::vector<ConnStats> stats(connections);
+        std::vector<std::thread> threads;
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto deadline = start + std::chrono::seconds(seconds);
+
+        for (uint32_t i = 0; i < connections; ++i) {
+            threads.emplace_back(
+                run_connection,
+                std::cref(socket_path), std::cref(open_spaces),
+                i + 1, batch_size, depth, deadline, std::ref(stats[i])
+            );
+        }
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        const double elapsed_s {
+            std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start
+            ).count()
+        };
+
+        uint64_t queries {0};
+        uint64_t found {0};
+        std::vector<std::chrono::microseconds> latencies;
+
+        for (const auto &conn_stats : stats) {
+            queries += conn_stats.queries;
+            found += conn_stats.found;
+            latencies.insert(
+                latencies.end(),
+                conn_stats.latencies.begin(), conn_stats.latencies.end()
+            );
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+
+        const auto pct = [&](const double p) -> int64_t {
+            if (latencies.empty()) {
+                return 0;
+            }
+
+            return latencies[
+                std::min(
+                    latencies.size() - 1,
+                    static_cast<size_t>(p / 100.0 * latencies.size())
+                )
+            ].count();
+        };
+
+        std::cout
+            << std::fixed << std::setprecision(1)
+            << "connections         : " << connections << std::endl
+            << "batch size          : " << batch_size << std::endl
+            << "depth               : " << depth << std::endl
+            << "queries             : " << queries << std::endl
+            << "found               : " << found << std::endl
+            << "QPS                 : " << queries / elapsed_s << std::endl
+            << "batch latency p50 us: " << pct(50) << std::endl
+            << "batch latency p99 us: " << pct(99) << std::endl
+            << "batch latency max us: " << pct(100) << std::endl;
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 7) {
+        std::cerr
+            << "Usage: " << argv[0]
+            << " <socket-path> <map-spec> [connections] [batch-size] [depth]"
+            << " [seconds]" << std::endl;
+
+        return 1;
+    }
+
+    try {
+        const std::string socket_path {argv[1]};
+
+        const auto arg_or = [&](const int i, const uint32_t fallback) -> uint32_t {
+            return argc > i ? std::stoul(argv[i]) : fallback;
+        };
+
+        const uint32_t connections {arg_or(3, 4)};
+        const uint32_t batch_size {arg_or(4, 64)};
+        const uint32_t depth {std::clamp(arg_or(5, 8), 1u, MAX_DEPTH)};
+        const uint32_t seconds {arg_or(6, 5)};
+
+        return with_map_spec(
+            argv[2],
+            [&](auto &map) {
+                return run(
+                    map, socket_path, connections, batch_size, depth, seconds
+                );
+            }
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
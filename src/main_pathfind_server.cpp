@@ -0,0 +1,72 @@
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "Log.h"
+#include "MapSpec.h"
+#include "PathServer.h"
+#include "Trace.h"
+
+// Headless path query server. Loads a map, then answers batches of path
+// queries over a Unix domain socket until interrupted (see `PathServer.h`).
+//
+// Usage:
+//
+//   main_pathfind_server <socket-path> <map-spec> [threads]
+//
+// See `with_map_spec()` for the map spec syntax. When built with tracing,
+// the trace is written on shutdown to `$PATHFINDING_TRACE_FILE`, if set.
+
+namespace {
+    std::atomic<bool> stop_requested {false};
+
+    void handle_stop_signal(int) {
+        stop_requested = true;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 4) {
+        std::cerr
+            << "Usage: " << argv[0] << " <socket-path> <map-spec> [threads]"
+            << std::endl;
+
+        return 1;
+    }
+
+    std::signal(SIGINT, handle_stop_signal);
+    std::signal(SIGTERM, handle_stop_signal);
+
+    try {
+        const std::string socket_path {argv[1]};
+        const uint32_t threads {
+            argc == 4
+                ? static_cast<uint32_t>(std::stoul(argv[3]))
+                : std::thread::hardware_concurrency()
+        };
+
+        return with_map_spec(
+            argv[2],
+            [&](auto &map) {
+                PathServer<std::remove_reference_t<decltype(map)>> server(
+                    map, socket_path, threads
+                );
+
+                server.serve(stop_requested);
+
+                trace_export_chrome_from_env();
+
+                log_flush();
+
+                return 0;
+            }
+        );
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+
+        return 1;
+    }
+}
@@ -1,10 +1,21 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <optional>
 #include <ranges>
 #include <sstream>
+#include <tuple>
 
+#include "AgentSim.h"
 #include "Draw.h"
+#include "Log.h"
 #include "Map.h"
+#include "OccupancyLayer.h"
+#include "PathJobs.h"
+#include "PathScheduler.h"
+#include "SearchObserver.h"
+#include "SpatialGrid.h"
+#include "Trace.h"
 #include "Util.h"
 
 #include "imgui.h"
@@ -28,6 +39,23 @@
 const uint32_t SCREEN_WIDTH {640 * 3};
 const uint32_t SCREEN_HEIGHT {480 * 2};
 
+// Links a `Pather` to its agent in the movement simulation.
+struct SimAgent {
+    uint32_t agent;
+};
+
+// Cells per second.
+const float pather_speed {8.0f};
+
+const std::chrono::microseconds sim_tick {1000000 / 60};
+const uint32_t max_sim_ticks_per_frame {4};
+
+// Cells.
+const float pathers_near_radius {8.0f};
+
+// The extra cost for a path to pass through a cell holding a pather.
+const float pather_occupancy_cost {4.0f};
+
 void pathfind_gfx(
     entt::registry &registry,
     GPU_Target* screen,
@@ -84,7 +112,7 @@ void pathfind_gfx(
     for (uint32_t y = 0; y < sprite_height; y++) {
         for (uint32_t x = 0; x < sprite_width; x++) {
             reinterpret_cast<uint32_t*>(pix_obstacle)[
-                get_node_index(x, y, sprite_width)
+                y * sprite_width + x
             ] = SDL_MapRGBA(
                 pixel_format,
                 255 /*= red*/,
@@ -97,7 +125,7 @@ void pathfind_gfx(
     for (uint32_t y = 0; y < sprite_height; y++) {
         for (uint32_t x = 0; x < sprite_width; x++) {
             reinterpret_cast<uint32_t*>(pix_open)[
-                get_node_index(x, y, sprite_width)
+                y * sprite_width + x
             ] = SDL_MapRGBA(
                 pixel_format,
                 200 /*= red*/,
@@ -110,7 +138,7 @@ void pathfind_gfx(
     for (uint32_t y = 0; y < sprite_height; y++) {
         for (uint32_t x = 0; x < sprite_width; x++) {
             reinterpret_cast<uint32_t*>(pix_path)[
-                get_node_index(x, y, sprite_width)
+                y * sprite_width + x
             ] = SDL_MapRGBA(
                 pixel_format,
                 0 /*= red*/,
@@ -123,7 +151,7 @@ void pathfind_gfx(
     for (uint32_t y = 0; y < sprite_height; y++) {
         for (uint32_t x = 0; x < sprite_width; x++) {
             reinterpret_cast<uint32_t*>(pix_explore)[
-                get_node_index(x, y, sprite_width)
+                y * sprite_width + x
             ] = SDL_MapRGBA(
                 pixel_format,
                 0 /*= red*/,
@@ -136,7 +164,7 @@ void pathfind_gfx(
     for (uint32_t y = 0; y < sprite_height; y++) {
         for (uint32_t x = 0; x < sprite_width; x++) {
             reinterpret_cast<uint32_t*>(pix_road)[
-                get_node_index(x, y, sprite_width)
+                y * sprite_width + x
             ] = SDL_MapRGBA(
                 pixel_format,
                 128 /*= red*/,
@@ -151,7 +179,7 @@ void pathfind_gfx(
             // Start with "beige-ish", and we'll modulate the color live, based
             // on the region value of the open tile we're painting.
             reinterpret_cast<uint32_t*>(pix_region)[
-                get_node_index(x, y, sprite_width)
+                y * sprite_width + x
             ] = SDL_MapRGBA(
                 pixel_format,
                 200 /*= red*/,
@@ -317,17 +345,12 @@ void pathfind_gfx(
 
     {
         GPU_Camera cam = GPU_GetCamera(screen);
-        std::cout
-            << "Cam values:" << std::endl
-            << "  x: " << cam.x << std::endl
-            << "  y: " << cam.y << std::endl
-            << "  z: " << cam.z << std::endl
-            << "  angle: " << cam.angle << std::endl
-            << "  zoom_x: " << cam.zoom_x << std::endl
-            << "  zoom_y: " << cam.zoom_y << std::endl
-            << "  z_near: " << cam.z_near << std::endl
-            << "  z_far: " << cam.z_far << std::endl
-            ;
+        LOG_INFO(
+            "Cam values: x: %f, y: %f, z: %f, angle: %f, zoom_x: %f, "
+            "zoom_y: %f, z_near: %f, z_far: %f",
+            cam.x, cam.y, cam.z, cam.angle,
+            cam.zoom_x, cam.zoom_y, cam.z_near, cam.z_far
+        );
     }
 
     // Will be used to cache the map texture since it changes infrequently.
@@ -348,6 +371,53 @@ void pathfind_gfx(
         RegionColorer<Map, decltype(block_lamb)>::get_cur_region_color()
     };
 
+    // Records which cells each pathfind explored, so they can be painted.
+    ExploredCellsObserver explored;
+
+    // The pathers' current cells, so that the drawn path goes around them.
+    OccupancyLayer pather_occupancy(map.width, map.height, pather_occupancy_cost);
+
+    // Path queries are time-sliced, so that a long search is spread across
+    // several frames rather than stalling one.
+    PathScheduler<Map, decltype(block_lamb)> path_scheduler(
+        map, block_lamb, &pather_occupancy
+    );
+
+    const uint32_t pathfind_frame_expansions {20000};
+    const std::chrono::microseconds pathfind_frame_time {4000};
+
+    std::optional<uint64_t> path_query;
+    std::optional<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>> cur_path_ends;
+    std::vector<std::pair<uint32_t, uint32_t>> cur_path;
+
+    // The pathers wander between random open cells, with their paths
+    // computed off the main thread and followed by the agent simulation.
+    PathJobSystem<Map, decltype(block_lamb)> path_jobs(map, block_lamb);
+
+    AgentSim agent_sim;
+    std::vector<entt::entity> agent_entities;
+
+    // Indexes the pathers by agent id, for finding those near the cursor.
+    SpatialGrid pather_grid(map.width, map.height);
+
+    for (const auto &[entity, pos] : registry.view<const Pather, const Pos>().each()) {
+        const uint32_t agent {agent_sim.add_agent(pos.x, pos.y, pather_speed)};
+
+        registry.emplace<SimAgent>(entity, agent);
+        agent_entities.push_back(entity);
+        pather_grid.insert(agent, pos.x, pos.y);
+        pather_occupancy.set(agent, pos.x, pos.y);
+
+        const auto [x_end, y_end] = map.get_rand_open_xy();
+
+        path_jobs.request(registry, entity, x_end, y_end);
+    }
+
+    uint64_t async_paths {0};
+    std::vector<entt::entity> arrived;
+
+    std::chrono::microseconds sim_time_pending {0};
+
     bool done = false;
     while (!done) {
         uint32_t drawn_sprites {0};
@@ -451,11 +521,13 @@ void pathfind_gfx(
                 Map, decltype(block_lamb)
             >::get_cur_region_color()
         ) {
+            TRACE_SCOPE("map texture rebuild");
+
             cur_region = RegionColorer<
                 Map, decltype(block_lamb)
             >::get_cur_region_color();
 
-            std::cout << "Drawing main map texture from scratch..." << std::endl;
+            LOG_INFO("Drawing main map texture from scratch...");
 
             // Only rendering one texture at a time substantially improves
             // performance. Switching between two textures back and forth is 3x+
@@ -548,7 +620,7 @@ void pathfind_gfx(
                 const uint32_t x_frame {x_node * sprite_width};
                 const uint32_t y_frame {y_node * sprite_height};
 
-                if (node.get_weight() < 1) {
+                if (node.get_terrain() == TERRAIN_ROAD) {
                     GPU_Blit(
                         texture_road,
                         nullptr,
@@ -620,60 +692,75 @@ void pathfind_gfx(
 
                 start_pathfinding = std::chrono::steady_clock::now();
 
-                {
-                    Pathfind<Map, decltype(block_lamb)> pathfinder(
-                        map,
+                const std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> path_ends {
+                    x_click_map, y_click_map, x_mouse_map, y_mouse_map
+                };
+
+                // The previous query is stale once either end moves.
+                if (path_ends != cur_path_ends) {
+                    if (path_query) {
+                        path_scheduler.cancel(*path_query);
+                    }
+
+                    cur_path_ends = path_ends;
+                    cur_path.clear();
+
+                    path_query = path_scheduler.submit(
                         x_click_map, y_click_map,
                         x_mouse_map, y_mouse_map,
-                        block_lamb
+                        [&](std::vector<std::pair<uint32_t, uint32_t>> &&path) {
+                            cur_path = std::move(path);
+                            path_query.reset();
+                        },
+                        &explored
                     );
+                }
 
-                    const auto path {pathfinder.get_path()};
+                path_scheduler.tick(
+                    pathfind_frame_expansions, pathfind_frame_time
+                );
 
-                    end_pathfinding = std::chrono::steady_clock::now();
+                end_pathfinding = std::chrono::steady_clock::now();
 
-                    dur_pathfinding +=
-                        std::chrono::duration_cast<std::chrono::microseconds>(
-                            end_pathfinding - start_pathfinding
-                        );
+                dur_pathfinding +=
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        end_pathfinding - start_pathfinding
+                    );
 
-                    if (path.size()) {
-                        for (
-                            const auto explored_idx : Pathfind<Map, decltype(block_lamb)>::static_seen_nodes_idx
-                        ) {
-                            const auto [x_explore_map, y_explore_map] = get_node_xy(explored_idx, map.width);
-
-                            const uint32_t x_explore = x_explore_map * sprite_width;
-                            const uint32_t y_explore = y_explore_map * sprite_height;
-
-                            GPU_Blit(
-                                texture_explore,
-                                nullptr,
-                                screen,
-                                x_explore,
-                                y_explore
-                            );
-
-                            ++drawn_sprites;
-                        }
-                    }
+                if (!path_query && cur_path.size()) {
+                    for (const auto explored_idx : explored.get_generated()) {
+                        const auto [x_explore_map, y_explore_map] = get_node_xy(explored_idx, map.width);
 
-                    for (const auto &[x_path_map, y_path_map] : path) {
-                        const uint32_t x_path = x_path_map * sprite_width;
-                        const uint32_t y_path = y_path_map * sprite_height;
+                        const uint32_t x_explore = x_explore_map * sprite_width;
+                        const uint32_t y_explore = y_explore_map * sprite_height;
 
                         GPU_Blit(
-                            texture_path,
+                            texture_explore,
                             nullptr,
                             screen,
-                            x_path,
-                            y_path
+                            x_explore,
+                            y_explore
                         );
 
                         ++drawn_sprites;
                     }
                 }
 
+                for (const auto &[x_path_map, y_path_map] : cur_path) {
+                    const uint32_t x_path = x_path_map * sprite_width;
+                    const uint32_t y_path = y_path_map * sprite_height;
+
+                    GPU_Blit(
+                        texture_path,
+                        nullptr,
+                        screen,
+                        x_path,
+                        y_path
+                    );
+
+                    ++drawn_sprites;
+                }
+
                 // uint32_t loops {0};
                 // for (const auto &[x_start, y_start] : open_spaces) {
                 //     std::ranges::reverse_view rv_open_spaces {open_spaces};
@@ -683,7 +770,8 @@ void pathfind_gfx(
                 //             map,
                 //             x_start, y_start,
                 //             x_end, y_end,
-                //             block_lamb
+                //             block_lamb,
+                //             {.observer = &explored}
                 //         );
 
                 //         start_pathfinding = std::chrono::steady_clock::now();
@@ -697,9 +785,7 @@ void pathfind_gfx(
                 //                  end_pathfinding - start_pathfinding
                 //              );
 
-                //         for (
-                //             const auto explored_idx : Pathfind<Map, decltype(block_lamb)>::static_seen_nodes_idx
-                //         ) {
+                //         for (const auto explored_idx : explored.get_generated()) {
                 //             const auto [x_explore_map, y_explore_map] = get_node_xy(explored_idx, map.width);
 
                 //             const uint32_t x_explore = x_explore_map * sprite_width;
@@ -744,6 +830,84 @@ void pathfind_gfx(
             }
         }
 
+        path_jobs.update(registry);
+
+        // Collected first, since re-requesting removes the result being
+        // iterated.
+        arrived.clear();
+
+        for (const auto entity : registry.view<const Pather, const PathResult>()) {
+            arrived.push_back(entity);
+        }
+
+        for (const auto entity : arrived) {
+            ++async_paths;
+
+            auto &path {registry.get<PathResult>(entity).path.path};
+
+            if (path.empty()) {
+                const auto [x_end, y_end] = map.get_rand_open_xy();
+
+                path_jobs.request(registry, entity, x_end, y_end);
+
+                continue;
+            }
+
+            // Into travel order.
+            std::reverse(path.begin(), path.end());
+
+            agent_sim.set_path(registry.get<SimAgent>(entity).agent, path);
+
+            registry.remove<PathResult>(entity);
+        }
+
+        // Advance the simulation in fixed ticks, however long the frame took,
+        // but without trying to catch up on a long stall.
+        sim_time_pending = std::min(
+            sim_time_pending + frame_dur, sim_tick * max_sim_ticks_per_frame
+        );
+
+        for (; sim_time_pending >= sim_tick; sim_time_pending -= sim_tick) {
+            agent_sim.step(
+                std::chrono::duration<float>(sim_tick).count(),
+                [&](const uint32_t x, const uint32_t y) {
+                    return map.is_blocking(x, y);
+                }
+            );
+        }
+
+        // Whether a pather arrived or found its way blocked, it heads off
+        // somewhere new from where it stands.
+        agent_sim.drain_events(
+            [&](const AgentSim::Event &event) {
+                const auto [x_end, y_end] = map.get_rand_open_xy();
+
+                path_jobs.request(
+                    registry, agent_entities[event.agent], x_end, y_end
+                );
+            }
+        );
+
+        for (uint32_t agent = 0; agent < agent_entities.size(); ++agent) {
+            registry.replace<Pos>(
+                agent_entities[agent], agent_sim.get_x(agent), agent_sim.get_y(agent)
+            );
+
+            pather_grid.move(agent, agent_sim.get_x(agent), agent_sim.get_y(agent));
+            pather_occupancy.set(agent, agent_sim.get_x(agent), agent_sim.get_y(agent));
+        }
+
+        uint32_t pathers_near_mouse {0};
+
+        pather_grid.query_radius(
+            static_cast<float>(x_mouse) / sprite_width,
+            static_cast<float>(y_mouse) / sprite_height,
+            pathers_near_radius,
+            [&](const uint32_t, const float, const float) {
+                ++pathers_near_mouse;
+            }
+        );
+
         if (frames % 60 == 0) {
             start_font = std::chrono::steady_clock::now();
         }
@@ -796,6 +960,17 @@ void pathfind_gfx(
             "Drawn sprites: %d", drawn_sprites
         );
 
+        font.draw(
+            screen, 0, font.getHeight() * 8, SDL_Color{0, 0, 0, 255},
+            "Async paths: %llu (%u in flight)",
+            static_cast<unsigned long long>(async_paths), path_jobs.in_flight()
+        );
+
+        font.draw(
+            screen, 0, font.getHeight() * 9, SDL_Color{0, 0, 0, 255},
+            "Pathers near cursor: %u", pathers_near_mouse
+        );
+
         font.drawBox(
             screen, SDL_Rect(0, font.getHeight() * 10, 400, 100),
             "The quick brown fox jumps over the lazy dog, the quick brown fox jumps over the lazy dog, the quick brown fox jumps over the lazy dog, the quick brown fox jumps over the lazy dog, the quick brown fox jumps over the lazy dog..."
@@ -816,7 +991,11 @@ void pathfind_gfx(
 
         start_flip = std::chrono::steady_clock::now();
 
-        GPU_Flip(screen);
+        {
+            TRACE_SCOPE("GPU_Flip");
+
+            GPU_Flip(screen);
+        }
 
         end_flip = std::chrono::steady_clock::now();
 
@@ -837,6 +1016,8 @@ void pathfind_gfx(
 
     Pathfind<Map, decltype(block_lamb)>::print_perf();
 
+    trace_export_chrome_from_env();
+
     return;
 }
 
@@ -1246,7 +1427,9 @@ void demo_gfx(
 int main(int argc, char** argv) {
     entt::registry registry;
 
-    std::cout << "Hello, world!" << std::endl;
+    trace_set_thread_name("main");
+
+    LOG_INFO("Hello, world!");
 
     try {
         GPU_SetDebugLevel(GPU_DEBUG_LEVEL_MAX);
@@ -1262,7 +1445,8 @@ int main(int argc, char** argv) {
         // SDL_GL_SetSwapInterval(0);
 
         if (screen == nullptr) {
-            std::cerr << "Failed to initialize sdl-gpu." << std::endl;
+            LOG_ERROR("Failed to initialize sdl-gpu.");
+            log_flush();
 
             exit(1);
         }
@@ -1335,12 +1519,14 @@ int main(int argc, char** argv) {
     } catch (SDL2pp::Exception& e) {
         // Exception stores SDL_GetError() result and name of function which
         // failed
-        std::cerr << "Error in: " << e.GetSDLFunction() << std::endl;
-        std::cerr << "  Reason: " << e.GetSDLError() << std::endl;
+        LOG_ERROR("Error in: %s", e.GetSDLFunction().c_str());
+        LOG_ERROR("  Reason: %s", e.GetSDLError().c_str());
     } catch (std::exception& e) {
         // This also works (e.g. "SDL_Init failed: No available video device")
-        std::cerr << e.what() << std::endl;
+        LOG_ERROR("%s", e.what());
     }
 
+    log_flush();
+
     return 0;
 }
@@ -1,6 +1,40 @@
 
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <thread>
 
+#include "AgentSim.h"
+#include "ChunkedMap.h"
+#include "ClearanceLayer.h"
+#include "CooperativePathfind.h"
+#include "CrowdAvoidance.h"
+#include "DistanceMatrix.h"
+#include "Log.h"
+#include "MapFile.h"
+#include "MapSnapshot.h"
+#include "MovingAI.h"
+#include "NavMesh.h"
+#include "OccupancyLayer.h"
+#include "PathJobQueue.h"
+#include "PathScheduler.h"
+#include "PathServer.h"
+#include "QueryProtocol.h"
+#include "Reachability.h"
+#include "RectangleDecomposition.h"
+#include "RegionLayers.h"
+#include "ReservationTable.h"
+#include "RoadNetwork.h"
+#include "SearchObserver.h"
+#include "ShardedPathfind.h"
+#include "SpatialGrid.h"
+#include "Trace.h"
 #include "Util.h"
 
 #include "gtest/gtest.h"
@@ -17,50 +51,118 @@ TEST(Util, NodeIndex) {
     EXPECT_DEATH(get_node_index(4u, 0u, 3), "Assertion");
     EXPECT_DEATH(get_node_index(4u, 1u, 3), "Assertion");
 
-    EXPECT_EQ(get_node_index(0u, 0u, 3), 0u);
-    EXPECT_EQ(get_node_index(1u, 0u, 3), 1u);
-    EXPECT_EQ(get_node_index(2u, 0u, 3), 2u);
+    // Row-major order, whichever layout the build uses (see `CellLayout`).
+    EXPECT_EQ(RowMajorLayout::index(0u, 0u, 3), 0u);
+    EXPECT_EQ(RowMajorLayout::index(1u, 0u, 3), 1u);
+    EXPECT_EQ(RowMajorLayout::index(2u, 0u, 3), 2u);
 
-    EXPECT_EQ(get_node_index(0u, 1u, 3), 3u);
-    EXPECT_EQ(get_node_index(1u, 1u, 3), 4u);
-    EXPECT_EQ(get_node_index(2u, 1u, 3), 5u);
+    EXPECT_EQ(RowMajorLayout::index(0u, 1u, 3), 3u);
+    EXPECT_EQ(RowMajorLayout::index(1u, 1u, 3), 4u);
+    EXPECT_EQ(RowMajorLayout::index(2u, 1u, 3), 5u);
 
-    EXPECT_EQ(get_node_index(0u, 2u, 3), 6u);
-    EXPECT_EQ(get_node_index(1u, 2u, 3), 7u);
-    EXPECT_EQ(get_node_index(2u, 2u, 3), 8u);
+    EXPECT_EQ(RowMajorLayout::index(0u, 2u, 3), 6u);
+    EXPECT_EQ(RowMajorLayout::index(1u, 2u, 3), 7u);
+    EXPECT_EQ(RowMajorLayout::index(2u, 2u, 3), 8u);
 
     // The width does not restrict the height; it is still possible to get
     // out-of-bounds indices from this function.
 
-    EXPECT_EQ(get_node_index(0u, 3u, 3), 9u);
-    EXPECT_EQ(get_node_index(1u, 3u, 3), 10u);
-    EXPECT_EQ(get_node_index(2u, 3u, 3), 11u);
+    EXPECT_EQ(RowMajorLayout::index(0u, 3u, 3), 9u);
+    EXPECT_EQ(RowMajorLayout::index(1u, 3u, 3), 10u);
+    EXPECT_EQ(RowMajorLayout::index(2u, 3u, 3), 11u);
 
-    EXPECT_EQ(get_node_index(0u, 4u, 3), 12u);
-    EXPECT_EQ(get_node_index(1u, 4u, 3), 13u);
-    EXPECT_EQ(get_node_index(2u, 4u, 3), 14u);
+    EXPECT_EQ(RowMajorLayout::index(0u, 4u, 3), 12u);
+    EXPECT_EQ(RowMajorLayout::index(1u, 4u, 3), 13u);
+    EXPECT_EQ(RowMajorLayout::index(2u, 4u, 3), 14u);
 }
 
 TEST(Util, NodeXY) {
-    EXPECT_EQ(get_node_xy(0, 3), std::make_pair(0u, 0u));
-    EXPECT_EQ(get_node_xy(1, 3), std::make_pair(1u, 0u));
-    EXPECT_EQ(get_node_xy(2, 3), std::make_pair(2u, 0u));
+    // Row-major order, whichever layout the build uses (see `CellLayout`).
+    EXPECT_EQ(RowMajorLayout::xy(0, 3), std::make_pair(0u, 0u));
+    EXPECT_EQ(RowMajorLayout::xy(1, 3), std::make_pair(1u, 0u));
+    EXPECT_EQ(RowMajorLayout::xy(2, 3), std::make_pair(2u, 0u));
 
-    EXPECT_EQ(get_node_xy(3, 3), std::make_pair(0u, 1u));
-    EXPECT_EQ(get_node_xy(4, 3), std::make_pair(1u, 1u));
-    EXPECT_EQ(get_node_xy(5, 3), std::make_pair(2u, 1u));
+    EXPECT_EQ(RowMajorLayout::xy(3, 3), std::make_pair(0u, 1u));
+    EXPECT_EQ(RowMajorLayout::xy(4, 3), std::make_pair(1u, 1u));
+    EXPECT_EQ(RowMajorLayout::xy(5, 3), std::make_pair(2u, 1u));
 
-    EXPECT_EQ(get_node_xy(6, 3), std::make_pair(0u, 2u));
-    EXPECT_EQ(get_node_xy(7, 3), std::make_pair(1u, 2u));
-    EXPECT_EQ(get_node_xy(8, 3), std::make_pair(2u, 2u));
+    EXPECT_EQ(RowMajorLayout::xy(6, 3), std::make_pair(0u, 2u));
+    EXPECT_EQ(RowMajorLayout::xy(7, 3), std::make_pair(1u, 2u));
+    EXPECT_EQ(RowMajorLayout::xy(8, 3), std::make_pair(2u, 2u));
 
-    EXPECT_EQ(get_node_xy(9, 3), std::make_pair(0u, 3u));
-    EXPECT_EQ(get_node_xy(10, 3), std::make_pair(1u, 3u));
-    EXPECT_EQ(get_node_xy(11, 3), std::make_pair(2u, 3u));
+    EXPECT_EQ(RowMajorLayout::xy(9, 3), std::make_pair(0u, 3u));
+    EXPECT_EQ(RowMajorLayout::xy(10, 3), std::make_pair(1u, 3u));
+    EXPECT_EQ(RowMajorLayout::xy(11, 3), std::make_pair(2u, 3u));
 
-    EXPECT_EQ(get_node_xy(12, 3), std::make_pair(0u, 4u));
-    EXPECT_EQ(get_node_xy(13, 3), std::make_pair(1u, 4u));
-    EXPECT_EQ(get_node_xy(14, 3), std::make_pair(2u, 4u));
+    EXPECT_EQ(RowMajorLayout::xy(12, 3), std::make_pair(0u, 4u));
+    EXPECT_EQ(RowMajorLayout::xy(13, 3), std::make_pair(1u, 4u));
+    EXPECT_EQ(RowMajorLayout::xy(14, 3), std::make_pair(2u, 4u));
+}
+
+// Every layout maps the cells of a map one-to-one into its index space,
+// padding the rest, and steps between neighbors as indexing them afresh would.
+template <typename Layout>
+void check_layout(const uint32_t width, const uint32_t height) {
+    const uint32_t count {Layout::count(width, height)};
+
+    ASSERT_GE(count, width * height);
+
+    std::vector<bool> seen(count, false);
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const uint32_t idx {Layout::index(x, y, width)};
+
+            ASSERT_LT(idx, count);
+            EXPECT_FALSE(seen[idx]);
+            EXPECT_EQ(Layout::xy(idx, width), std::make_pair(x, y));
+
+            seen[idx] = true;
+
+            for (int32_t d_y = -1; d_y <= 1; ++d_y) {
+                for (int32_t d_x = -1; d_x <= 1; ++d_x) {
+                    const int64_t x_to {int64_t {x} + d_x};
+                    const int64_t y_to {int64_t {y} + d_y};
+
+                    if (x_to < 0 || y_to < 0 || x_to >= width || y_to >= height) {
+                        continue;
+                    }
+
+                    EXPECT_EQ(
+                        Layout::step(idx, x, y, d_x, d_y, width),
+                        Layout::index(x_to, y_to, width)
+                    );
+                }
+            }
+        }
+    }
+
+    // The rest are padding, outside the map.
+    for (uint32_t idx = 0; idx < count; ++idx) {
+        if (!seen[idx]) {
+            const auto [x, y] = Layout::xy(idx, width);
+
+            EXPECT_TRUE(x >= width || y >= height);
+            EXPECT_EQ(Layout::index(x, y, width), idx);
+        }
+    }
+}
+
+TEST(Util, CellLayouts) {
+    for (const auto &[width, height] : {
+        std::make_pair(1u, 1u), std::make_pair(3u, 5u), std::make_pair(16u, 16u),
+        std::make_pair(37u, 21u), std::make_pair(64u, 3u)
+    }) {
+        check_layout<RowMajorLayout>(width, height);
+        check_layout<TiledLayout<2>>(width, height);
+        check_layout<TiledLayout<4>>(width, height);
+        check_layout<MortonLayout<2>>(width, height);
+        check_layout<MortonLayout<4>>(width, height);
+    }
+
+    EXPECT_EQ(TiledLayout<2>::count(5, 3), 8u * 4u);
+    EXPECT_EQ(MortonLayout<2>::index(3, 2, 8), 0b1101u);
+    EXPECT_EQ(MortonLayout<2>::index(0, 4, 8), 2u * 16u);
 }
 
 TEST(Util, Dist) {
@@ -92,6 +194,2646 @@ TEST(Util, Dist) {
     }
 }
 
+TEST(MovingAI, LoadMap) {
+    std::istringstream in(
+        "type octile\n"
+        "height 2\n"
+        "width 3\n"
+        "map\n"
+        ".@T\n"
+        "GSW\n"
+    );
+
+    const Map map {load_movingai_map(in)};
+
+    EXPECT_EQ(map.width, 3u);
+    EXPECT_EQ(map.height, 2u);
+
+    EXPECT_FALSE(map.is_blocking(0, 0));
+    EXPECT_TRUE(map.is_blocking(1, 0));
+    EXPECT_TRUE(map.is_blocking(2, 0));
+    EXPECT_FALSE(map.is_blocking(0, 1));
+    EXPECT_FALSE(map.is_blocking(1, 1));
+    EXPECT_TRUE(map.is_blocking(2, 1));
+
+    std::istringstream truncated("type octile\nheight 2\nwidth 3\nmap\n...\n");
+
+    EXPECT_THROW(load_movingai_map(truncated), std::runtime_error);
+}
+
+TEST(MovingAI, LoadScen) {
+    std::istringstream in(
+        "version 1\n"
+        "0\tt.map\t3\t2\t0\t0\t2\t1\t2.41421356\n"
+    );
+
+    const auto entries {load_movingai_scen(in)};
+
+    ASSERT_EQ(entries.size(), 1u);
+    EXPECT_EQ(entries[0].map_name, "t.map");
+    EXPECT_EQ(entries[0].x_end, 2u);
+    EXPECT_EQ(entries[0].y_end, 1u);
+    EXPECT_NEAR(entries[0].optimal_length, 2.41421356, 1e-6);
+
+    EXPECT_NEAR(path_length_octile({{2, 1}, {1, 0}, {0, 0}}), 2.41421356, 1e-6);
+}
+
+TEST(MapFile, RoundTrip) {
+    const std::string path {testing::TempDir() + "round_trip.pfmap"};
+
+    Map map {Map::gen_rand_map(67, 31)};
+
+    write_map_file(map, path);
+
+    {
+        MappedMap mapped {MappedMap::open(path)};
+
+        ASSERT_EQ(mapped.width, map.width);
+        ASSERT_EQ(mapped.height, map.height);
+
+        for (uint32_t i = 0; i < map.get_nodes().size(); ++i) {
+            EXPECT_EQ(
+                mapped.get_nodes()[i].get_blocking(),
+                map.get_nodes()[i].get_blocking()
+            );
+            EXPECT_EQ(
+                mapped.get_nodes()[i].get_terrain(),
+                map.get_nodes()[i].get_terrain()
+            );
+            EXPECT_FALSE(mapped.get_nodes()[i].get_region());
+        }
+
+        // Edits are private to the mapping.
+        mapped.get_nodes_mut()[0].set_blocking(
+            !map.get_nodes()[0].get_blocking()
+        );
+
+        EXPECT_NE(
+            mapped.get_nodes()[0].get_blocking(),
+            map.get_nodes()[0].get_blocking()
+        );
+    }
+
+    MappedMap reopened {MappedMap::open(path)};
+
+    EXPECT_EQ(
+        reopened.get_nodes()[0].get_blocking(),
+        map.get_nodes()[0].get_blocking()
+    );
+}
+
+TEST(MapFile, RejectsInvalidDimensions) {
+    const std::string path {testing::TempDir() + "bad_dimensions.pfmap"};
+
+    // Rewrite the dimensions in the header of the file at `path`.
+    const auto set_dimensions = [&](const uint32_t width, const uint32_t height) {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+
+        MapFileHeader header;
+
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+        header.width = width;
+        header.height = height;
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    };
+
+    write_map_file(Map::gen_rand_map(67, 31), path);
+    set_dimensions(0, 31);
+
+    EXPECT_THROW(MappedMap::open(path), std::runtime_error);
+
+    // 65536 x 65537 cells wraps around, in 32 bits, to as many as a single row
+    // of 65536 cells, in every layout, so the sections of such a row would
+    // pass for those of the whole map.
+    std::vector<MapNode> row;
+
+    for (uint32_t i = 0; i < get_node_count(65536, 1); ++i) {
+        const auto [x, y] = get_node_xy(i, 65536);
+
+        row.emplace_back(x, y, y > 0);
+    }
+
+    write_map_file(Map(65536, 1, std::move(row)), path);
+    set_dimensions(65536, 65537);
+
+    EXPECT_THROW(MappedMap::open(path), std::runtime_error);
+}
+
+TEST(ChunkedMap, MatchesMap) {
+    const std::string dir {testing::TempDir() + "chunks"};
+
+    std::filesystem::remove_all(dir);
+
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    // Walls every 16 columns, with a gap every 32 rows, offset per wall.
+    const auto is_wall = [](const uint32_t x, const uint32_t y) {
+        return x % 16 == 8 && (y + x) % 32 > 2;
+    };
+
+    const auto generator = [&](
+        const uint32_t x_chunk, const uint32_t y_chunk, MapChunk &chunk
+    ) {
+        chunk.terrain.fill(TERRAIN_GROUND);
+
+        for (uint32_t y = 0; y < MapChunk::SIZE; ++y) {
+            for (uint32_t x = 0; x < MapChunk::SIZE; ++x) {
+                chunk.set_blocking(
+                    MapChunk::offset(x, y),
+                    is_wall(x_chunk * MapChunk::SIZE + x, y_chunk * MapChunk::SIZE + y)
+                );
+            }
+        }
+    };
+
+    const uint32_t width {300};
+    const uint32_t height {200};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(
+            map.is_padding(node.x_coord, node.y_coord) ||
+                is_wall(node.x_coord, node.y_coord)
+        );
+        node.set_terrain(TERRAIN_GROUND);
+    }
+
+    ChunkStore store(dir);
+
+    {
+        ChunkedMap chunked(width, height, store, 6, generator);
+
+        const std::vector<std::array<uint32_t, 4>> queries {
+            {0, 0, 299, 199}, {299, 0, 0, 199}, {150, 100, 3, 7}, {20, 190, 280, 10}
+        };
+
+        for (const auto &[x_start, y_start, x_end, y_end] : queries) {
+            Pathfind<Map, decltype(block_lamb)> pathfinder(
+                map, x_start, y_start, x_end, y_end, block_lamb
+            );
+            Pathfind<ChunkedMap, decltype(block_lamb)> chunked_pathfinder(
+                chunked, x_start, y_start, x_end, y_end, block_lamb
+            );
+
+            const auto path {pathfinder.get_path()};
+
+            ASSERT_FALSE(path.empty());
+            EXPECT_EQ(chunked_pathfinder.get_path(), path);
+            EXPECT_LE(chunked.get_resident_count(), 6u);
+        }
+
+        EXPECT_GT(chunked.get_stats().evictions, 0u);
+
+        // Edits survive eviction, which the next search forces.
+        chunked.get_nodes_mut()[get_node_index(5, 5, width)].set_blocking(true);
+
+        Pathfind<ChunkedMap, decltype(block_lamb)> pathfinder(
+            chunked, 299, 199, 0, 199, block_lamb
+        );
+
+        EXPECT_FALSE(pathfinder.get_path().empty());
+        EXPECT_TRUE(chunked.is_blocking(5, 5));
+        EXPECT_GT(chunked.get_stats().writes, 0u);
+    }
+
+    // And a new map over the same store.
+    ChunkedMap reopened(width, height, store, 2, generator, 4, 100);
+
+    EXPECT_TRUE(reopened.is_blocking(5, 5));
+    EXPECT_FALSE(reopened.is_blocking(6, 5));
+
+    // A search that would generate more nodes than the cap finds no path.
+    Pathfind<ChunkedMap, decltype(block_lamb)> pathfinder(
+        reopened, 0, 0, 299, 199, block_lamb
+    );
+
+    EXPECT_TRUE(pathfinder.get_path().empty());
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(QueryProtocol, RoundTrip) {
+    const std::vector<PathQuery> queries {{1, 2, 3, 4}, {5, 6, 7, 8}};
+
+    const auto frame {encode_request(7, queries)};
+
+    const std::vector<unsigned char> payload(frame.begin() + 4, frame.end());
+
+    const auto [batch_id, decoded] = decode_request(payload);
+
+    EXPECT_EQ(batch_id, 7u);
+    ASSERT_EQ(decoded.size(), 2u);
+    EXPECT_EQ(decoded[1].x_start, 5u);
+    EXPECT_EQ(decoded[1].y_end, 8u);
+
+    // As returned by `Pathfind::get_path()`, from end to start.
+    const std::vector<std::pair<uint32_t, uint32_t>> path {
+        {3, 4}, {2, 3}, {2, 2}, {1, 2}
+    };
+
+    std::vector<unsigned char> encoded;
+
+    encode_path(encoded, path);
+    encode_path(encoded, {});
+
+    // Count, origin, and one byte per step.
+    EXPECT_EQ(encoded.size(), 4u + 8u + 3u + 4u);
+
+    const unsigned char *cursor {encoded.data()};
+    const unsigned char *end {encoded.data() + encoded.size()};
+
+    const auto decoded_path {decode_path(cursor, end)};
+    const std::vector<std::pair<uint32_t, uint32_t>> path_forward(
+        path.rbegin(), path.rend()
+    );
+
+    EXPECT_EQ(decoded_path, path_forward);
+    EXPECT_TRUE(decode_path(cursor, end).empty());
+    EXPECT_EQ(cursor, end);
+    EXPECT_THROW(decode_path(cursor, end), std::runtime_error);
+}
+
+TEST(PathServer, AnswersPipelinedBatches) {
+    const uint32_t width {60};
+    const uint32_t height {40};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    const std::string socket_path {testing::TempDir() + "path_server.sock"};
+
+    PathServer<Map> server(map, socket_path, 4);
+
+    std::atomic<bool> stop {false};
+    std::thread serving([&]() { server.serve(stop); });
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    // More batches than a connection may have in flight, of varying sizes,
+    // including empty ones, and queries off the map.
+    const uint32_t batch_count {ServerConnection::MAX_INFLIGHT_BATCHES + 36};
+
+    std::mt19937 gen {31};
+    std::uniform_int_distribution<uint32_t> rng_x(0, width);
+    std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+    std::uniform_int_distribution<uint32_t> rng_count(0, 40);
+
+    std::vector<std::vector<PathQuery>> batches(batch_count);
+    std::vector<std::vector<std::vector<std::pair<uint32_t, uint32_t>>>> expected(
+        batch_count
+    );
+
+    for (uint32_t id = 0; id < batch_count; ++id) {
+        batches[id].resize(rng_count(gen));
+
+        for (auto &query : batches[id]) {
+            query = {rng_x(gen), rng_y(gen), rng_x(gen), rng_y(gen)};
+
+            std::vector<std::pair<uint32_t, uint32_t>> path;
+
+            if (query.x_start < width && query.x_end < width) {
+                Pathfind<Map, decltype(block_lamb)> pathfinder(
+                    map,
+                    query.x_start, query.y_start,
+                    query.x_end, query.y_end,
+                    block_lamb
+                );
+
+                path = pathfinder.get_path();
+            }
+
+            // Responses are in travel order.
+            expected[id].emplace_back(path.rbegin(), path.rend());
+        }
+    }
+
+    const int fd {connect_unix(socket_path)};
+
+    std::thread sender(
+        [&]() {
+            for (uint32_t id = 0; id < batch_count; ++id) {
+                const auto frame {encode_request(id, batches[id])};
+
+                ASSERT_TRUE(write_all(fd, frame.data(), frame.size()));
+            }
+        }
+    );
+
+    std::vector<uint32_t> answered(batch_count, 0);
+    std::vector<unsigned char> payload;
+
+    for (uint32_t i = 0; i < batch_count; ++i) {
+        ASSERT_TRUE(read_frame(fd, payload));
+
+        const unsigned char *cursor {payload.data()};
+        const unsigned char *end {payload.data() + payload.size()};
+
+        const uint32_t batch_id {consume_u32(cursor, end)};
+
+        ASSERT_LT(batch_id, batch_count);
+        ASSERT_EQ(consume_u32(cursor, end), expected[batch_id].size());
+
+        ++answered[batch_id];
+
+        for (const auto &path : expected[batch_id]) {
+            EXPECT_EQ(decode_path(cursor, end), path);
+        }
+
+        EXPECT_EQ(cursor, end);
+    }
+
+    sender.join();
+
+    EXPECT_EQ(
+        std::count(answered.begin(), answered.end(), 1u),
+        static_cast<ptrdiff_t>(batch_count)
+    );
+
+    stop = true;
+    serving.join();
+
+    ::close(fd);
+}
+
+TEST(PathServer, StopsWithStalledClient) {
+    Map map {Map::gen_rand_map(20, 10)};
+
+    const std::string socket_path {testing::TempDir() + "path_server_stalled.sock"};
+
+    PathServer<Map> server(map, socket_path, 2);
+
+    std::atomic<bool> stop {false};
+    std::thread serving([&]() { server.serve(stop); });
+
+    const int fd {connect_unix(socket_path)};
+
+    // A client that never reads its responses. Queries off the map are cheap
+    // to answer, so the responses soon overflow the socket buffers, and the
+    // connection's writer blocks. Its reader then stops at the cap on batches
+    // in flight, and the client's own writes block in turn, until the server
+    // disconnects it.
+    std::thread sender(
+        [&]() {
+            const std::vector<PathQuery> queries(2048, {100, 0, 100, 0});
+            const uint32_t batch_count {4 * ServerConnection::MAX_INFLIGHT_BATCHES};
+
+            for (uint32_t id = 0; id < batch_count; ++id) {
+                const auto frame {encode_request(id, queries)};
+
+                if (!write_all(fd, frame.data(), frame.size())) {
+                    return;
+                }
+            }
+        }
+    );
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    stop = true;
+    serving.join();
+
+    sender.join();
+
+    ::close(fd);
+}
+
+namespace {
+    // Collects logged messages, through `log_set_sink()`.
+    struct LogCapture {
+        static inline std::mutex mu;
+        static inline std::vector<std::pair<LogLevel, std::string>> messages;
+
+        // While set, the sink stalls on a message starting "gate", as a slow
+        // sink would, so that the logging thread's ring fills up.
+        static inline std::atomic<bool> hold {false};
+        static inline std::atomic<bool> held {false};
+
+        static void sink(const LogLevel level, const char *text, const uint32_t length) {
+            std::string message(text, length);
+
+            if (message.starts_with("gate")) {
+                held = true;
+
+                while (hold) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+
+            std::scoped_lock<std::mutex> lock(mu);
+
+            messages.emplace_back(level, std::move(message));
+        }
+
+        LogCapture() {
+            log_flush();
+            log_set_sink(sink);
+        }
+
+        ~LogCapture() {
+            log_flush();
+            log_set_sink(nullptr);
+
+            messages.clear();
+        }
+
+        // The number of messages captured so far that start with `prefix`.
+        uint32_t count(const std::string &prefix) const {
+            std::scoped_lock<std::mutex> lock(mu);
+
+            return std::count_if(messages.begin(), messages.end(), [&](const auto &message) {
+                return message.second.starts_with(prefix);
+            });
+        }
+    };
+}
+
+TEST(Log, CapturesFlushedMessages) {
+    const LogCapture capture;
+
+    log_set_level(LogLevel::WARN);
+
+    LOG_INFO("filtered %d", 1);
+    LOG_WARN("kept %d", 2);
+
+    log_set_level(LogLevel::INFO);
+
+    // A thread's messages are written out even once it has exited.
+    std::thread([]() {
+        for (uint32_t i = 0; i < 3; ++i) {
+            LOG_INFO("from exited thread %u", i);
+        }
+    }).join();
+
+    log_flush();
+
+    EXPECT_EQ(capture.count("filtered"), 0u);
+    EXPECT_EQ(capture.count("kept 2"), 1u);
+    EXPECT_EQ(capture.count("from exited thread"), 3u);
+
+    // The first 5 of each second get through; the rest are counted, and the
+    // count is logged once the next second begins.
+    const auto log_limited = []() {
+        LOG_RATE_LIMITED(LogLevel::INFO, 5, "limited");
+    };
+
+    for (uint32_t i = 0; i < 20; ++i) {
+        log_limited();
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+    log_limited();
+    log_flush();
+
+    EXPECT_EQ(capture.count("limited"), 6u);
+    EXPECT_EQ(capture.count("15 messages suppressed by rate limit"), 1u);
+}
+
+TEST(Log, DropsWhenRingIsFull) {
+    const LogCapture capture;
+
+    // Stall the drain thread on the gate, so that nothing leaves this
+    // thread's ring while it is filled past its capacity of 1024.
+    LogCapture::hold = true;
+    LogCapture::held = false;
+
+    LOG_INFO("gate");
+
+    while (!LogCapture::held) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    for (uint32_t i = 0; i < 1034; ++i) {
+        LOG_INFO("filler %u", i);
+    }
+
+    LogCapture::hold = false;
+
+    log_flush();
+
+    // The gate still holds a slot until it has been written.
+    EXPECT_EQ(capture.count("filler"), 1023u);
+    EXPECT_EQ(capture.count("11 log messages dropped"), 1u);
+}
+
+#ifdef PATHFINDING_TRACE
+
+namespace {
+    struct ChromeTraceEvent {
+        std::string name;
+        std::string ph;
+        uint32_t tid;
+        double ts;
+        double dur;
+        // The thread name, for "thread_name" metadata events.
+        std::string thread_name;
+    };
+
+    // Parses a trace written by `trace_export_chrome()`, one event per line.
+    std::vector<ChromeTraceEvent> read_chrome_trace(const std::string &path) {
+        std::ifstream in(path);
+        std::string line;
+
+        std::getline(in, line);
+        EXPECT_EQ(line, "{\"traceEvents\":[");
+
+        const std::regex span_re {
+            R"re(\{"name":"([^"]*)","ph":"X","pid":1,"tid":(\d+),"ts":([0-9.]+),"dur":([0-9.]+)\},?)re"
+        };
+        const std::regex meta_re {
+            R"re(\{"name":"thread_name","ph":"M","pid":1,"tid":(\d+),"args":\{"name":"([^"]*)"\}\},?)re"
+        };
+
+        std::vector<ChromeTraceEvent> events;
+
+        while (std::getline(in, line) && line != "]}") {
+            std::smatch match;
+
+            if (std::regex_match(line, match, span_re)) {
+                events.push_back({
+                    match[1], "X", static_cast<uint32_t>(std::stoul(match[2])),
+                    std::stod(match[3]), std::stod(match[4]), ""
+                });
+            }
+            else if (std::regex_match(line, match, meta_re)) {
+                events.push_back({
+                    "thread_name", "M", static_cast<uint32_t>(std::stoul(match[1])),
+                    0, 0, match[2]
+                });
+            }
+            else {
+                ADD_FAILURE() << "Unexpected trace line: " << line;
+            }
+        }
+
+        EXPECT_EQ(line, "]}");
+
+        return events;
+    }
+
+    const ChromeTraceEvent *find_trace_event(
+        const std::vector<ChromeTraceEvent> &events, const std::string &name
+    ) {
+        const auto found {
+            std::find_if(events.begin(), events.end(), [&](const auto &event) {
+                return event.name == name;
+            })
+        };
+
+        return found == events.end() ? nullptr : &*found;
+    }
+}
+
+TEST(Trace, ExportsChromeJson) {
+    const std::string path {testing::TempDir() + "trace.json"};
+
+    // Free the rings of any threads earlier tests left behind.
+    ASSERT_TRUE(trace_export_chrome(path));
+
+    {
+        TRACE_SCOPE("trace test main");
+    }
+
+    std::thread([]() {
+        trace_set_thread_name("trace test thread");
+
+        TRACE_SCOPE("trace test other");
+    }).join();
+
+    ASSERT_TRUE(trace_export_chrome(path));
+
+    {
+        const auto events {read_chrome_trace(path)};
+
+        const ChromeTraceEvent *main_span {find_trace_event(events, "trace test main")};
+        const ChromeTraceEvent *other_span {find_trace_event(events, "trace test other")};
+
+        ASSERT_TRUE(main_span);
+        ASSERT_TRUE(other_span);
+        EXPECT_NE(main_span->tid, other_span->tid);
+        EXPECT_GE(other_span->ts, main_span->ts + main_span->dur);
+
+        EXPECT_TRUE(std::any_of(events.begin(), events.end(), [&](const auto &event) {
+            return event.ph == "M" && event.tid == other_span->tid &&
+                event.thread_name == "trace test thread";
+        }));
+    }
+
+    // More threads exit than there are rings kept for; the oldest are freed,
+    // and once exported, so are the rest.
+    const uint32_t exited {40};
+    const uint32_t kept {32};
+
+    // Reserved, so that the names stay put until they are exported.
+    std::vector<std::string> names;
+
+    names.reserve(exited);
+
+    for (uint32_t i = 0; i < exited; ++i) {
+        names.push_back("trace test exited " + std::to_string(i));
+
+        std::thread([&]() {
+            const TraceSpan span {names.back().c_str()};
+        }).join();
+    }
+
+    ASSERT_TRUE(trace_export_chrome(path));
+
+    {
+        const auto events {read_chrome_trace(path)};
+
+        EXPECT_TRUE(find_trace_event(events, "trace test main"));
+        EXPECT_FALSE(find_trace_event(events, "trace test other"));
+
+        for (uint32_t i = 0; i < exited; ++i) {
+            EXPECT_EQ(find_trace_event(events, names[i]) != nullptr, i >= exited - kept)
+                << names[i];
+        }
+    }
+
+    ASSERT_TRUE(trace_export_chrome(path));
+
+    {
+        const auto events {read_chrome_trace(path)};
+
+        EXPECT_TRUE(find_trace_event(events, "trace test main"));
+
+        for (const auto &name : names) {
+            EXPECT_FALSE(find_trace_event(events, name)) << name;
+        }
+    }
+}
+
+#endif
+
+TEST(Pathfind, ObserverSeesGeneratedCells) {
+    Map map {Map::gen_rand_map(40, 20)};
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef Pathfind<Map, decltype(block_lamb)> pathfind_t;
+
+    std::vector<std::pair<uint32_t, uint32_t>> open_spaces;
+
+    for (const auto &node : map.get_nodes()) {
+        if (!node.get_blocking()) {
+            open_spaces.emplace_back(node.x_coord, node.y_coord);
+        }
+    }
+
+    ASSERT_GE(open_spaces.size(), 2u);
+
+    const auto [x_start, y_start] = open_spaces.front();
+    const auto [x_end, y_end] = open_spaces.back();
+
+    ExploredCellsObserver explored;
+
+    pathfind_t observed(
+        map, x_start, y_start, x_end, y_end, block_lamb, {.observer = &explored}
+    );
+
+    const auto path {observed.get_path()};
+
+    EXPECT_EQ(explored.get_generated().size(), pathfind_t::get_perf().count_novel_nodes);
+
+    for (const auto &[x, y] : path) {
+        EXPECT_TRUE(explored.was_generated(get_node_index(x, y, map.width)));
+    }
+
+    // Installing an observer must not change the search.
+    pathfind_t unobserved(map, x_start, y_start, x_end, y_end, block_lamb);
+
+    EXPECT_EQ(unobserved.get_path(), path);
+}
+
+TEST(Pathfind, SlicedMatchesUnsliced) {
+    Map map {Map::gen_rand_map(60, 30)};
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef Pathfind<Map, decltype(block_lamb)> pathfind_t;
+
+    std::vector<std::pair<uint32_t, uint32_t>> open_spaces;
+
+    for (const auto &node : map.get_nodes()) {
+        if (!node.get_blocking()) {
+            open_spaces.emplace_back(node.x_coord, node.y_coord);
+        }
+    }
+
+    ASSERT_GE(open_spaces.size(), 2u);
+
+    const auto [x_start, y_start] = open_spaces.front();
+    const auto [x_end, y_end] = open_spaces.back();
+
+    pathfind_t unsliced(map, x_start, y_start, x_end, y_end, block_lamb);
+
+    const auto path {unsliced.get_path()};
+    const auto perf {pathfind_t::get_perf()};
+
+    ASSERT_FALSE(path.empty());
+
+    pathfind_t sliced(map, x_start, y_start, x_end, y_end, block_lamb);
+
+    pathfind_t::SliceBudget budget;
+
+    budget.max_expansions = 7;
+
+    auto task {sliced.get_path_sliced(budget)};
+
+    uint32_t slices {1};
+
+    while (!task.resume()) {
+        EXPECT_EQ(budget.expanded, budget.max_expansions);
+
+        // Searches interleaved with a sliced one must not disturb its
+        // counters.
+        pathfind_t(map, x_end, y_end, x_start, y_start, block_lamb).get_path();
+
+        ++slices;
+    }
+
+    EXPECT_EQ(task.take_result(), path);
+    EXPECT_EQ(pathfind_t::get_perf().count_expanded_nodes, perf.count_expanded_nodes);
+    EXPECT_GE(slices, perf.count_expanded_nodes / budget.max_expansions);
+
+    // The scheduler completes every query, whatever its budget.
+    PathScheduler<Map, decltype(block_lamb)> scheduler(map, block_lamb);
+
+    std::vector<pathfind_t::path_t> paths;
+
+    for (uint32_t i = 0; i < 4; ++i) {
+        scheduler.submit(
+            x_start, y_start, x_end, y_end,
+            [&](pathfind_t::path_t &&path) {
+                paths.push_back(std::move(path));
+            }
+        );
+    }
+
+    const uint64_t cancelled {
+        scheduler.submit(x_start, y_start, x_end, y_end, [](auto &&) {})
+    };
+
+    EXPECT_TRUE(scheduler.cancel(cancelled));
+
+    while (scheduler.in_flight() > 0) {
+        scheduler.tick(100, std::chrono::seconds(1));
+    }
+
+    ASSERT_EQ(paths.size(), 4u);
+
+    for (const auto &scheduled_path : paths) {
+        EXPECT_EQ(scheduled_path, path);
+    }
+}
+
+TEST(PathJobQueue, MatchesSynchronous) {
+    Map map {Map::gen_rand_map(60, 30)};
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef Pathfind<Map, decltype(block_lamb)> pathfind_t;
+    typedef PathJobQueue<Map, decltype(block_lamb), uint32_t> queue_t;
+
+    std::vector<std::pair<uint32_t, uint32_t>> open_spaces;
+
+    for (const auto &node : map.get_nodes()) {
+        if (!node.get_blocking()) {
+            open_spaces.emplace_back(node.x_coord, node.y_coord);
+        }
+    }
+
+    ASSERT_GE(open_spaces.size(), 2u);
+
+    queue_t queue(map, block_lamb, 2);
+
+    std::vector<queue_t::Job> jobs;
+    std::vector<pathfind_t::path_t> expected;
+
+    for (uint32_t i = 0; i < 100; ++i) {
+        const auto [x_start, y_start] = open_spaces[(i * 7) % open_spaces.size()];
+        const auto [x_end, y_end] = open_spaces[(i * 13 + 5) % open_spaces.size()];
+
+        jobs.push_back({i, x_start, y_start, x_end, y_end});
+        expected.push_back(
+            pathfind_t(map, x_start, y_start, x_end, y_end, block_lamb).get_path()
+        );
+    }
+
+    // Out of bounds queries yield no path rather than failing.
+    jobs.push_back({100, map.width, 0, 0, 0});
+
+    queue.submit(std::move(jobs));
+
+    std::vector<std::optional<pathfind_t::path_t>> results(101);
+
+    const auto collect = [&](queue_t::Result &&result) {
+        results[result.tag] = result.path.path;
+    };
+
+    while (queue.in_flight() > 0) {
+        queue.drain(collect);
+    }
+
+    // Results completed since the last drain.
+    queue.drain(collect);
+
+    for (uint32_t i = 0; i < 100; ++i) {
+        ASSERT_TRUE(results[i]);
+        EXPECT_EQ(*results[i], expected[i]);
+    }
+
+    ASSERT_TRUE(results[100]);
+    EXPECT_TRUE(results[100]->empty());
+}
+
+TEST(PathBufferPool, ReusesBuffers) {
+    PathBufferPool pool(1);
+
+    {
+        auto buffer {pool.acquire()};
+
+        buffer.path.resize(100);
+
+        auto other {pool.acquire()};
+
+        other.path.resize(10);
+    }
+
+    // Only the first buffer returned is retained, and it comes back empty
+    // but with its storage intact.
+    EXPECT_EQ(pool.idle(), 1u);
+
+    auto buffer {pool.acquire()};
+
+    EXPECT_TRUE(buffer.path.empty());
+    EXPECT_GE(buffer.path.capacity(), 10u);
+    EXPECT_EQ(pool.idle(), 0u);
+}
+
+TEST(ReservationTable, ReserveReleaseAdvance) {
+    ReservationTable table(4, 8);
+
+    EXPECT_TRUE(table.reserve(10, 0, 1));
+    EXPECT_TRUE(table.reserve(10, 0, 1));
+    EXPECT_FALSE(table.reserve(10, 0, 2));
+    EXPECT_TRUE(table.reserve(10, 1, 2));
+    EXPECT_FALSE(table.reserve(10, 4, 2));
+
+    EXPECT_EQ(table.get_agent(10, 0), 1u);
+    EXPECT_EQ(table.get_agent(11, 0), ReservationTable::NO_AGENT);
+
+    table.release(10, 0, 2);
+    EXPECT_EQ(table.get_agent(10, 0), 1u);
+
+    table.release(10, 0, 1);
+    EXPECT_EQ(table.get_agent(10, 0), ReservationTable::NO_AGENT);
+    EXPECT_TRUE(table.reserve(10, 0, 2));
+
+    // Advancing recycles the expired slot for the new last time step.
+    table.advance(1);
+    EXPECT_EQ(table.get_agent(10, 1), 2u);
+    EXPECT_EQ(table.get_agent(10, 4), ReservationTable::NO_AGENT);
+    EXPECT_TRUE(table.reserve(10, 4, 3));
+}
+
+TEST(ReservationTable, ReleasedEntriesAreReused) {
+    ReservationTable table(2, 8);
+
+    // A few held throughout, while far more than a slot holds are reserved
+    // and released, as replanning agents do.
+    for (uint32_t cell = 0; cell < 4; ++cell) {
+        ASSERT_TRUE(table.reserve(cell * 7, 0, 100 + cell));
+    }
+
+    for (uint32_t i = 0; i < 1000; ++i) {
+        const uint32_t cell {100 + i % 37};
+
+        ASSERT_TRUE(table.reserve(cell, 0, i));
+        ASSERT_FALSE(table.reserve(cell, 0, i + 1));
+        EXPECT_EQ(table.get_agent(cell, 0), i);
+
+        table.release(cell, 0, i);
+
+        EXPECT_EQ(table.get_agent(cell, 0), ReservationTable::NO_AGENT);
+    }
+
+    for (uint32_t cell = 0; cell < 4; ++cell) {
+        EXPECT_EQ(table.get_agent(cell * 7, 0), 100 + cell);
+    }
+
+    // Agents racing for the same few cells, with churn, never both hold one.
+    std::vector<std::atomic<uint32_t>> holders(4);
+    std::atomic<bool> collided {false};
+    std::vector<std::thread> threads;
+
+    for (uint32_t agent = 0; agent < 4; ++agent) {
+        threads.emplace_back(
+            [&, agent]() {
+                for (uint32_t i = 0; i < 20000; ++i) {
+                    const uint32_t cell {i % 4};
+
+                    if (!table.reserve(200 + cell, 1, agent)) {
+                        continue;
+                    }
+
+                    if (holders[cell].fetch_add(1) != 0) {
+                        collided = true;
+                    }
+
+                    holders[cell].fetch_sub(1);
+
+                    table.release(200 + cell, 1, agent);
+                }
+            }
+        );
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_FALSE(collided);
+}
+
+TEST(CooperativePathfind, NoCollisionsWithinWindow) {
+    Map map {Map::gen_rand_map(40, 20)};
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    RegionColorer<Map, decltype(block_lamb)>::color_all_regions(map, block_lamb);
+
+    std::vector<uint32_t> open_cells;
+
+    for (uint32_t idx = 0; idx < map.get_nodes().size(); ++idx) {
+        if (!map.get_nodes()[idx].get_blocking()) {
+            open_cells.push_back(idx);
+        }
+    }
+
+    const uint32_t num_agents {20};
+    const uint32_t window {16};
+
+    ASSERT_GE(open_cells.size(), num_agents * 2);
+
+    ReservationTable reservations(window, num_agents);
+
+    for (uint32_t i = 0; i < num_agents; ++i) {
+        reservations.reserve(open_cells[i], 0, i);
+    }
+
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> paths;
+
+    for (uint32_t i = 0; i < num_agents; ++i) {
+        const auto [x_start, y_start] = get_node_xy(open_cells[i], map.width);
+        const auto [x_end, y_end] = get_node_xy(
+            open_cells[open_cells.size() - 1 - i], map.width
+        );
+
+        CooperativePathfind<Map, decltype(block_lamb)> pathfinder(
+            map, reservations, i, x_start, y_start, x_end, y_end, 0, block_lamb
+        );
+
+        paths.push_back(pathfinder.get_path());
+
+        if (paths.back().empty()) {
+            paths.back().emplace_back(x_start, y_start);
+        }
+        else {
+            EXPECT_EQ(paths.back().front(), std::make_pair(x_start, y_start));
+            EXPECT_EQ(paths.back().back(), std::make_pair(x_end, y_end));
+        }
+    }
+
+    for (uint32_t t = 0; t < window; ++t) {
+        std::unordered_set<uint32_t> occupied;
+
+        for (const auto &path : paths) {
+            const auto [x, y] = path[std::min<size_t>(t, path.size() - 1)];
+
+            EXPECT_TRUE(occupied.insert(get_node_index(x, y, map.width)).second);
+        }
+    }
+}
+
+TEST(AgentSim, FollowsPathAndQueuesEvents) {
+    AgentSim sim;
+
+    // More agents than a SIMD pass handles at once, so that both the vector
+    // and scalar movement paths are exercised.
+    for (uint32_t i = 0; i < 7; ++i) {
+        sim.add_agent(0, 0, 1.0f);
+    }
+
+    const uint32_t path {sim.add_path({{0, 0}, {1, 0}, {2, 0}, {2, 1}})};
+
+    for (uint32_t i = 0; i < 7; ++i) {
+        sim.set_path(i, path);
+    }
+
+    sim.release_path(path);
+
+    bool blocked_cell {false};
+
+    const auto is_blocked = [&](const uint32_t x, const uint32_t y) {
+        return blocked_cell && x == 2 && y == 1;
+    };
+
+    EXPECT_FLOAT_EQ(sim.get_x(6), 0.5f);
+
+    // Half a cell per step.
+    sim.step(0.5f, is_blocked);
+
+    EXPECT_FLOAT_EQ(sim.get_x(6), 1.0f);
+    EXPECT_EQ(sim.drain_events([](const auto &) {}), 0u);
+
+    // Reach the second waypoint, then block the cell after the next.
+    sim.step(0.5f, is_blocked);
+
+    EXPECT_FLOAT_EQ(sim.get_x(6), 1.5f);
+
+    blocked_cell = true;
+
+    sim.step(0.5f, is_blocked);
+    sim.step(0.5f, is_blocked);
+
+    std::vector<uint32_t> blocked;
+
+    sim.drain_events(
+        [&](const AgentSim::Event &event) {
+            EXPECT_EQ(event.kind, AgentSim::Event::BLOCKED);
+
+            blocked.push_back(event.agent);
+        }
+    );
+
+    EXPECT_EQ(blocked.size(), 7u);
+    EXPECT_FLOAT_EQ(sim.get_x(3), 2.5f);
+    EXPECT_FALSE(sim.is_moving(3));
+
+    // Stopped agents stay put.
+    sim.step(0.5f, is_blocked);
+
+    EXPECT_FLOAT_EQ(sim.get_x(3), 2.5f);
+
+    // A fresh path runs to its end.
+    sim.set_path(3, AgentSim::path_t {{2, 0}, {3, 0}});
+
+    sim.step(1.0f, is_blocked);
+
+    std::vector<AgentSim::Event> events;
+
+    sim.drain_events(
+        [&](const AgentSim::Event &event) {
+            events.push_back(event);
+        }
+    );
+
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].kind, AgentSim::Event::ARRIVED);
+    EXPECT_EQ(events[0].agent, 3u);
+    EXPECT_FLOAT_EQ(sim.get_x(3), 3.5f);
+
+    // A path of one waypoint, eg, from a query whose start is its goal, has
+    // arrived as soon as it is set.
+    events.clear();
+
+    sim.set_path(5, AgentSim::path_t {{4, 4}});
+
+    sim.drain_events(
+        [&](const AgentSim::Event &event) {
+            events.push_back(event);
+        }
+    );
+
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].kind, AgentSim::Event::ARRIVED);
+    EXPECT_EQ(events[0].agent, 5u);
+    EXPECT_FLOAT_EQ(sim.get_x(5), 4.5f);
+    EXPECT_FALSE(sim.is_moving(5));
+}
+
+TEST(SpatialGrid, QueriesMatchBruteForce) {
+    const uint32_t width {100};
+    const uint32_t height {70};
+
+    SpatialGrid grid(width, height, 8);
+
+    std::mt19937 gen {4};
+    std::uniform_real_distribution<float> rng_x(0, width);
+    std::uniform_real_distribution<float> rng_y(0, height);
+
+    std::vector<std::pair<float, float>> positions(500);
+    std::vector<bool> present(positions.size(), true);
+
+    for (uint32_t id = 0; id < positions.size(); ++id) {
+        positions[id] = {rng_x(gen), rng_y(gen)};
+
+        grid.insert(id, positions[id].first, positions[id].second);
+    }
+
+    // Move half, and remove a tenth.
+    for (uint32_t id = 0; id < positions.size(); id += 2) {
+        positions[id] = {rng_x(gen), rng_y(gen)};
+
+        grid.move(id, positions[id].first, positions[id].second);
+    }
+
+    for (uint32_t id = 0; id < positions.size(); id += 10) {
+        present[id] = false;
+
+        grid.remove(id);
+    }
+
+    EXPECT_EQ(grid.size(), 450u);
+    EXPECT_FALSE(grid.contains(0));
+    EXPECT_TRUE(grid.contains(1));
+
+    for (uint32_t query = 0; query < 50; ++query) {
+        const float x {rng_x(gen)};
+        const float y {rng_y(gen)};
+        const float radius {query * 0.5f};
+
+        std::vector<uint32_t> expected_radius;
+        std::vector<uint32_t> expected_rect;
+
+        for (uint32_t id = 0; id < positions.size(); ++id) {
+            if (!present[id]) {
+                continue;
+            }
+
+            const auto [x_id, y_id] = positions[id];
+            const float dx {x_id - x};
+            const float dy {y_id - y};
+
+            if (dx * dx + dy * dy <= radius * radius) {
+                expected_radius.push_back(id);
+            }
+
+            if (
+                x_id >= x - radius && x_id <= x + radius &&
+                y_id >= y && y_id <= y + radius * 2
+            ) {
+                expected_rect.push_back(id);
+            }
+        }
+
+        std::vector<uint32_t> found_radius;
+        std::vector<uint32_t> found_rect;
+
+        grid.query_radius(
+            x, y, radius,
+            [&](const uint32_t id, const float, const float) {
+                found_radius.push_back(id);
+            }
+        );
+
+        grid.query_rect(
+            x - radius, y, x + radius, y + radius * 2,
+            [&](const uint32_t id, const float, const float) {
+                found_rect.push_back(id);
+            }
+        );
+
+        std::sort(found_radius.begin(), found_radius.end());
+        std::sort(found_rect.begin(), found_rect.end());
+
+        EXPECT_EQ(found_radius, expected_radius);
+        EXPECT_EQ(found_rect, expected_rect);
+    }
+}
+
+TEST(OccupancyLayer, PathAvoidsOccupiedCells) {
+    Map map {Map::gen_rand_map(20, 7)};
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(false);
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef Pathfind<Map, decltype(block_lamb)> pathfind_t;
+
+    OccupancyLayer occupancy(map.width, map.height, 10.0f);
+
+    // A wall of agents across the middle row, with one agent placed and
+    // then moved onto it.
+    for (uint32_t x = 5; x < 15; ++x) {
+        occupancy.set(x, x + 0.5f, 3.5f);
+    }
+
+    occupancy.set(100, 0.5f, 0.5f);
+    occupancy.set(100, 6.5f, 3.5f);
+
+    EXPECT_EQ(occupancy.get_count(get_node_index(0, 0, map.width)), 0u);
+    EXPECT_EQ(occupancy.get_count(get_node_index(6, 3, map.width)), 2u);
+    EXPECT_FLOAT_EQ(occupancy.get_cost(get_node_index(6, 3, map.width)), 20.0f);
+
+    const auto occupied_cells = [&](const auto &path) {
+        uint32_t count {0};
+
+        for (const auto &[x, y] : path) {
+            count += occupancy.get_count(get_node_index(x, y, map.width)) > 0;
+        }
+
+        return count;
+    };
+
+    pathfind_t through(map, 0, 3, 19, 3, block_lamb);
+
+    EXPECT_GT(occupied_cells(through.get_path()), 0u);
+
+    pathfind_t around(map, 0, 3, 19, 3, block_lamb, {.occupancy = &occupancy});
+
+    const auto path {around.get_path()};
+
+    ASSERT_FALSE(path.empty());
+    EXPECT_EQ(occupied_cells(path), 0u);
+
+    // The static map is untouched.
+    for (const auto &node : map.get_nodes()) {
+        EXPECT_FALSE(node.get_blocking());
+    }
+
+    occupancy.remove(100);
+
+    EXPECT_EQ(occupancy.get_count(get_node_index(6, 3, map.width)), 1u);
+
+    occupancy.clear();
+
+    EXPECT_EQ(occupancy.get_count(get_node_index(6, 3, map.width)), 0u);
+    EXPECT_FLOAT_EQ(occupancy.get_cost(get_node_index(6, 3, map.width)), 0.0f);
+}
+
+TEST(CrowdAvoidance, HeadOnAgentsPassWithoutOverlap) {
+    const CrowdAvoidance::Params params;
+
+    CrowdAvoidance crowd(40, 40, params, 2);
+
+    // Two lines of agents walking straight through each other.
+    const uint32_t per_side {8};
+
+    for (uint32_t i = 0; i < per_side; ++i) {
+        crowd.add_agent(5.0f, 10.0f + i * 2.0f, 1.0f);
+        crowd.add_agent(35.0f, 10.0f + i * 2.0f + 0.1f, 1.0f);
+    }
+
+    float min_dist {1e9f};
+
+    for (uint32_t step = 0; step < 400; ++step) {
+        for (uint32_t i = 0; i < crowd.size(); ++i) {
+            crowd.set_preferred_velocity(i, i % 2 == 0 ? 1.0f : -1.0f, 0);
+        }
+
+        crowd.step(0.1f);
+
+        for (uint32_t i = 0; i < crowd.size(); ++i) {
+            for (uint32_t j = i + 1; j < crowd.size(); ++j) {
+                min_dist = std::min(
+                    min_dist,
+                    std::hypot(crowd.get_x(i) - crowd.get_x(j), crowd.get_y(i) - crowd.get_y(j))
+                );
+            }
+        }
+    }
+
+    // A little slack for the discrete steps.
+    EXPECT_GT(min_dist, params.radius * 2 * 0.9f);
+
+    for (uint32_t i = 0; i < crowd.size(); ++i) {
+        if (i % 2 == 0) {
+            EXPECT_GT(crowd.get_x(i), 30.0f);
+        }
+        else {
+            EXPECT_LT(crowd.get_x(i), 10.0f);
+        }
+    }
+}
+
+TEST(CrowdAvoidance, NoNeighborsIgnoresOthers) {
+    CrowdAvoidance::Params params;
+
+    params.max_neighbors = 0;
+
+    CrowdAvoidance crowd(40, 40, params, 2);
+
+    crowd.add_agent(10.0f, 20.0f, 1.0f);
+    crowd.add_agent(11.0f, 20.0f, 1.0f);
+
+    for (uint32_t step = 0; step < 10; ++step) {
+        crowd.set_preferred_velocity(0, 1.0f, 0);
+        crowd.set_preferred_velocity(1, -1.0f, 0);
+
+        crowd.step(0.1f);
+    }
+
+    // Straight through each other.
+    EXPECT_NEAR(crowd.get_x(0), 11.0f, 1e-3);
+    EXPECT_NEAR(crowd.get_x(1), 10.0f, 1e-3);
+}
+
+TEST(RegionLayers, ProfilesKeepSeparateLabels) {
+    Map map {Map::gen_rand_map(20, 10)};
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(false);
+    }
+
+    // Walkers go anywhere open; waders cannot cross the middle columns,
+    // which splits the map in two for them. Both predicates are of one type,
+    // so only registering them apart keeps their labels apart.
+    const auto make_mover = [](const bool wades) {
+        return [wades](const MapNode &node) -> bool {
+            return !node.get_blocking() &&
+                (!wades || node.x_coord < 8 || node.x_coord >= 12);
+        };
+    };
+
+    const auto walker {make_mover(false)};
+    const auto wader {make_mover(true)};
+
+    typedef Pathfind<Map, decltype(walker)> pathfind_t;
+
+    RegionLayers layers(map.width, map.height);
+
+    RegionProfile &walker_profile {layers.register_profile()};
+    RegionProfile &wader_profile {layers.register_profile()};
+
+    RegionLayer &walker_layer {walker_profile.get()};
+    RegionLayer &wader_layer {wader_profile.get()};
+
+    EXPECT_NE(&walker_layer, &wader_layer);
+    EXPECT_EQ(&walker_profile.get(), &walker_layer);
+
+    RegionColorer<Map, decltype(walker)>::color_all_regions(map, walker, &walker_layer);
+
+    // Interleave both profiles; neither relabels the other.
+    for (uint32_t i = 0; i < 2; ++i) {
+        pathfind_t wading(map, 0, 0, 19, 9, wader, {.region_profile = &wader_profile});
+
+        EXPECT_TRUE(wading.get_path().empty());
+
+        pathfind_t walking(map, 0, 0, 19, 9, walker, {.region_profile = &walker_profile});
+
+        EXPECT_FALSE(walking.get_path().empty());
+    }
+
+    EXPECT_TRUE(walker_layer.get_region(get_node_index(19, 9, map.width)));
+    EXPECT_TRUE(wader_layer.get_region(get_node_index(0, 0, map.width)));
+    EXPECT_TRUE(wader_layer.get_region(get_node_index(19, 9, map.width)));
+    EXPECT_NE(
+        wader_layer.get_region(get_node_index(0, 0, map.width)),
+        wader_layer.get_region(get_node_index(19, 9, map.width))
+    );
+
+    // The map's own labels are untouched.
+    for (const auto &node : map.get_nodes()) {
+        EXPECT_FALSE(node.get_region());
+    }
+
+    const uint64_t version {walker_layer.get_version()};
+
+    layers.invalidate_all();
+
+    EXPECT_GT(walker_layer.get_version(), version);
+    EXPECT_FALSE(walker_layer.get_region(get_node_index(0, 0, map.width)));
+    EXPECT_FALSE(wader_layer.get_region(get_node_index(0, 0, map.width)));
+}
+
+TEST(Pathfind, TerrainCostsPerAgent) {
+    Map map {Map::gen_rand_map(20, 5)};
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(false);
+        node.set_terrain(node.y_coord == 2 ? TERRAIN_ROAD : TERRAIN_GROUND);
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef Pathfind<Map, decltype(block_lamb)> pathfind_t;
+
+    // Shared by two profiles: one prefers the road, the other shuns it.
+    constexpr TerrainCosts road_shy {{1.0f, 4.0f}};
+
+    // Classes it lists no cost for cost as much as ground.
+    static_assert(road_shy[7] == 1.0f);
+    // Classes past the table alias those within it.
+    static_assert(road_shy[TerrainCosts::MAX_CLASSES] == road_shy[TERRAIN_GROUND]);
+    static_assert(road_shy[TerrainCosts::MAX_CLASSES + 1] == road_shy[TERRAIN_ROAD]);
+    static_assert(road_shy[255] == road_shy[TerrainCosts::MAX_CLASSES - 1]);
+    EXPECT_THROW(TerrainCosts(std::initializer_list<float> {}), std::invalid_argument);
+
+    const auto road_cells = [&](const auto &path) {
+        uint32_t count {0};
+
+        for (const auto &[x, y] : path) {
+            count += map.get_nodes()[get_node_index(x, y, map.width)].get_terrain() == TERRAIN_ROAD;
+        }
+
+        return count;
+    };
+
+    pathfind_t on_foot(map, 0, 2, 19, 2, block_lamb);
+    pathfind_t shy(map, 0, 2, 19, 2, block_lamb, {.terrain_costs = road_shy});
+
+    const auto path_on_foot {on_foot.get_path()};
+    const auto path_shy {shy.get_path()};
+
+    ASSERT_FALSE(path_on_foot.empty());
+    ASSERT_FALSE(path_shy.empty());
+
+    EXPECT_EQ(road_cells(path_on_foot), path_on_foot.size());
+    // Only the endpoints, which are on the road.
+    EXPECT_EQ(road_cells(path_shy), 2u);
+}
+
+TEST(RoadNetwork, RidesTheRoads) {
+    Map map {Map::gen_rand_map(120, 40)};
+
+    // Open ground with a wall across the middle, crossed by one road: a loop
+    // around the map's edge with a spur down through the wall.
+    for (auto &node : map.get_nodes_mut()) {
+        const uint32_t x {node.x_coord};
+        const uint32_t y {node.y_coord};
+
+        const bool road {x == 0 || y == 0 || x == 119 || y == 39 || (x == 60 && y < 20)};
+
+        node.set_blocking(!road && y == 20);
+        node.set_terrain(road ? TERRAIN_ROAD : TERRAIN_GROUND);
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    RoadNetwork<Map, decltype(block_lamb)> roads(map, block_lamb, DEFAULT_TERRAIN_COSTS, 10);
+
+    // The spur's dead end and the tee where it leaves the loop; corners are
+    // just bends.
+    EXPECT_EQ(roads.num_junctions(), 2u);
+
+    for (const auto &[x_start, y_start, x_end, y_end] : {
+        std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> {30, 5, 90, 30},
+        {5, 35, 115, 35},
+        {58, 10, 62, 12},
+    }) {
+        const auto path {roads.get_path(x_start, y_start, x_end, y_end)};
+
+        ASSERT_FALSE(path.empty());
+        EXPECT_EQ(path.front(), std::make_pair(x_end, y_end));
+        EXPECT_EQ(path.back(), std::make_pair(x_start, y_start));
+
+        for (uint32_t i = 1; i < path.size(); ++i) {
+            const auto [x_prev, y_prev] = path[i - 1];
+            const auto [x, y] = path[i];
+
+            EXPECT_EQ(dist_chebyshev(x_prev, y_prev, x, y), 1);
+            EXPECT_FALSE(map.is_blocking(x, y));
+        }
+    }
+}
+
+TEST(RoadNetwork, BoardsAtTheEndpoints) {
+    Map map {Map::gen_rand_map(400, 40)};
+
+    // Open ground, with a loop around the map's edge and a road across its
+    // middle, joining the loop at two tees.
+    for (auto &node : map.get_nodes_mut()) {
+        const uint32_t x {node.x_coord};
+        const uint32_t y {node.y_coord};
+
+        const bool road {x == 0 || y == 0 || x == 399 || y == 39 || x == 200};
+
+        node.set_blocking(false);
+        node.set_terrain(road ? TERRAIN_ROAD : TERRAIN_GROUND);
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef Pathfind<Map, decltype(block_lamb)> pathfind_t;
+
+    RoadNetwork<Map, decltype(block_lamb)> roads(map, block_lamb);
+
+    pathfind_t direct(map, 30, 5, 370, 30, block_lamb);
+
+    ASSERT_FALSE(direct.get_path().empty());
+
+    const uint32_t expanded_direct {pathfind_t::get_perf().count_expanded_nodes};
+
+    // An endpoint on the road boards or alights right there. The last search
+    // is then the other endpoint's short walk to or from the road, rather
+    // than a search of the map.
+    for (const auto &[x_start, y_start, x_end, y_end] : {
+        std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> {30, 5, 370, 30},
+        {30, 0, 370, 30},
+        {30, 5, 370, 39},
+        // Nothing to walk, so no search at all.
+        {30, 0, 370, 39},
+    }) {
+        const auto path {roads.get_path(x_start, y_start, x_end, y_end)};
+
+        ASSERT_FALSE(path.empty());
+        EXPECT_EQ(path.front(), std::make_pair(x_end, y_end));
+        EXPECT_EQ(path.back(), std::make_pair(x_start, y_start));
+        EXPECT_LT(pathfind_t::get_perf().count_expanded_nodes * 10, expanded_direct);
+    }
+}
+
+TEST(ClearanceLayer, RepairMatchesBruteForce) {
+    const uint32_t width {40};
+    const uint32_t height {30};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    // Mostly open, so that there are large squares to find.
+    std::mt19937 gen {5};
+    std::uniform_int_distribution<uint32_t> rng_percent(0, 99);
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(rng_percent(gen) < 8);
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    const auto expect_brute_force = [&](const ClearanceLayer &clearance) {
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                uint32_t size {0};
+
+                for (bool fits {true}; fits && x + size < width && y + size < height;) {
+                    // Try growing the square by its next row and column.
+                    for (uint32_t i = 0; i <= size; ++i) {
+                        fits = fits &&
+                            !map.is_blocking(x + size, y + i) &&
+                            !map.is_blocking(x + i, y + size);
+                    }
+
+                    size += fits;
+                }
+
+                ASSERT_EQ(clearance.get(x, y), size) << x << ", " << y;
+            }
+        }
+    };
+
+    ClearanceLayer clearance(width, height);
+
+    clearance.compute(map, block_lamb);
+
+    expect_brute_force(clearance);
+
+    std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+    std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+
+    for (uint32_t edit = 0; edit < 50; ++edit) {
+        const uint32_t x_min {rng_x(gen)};
+        const uint32_t y_min {rng_y(gen)};
+        const uint32_t x_max {std::min(x_min + rng_percent(gen) % 4, width - 1)};
+        const uint32_t y_max {std::min(y_min + rng_percent(gen) % 4, height - 1)};
+        const bool blocking {rng_percent(gen) < 50};
+
+        for (uint32_t y = y_min; y <= y_max; ++y) {
+            for (uint32_t x = x_min; x <= x_max; ++x) {
+                map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(blocking);
+            }
+        }
+
+        clearance.repair(map, block_lamb, x_min, y_min, x_max, y_max);
+
+        expect_brute_force(clearance);
+    }
+}
+
+TEST(ClearanceLayer, RepairMatchesCompute) {
+    std::mt19937 gen {17};
+    std::uniform_int_distribution<uint32_t> rng_side(1, 40);
+    std::uniform_int_distribution<uint32_t> rng_percent(0, 99);
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    // Edits of mixed shapes, from single cells to long runs, setting their
+    // cells to mixed values, on maps of mixed density.
+    for (uint32_t trial = 0; trial < 200; ++trial) {
+        const uint32_t width {rng_side(gen)};
+        const uint32_t height {rng_side(gen)};
+        const uint32_t density {rng_percent(gen) / 2};
+
+        Map map {Map::gen_rand_map(width, height)};
+
+        for (auto &node : map.get_nodes_mut()) {
+            node.set_blocking(rng_percent(gen) < density);
+        }
+
+        ClearanceLayer clearance(width, height);
+        ClearanceLayer expected(width, height);
+
+        clearance.compute(map, block_lamb);
+
+        std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+        std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+
+        for (uint32_t edit = 0; edit < 20; ++edit) {
+            const uint32_t x_a {rng_x(gen)};
+            const uint32_t x_b {rng_x(gen)};
+            const uint32_t y_a {rng_y(gen)};
+            const uint32_t y_b {rng_y(gen)};
+
+            const uint32_t x_min {std::min(x_a, x_b)};
+            const uint32_t y_min {std::min(y_a, y_b)};
+            const uint32_t x_max {rng_percent(gen) < 30 ? x_min : std::max(x_a, x_b)};
+            const uint32_t y_max {rng_percent(gen) < 30 ? y_min : std::max(y_a, y_b)};
+            const uint32_t blocking_percent {rng_percent(gen)};
+
+            for (uint32_t y = y_min; y <= y_max; ++y) {
+                for (uint32_t x = x_min; x <= x_max; ++x) {
+                    map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(
+                        rng_percent(gen) < blocking_percent
+                    );
+                }
+            }
+
+            clearance.repair(map, block_lamb, x_min, y_min, x_max, y_max);
+            expected.compute(map, block_lamb);
+
+            for (uint32_t y = 0; y < height; ++y) {
+                for (uint32_t x = 0; x < width; ++x) {
+                    ASSERT_EQ(clearance.get(x, y), expected.get(x, y))
+                        << width << "x" << height << " at " << x << ", " << y;
+                }
+            }
+        }
+    }
+
+    // The case of an edited column right of cells changed below it, apart.
+    Map map {Map::gen_rand_map(13, 29)};
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(false);
+    }
+
+    ClearanceLayer clearance(13, 29);
+    ClearanceLayer expected(13, 29);
+
+    clearance.compute(map, block_lamb);
+
+    for (uint32_t y = 9; y <= 23; ++y) {
+        map.get_nodes_mut()[get_node_index(12, y, 13)].set_blocking(true);
+    }
+
+    clearance.repair(map, block_lamb, 12, 9, 12, 23);
+    expected.compute(map, block_lamb);
+
+    for (uint32_t y = 0; y < 29; ++y) {
+        for (uint32_t x = 0; x < 13; ++x) {
+            ASSERT_EQ(clearance.get(x, y), expected.get(x, y)) << x << ", " << y;
+        }
+    }
+}
+
+TEST(Pathfind, LargeAgentsNeedClearance) {
+    Map map {Map::gen_rand_map(20, 20)};
+
+    // A wall across the middle, with a one-cell gap on the left and a
+    // two-cell gap on the right.
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(
+            node.y_coord == 10 && node.x_coord != 2 &&
+            node.x_coord != 16 && node.x_coord != 17
+        );
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    ClearanceLayer clearance(map.width, map.height);
+
+    clearance.compute(map, block_lamb);
+
+    RegionLayers region_layers(map.width, map.height);
+    RegionProfile &region_profile {region_layers.register_profile()};
+
+    for (const uint8_t agent_size : {1, 2, 3}) {
+        Pathfind<Map, decltype(block_lamb)> pathfinder(
+            map, 1, 1, 1, 17, block_lamb,
+            {
+                .region_profile = &region_profile,
+                .clearance = &clearance,
+                .agent_size = agent_size,
+            }
+        );
+
+        const auto path {pathfinder.get_path()};
+
+        if (agent_size == 3) {
+            EXPECT_TRUE(path.empty());
+
+            continue;
+        }
+
+        ASSERT_FALSE(path.empty());
+
+        // Every cell of the agent's footprint is open all along the path, so
+        // only the single cell agent may take the near gap.
+        for (const auto &[x, y] : path) {
+            for (uint32_t d_y = 0; d_y < agent_size; ++d_y) {
+                for (uint32_t d_x = 0; d_x < agent_size; ++d_x) {
+                    EXPECT_FALSE(map.is_blocking(x + d_x, y + d_y));
+                }
+            }
+
+            if (y == 10) {
+                EXPECT_EQ(x, agent_size == 1 ? 2u : 16u);
+            }
+        }
+    }
+}
+
+TEST(Reachability, CostsAreShortestWithinRange) {
+    const uint32_t width {150};
+    const uint32_t height {90};
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    // Once with uniform ground, for the wavefront, and once with roads, for
+    // Dijkstra.
+    for (const bool roads : {false, true}) {
+        Map map {Map::gen_rand_map(width, height)};
+
+        std::mt19937 gen {7};
+        std::uniform_int_distribution<uint32_t> rng_percent(0, 99);
+
+        for (auto &node : map.get_nodes_mut()) {
+            node.set_blocking(rng_percent(gen) < 20);
+            node.set_terrain(roads && rng_percent(gen) < 30 ? TERRAIN_ROAD : TERRAIN_GROUND);
+        }
+
+        Reachability<Map, decltype(block_lamb)> reach(map, block_lamb);
+
+        std::vector<float> costs(get_node_count(width, height), INFINITY);
+        std::vector<uint64_t> bits(reach.get_bitset_words(), 0);
+
+        const float max_cost {30};
+
+        for (const auto &[x_start, y_start] : {
+            std::pair<uint32_t, uint32_t> {75, 45}, {3, 2}, {140, 80}
+        }) {
+            map.get_nodes_mut()[get_node_index(x_start, y_start, width)].set_blocking(false);
+            reach.update(x_start, y_start, x_start, y_start);
+
+            const auto range {reach.costs_within(x_start, y_start, max_cost, costs)};
+            const auto range_bits {reach.cells_within(x_start, y_start, max_cost, bits)};
+
+            ASSERT_FALSE(range.empty());
+            EXPECT_EQ(range.count, range_bits.count);
+            EXPECT_EQ(costs[get_node_index(x_start, y_start, width)], 0);
+
+            uint32_t count {0};
+
+            for (uint32_t y = 0; y < height; ++y) {
+                for (uint32_t x = 0; x < width; ++x) {
+                    const float cost {costs[get_node_index(x, y, width)]};
+
+                    EXPECT_EQ(reach.test(bits, x, y), cost <= max_cost);
+
+                    if (map.is_blocking(x, y) || (x == x_start && y == y_start)) {
+                        continue;
+                    }
+
+                    // The cheapest way in, from any neighbor a step may come
+                    // from under the corner rule.
+                    float best {INFINITY};
+
+                    for (int32_t d_y = -1; d_y <= 1; ++d_y) {
+                        for (int32_t d_x = -1; d_x <= 1; ++d_x) {
+                            const int32_t x_from {static_cast<int32_t>(x) + d_x};
+                            const int32_t y_from {static_cast<int32_t>(y) + d_y};
+
+                            if (
+                                (d_x == 0 && d_y == 0) ||
+                                x_from < 0 || y_from < 0 ||
+                                x_from >= static_cast<int32_t>(width) ||
+                                y_from >= static_cast<int32_t>(height) ||
+                                map.is_blocking(x_from, y_from) ||
+                                map.is_blocking(x_from, y) ||
+                                map.is_blocking(x, y_from)
+                            ) {
+                                continue;
+                            }
+
+                            best = std::min(best, costs[get_node_index(x_from, y_from, width)]);
+                        }
+                    }
+
+                    best += DEFAULT_TERRAIN_COSTS[map.get_nodes()[get_node_index(x, y, width)].get_terrain()];
+
+                    if (best <= max_cost) {
+                        EXPECT_NEAR(cost, best, 1e-3) << x << ", " << y;
+
+                        ++count;
+                    }
+                    else {
+                        EXPECT_EQ(cost, INFINITY) << x << ", " << y;
+                    }
+                }
+            }
+
+            EXPECT_EQ(count + 1, range.count);
+
+            reach.clear(costs, range);
+            reach.clear(bits, range_bits);
+
+            EXPECT_TRUE(std::all_of(costs.begin(), costs.end(), [](const float cost) {
+                return cost == INFINITY;
+            }));
+            EXPECT_TRUE(std::all_of(bits.begin(), bits.end(), [](const uint64_t word) {
+                return word == 0;
+            }));
+        }
+    }
+}
+
+TEST(Reachability, ClearKeepsCellsOutsideRange) {
+    const uint32_t width {150};
+    const uint32_t height {40};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    Reachability<Map, decltype(block_lamb)> reach(map, block_lamb);
+
+    // Spans parts of three words per row, and, in tiled layouts, parts of
+    // several tiles.
+    Reachability<Map, decltype(block_lamb)>::Range range;
+
+    range.x_min = 37;
+    range.y_min = 5;
+    range.x_max = 140;
+    range.y_max = 22;
+
+    std::vector<float> costs(get_node_count(width, height), 0);
+    std::vector<uint64_t> bits(reach.get_bitset_words(), ~uint64_t {0});
+
+    reach.clear(costs, range);
+    reach.clear(bits, range);
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const bool inside {
+                x >= range.x_min && x <= range.x_max &&
+                y >= range.y_min && y <= range.y_max
+            };
+
+            EXPECT_EQ(costs[get_node_index(x, y, width)], inside ? INFINITY : 0)
+                << x << ", " << y;
+            EXPECT_EQ(reach.test(bits, x, y), !inside) << x << ", " << y;
+        }
+    }
+}
+
+TEST(DistanceMatrix, MatchesReachabilityCosts) {
+    const uint32_t width {60};
+    const uint32_t height {40};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    std::mt19937 gen {11};
+    std::uniform_int_distribution<uint32_t> rng_percent(0, 99);
+
+    // Random walls and roads, and a walled-off pocket in one corner.
+    for (auto &node : map.get_nodes_mut()) {
+        const bool pocket_wall {
+            (node.x_coord == 5 && node.y_coord <= 5) ||
+            (node.y_coord == 5 && node.x_coord <= 5)
+        };
+
+        node.set_blocking(pocket_wall || rng_percent(gen) < 15);
+        node.set_terrain(rng_percent(gen) < 30 ? TERRAIN_ROAD : TERRAIN_GROUND);
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    typedef std::vector<std::pair<uint32_t, uint32_t>> path_t;
+
+    const path_t sources {{30, 20}, {55, 35}, {10, 30}, {1, 1}};
+    const path_t targets {{2, 2}, {50, 10}, {30, 20}, {20, 35}, {58, 1}, {50, 10}};
+
+    for (const auto &[x, y] : sources) {
+        map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(false);
+    }
+    for (const auto &[x, y] : targets) {
+        map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(false);
+    }
+
+    DistanceMatrix<Map, decltype(block_lamb)> distances(
+        map, block_lamb, nullptr, DEFAULT_TERRAIN_COSTS, 2
+    );
+
+    std::vector<float> matrix;
+
+    distances.compute(sources, targets, matrix);
+
+    ASSERT_EQ(matrix.size(), sources.size() * targets.size());
+
+    Reachability<Map, decltype(block_lamb)> reach(map, block_lamb);
+
+    std::vector<float> costs(get_node_count(width, height), INFINITY);
+
+    for (uint32_t source = 0; source < sources.size(); ++source) {
+        const auto [x, y] = sources[source];
+
+        const auto range {reach.costs_within(x, y, 1e6, costs)};
+
+        for (uint32_t target = 0; target < targets.size(); ++target) {
+            const auto [x_target, y_target] = targets[target];
+
+            const float expected {costs[get_node_index(x_target, y_target, width)]};
+            const float cost {matrix[source * targets.size() + target]};
+
+            if (expected == INFINITY) {
+                EXPECT_EQ(cost, INFINITY);
+
+                continue;
+            }
+
+            EXPECT_NEAR(cost, expected, 1e-3);
+
+            // The path on demand comes to the same cost.
+            const auto path {distances.get_path(sources[source], targets[target])};
+
+            ASSERT_FALSE(path.empty());
+            EXPECT_EQ(path.front(), targets[target]);
+            EXPECT_EQ(path.back(), sources[source]);
+
+            float path_cost {0};
+
+            for (uint32_t i = 0; i + 1 < path.size(); ++i) {
+                const auto [x_path, y_path] = path[i];
+
+                path_cost += DEFAULT_TERRAIN_COSTS[
+                    map.get_nodes()[get_node_index(x_path, y_path, width)].get_terrain()
+                ];
+            }
+
+            EXPECT_NEAR(path_cost, expected, 1e-3);
+        }
+
+        reach.clear(costs, range);
+    }
+
+    // The pocket is only reachable from within.
+    EXPECT_EQ(matrix[0], INFINITY);
+    EXPECT_EQ(matrix[3 * targets.size() + 1], INFINITY);
+
+    // The nearest two of the first source's targets, in order.
+    DistanceSearch<Map, decltype(block_lamb)> search(map, block_lamb);
+
+    std::vector<std::pair<uint32_t, float>> nearest;
+
+    search.nearest(30, 20, targets, 2, nearest);
+
+    std::vector<std::pair<float, uint32_t>> expected;
+
+    for (uint32_t target = 0; target < targets.size(); ++target) {
+        expected.emplace_back(matrix[target], target);
+    }
+
+    std::sort(expected.begin(), expected.end());
+
+    ASSERT_EQ(nearest.size(), 2u);
+    EXPECT_EQ(nearest[0].first, 2u);
+    EXPECT_EQ(nearest[0].second, 0);
+    EXPECT_NEAR(nearest[1].second, expected[1].first, 1e-3);
+}
+
+TEST(DistanceMatrix, KeepsToItsRegionLayer) {
+    Map map {Map::gen_rand_map(20, 10)};
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(false);
+    }
+
+    const auto walker = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    const auto wader = [](const MapNode &node) -> bool {
+        return !node.get_blocking() && (node.x_coord < 8 || node.x_coord >= 12);
+    };
+
+    // The map's own labels split it in two, as only waders see it.
+    RegionColorer<Map, decltype(wader)>::color_all_regions(map, wader);
+
+    RegionLayers layers(map.width, map.height);
+
+    DistanceMatrix<Map, decltype(walker)> distances(
+        map, walker, &layers.register_profile(), DEFAULT_TERRAIN_COSTS, 2
+    );
+
+    std::vector<float> matrix;
+
+    distances.compute({{0, 0}}, {{19, 9}}, matrix);
+
+    ASSERT_EQ(matrix.size(), 1u);
+    EXPECT_LT(matrix[0], INFINITY);
+}
+
+TEST(RectangleDecomposition, ReducedSearchFindsEqualPaths) {
+    const uint32_t width {80};
+    const uint32_t height {60};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    // Rooms: open ground split by walls with doorways, a few pillars, and a
+    // band of road, so that rectangles split on terrain too.
+    std::mt19937 gen {13};
+    std::uniform_int_distribution<uint32_t> rng_percent(0, 99);
+
+    for (auto &node : map.get_nodes_mut()) {
+        const uint32_t x {node.x_coord};
+        const uint32_t y {node.y_coord};
+
+        const bool wall {
+            (x % 20 == 0 && y % 15 != 7) || (y % 15 == 0 && x % 20 != 10)
+        };
+
+        node.set_blocking(wall || rng_percent(gen) < 2);
+        node.set_terrain(y >= 30 && y < 33 ? TERRAIN_ROAD : TERRAIN_GROUND);
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    RectangleDecomposition rectangles(width, height);
+
+    rectangles.build(map, block_lamb);
+
+    // Every open cell is covered by exactly one rectangle of open cells of
+    // one terrain class.
+    const auto expect_covered = [&]() {
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                const uint32_t id {rectangles.get_rect_id(get_node_index(x, y, width))};
+
+                ASSERT_EQ(id == RectangleDecomposition::NONE, map.is_blocking(x, y));
+
+                if (id == RectangleDecomposition::NONE) {
+                    continue;
+                }
+
+                const auto &rect {rectangles.get_rect(id)};
+
+                ASSERT_TRUE(
+                    x >= rect.x_min && x <= rect.x_max &&
+                    y >= rect.y_min && y <= rect.y_max
+                );
+                ASSERT_EQ(
+                    map.get_nodes()[get_node_index(x, y, width)].get_terrain(),
+                    map.get_nodes()[get_node_index(rect.x_min, rect.y_min, width)].get_terrain()
+                );
+            }
+        }
+    };
+
+    expect_covered();
+
+    const auto path_cost = [&](const std::vector<std::pair<uint32_t, uint32_t>> &path) {
+        double cost {0};
+
+        for (uint32_t i = 1; i < path.size(); ++i) {
+            const auto [x_prev, y_prev] = path[i - 1];
+            const auto [x, y] = path[i];
+
+            EXPECT_EQ(dist_chebyshev(x_prev, y_prev, x, y), 1);
+            EXPECT_FALSE(map.is_blocking(x, y));
+
+            // The path runs end-first, so each step's cost is that of the
+            // cell it leaves.
+            cost += DEFAULT_TERRAIN_COSTS[
+                map.get_nodes()[get_node_index(x_prev, y_prev, width)].get_terrain()
+            ];
+        }
+
+        return cost;
+    };
+
+    const auto check_queries = [&]() {
+        std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+        std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+
+        for (uint32_t query = 0; query < 30; ++query) {
+            const uint32_t x_start {rng_x(gen)};
+            const uint32_t y_start {rng_y(gen)};
+            const uint32_t x_end {rng_x(gen)};
+            const uint32_t y_end {rng_y(gen)};
+
+            Pathfind<Map, decltype(block_lamb)> plain(
+                map, x_start, y_start, x_end, y_end, block_lamb
+            );
+            Pathfind<Map, decltype(block_lamb)> reduced(
+                map, x_start, y_start, x_end, y_end, block_lamb,
+                {.rectangles = &rectangles}
+            );
+
+            const auto path_plain {plain.get_path()};
+            const auto path_reduced {reduced.get_path()};
+
+            ASSERT_EQ(path_plain.empty(), path_reduced.empty());
+
+            if (path_reduced.empty()) {
+                continue;
+            }
+
+            EXPECT_EQ(path_reduced.front(), std::make_pair(x_end, y_end));
+            EXPECT_EQ(path_reduced.back(), std::make_pair(x_start, y_start));
+
+            // Neither search is exact, but they should come out close.
+            EXPECT_LT(path_cost(path_reduced), path_cost(path_plain) * 1.15 + 3);
+        }
+    };
+
+    check_queries();
+
+    // Knock doorways through walls and drop new pillars, repairing as we go.
+    for (uint32_t edit = 0; edit < 40; ++edit) {
+        const uint32_t x {rng_percent(gen) * width / 100};
+        const uint32_t y {rng_percent(gen) * height / 100};
+
+        auto &node {map.get_nodes_mut()[get_node_index(x, y, width)]};
+
+        node.set_blocking(!node.get_blocking());
+
+        rectangles.repair(map, block_lamb, x, y, x, y);
+    }
+
+    map.clear_regions();
+
+    expect_covered();
+    check_queries();
+}
+
+TEST(NavMesh, PathsKeepToOpenCells) {
+    const uint32_t width {100};
+    const uint32_t height {70};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    // Open ground with scattered boxes and a band of road, so that polygons
+    // split on terrain too, and tiles that do not divide the map evenly.
+    std::mt19937 gen {17};
+    std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+    std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+    std::uniform_int_distribution<uint32_t> rng_side(1, 8);
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(false);
+        node.set_terrain(
+            node.x_coord >= 40 && node.x_coord < 43 ? TERRAIN_ROAD : TERRAIN_GROUND
+        );
+    }
+
+    for (uint32_t box = 0; box < 60; ++box) {
+        const uint32_t x_min {rng_x(gen)};
+        const uint32_t y_min {rng_y(gen)};
+        const uint32_t x_max {std::min(width - 1, x_min + rng_side(gen))};
+        const uint32_t y_max {std::min(height - 1, y_min + rng_side(gen))};
+
+        for (uint32_t y = y_min; y <= y_max; ++y) {
+            for (uint32_t x = x_min; x <= x_max; ++x) {
+                map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(true);
+            }
+        }
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    NavMesh mesh(width, height, 16, 4);
+
+    mesh.build(map, block_lamb);
+
+    EXPECT_LT(mesh.size() * 10, width * height);
+
+    NavMeshQuery query(mesh);
+
+    const auto check_queries = [&]() {
+        for (uint32_t i = 0; i < 40; ++i) {
+            const uint32_t x_start {rng_x(gen)};
+            const uint32_t y_start {rng_y(gen)};
+            const uint32_t x_end {rng_x(gen)};
+            const uint32_t y_end {rng_y(gen)};
+
+            Pathfind<Map, decltype(block_lamb)> plain(
+                map, x_start, y_start, x_end, y_end, block_lamb
+            );
+
+            const auto path_plain {plain.get_path()};
+            const auto path_mesh {query.get_path(x_start, y_start, x_end, y_end)};
+
+            if (x_start == x_end && y_start == y_end) {
+                continue;
+            }
+
+            ASSERT_EQ(path_plain.empty(), path_mesh.empty());
+
+            if (path_mesh.empty()) {
+                continue;
+            }
+
+            EXPECT_EQ(path_mesh.front(), std::make_pair(x_end, y_end));
+            EXPECT_EQ(path_mesh.back(), std::make_pair(x_start, y_start));
+
+            double cost_plain {0};
+            double cost_mesh {0};
+
+            for (uint32_t step = 1; step < path_plain.size(); ++step) {
+                const auto [x, y] = path_plain[step - 1];
+
+                cost_plain += DEFAULT_TERRAIN_COSTS[
+                    map.get_nodes()[get_node_index(x, y, width)].get_terrain()
+                ];
+            }
+
+            // Every step is to an open neighbor, without cutting a corner.
+            for (uint32_t step = 1; step < path_mesh.size(); ++step) {
+                const auto [x_prev, y_prev] = path_mesh[step - 1];
+                const auto [x, y] = path_mesh[step];
+
+                ASSERT_EQ(dist_chebyshev(x_prev, y_prev, x, y), 1);
+                ASSERT_FALSE(map.is_blocking(x, y));
+                ASSERT_FALSE(map.is_blocking(x_prev, y) || map.is_blocking(x, y_prev));
+
+                cost_mesh += DEFAULT_TERRAIN_COSTS[
+                    map.get_nodes()[get_node_index(x_prev, y_prev, width)].get_terrain()
+                ];
+            }
+
+            // The mesh search is not exact, but should come out close.
+            EXPECT_LT(cost_mesh, cost_plain * 1.25 + 3);
+        }
+    };
+
+    check_queries();
+
+    // Punch holes and drop boxes, rebuilding as we go; the result should be
+    // the mesh a fresh build finds.
+    for (uint32_t edit = 0; edit < 30; ++edit) {
+        const uint32_t x_min {rng_x(gen)};
+        const uint32_t y_min {rng_y(gen)};
+        const uint32_t x_max {std::min(width - 1, x_min + rng_side(gen))};
+        const uint32_t y_max {std::min(height - 1, y_min + rng_side(gen))};
+        const bool blocking {edit % 2 == 0};
+
+        for (uint32_t y = y_min; y <= y_max; ++y) {
+            for (uint32_t x = x_min; x <= x_max; ++x) {
+                map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(blocking);
+            }
+        }
+
+        mesh.rebuild(map, block_lamb, x_min, y_min, x_max, y_max);
+    }
+
+    map.clear_regions();
+
+    NavMesh fresh(width, height, 16, 1);
+
+    fresh.build(map, block_lamb);
+
+    ASSERT_EQ(mesh.size(), fresh.size());
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const uint32_t id {mesh.get_polygon_id(x, y)};
+
+            ASSERT_EQ(id, fresh.get_polygon_id(x, y));
+
+            if (id != NavMesh::NONE) {
+                ASSERT_EQ(mesh.get_portals(id).size(), fresh.get_portals(id).size());
+            }
+        }
+    }
+
+    check_queries();
+}
+
+TEST(ShardedPathfind, MatchesDistanceSearch) {
+    const uint32_t width {100};
+    const uint32_t height {70};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    // Random walls and a band of road, on shards that do not divide the map
+    // evenly.
+    std::mt19937 gen {23};
+    std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+    std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+    std::uniform_int_distribution<uint32_t> rng_percent(0, 99);
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(
+            map.is_padding(node.x_coord, node.y_coord) || rng_percent(gen) < 20
+        );
+        node.set_terrain(
+            node.y_coord >= 30 && node.y_coord < 33 ? TERRAIN_ROAD : TERRAIN_GROUND
+        );
+    }
+
+    const auto block_lamb = [](const MapNode &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    ShardedPathfind sharded(map, 24);
+
+    EXPECT_EQ(sharded.get_shard_count(), 15u);
+    EXPECT_GT(sharded.get_border_node_count(), 0u);
+
+    DistanceSearch<Map, decltype(block_lamb)> exact(map, block_lamb);
+
+    const auto check_queries = [&]() {
+        std::vector<float> costs;
+
+        for (uint32_t i = 0; i < 40; ++i) {
+            const uint32_t x_start {rng_x(gen)};
+            const uint32_t y_start {rng_y(gen)};
+            const uint32_t x_end {rng_x(gen)};
+            const uint32_t y_end {rng_y(gen)};
+
+            if (x_start == x_end && y_start == y_end) {
+                continue;
+            }
+
+            exact.costs_to(x_start, y_start, {{x_end, y_end}}, costs);
+
+            const auto path {sharded.get_path(x_start, y_start, x_end, y_end)};
+
+            ASSERT_EQ(path.empty(), costs[0] == INFINITY);
+
+            if (path.empty()) {
+                continue;
+            }
+
+            EXPECT_EQ(path.front(), std::make_pair(x_end, y_end));
+            EXPECT_EQ(path.back(), std::make_pair(x_start, y_start));
+            EXPECT_LE(sharded.get_refined_shard_count(), sharded.get_shard_count());
+
+            double cost {0};
+
+            // Every step is to an open neighbor, without cutting a corner.
+            for (uint32_t step = 1; step < path.size(); ++step) {
+                const auto [x_prev, y_prev] = path[step - 1];
+                const auto [x, y] = path[step];
+
+                ASSERT_EQ(dist_chebyshev(x_prev, y_prev, x, y), 1);
+                ASSERT_FALSE(map.is_blocking(x, y));
+                ASSERT_FALSE(map.is_blocking(x_prev, y) || map.is_blocking(x, y_prev));
+
+                cost += DEFAULT_TERRAIN_COSTS[
+                    map.get_nodes()[get_node_index(x_prev, y_prev, width)].get_terrain()
+                ];
+            }
+
+            // Routes only cross shard edges at transitions, so come out a
+            // little costlier than the exact path.
+            EXPECT_GE(cost, costs[0] - 1e-3);
+            EXPECT_LT(cost, costs[0] * 1.25 + 3);
+        }
+    };
+
+    check_queries();
+
+    // Wall off the left half along a shard edge but for one gap, so that
+    // paths across have to find it, then close it.
+    const auto set_blocking = [&](const uint32_t x, const uint32_t y, const bool blocking) {
+        map.get_nodes_mut()[get_node_index(x, y, width)].set_blocking(blocking);
+        sharded.set_blocking(x, y, blocking);
+    };
+
+    for (uint32_t y = 0; y < height; ++y) {
+        set_blocking(48, y, y != 50);
+    }
+
+    set_blocking(47, 50, false);
+    set_blocking(49, 50, false);
+
+    check_queries();
+
+    for (const uint32_t x : {10u, 30u}) {
+        set_blocking(x, 10, false);
+        set_blocking(x + 60, 60, false);
+    }
+
+    EXPECT_FALSE(sharded.get_path(10, 10, 70, 60).empty());
+
+    set_blocking(48, 50, true);
+
+    EXPECT_TRUE(sharded.get_path(10, 10, 70, 60).empty());
+    EXPECT_TRUE(sharded.get_path(90, 60, 30, 10).empty());
+
+    // Out of bounds edits are rejected, and leave the workers serving.
+    EXPECT_THROW(sharded.set_blocking(width, 0, true), std::invalid_argument);
+    EXPECT_THROW(sharded.set_blocking(0, height, true), std::invalid_argument);
+
+    check_queries();
+}
+
+TEST(VersionedMap, SnapshotsAreIsolated) {
+    const uint32_t width {150};
+    const uint32_t height {100};
+
+    Map map {Map::gen_rand_map(width, height)};
+
+    std::mt19937 gen {29};
+    std::uniform_int_distribution<uint32_t> rng_x(0, width - 1);
+    std::uniform_int_distribution<uint32_t> rng_y(0, height - 1);
+    std::uniform_int_distribution<uint32_t> rng_percent(0, 99);
+
+    for (auto &node : map.get_nodes_mut()) {
+        node.set_blocking(
+            map.is_padding(node.x_coord, node.y_coord) || rng_percent(gen) < 15
+        );
+        node.set_terrain(node.x_coord % 20 == 3 ? TERRAIN_ROAD : TERRAIN_GROUND);
+    }
+
+    const auto block_lamb = [](const auto &node) -> bool {
+        return !node.get_blocking();
+    };
+
+    VersionedMap versioned(map);
+    VersionedMap::Reader reader(versioned);
+
+    // The first version finds the paths the map does.
+    {
+        const auto pinned {reader.pin()};
+
+        EXPECT_EQ(pinned->version, 0u);
+
+        for (uint32_t i = 0; i < 20; ++i) {
+            const uint32_t x_start {rng_x(gen)};
+            const uint32_t y_start {rng_y(gen)};
+            const uint32_t x_end {rng_x(gen)};
+            const uint32_t y_end {rng_y(gen)};
+
+            Pathfind<Map, decltype(block_lamb)> pathfinder(
+                map, x_start, y_start, x_end, y_end, block_lamb
+            );
+            Pathfind<const MapSnapshot, decltype(block_lamb)> snapshot_pathfinder(
+                *pinned, x_start, y_start, x_end, y_end, block_lamb
+            );
+
+            EXPECT_EQ(snapshot_pathfinder.get_path(), pathfinder.get_path());
+        }
+    }
+
+    // Edits show only in the versions after, and old versions stay until
+    // unpinned.
+    EXPECT_EQ(versioned.publish(), 0u);
+
+    {
+        const auto old_pinned {reader.pin()};
+
+        versioned.set_blocking(1, 1, true);
+        versioned.set_blocking(2, 1, true);
+        versioned.set_terrain(140, 90, TERRAIN_ROAD);
+
+        EXPECT_EQ(versioned.publish(), 1u);
+        EXPECT_EQ(versioned.get_retired_count(), 1u);
+
+        // Only the two chunks edited were copied.
+        EXPECT_EQ(versioned.get_stats().copies, 2u);
+
+        EXPECT_EQ(old_pinned->is_blocking(1, 1), map.is_blocking(1, 1));
+        EXPECT_EQ(
+            old_pinned->get_nodes()[get_node_index(140, 90, width)].get_terrain(),
+            map.get_nodes()[get_node_index(140, 90, width)].get_terrain()
+        );
+
+        VersionedMap::Reader other_reader(versioned);
+
+        const auto pinned {other_reader.pin()};
+
+        EXPECT_EQ(pinned->version, 1u);
+        EXPECT_TRUE(pinned->is_blocking(1, 1));
+        EXPECT_TRUE(pinned->is_blocking(2, 1));
+        EXPECT_EQ(
+            pinned->get_nodes()[get_node_index(140, 90, width)].get_terrain(),
+            TERRAIN_ROAD
+        );
+        EXPECT_EQ(pinned->is_blocking(100, 10), map.is_blocking(100, 10));
+
+        versioned.reclaim();
+
+        EXPECT_EQ(versioned.get_retired_count(), 1u);
+    }
+
+    versioned.reclaim();
+
+    EXPECT_EQ(versioned.get_retired_count(), 0u);
+
+    // Clear the endpoints of the searches below.
+    for (uint32_t y = 48; y <= 52; ++y) {
+        for (uint32_t x = 8; x <= 142; x += 134) {
+            for (uint32_t dx = 0; dx < 5; ++dx) {
+                versioned.set_blocking(x + dx - 2, y, false);
+            }
+        }
+    }
+
+    EXPECT_EQ(versioned.publish(), 2u);
+
+    // A reader searching throughout, while walls open and close, only ever
+    // sees whole versions.
+    std::atomic<bool> done {false};
+    std::atomic<uint32_t> count_searches {0};
+
+    std::thread searcher(
+        [&]() {
+            VersionedMap::Reader reader(versioned);
+
+            while (!done.load()) {
+                const auto pinned {reader.pin()};
+
+                // Odd versions wall off column 75.
+                const bool walled {pinned->version % 2 == 1};
+
+                for (uint32_t y = 0; y < height; ++y) {
+                    EXPECT_EQ(
+                        pinned->is_blocking(75, y), walled || map.is_blocking(75, y)
+                    );
+                }
+
+                Pathfind<const MapSnapshot, decltype(block_lamb)> pathfinder(
+                    *pinned, 10, 50, 140, 50, block_lamb
+                );
+
+                const auto path {pathfinder.get_path()};
+
+                EXPECT_EQ(path.empty(), walled);
+
+                for (const auto &[x, y] : path) {
+                    EXPECT_FALSE(pinned->is_blocking(x, y));
+                }
+
+                ++count_searches;
+            }
+        }
+    );
+
+    for (uint32_t edit = 0; edit < 200; ++edit) {
+        for (uint32_t y = 0; y < height; ++y) {
+            versioned.set_blocking(75, y, edit % 2 == 0 || map.is_blocking(75, y));
+        }
+
+        EXPECT_EQ(versioned.publish(), edit + 3);
+    }
+
+    // On a single core, the searcher may not have run yet.
+    while (count_searches == 0) {
+        std::this_thread::yield();
+    }
+
+    done.store(true);
+    searcher.join();
+
+    versioned.reclaim();
+
+    EXPECT_EQ(versioned.get_retired_count(), 0u);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
 